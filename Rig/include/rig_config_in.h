@@ -27,6 +27,7 @@
 #cmakedefine HAVE_POSIX_MEMALIGN 1
 #cmakedefine HAVE_ALIGNED_MALLOC 1
 #cmakedefine HAVE_SCHED_YIELD 1
+#cmakedefine HAVE_MALLOC_USABLE_SIZE 1
 
 #cmakedefine SIZEOF_SHORT_INT     @SIZEOF_SHORT_INT@
 #cmakedefine SIZEOF_INT           @SIZEOF_INT@
@@ -22,9 +22,6 @@
 // Compile-time features availability information
 #cmakedefine RIG_STACK_PRECISE_ITERATOR 1
 #cmakedefine RIG_QUEUE_PRECISE_ITERATOR 1
-#cmakedefine RIG_STACK_SMR_TYPE @RIG_STACK_SMR_TYPE@
-#cmakedefine RIG_QUEUE_SMR_TYPE @RIG_QUEUE_SMR_TYPE@
-#cmakedefine RIG_LIST_SMR_TYPE @RIG_LIST_SMR_TYPE@
 
 // Main includes (always present!)
 #include <stdbool.h>
@@ -67,6 +64,13 @@ void rig_mem_free_aligned(void *mem);
 
 size_t rig_mem_pagesize(void) ATTR_WARNUNUSED;
 
+// Per-thread node pool for small, fixed-size objects
+#define RIG_MEM_POOL_MAX 64
+
+void *rig_mem_pool_alloc(size_t size) ATTR_WARNUNUSED;
+void rig_mem_pool_free(void *mem);
+void rig_mem_pool_record_release(void);
+
 // Miscellaneous functions
 size_t rig_misc_pid(void) ATTR_WARNUNUSED;
 // TODO: void rig_misc_processname(const char *pname);
@@ -132,9 +136,11 @@ size_t rig_misc_pid(void) ATTR_WARNUNUSED;
 typedef struct rig_counter *RIG_COUNTER;
 
 RIG_COUNTER rig_counter_init(size_t init_val, size_t max_val) ATTR_WARNUNUSED;
+RIG_COUNTER rig_counter_init_sharded(size_t init_val, size_t max_val) ATTR_WARNUNUSED;
 void rig_counter_destroy(RIG_COUNTER *cnt);
 size_t rig_counter_get_max(RIG_COUNTER cnt) ATTR_WARNUNUSED;
 size_t rig_counter_get(RIG_COUNTER cnt) ATTR_WARNUNUSED;
+size_t rig_counter_get_approx(RIG_COUNTER cnt) ATTR_WARNUNUSED;
 bool rig_counter_get_and_set(RIG_COUNTER cnt, size_t new_val, size_t *old_val);
 static inline bool rig_counter_set(RIG_COUNTER cnt, size_t new_val) { return (rig_counter_get_and_set(cnt, new_val, NULL)); }
 bool rig_counter_inc(RIG_COUNTER cnt);
@@ -210,6 +216,7 @@ bool rig_mlock_islocked(RIG_MLOCK ml) ATTR_WARNUNUSED;
 #define RIG_MRWLOCK_RECURSIVE_READ  ((uint16_t)(1 << 0))
 #define RIG_MRWLOCK_RECURSIVE_WRITE ((uint16_t)(1 << 1))
 #define RIG_MRWLOCK_RECURSIVE (RIG_MRWLOCK_RECURSIVE_READ | RIG_MRWLOCK_RECURSIVE_WRITE)
+#define RIG_MRWLOCK_READ_BIASED     ((uint16_t)(1 << 2))
 
 typedef struct rig_mrwlock *RIG_MRWLOCK;
 
@@ -256,22 +263,72 @@ void rig_smr_hp_set(RIG_SMR_HP_Record hprecord, size_t hp, void *ptr);
 void rig_smr_hp_release(RIG_SMR_HP_Record hprecord, size_t hp);
 void rig_smr_hp_mem_retire(void *mem);
 void rig_smr_hp_mem_retire_noscan(void *mem);
+void rig_smr_hp_pool_retire(void *mem);
+void rig_smr_hp_pool_retire_noscan(void *mem);
+void rig_smr_hp_retire_fn(void *mem, void (*fn)(void *mem, void *ctx), void *ctx);
 void rig_smr_hp_mem_scan(void);
 void rig_smr_hp_mem_scan_full(void);
+void rig_smr_hp_threshold_set(size_t factor, size_t max_bytes);
 void rig_smr_hp_debug_info(bool print_list);
 
 void rig_smr_epoch_record_release(void);
 void rig_smr_epoch_critical_enter(void);
 void rig_smr_epoch_critical_exit(void);
 void rig_smr_epoch_mem_retire(void *mem);
+void rig_smr_epoch_pool_retire(void *mem);
+void rig_smr_epoch_retire_fn(void *mem, void (*fn)(void *mem, void *ctx), void *ctx);
+void rig_smr_epoch_threshold_set(size_t factor, size_t max_bytes);
 void rig_smr_epoch_debug_info(bool print_list);
 
+typedef struct rig_smr_ibr_record *RIG_SMR_IBR_Record;
+
+RIG_SMR_IBR_Record rig_smr_ibr_record_get(void) ATTR_WARNUNUSED;
+void rig_smr_ibr_record_release(void);
+RIG_SMR_IBR_Record rig_smr_ibr_critical_enter(void);
+void rig_smr_ibr_critical_exit(void);
+bool rig_smr_ibr_protect(RIG_SMR_IBR_Record ibrrecord) ATTR_WARNUNUSED;
+void *rig_smr_ibr_pool_alloc(size_t size) ATTR_WARNUNUSED;
+void rig_smr_ibr_pool_free(void *mem);
+void rig_smr_ibr_mem_retire(void *mem);
+void rig_smr_ibr_pool_retire(void *mem);
+void rig_smr_ibr_retire_fn(void *mem, void (*fn)(void *mem, void *ctx), void *ctx);
+void rig_smr_ibr_mem_scan(void);
+void rig_smr_ibr_threshold_set(size_t factor, size_t max_bytes);
+void rig_smr_ibr_debug_info(bool print_list);
+
+void rig_smr_qsbr_record_release(void);
+void rig_smr_qsbr_quiescent(void);
+void rig_smr_qsbr_offline(void);
+void rig_smr_qsbr_online(void);
+void rig_smr_qsbr_mem_retire(void *mem);
+void rig_smr_qsbr_pool_retire(void *mem);
+void rig_smr_qsbr_retire_fn(void *mem, void (*fn)(void *mem, void *ctx), void *ctx);
+void rig_smr_qsbr_threshold_set(size_t factor, size_t max_bytes);
+void rig_smr_qsbr_debug_info(bool print_list);
+
+struct rig_smr_stats {
+	size_t blocks; // blocks of retired memory handed over to the reclaimer
+	size_t bytes; // bytes handed over to the reclaimer
+	size_t pending; // blocks not yet reclaimed
+	size_t lag_avg_us; // average time from hand-over to reclamation
+	size_t lag_max_us; // maximum time from hand-over to reclamation
+};
+
+bool rig_smr_reclaimer_start(void);
+bool rig_smr_reclaimer_stop(void);
+void rig_smr_reclaimer_stats(struct rig_smr_stats *stats);
+
 /*
  * Rig List Functions
  */
 
 #define RIG_LIST_NOCOUNT ((uint16_t)(1 << 0))
 #define RIG_LIST_NODUPS  ((uint16_t)(1 << 1))
+#define RIG_LIST_ORDERED ((uint16_t)(1 << 2))
+#define RIG_LIST_SMR_EPOCH ((uint16_t)(1 << 3))
+#define RIG_LIST_SMR_IBR ((uint16_t)(1 << 4))
+#define RIG_LIST_SMR_QSBR ((uint16_t)(1 << 5))
+#define RIG_LIST_SHARDED_COUNT ((uint16_t)(1 << 6))
 
 typedef struct rig_list *RIG_LIST;
 
@@ -304,6 +361,11 @@ RIG_LIST rig_list_duplicate(RIG_LIST l) ATTR_WARNUNUSED;
  */
 
 #define RIG_QUEUE_NOCOUNT ((uint16_t)(1 << 0))
+#define RIG_QUEUE_SPSC    ((uint16_t)(1 << 1))
+#define RIG_QUEUE_MPSC    ((uint16_t)(1 << 2))
+#define RIG_QUEUE_SMR_EPOCH ((uint16_t)(1 << 3))
+#define RIG_QUEUE_SMR_QSBR ((uint16_t)(1 << 4))
+#define RIG_QUEUE_SHARDED_COUNT ((uint16_t)(1 << 5))
 
 typedef struct rig_queue *RIG_QUEUE;
 
@@ -312,7 +374,10 @@ RIG_QUEUE rig_queue_newref(RIG_QUEUE q) ATTR_WARNUNUSED;
 void rig_queue_destroy(RIG_QUEUE *q);
 void rig_queue_clear(RIG_QUEUE q);
 bool rig_queue_put(RIG_QUEUE q, void *item);
+bool rig_queue_put_many(RIG_QUEUE q, void *items[], size_t count);
 void *rig_queue_get(RIG_QUEUE q);
+void *rig_queue_get_wait(RIG_QUEUE q, size_t timeout);
+size_t rig_queue_get_many(RIG_QUEUE q, void *items[], size_t count);
 void *rig_queue_peek(RIG_QUEUE q);
 bool rig_queue_empty(RIG_QUEUE q) ATTR_WARNUNUSED;
 bool rig_queue_full(RIG_QUEUE q) ATTR_WARNUNUSED;
@@ -327,20 +392,50 @@ void rig_queue_iter_end(RIG_QUEUE_ITER *iter);
 
 RIG_QUEUE rig_queue_duplicate(RIG_QUEUE q) ATTR_WARNUNUSED;
 
+/*
+ * Rig Ring Functions
+ */
+
+#define RIG_RING_SPSC ((uint16_t)(1 << 0))
+
+typedef struct rig_ring *RIG_RING;
+
+RIG_RING rig_ring_init(size_t capacity, uint16_t flags) ATTR_WARNUNUSED;
+RIG_RING rig_ring_newref(RIG_RING r) ATTR_WARNUNUSED;
+void rig_ring_destroy(RIG_RING *r);
+void rig_ring_clear(RIG_RING r);
+bool rig_ring_put(RIG_RING r, void *item);
+void *rig_ring_get(RIG_RING r);
+void *rig_ring_peek(RIG_RING r);
+bool rig_ring_empty(RIG_RING r) ATTR_WARNUNUSED;
+bool rig_ring_full(RIG_RING r) ATTR_WARNUNUSED;
+size_t rig_ring_count(RIG_RING r) ATTR_WARNUNUSED;
+size_t rig_ring_capacity(RIG_RING r) ATTR_WARNUNUSED;
+
 /*
  * Rig Stack Functions
  */
 
 #define RIG_STACK_NOCOUNT ((uint16_t)(1 << 0))
+#define RIG_STACK_ELIMINATION ((uint16_t)(1 << 1))
+#define RIG_STACK_SMR_EPOCH ((uint16_t)(1 << 2))
+#define RIG_STACK_SMR_QSBR ((uint16_t)(1 << 3))
+#define RIG_STACK_SHARDED_COUNT ((uint16_t)(1 << 4))
 
 typedef struct rig_stack *RIG_STACK;
+typedef struct rig_stack_chain *RIG_STACK_CHAIN;
 
 RIG_STACK rig_stack_init(size_t capacity, uint16_t flags) ATTR_WARNUNUSED;
 RIG_STACK rig_stack_newref(RIG_STACK s)  ATTR_WARNUNUSED;
 void rig_stack_destroy(RIG_STACK *s);
 void rig_stack_clear(RIG_STACK s);
 bool rig_stack_push(RIG_STACK s, void *item);
+bool rig_stack_push_chain(RIG_STACK s, void *items[], size_t count);
 void *rig_stack_pop(RIG_STACK s);
+RIG_STACK_CHAIN rig_stack_pop_all(RIG_STACK s) ATTR_WARNUNUSED;
+void *rig_stack_chain_next(RIG_STACK_CHAIN *chain);
+void rig_stack_chain_end(RIG_STACK_CHAIN *chain);
+void *rig_stack_pop_wait(RIG_STACK s, size_t timeout);
 void *rig_stack_peek(RIG_STACK s);
 bool rig_stack_empty(RIG_STACK s) ATTR_WARNUNUSED;
 bool rig_stack_full(RIG_STACK s) ATTR_WARNUNUSED;
@@ -15,6 +15,7 @@
 
 #include "rig.h"
 #include "rig_config.h"
+#include <atomic_ops.h>
 
 #define VERIFY_ERRET(err) rig_acheck_msg(err, "unexpected error return value")
 
@@ -43,21 +44,180 @@
 // RWLOCK Unlock operation for thread-safety
 #define RW_UNLOCK(s) if (LOCK(s) != NULL) rig_mrwlock_unlock(LOCK(s))
 
-// Iterator Hazard Pointer Management
-#define CHECK_ITER_HPS \
-	RIG_SMR_HP_Record hprec = rig_smr_hp_record_get(); \
-	if ((rig_smr_hp_get(hprec, 4) != NULL) \
-	 || (rig_smr_hp_get(hprec, 5) != NULL) \
-	 || (rig_smr_hp_get(hprec, 6) != NULL) \
-	 || (rig_smr_hp_get(hprec, 7) != NULL)) { \
-		ERRET(EALREADY, NULL); \
-	}
-
-#define RESET_ITER_HPS \
-	RIG_SMR_HP_Record hprec = rig_smr_hp_record_get(); \
-	rig_smr_hp_release(hprec, 4); \
-	rig_smr_hp_release(hprec, 5); \
-	rig_smr_hp_release(hprec, 6); \
-	rig_smr_hp_release(hprec, 7);
+// SMR retire lists tag memory coming from the node pool (rig_mem_pool_alloc())
+// in the lowest pointer bit, so it can be given back to the right allocator.
+// Pointers retired with a destructor are tagged in the second lowest bit, and
+// take up three slots in the retire lists: the pointer, the destructor, its context.
+typedef union rig_smr_retired {
+	void *ptr;
+	void (*fn)(void *ptr, void *ctx);
+} RIG_SMR_Retired;
+
+#define SMR_POOL_TAG(p) ((void *)((uintptr_t)(p) | (uintptr_t)0x01))
+#define SMR_POOL_UNTAG(p) ((void *)((uintptr_t)(p) & ~(uintptr_t)0x01))
+#define SMR_POOL_TAGGED(p) ((uintptr_t)(p) & (uintptr_t)0x01)
+#define SMR_FN_TAG(p) ((void *)((uintptr_t)(p) | (uintptr_t)0x02))
+#define SMR_FN_TAGGED(p) ((uintptr_t)(p) & (uintptr_t)0x02)
+#define SMR_UNTAG(p) ((void *)((uintptr_t)(p) & ~(uintptr_t)0x03))
+#define SMR_MEM_FREE(p) if (SMR_POOL_TAGGED(p)) { rig_mem_pool_free(SMR_POOL_UNTAG(p)); } else { rig_mem_free(p); }
+// Number of retire list slots taken by the entry starting with p
+#define SMR_RETIRED_SLOTS(p) ((SMR_FN_TAGGED(p)) ? (3) : (1))
+// Reclaim the retire list entry starting at r (an array of RIG_SMR_Retired)
+#define SMR_RETIRED_FREE(r) if (SMR_FN_TAGGED((r)[0].ptr)) { (r)[1].fn(SMR_UNTAG((r)[0].ptr), (r)[2].ptr); } else { SMR_MEM_FREE((r)[0].ptr) }
+// Size of retired memory, so SMR can bound the bytes it keeps back per thread,
+// what goes to a destructor is unknown and counted as one cache-line
+#define SMR_MEM_SIZE(p) ((SMR_FN_TAGGED(p)) ? ((size_t)CACHELINE_SIZE) \
+	: ((SMR_POOL_TAGGED(p)) ? (rig_mem_pool_size(SMR_POOL_UNTAG(p))) : (rig_mem_size(p))))
+
+size_t rig_mem_size(void *mem) ATTR_WARNUNUSED;
+size_t rig_mem_pool_size(void *mem) ATTR_WARNUNUSED;
+void rig_mem_pool_ref(void);
+void rig_mem_pool_unref(void);
+
+// Background reclamation: SMR schemes hand blocks of retired memory over to
+// the reclaimer thread, which calls reclaim() on them (that frees the block too)
+typedef struct rig_smr_block *RIG_SMR_Block;
+
+struct rig_smr_block {
+	RIG_SMR_Block next;
+	void (*reclaim)(RIG_SMR_Block block);
+	uint64_t handoff_us;
+	size_t bytes;
+};
+
+bool rig_smr_reclaimer_offload(void) ATTR_WARNUNUSED;
+void rig_smr_reclaimer_handoff(RIG_SMR_Block block);
+void rig_smr_reclaimer_shutdown(void);
+
+uint64_t rig_time_us(void) ATTR_WARNUNUSED;
+
+// Counters embedded in the data structures, instead of allocated on their own:
+// a pointer to one is a valid RIG_COUNTER, the standalone ones come padded
+// to a cache-line by their allocation
+struct rig_counter {
+	atomic_ops_uint counter;
+	size_t maximum_value; // read-only value
+	struct rig_counter_shard *shards; // read-only value, NULL if not sharded
+	size_t shards_mask; // read-only value
+	size_t batch; // read-only value
+};
+
+bool rig_counter_init_inline(RIG_COUNTER c, size_t initial_value, size_t maximum_value, bool sharded) ATTR_WARNUNUSED;
+void rig_counter_destroy_inline(RIG_COUNTER c);
+
+// Counter updates with a single adding thread, see RIG_QUEUE_SPSC
+bool rig_counter_add_single(RIG_COUNTER c, size_t add_to_value) ATTR_WARNUNUSED;
+void rig_counter_sub_single(RIG_COUNTER c, size_t sub_from_value);
+
+// Number of online CPUs, sizes per-CPU data (counter shards, reader slots)
+size_t rig_counter_cpus(void) ATTR_WARNUNUSED;
+
+// Event-count, to let consumers of lock-free data structures sleep while they're empty
+typedef struct rig_eventcount *RIG_EVENTCOUNT;
+
+RIG_EVENTCOUNT rig_eventcount_init(void) ATTR_WARNUNUSED;
+void rig_eventcount_destroy(RIG_EVENTCOUNT *ec);
+void rig_eventcount_notify(RIG_EVENTCOUNT ec, size_t count);
+void *rig_eventcount_await(RIG_EVENTCOUNT ec, void *(*try_get)(void *ds), void *ds, bool qsbr, size_t timeout);
+
+// SMR scheme selection, per data structure instance: the code depending on it
+// is written once, in ALWAYSINLINE functions taking the scheme as their last
+// argument, and SMR_DISPATCH() calls them with a constant, so that every scheme
+// gets its own specialized copy, with no further tests of the scheme inside.
+#define SMR_HP 1
+#define SMR_EPOCH 2
+#define SMR_IBR 3
+#define SMR_QSBR 4
+
+#define SMR_DISPATCH(smr, fn, ...) (((smr) == SMR_EPOCH) ? (fn(__VA_ARGS__, SMR_EPOCH)) \
+	: (((smr) == SMR_QSBR) ? (fn(__VA_ARGS__, SMR_QSBR)) : (fn(__VA_ARGS__, SMR_HP))))
+// Only for data structures supporting IBR, the others don't get a copy for it
+#define SMR_DISPATCH_IBR(smr, fn, ...) (((smr) == SMR_IBR) ? (fn(__VA_ARGS__, SMR_IBR)) : (SMR_DISPATCH(smr, fn, __VA_ARGS__)))
+
+static inline void *rig_smr_enter(int smr) ATTR_ALWAYSINLINE;
+static inline void rig_smr_exit(int smr) ATTR_ALWAYSINLINE;
+static inline void *rig_smr_pool_alloc(int smr, size_t size) ATTR_ALWAYSINLINE;
+static inline void rig_smr_pool_free(int smr, void *mem) ATTR_ALWAYSINLINE;
+static inline void rig_smr_pool_retire(int smr, void *mem) ATTR_ALWAYSINLINE;
+
+// QSBR has no protected sections, threads only have to be online
+void rig_smr_qsbr_enter(void);
+bool rig_smr_qsbr_is_online(void) ATTR_WARNUNUSED;
+
+// Enter a SMR protected section: returns this thread's record for HPs
+// (RIG_SMR_HP_Record) and IBR (RIG_SMR_IBR_Record), NULL for epochs and QSBR
+static inline void *rig_smr_enter(int smr) {
+	if (smr == SMR_EPOCH) {
+		rig_smr_epoch_critical_enter();
+		return (NULL);
+	}
+
+	if (smr == SMR_QSBR) {
+		rig_smr_qsbr_enter();
+		return (NULL);
+	}
+
+	if (smr == SMR_IBR) {
+		return (rig_smr_ibr_critical_enter());
+	}
+
+	return (rig_smr_hp_record_get());
+}
+
+// Leave a SMR protected section, HPs must be released by the caller,
+// nothing to do for QSBR until the next quiescent state
+static inline void rig_smr_exit(int smr) {
+	if (smr == SMR_EPOCH) {
+		rig_smr_epoch_critical_exit();
+	}
+	else if (smr == SMR_IBR) {
+		rig_smr_ibr_critical_exit();
+	}
+}
+
+// Nodes that get retired: IBR has to know the era they were allocated in
+static inline void *rig_smr_pool_alloc(int smr, size_t size) {
+	if (smr == SMR_IBR) {
+		return (rig_smr_ibr_pool_alloc(size));
+	}
+
+	return (rig_mem_pool_alloc(size));
+}
+
+static inline void rig_smr_pool_free(int smr, void *mem) {
+	if (smr == SMR_IBR) {
+		rig_smr_ibr_pool_free(mem);
+	}
+	else {
+		rig_mem_pool_free(mem);
+	}
+}
+
+static inline void rig_smr_pool_retire(int smr, void *mem) {
+	if (smr == SMR_EPOCH) {
+		rig_smr_epoch_pool_retire(mem);
+	}
+	else if (smr == SMR_IBR) {
+		rig_smr_ibr_pool_retire(mem);
+	}
+	else if (smr == SMR_QSBR) {
+		rig_smr_qsbr_pool_retire(mem);
+	}
+	else {
+		rig_smr_hp_pool_retire(mem);
+	}
+}
+
+// Iterator Hazard Pointer Management: every iterator gets a record of its own,
+// seen by all scans just like the threads' ones, so that any number of them
+// can be open at the same time, retired memory goes to the thread's record
+RIG_SMR_HP_Record rig_smr_hp_record_acquire(void) ATTR_WARNUNUSED;
+void rig_smr_hp_record_yield(RIG_SMR_HP_Record hp_record);
+
+#define RESET_ITER_HPS(hprec) \
+	rig_smr_hp_release(hprec, 0); \
+	rig_smr_hp_release(hprec, 1); \
+	rig_smr_hp_release(hprec, 2); \
+	rig_smr_hp_record_yield(hprec);
 
 #endif /* RIG_INTERNAL_H */
@@ -0,0 +1,1177 @@
+/**
+ * This file is part of the Rig project.
+ *
+ * For the full copyright and license information, please view the COPYING
+ * file that was distributed with this source code.
+ *
+ * @copyright  (c) the Rig project
+ * @author     Luca Longinotti <chtekk@longitekk.com>
+ * @license    BSD 2-clause
+ * @version    $Id$
+ */
+
+#include "rig_internal.h"
+#include <atomic_ops.h>
+#include <stdarg.h>
+#include <string.h>
+#include "support/array_stack.c"
+
+/*
+ * Rig Array Data Definitions
+ */
+
+/** Types */
+typedef struct ArrayItemStruct *ArrayItem;
+typedef struct ArrayEntryStruct *ArrayEntry;
+typedef struct ArraySearchStruct *ArraySearch;
+
+/** Structures */
+struct rig_array {
+	atomic_ops_uint refcount;
+	RIG_LIST list; // read-only value
+	uint16_t flags; // read-only value
+};
+
+struct ArrayItemStruct {
+	uint8_t type; // Type specifier ('i', 's', 'p' or 'a')
+	size_t len; // String length (only for 's')
+	union {
+		intmax_t i;
+		void *p;
+		char *s;
+		RIG_ARRAY a;
+	} v;
+};
+
+struct ArrayEntryStruct {
+	struct ArrayItemStruct key;
+	struct ArrayItemStruct value; // Type ARRAY_SEARCH for search keys
+};
+
+struct ArraySearchStruct {
+	struct ArrayEntryStruct entry; // Must be first, the list only sees this
+	ArrayEntry found; // Entry matching the search key, set by array_cmp()
+	bool exact; // Only match the entry already in found
+};
+
+#define ARRAY_SEARCH 0 // Value type of search keys, never stored
+
+/*
+ * An array is a hash map of typed keys to typed values, built on top of a
+ * RIG_LIST (with RIG_LIST_NODUPS), which holds one ArrayEntry per key, and
+ * does all the lock-free hashing, searching, adding and removing.
+ * Since the list only gives back whether an item was found or not, searches
+ * are done with an ArraySearch as the item: the comparator function stores
+ * the matching entry in it, so the value can be read back afterwards.
+ * The list only protects its own nodes, not the items they point to, so the
+ * entries themselves are protected with epoch-based SMR, regardless of the
+ * SMR type used by the list: every operation runs inside an epoch critical
+ * section, and removed entries are retired only in there. This also covers
+ * the rig_array structure itself, which gets retired when the last reference
+ * to it is dropped, so that a reader that just found it as a nested value can
+ * still safely try to get a reference to it (and fail, as it's now zero).
+ *
+ * The types are specified by the type field of the RIG_ASPEC entries, the
+ * first character for the key, the second for the value:
+ * - 'i': intmax_t (keys and values, always pass an intmax_t!)
+ * - 's': NUL-terminated string (keys and values, copied into the array)
+ * - 'p': generic pointer (keys and values, the memory it points to is the
+ *   caller's responsibility)
+ * - 'a': nested RIG_ARRAY (values only, the array keeps a reference to it,
+ *   or a full copy if RIG_ARRAY_DUPLICATE is set in the RIG_ASPEC flags)
+ * Every RIG_ASPEC entry applies to 'count' consecutive key/value arguments,
+ * a count of zero being the same as one; 'id' is reserved and ignored.
+ */
+
+static int array_cmp(void *data, void *item);
+static size_t array_hash(void *item);
+
+static inline bool array_acquire(RIG_ARRAY a) ATTR_ALWAYSINLINE;
+static inline bool array_check_spec(RIG_ARRAY_ASP tinfo[], size_t tsize, bool values) ATTR_ALWAYSINLINE;
+static inline bool array_read_item(ArrayItem item, uint8_t type, va_list *args) ATTR_ALWAYSINLINE;
+static inline ArrayEntry array_entry_new(ArrayItem key, ArrayItem value) ATTR_ALWAYSINLINE;
+static inline void array_entry_free(ArrayEntry entry) ATTR_ALWAYSINLINE;
+static inline void array_entry_retire(ArrayEntry entry) ATTR_ALWAYSINLINE;
+static inline ArrayEntry array_search(RIG_ARRAY a, ArraySearch search) ATTR_ALWAYSINLINE;
+static inline bool array_remove(RIG_ARRAY a, ArraySearch search) ATTR_ALWAYSINLINE;
+static bool array_find(RIG_ARRAY a, RIG_ARRAY_ASP tinfo[], size_t tsize, bool any, va_list *args);
+static inline bool array_copy_value(ArrayEntry entry, uint8_t type, void *out) ATTR_ALWAYSINLINE;
+
+/**
+ * INTERNAL
+ * Comparator function, compares the key of an entry in the list with the key
+ * searched for. If the latter is part of an ArraySearch, the matching entry
+ * is remembered there.
+ *
+ * @param data
+ *     entry in the list
+ * @param item
+ *     entry or search key searched for
+ *
+ * @return
+ *     zero if equal, else non-zero
+ */
+static int array_cmp(void *data, void *item) {
+	ArrayEntry entry = data, key = item;
+
+	if (entry->key.type != key->key.type) {
+		return (1);
+	}
+
+	switch (key->key.type) {
+		case 'i':
+			if (entry->key.v.i != key->key.v.i) {
+				return (1);
+			}
+			break;
+		case 's':
+			if ((entry->key.len != key->key.len) || (memcmp(entry->key.v.s, key->key.v.s, key->key.len) != 0)) {
+				return (1);
+			}
+			break;
+		default: // 'p'
+			if (entry->key.v.p != key->key.v.p) {
+				return (1);
+			}
+			break;
+	}
+
+	if (key->value.type == ARRAY_SEARCH) {
+		ArraySearch search = item;
+
+		if (search->exact && (search->found != entry)) {
+			return (1);
+		}
+
+		search->found = entry;
+	}
+
+	return (0);
+}
+
+/**
+ * INTERNAL
+ * Hash function, hashes the key of an entry or search key.
+ *
+ * @param item
+ *     entry or search key
+ *
+ * @return
+ *     hash value
+ */
+static size_t array_hash(void *item) {
+	ArrayEntry key = item;
+
+	switch (key->key.type) {
+		case 'i':
+			return (rig_hash((const uint8_t *)&key->key.v.i, sizeof(key->key.v.i), RIG_HASH_DEFAULT));
+		case 's':
+			return (rig_hash((const uint8_t *)key->key.v.s, key->key.len, RIG_HASH_DEFAULT));
+		default: // 'p'
+			return (rig_hash((const uint8_t *)&key->key.v.p, sizeof(key->key.v.p), RIG_HASH_DEFAULT));
+	}
+}
+
+/**
+ * Initialize an array, a concurrent hash map of typed keys to typed values.
+ * Reading from it never takes any locks, see the description of the RIG_ASPEC
+ * type specifiers above for what keys and values it accepts.
+ *
+ * @param flags
+ *     flags to modify array behavior, none are currently supported
+ * @param capacity
+ *     maximum number of key/value pairs the array can contain, 0 means unlimited
+ *
+ * @return
+ *     array pointer, NULL on error.
+ *     On error, the following error codes are set:
+ *     - EINVAL (invalid arguments passed)
+ *     - ENOMEM (insufficient memory)
+ */
+RIG_ARRAY rig_array_init(uint16_t flags, size_t capacity) {
+	CHECK_PERMITTED_FLAGS(flags, 0);
+
+	// Allocate memory for the array
+	RIG_ARRAY a = rig_mem_alloc(sizeof(*a), 0);
+	NULLCHECK_ERRET(a, ENOMEM, NULL);
+
+	// Initialize the list holding the entries
+	a->list = rig_list_init(capacity, RIG_LIST_NODUPS, &array_cmp, &array_hash);
+	NULLCHECK_ERRET_CLEANUP(a->list, ENOMEM, NULL, rig_mem_free(a));
+
+	// Initialize the needed values
+	atomic_ops_uint_store(&a->refcount, 1, ATOMIC_OPS_FENCE_NONE);
+	a->flags = flags;
+
+	atomic_ops_fence(ATOMIC_OPS_FENCE_FULL);
+
+	return (a);
+}
+
+/**
+ * INTERNAL
+ * Get a new reference to an array, unless its reference count already
+ * dropped to zero, in which case it's being destroyed.
+ * Call only from inside an epoch critical section if the caller doesn't
+ * already hold a reference.
+ *
+ * @param a
+ *     array pointer
+ *
+ * @return
+ *     boolean indicating success
+ */
+static inline bool array_acquire(RIG_ARRAY a) {
+	size_t refs;
+
+	do {
+		refs = atomic_ops_uint_load(&a->refcount, ATOMIC_OPS_FENCE_ACQUIRE);
+
+		if (refs == 0) {
+			return (false);
+		}
+	} while (!atomic_ops_uint_cas(&a->refcount, refs, refs + 1, ATOMIC_OPS_FENCE_FULL));
+
+	return (true);
+}
+
+/**
+ * Create new reference to specified array.
+ *
+ * @param a
+ *     array pointer
+ *
+ * @return
+ *     array pointer
+ */
+RIG_ARRAY rig_array_newref(RIG_ARRAY a) {
+	NULLCHECK_EXIT(a);
+
+	rig_acheck_msg(array_acquire(a), "reference count already zero, uncounted references exist");
+
+	return (a);
+}
+
+/**
+ * Destroy specified array reference and set pointer to NULL.
+ * If reference count reaches zero, proceed to full destruction, which also
+ * drops the references to any nested arrays it contains.
+ *
+ * @param *a
+ *     pointer to array pointer
+ */
+void rig_array_destroy(RIG_ARRAY *a) {
+	NULLCHECK_EXIT(a);
+	NULLCHECK_EXIT(*a);
+
+	size_t refs;
+
+	do {
+		refs = atomic_ops_uint_load(&(*a)->refcount, ATOMIC_OPS_FENCE_NONE);
+
+		rig_acheck_msg(refs != 0, "reference count already zero, uncounted references exist");
+	} while (!atomic_ops_uint_cas(&(*a)->refcount, refs, refs - 1, ATOMIC_OPS_FENCE_FULL));
+
+	if (refs == 1) {
+		// Last reference, nobody can get a new one anymore: remove all entries,
+		// destroy the list, and then retire the array itself, as readers that
+		// found it as a nested value may still be looking at the refcount
+		rig_array_clear(*a);
+		rig_list_destroy(&(*a)->list);
+
+		rig_smr_epoch_critical_enter();
+		rig_smr_epoch_mem_retire(*a);
+		rig_smr_epoch_critical_exit();
+	}
+
+	*a = NULL;
+
+	atomic_ops_fence(ATOMIC_OPS_FENCE_FULL);
+}
+
+/**
+ * Clear the array by removing all key/value pairs from it.
+ *
+ * @param a
+ *     array pointer
+ */
+void rig_array_clear(RIG_ARRAY a) {
+	NULLCHECK_EXIT(a);
+
+	ArrayEntry entry;
+
+	rig_smr_epoch_critical_enter();
+
+	while ((entry = rig_list_get(a->list)) != NULL) {
+		array_entry_retire(entry);
+	}
+
+	rig_smr_epoch_critical_exit();
+}
+
+/**
+ * INTERNAL
+ * Check that a type specification is valid.
+ *
+ * @param tinfo
+ *     array of type specifications
+ * @param tsize
+ *     number of type specifications
+ * @param values
+ *     whether the value type has to be checked too, or only the key type
+ *
+ * @return
+ *     boolean indicating validity
+ */
+static inline bool array_check_spec(RIG_ARRAY_ASP tinfo[], size_t tsize, bool values) {
+	if ((tinfo == NULL) || (tsize == 0)) {
+		return (false);
+	}
+
+	for (size_t i = 0; i < tsize; i++) {
+		if ((tinfo[i].type[0] != 'i') && (tinfo[i].type[0] != 's') && (tinfo[i].type[0] != 'p')) {
+			return (false);
+		}
+
+		if (values && (tinfo[i].type[1] != 'i') && (tinfo[i].type[1] != 's') && (tinfo[i].type[1] != 'p')
+		 && (tinfo[i].type[1] != 'a')) {
+			return (false);
+		}
+
+		if (TEST_BITFIELD(tinfo[i].flags, ~RIG_ARRAY_DUPLICATE)) {
+			return (false);
+		}
+	}
+
+	return (true);
+}
+
+/**
+ * INTERNAL
+ * Read a key or value of the specified type from the variable arguments.
+ * Strings and arrays are not copied, nor are new references taken.
+ *
+ * @param item
+ *     item in which to store the argument
+ * @param type
+ *     type specifier
+ * @param *args
+ *     pointer to the variable arguments list
+ *
+ * @return
+ *     boolean indicating success (false on NULL strings or arrays)
+ */
+static inline bool array_read_item(ArrayItem item, uint8_t type, va_list *args) {
+	item->type = type;
+	item->len = 0;
+
+	switch (type) {
+		case 'i':
+			item->v.i = va_arg(*args, intmax_t);
+			return (true);
+		case 's':
+			item->v.s = va_arg(*args, char *);
+			if (item->v.s == NULL) {
+				return (false);
+			}
+			item->len = strlen(item->v.s);
+			return (true);
+		case 'p':
+			item->v.p = va_arg(*args, void *);
+			return (true);
+		default: // 'a'
+			item->v.a = va_arg(*args, RIG_ARRAY);
+			return (item->v.a != NULL);
+	}
+}
+
+/**
+ * INTERNAL
+ * Create a new entry, copying the key and value into it. Strings are copied
+ * into the same memory block as the entry, nested arrays are not touched, the
+ * entry takes over the reference the caller holds.
+ *
+ * @param key
+ *     key item
+ * @param value
+ *     value item
+ *
+ * @return
+ *     entry pointer, NULL on error.
+ *     On error, the following error codes are set:
+ *     - ENOMEM (insufficient memory)
+ */
+static inline ArrayEntry array_entry_new(ArrayItem key, ArrayItem value) {
+	size_t klen = (key->type == 's') ? (key->len + 1) : (0);
+	size_t vlen = (value->type == 's') ? (value->len + 1) : (0);
+
+	ArrayEntry entry = rig_mem_alloc(sizeof(*entry), klen + vlen);
+	NULLCHECK_ERRET(entry, ENOMEM, NULL);
+
+	entry->key = *key;
+	entry->value = *value;
+
+	char *strings = (char *)(entry + 1);
+
+	if (klen != 0) {
+		entry->key.v.s = memcpy(strings, key->v.s, klen);
+	}
+
+	if (vlen != 0) {
+		entry->value.v.s = memcpy(strings + klen, value->v.s, vlen);
+	}
+
+	return (entry);
+}
+
+/**
+ * INTERNAL
+ * Free an entry that was never visible to other threads.
+ *
+ * @param entry
+ *     entry pointer
+ */
+static inline void array_entry_free(ArrayEntry entry) {
+	if (entry->value.type == 'a') {
+		rig_array_destroy(&entry->value.v.a);
+	}
+
+	rig_mem_free(entry);
+}
+
+/**
+ * INTERNAL
+ * Retire an entry that was removed from the list. Call only from inside an
+ * epoch critical section.
+ * The reference to a nested array is dropped right away: readers that still
+ * see the entry will either get their own reference before the count drops
+ * to zero, or fail to and treat the value as removed.
+ *
+ * @param entry
+ *     entry pointer
+ */
+static inline void array_entry_retire(ArrayEntry entry) {
+	if (entry->value.type == 'a') {
+		RIG_ARRAY nested = entry->value.v.a;
+		rig_array_destroy(&nested);
+	}
+
+	rig_smr_epoch_mem_retire(entry);
+}
+
+/**
+ * INTERNAL
+ * Search for the entry matching the specified search key. Call only from
+ * inside an epoch critical section, which protects the returned entry.
+ *
+ * @param a
+ *     array pointer
+ * @param search
+ *     search key
+ *
+ * @return
+ *     entry pointer, NULL on error.
+ *     On error, the following error codes are set:
+ *     - ENOENT (key not found)
+ */
+static inline ArrayEntry array_search(RIG_ARRAY a, ArraySearch search) {
+	search->entry.value.type = ARRAY_SEARCH;
+	search->found = NULL;
+	search->exact = false;
+
+	if (!rig_list_find(a->list, search)) {
+		return (NULL);
+	}
+
+	return (search->found);
+}
+
+/**
+ * INTERNAL
+ * Remove the entry matching the specified search key, and retire it. Call
+ * only from inside an epoch critical section.
+ * If search->exact is set, only the entry in search->found is removed.
+ *
+ * @param a
+ *     array pointer
+ * @param search
+ *     search key
+ *
+ * @return
+ *     boolean indicating success.
+ *     On error, the following error codes are set:
+ *     - ENOENT (key not found)
+ */
+static inline bool array_remove(RIG_ARRAY a, ArraySearch search) {
+	search->entry.value.type = ARRAY_SEARCH;
+
+	if (!search->exact) {
+		search->found = NULL;
+	}
+
+	if (!rig_list_del(a->list, search)) {
+		return (false);
+	}
+
+	// The comparator ran last on the entry that was actually removed
+	array_entry_retire(search->found);
+
+	return (true);
+}
+
+/**
+ * Add key/value pairs to the array.
+ * The variable arguments are the keys and values, alternating, their types
+ * given by tinfo. Either all pairs are added, or none are: if a key already
+ * exists, or any other error happens, the pairs added so far are removed
+ * again. Concurrent readers may see them in the meantime.
+ *
+ * @param a
+ *     array pointer
+ * @param tinfo
+ *     array of type specifications, use RIG_ASPEC() to build it
+ * @param tsize
+ *     number of type specifications, use RIG_ASPEC() to get it
+ *
+ * @return
+ *     boolean indicating success.
+ *     On error, the following error codes are set:
+ *     - EINVAL (invalid type specification, NULL string or array passed)
+ *     - EEXIST (key already present)
+ *     - EXFULL (array full)
+ *     - ENOMEM (insufficient memory)
+ */
+bool rig_array_add(RIG_ARRAY a, RIG_ARRAY_ASP tinfo[], size_t tsize, ...) {
+	NULLCHECK_EXIT(a);
+
+	if (!array_check_spec(tinfo, tsize, true)) {
+		ERRET(EINVAL, false);
+	}
+
+	struct ArrayItemStruct key, value;
+	struct array_stack added;
+	int err = 0;
+
+	array_stack_init(&added, sizeof(void *));
+
+	va_list args;
+	va_start(args, tsize);
+
+	rig_smr_epoch_critical_enter();
+
+	for (size_t i = 0; (i < tsize) && (err == 0); i++) {
+		for (size_t j = 0; (j < tinfo[i].count) || (j == 0); j++) {
+			if ((!array_read_item(&key, tinfo[i].type[0], &args)) || (!array_read_item(&value, tinfo[i].type[1], &args))) {
+				err = EINVAL;
+				break;
+			}
+
+			// Nested arrays: take a reference, or a full copy
+			if (value.type == 'a') {
+				if (TEST_BITFIELD(tinfo[i].flags, RIG_ARRAY_DUPLICATE)) {
+					value.v.a = rig_array_duplicate(value.v.a, RIG_ARRAY_DUPLICATE);
+
+					if (value.v.a == NULL) {
+						err = errno;
+						break;
+					}
+				}
+				else {
+					value.v.a = rig_array_newref(value.v.a);
+				}
+			}
+
+			ArrayEntry entry = array_entry_new(&key, &value);
+
+			if (entry == NULL) {
+				if (value.type == 'a') {
+					rig_array_destroy(&value.v.a);
+				}
+
+				err = ENOMEM;
+				break;
+			}
+
+			if (!rig_list_add(a->list, entry)) {
+				err = errno;
+				array_entry_free(entry);
+				break;
+			}
+
+			array_stack_push(&added, &entry);
+		}
+	}
+
+	va_end(args);
+
+	if (err != 0) {
+		// Roll back, removing exactly the entries this call added
+		struct ArraySearchStruct search;
+		ArrayEntry *entryp, entry;
+
+		while ((entryp = array_stack_pop(&added)) != NULL) {
+			entry = *entryp;
+			search.entry.key = entry->key;
+			search.found = entry;
+			search.exact = true;
+
+			array_remove(a, &search);
+		}
+	}
+
+	rig_smr_epoch_critical_exit();
+
+	array_stack_destroy(&added);
+
+	if (err != 0) {
+		ERRET(err, false);
+	}
+
+	return (true);
+}
+
+/**
+ * Remove key/value pairs from the array.
+ * The variable arguments are the keys, their types given by the first type
+ * specifier of every entry in tinfo (the value type is ignored).
+ * All keys are processed, even if some of them are not found.
+ *
+ * @param a
+ *     array pointer
+ * @param tinfo
+ *     array of type specifications, use RIG_ASPEC() to build it
+ * @param tsize
+ *     number of type specifications, use RIG_ASPEC() to get it
+ *
+ * @return
+ *     boolean indicating success (all keys were removed).
+ *     On error, the following error codes are set:
+ *     - EINVAL (invalid type specification, NULL string passed)
+ *     - ENOENT (at least one key not found)
+ */
+bool rig_array_del(RIG_ARRAY a, RIG_ARRAY_ASP tinfo[], size_t tsize, ...) {
+	NULLCHECK_EXIT(a);
+
+	if (!array_check_spec(tinfo, tsize, false)) {
+		ERRET(EINVAL, false);
+	}
+
+	struct ArraySearchStruct search;
+	int err = 0;
+
+	va_list args;
+	va_start(args, tsize);
+
+	rig_smr_epoch_critical_enter();
+
+	for (size_t i = 0; (i < tsize) && (err != EINVAL); i++) {
+		for (size_t j = 0; (j < tinfo[i].count) || (j == 0); j++) {
+			if (!array_read_item(&search.entry.key, tinfo[i].type[0], &args)) {
+				err = EINVAL;
+				break;
+			}
+
+			search.exact = false;
+
+			if (!array_remove(a, &search)) {
+				err = ENOENT;
+			}
+		}
+	}
+
+	rig_smr_epoch_critical_exit();
+
+	va_end(args);
+
+	if (err != 0) {
+		ERRET(err, false);
+	}
+
+	return (true);
+}
+
+/**
+ * INTERNAL
+ * Common code for rig_array_find() and rig_array_find_any().
+ *
+ * @param a
+ *     array pointer
+ * @param tinfo
+ *     array of type specifications
+ * @param tsize
+ *     number of type specifications
+ * @param any
+ *     return on the first key found, instead of requiring all
+ * @param *args
+ *     pointer to the variable arguments list
+ *
+ * @return
+ *     boolean indicating success.
+ */
+static bool array_find(RIG_ARRAY a, RIG_ARRAY_ASP tinfo[], size_t tsize, bool any, va_list *args) {
+	if (!array_check_spec(tinfo, tsize, false)) {
+		ERRET(EINVAL, false);
+	}
+
+	struct ArraySearchStruct search;
+	bool found = !any;
+
+	rig_smr_epoch_critical_enter();
+
+	for (size_t i = 0; (i < tsize) && (found != any); i++) {
+		for (size_t j = 0; ((j < tinfo[i].count) || (j == 0)) && (found != any); j++) {
+			if (!array_read_item(&search.entry.key, tinfo[i].type[0], args)) {
+				rig_smr_epoch_critical_exit();
+
+				ERRET(EINVAL, false);
+			}
+
+			found = (array_search(a, &search) != NULL);
+		}
+	}
+
+	rig_smr_epoch_critical_exit();
+
+	if (!found) {
+		ERRET(ENOENT, false);
+	}
+
+	return (true);
+}
+
+/**
+ * Check whether all the specified keys are present in the array.
+ * The variable arguments are the keys, their types given by the first type
+ * specifier of every entry in tinfo (the value type is ignored).
+ *
+ * @param a
+ *     array pointer
+ * @param tinfo
+ *     array of type specifications, use RIG_ASPEC() to build it
+ * @param tsize
+ *     number of type specifications, use RIG_ASPEC() to get it
+ *
+ * @return
+ *     boolean indicating success (all keys present).
+ *     On error, the following error codes are set:
+ *     - EINVAL (invalid type specification, NULL string passed)
+ *     - ENOENT (at least one key not found)
+ */
+bool rig_array_find(RIG_ARRAY a, RIG_ARRAY_ASP tinfo[], size_t tsize, ...) {
+	NULLCHECK_EXIT(a);
+
+	va_list args;
+	va_start(args, tsize);
+
+	bool found = array_find(a, tinfo, tsize, false, &args);
+
+	va_end(args);
+
+	return (found);
+}
+
+/**
+ * Check whether any of the specified keys is present in the array.
+ * The variable arguments are the keys, their types given by the first type
+ * specifier of every entry in tinfo (the value type is ignored).
+ *
+ * @param a
+ *     array pointer
+ * @param tinfo
+ *     array of type specifications, use RIG_ASPEC() to build it
+ * @param tsize
+ *     number of type specifications, use RIG_ASPEC() to get it
+ *
+ * @return
+ *     boolean indicating success (at least one key present).
+ *     On error, the following error codes are set:
+ *     - EINVAL (invalid type specification, NULL string passed)
+ *     - ENOENT (no key found)
+ */
+bool rig_array_find_any(RIG_ARRAY a, RIG_ARRAY_ASP tinfo[], size_t tsize, ...) {
+	NULLCHECK_EXIT(a);
+
+	va_list args;
+	va_start(args, tsize);
+
+	bool found = array_find(a, tinfo, tsize, true, &args);
+
+	va_end(args);
+
+	return (found);
+}
+
+/**
+ * INTERNAL
+ * Copy the value of an entry out to where the caller wants it. Call only from
+ * inside an epoch critical section. On error, the value is set to zero/NULL.
+ *
+ * @param entry
+ *     entry pointer, NULL to just reset the value
+ * @param type
+ *     value type the caller expects
+ * @param out
+ *     pointer to the caller's variable of the right type
+ *
+ * @return
+ *     boolean indicating success.
+ *     On error, the following error codes are set:
+ *     - EINVAL (value has a different type)
+ *     - ENOENT (nested array currently being destroyed)
+ *     - ENOMEM (insufficient memory to copy string)
+ */
+static inline bool array_copy_value(ArrayEntry entry, uint8_t type, void *out) {
+	int err = ENOENT;
+
+	if ((entry != NULL) && (entry->value.type != type)) {
+		err = EINVAL;
+		entry = NULL;
+	}
+
+	switch (type) {
+		case 'i':
+			*((intmax_t *)out) = (entry != NULL) ? (entry->value.v.i) : (0);
+			break;
+		case 's':
+			*((char **)out) = NULL;
+
+			if (entry != NULL) {
+				char *copy = rig_mem_alloc(sizeof(char), entry->value.len);
+
+				if (copy == NULL) {
+					err = ENOMEM;
+					entry = NULL;
+					break;
+				}
+
+				*((char **)out) = memcpy(copy, entry->value.v.s, entry->value.len + 1);
+			}
+			break;
+		case 'p':
+			*((void **)out) = (entry != NULL) ? (entry->value.v.p) : (NULL);
+			break;
+		default: // 'a'
+			*((RIG_ARRAY *)out) = NULL;
+
+			if ((entry != NULL) && (array_acquire(entry->value.v.a))) {
+				*((RIG_ARRAY *)out) = entry->value.v.a;
+			}
+			else {
+				entry = NULL;
+			}
+			break;
+	}
+
+	if (entry == NULL) {
+		ERRET(err, false);
+	}
+
+	return (true);
+}
+
+/**
+ * Get the values of the specified keys.
+ * The variable arguments are the keys and pointers to variables to store the
+ * values in, alternating, their types given by tinfo. All keys are processed:
+ * the values of those not found are set to zero/NULL.
+ * Strings are returned as copies, to be freed with rig_mem_free(), nested
+ * arrays as new references, to be released with rig_array_destroy().
+ *
+ * @param a
+ *     array pointer
+ * @param tinfo
+ *     array of type specifications, use RIG_ASPEC() to build it
+ * @param tsize
+ *     number of type specifications, use RIG_ASPEC() to get it
+ *
+ * @return
+ *     boolean indicating success (all values found).
+ *     On error, the following error codes are set:
+ *     - EINVAL (invalid type specification, NULL string or pointer passed,
+ *       value present with different type)
+ *     - ENOENT (at least one key not found)
+ *     - ENOMEM (insufficient memory to copy string)
+ */
+bool rig_array_lookup(RIG_ARRAY a, RIG_ARRAY_ASP tinfo[], size_t tsize, ...) {
+	NULLCHECK_EXIT(a);
+
+	if (!array_check_spec(tinfo, tsize, true)) {
+		ERRET(EINVAL, false);
+	}
+
+	struct ArraySearchStruct search;
+	int err = 0;
+
+	va_list args;
+	va_start(args, tsize);
+
+	rig_smr_epoch_critical_enter();
+
+	for (size_t i = 0; (i < tsize) && (err != EINVAL); i++) {
+		for (size_t j = 0; (j < tinfo[i].count) || (j == 0); j++) {
+			bool valid = array_read_item(&search.entry.key, tinfo[i].type[0], &args);
+			void *out = va_arg(args, void *);
+
+			if ((!valid) || (out == NULL)) {
+				err = EINVAL;
+				break;
+			}
+
+			if (!array_copy_value(array_search(a, &search), tinfo[i].type[1], out)) {
+				err = errno;
+			}
+		}
+	}
+
+	rig_smr_epoch_critical_exit();
+
+	va_end(args);
+
+	if (err != 0) {
+		ERRET(err, false);
+	}
+
+	return (true);
+}
+
+/**
+ * Get a nested array, following a path of keys.
+ * The variable arguments are the keys, their types given by the first type
+ * specifier of every entry in tinfo (the value type is ignored); every key
+ * except the last one leads to the next nested array to search in.
+ * The nested array is returned as a new reference, to be released with
+ * rig_array_destroy(), so it stays usable even if it's concurrently removed.
+ *
+ * @param a
+ *     array pointer
+ * @param tinfo
+ *     array of type specifications, use RIG_ASPEC() to build it
+ * @param tsize
+ *     number of type specifications, use RIG_ASPEC() to get it
+ *
+ * @return
+ *     nested array pointer, NULL on error.
+ *     On error, the following error codes are set:
+ *     - EINVAL (invalid type specification, NULL string passed, value not
+ *       an array)
+ *     - ENOENT (key not found)
+ */
+RIG_ARRAY rig_array_nested(RIG_ARRAY a, RIG_ARRAY_ASP tinfo[], size_t tsize, ...) {
+	NULLCHECK_EXIT(a);
+
+	if (!array_check_spec(tinfo, tsize, false)) {
+		ERRET(EINVAL, NULL);
+	}
+
+	struct ArraySearchStruct search;
+	RIG_ARRAY curr = rig_array_newref(a), next = NULL;
+	int err = 0;
+
+	va_list args;
+	va_start(args, tsize);
+
+	rig_smr_epoch_critical_enter();
+
+	for (size_t i = 0; (i < tsize) && (err == 0); i++) {
+		for (size_t j = 0; (j < tinfo[i].count) || (j == 0); j++) {
+			if (!array_read_item(&search.entry.key, tinfo[i].type[0], &args)) {
+				err = EINVAL;
+				break;
+			}
+
+			if (!array_copy_value(array_search(curr, &search), 'a', &next)) {
+				err = errno;
+				break;
+			}
+
+			// Hold a reference on each level while searching it
+			rig_array_destroy(&curr);
+			curr = next;
+		}
+	}
+
+	if (err != 0) {
+		rig_array_destroy(&curr);
+	}
+
+	rig_smr_epoch_critical_exit();
+
+	va_end(args);
+
+	if (err != 0) {
+		ERRET(err, NULL);
+	}
+
+	return (curr);
+}
+
+/**
+ * Check if array is empty.
+ *
+ * @param a
+ *     array pointer
+ *
+ * @return
+ *     boolean indicating emptiness
+ */
+bool rig_array_empty(RIG_ARRAY a) {
+	NULLCHECK_EXIT(a);
+
+	return (rig_list_empty(a->list));
+}
+
+/**
+ * Check if array is full.
+ *
+ * @param a
+ *     array pointer
+ *
+ * @return
+ *     boolean indicating fullness
+ */
+bool rig_array_full(RIG_ARRAY a) {
+	NULLCHECK_EXIT(a);
+
+	return (rig_list_full(a->list));
+}
+
+/**
+ * Get current number of key/value pairs in the array.
+ *
+ * @param a
+ *     array pointer
+ *
+ * @return
+ *     number of key/value pairs
+ */
+size_t rig_array_count(RIG_ARRAY a) {
+	NULLCHECK_EXIT(a);
+
+	return (rig_list_count(a->list));
+}
+
+/**
+ * Get maximum number of key/value pairs the array can hold.
+ *
+ * @param a
+ *     array pointer
+ *
+ * @return
+ *     capacity of array
+ */
+size_t rig_array_capacity(RIG_ARRAY a) {
+	NULLCHECK_EXIT(a);
+
+	return (rig_list_capacity(a->list));
+}
+
+/**
+ * Duplicate the specified array.
+ * Nested arrays are shared between the original and the copy, unless
+ * RIG_ARRAY_DUPLICATE is given, in which case they are copied recursively.
+ *
+ * @param a
+ *     array pointer
+ * @param flags
+ *     flags to modify duplication behavior, the following are currently supported:
+ *     - RIG_ARRAY_DUPLICATE (also duplicate nested arrays)
+ *
+ * @return
+ *     New array copy data, NULL on error.
+ *     On error, the following error codes are set:
+ *     - EINVAL (invalid arguments passed)
+ *     - ENOMEM (insufficient memory)
+ */
+RIG_ARRAY rig_array_duplicate(RIG_ARRAY a, uint16_t flags) {
+	NULLCHECK_EXIT(a);
+	CHECK_PERMITTED_FLAGS(flags, RIG_ARRAY_DUPLICATE);
+
+	RIG_ARRAY dup_a = rig_array_init(a->flags, rig_array_capacity(a));
+	NULLCHECK_ERRET(dup_a, ENOMEM, NULL);
+
+	rig_smr_epoch_critical_enter();
+
+	RIG_LIST_ITER iter = rig_list_iter_begin(a->list);
+	NULLCHECK_ERRET_CLEANUP(iter, errno, NULL, rig_smr_epoch_critical_exit(); rig_array_destroy(&dup_a));
+
+	// First collect the entries, so the iterator is done before nested arrays
+	// get duplicated; the epoch critical section keeps them alive meanwhile
+	struct array_stack tmp_stack;
+	array_stack_init(&tmp_stack, sizeof(void *));
+
+	ArrayEntry entry;
+
+	while ((entry = rig_list_iter_next(iter)) != NULL) {
+		// Skip nested arrays that are concurrently being destroyed
+		if ((entry->value.type != 'a') || (array_acquire(entry->value.v.a))) {
+			array_stack_push(&tmp_stack, &entry);
+		}
+	}
+
+	rig_list_iter_end(&iter);
+
+	ArrayEntry *entryp;
+	int err = 0;
+
+	while ((entryp = array_stack_pop(&tmp_stack)) != NULL) {
+		entry = *entryp;
+
+		// For nested arrays, value now holds the reference collected above
+		struct ArrayItemStruct value = entry->value;
+
+		if (err != 0) {
+			// Just drop the collected references
+			if (value.type == 'a') {
+				rig_array_destroy(&value.v.a);
+			}
+			continue;
+		}
+
+		if ((value.type == 'a') && (TEST_BITFIELD(flags, RIG_ARRAY_DUPLICATE))) {
+			RIG_ARRAY nested = value.v.a;
+
+			value.v.a = rig_array_duplicate(nested, flags);
+			err = (value.v.a == NULL) ? (errno) : (0);
+
+			rig_array_destroy(&nested);
+
+			if (err != 0) {
+				continue;
+			}
+		}
+
+		ArrayEntry dup_entry = array_entry_new(&entry->key, &value);
+
+		if (dup_entry == NULL) {
+			if (value.type == 'a') {
+				rig_array_destroy(&value.v.a);
+			}
+
+			err = ENOMEM;
+			continue;
+		}
+
+		if (!rig_list_add(dup_a->list, dup_entry)) {
+			rig_acheck_msg(errno != EEXIST, "EEXIST should never happen during array duplication!");
+
+			array_entry_free(dup_entry);
+
+			// Ignore EXFULL, we're done once the copy is full
+			if (errno == ENOMEM) {
+				err = ENOMEM;
+			}
+		}
+	}
+
+	rig_smr_epoch_critical_exit();
+
+	array_stack_destroy(&tmp_stack);
+
+	if (err != 0) {
+		rig_array_destroy(&dup_a);
+
+		ERRET(err, NULL);
+	}
+
+	return (dup_a);
+}
@@ -12,16 +12,82 @@
 
 #include "rig_internal.h"
 #include <atomic_ops.h>
+#include <unistd.h>
 
-struct rig_counter {
-	atomic_ops_uint counter CACHELINE_ALIGNED;
-	size_t maximum_value; // read-only value
+#define RIG_COUNTER_SHARDS_MAX 64 // Upper bound on the number of shards of a sharded counter
+#define RIG_COUNTER_SHARD_BATCH 32 // Units a shard reserves from the central value at most
+
+struct rig_counter_shard {
+	atomic_ops_uint spare CACHELINE_ALIGNED; // Reserved units not yet handed out
 };
 
+#if defined(SYSTEM_TLS_SUPPORT)
+	static SYSTEM_TLS_DECL size_t Counter_Shard = 0;
+#else
+	static RIG_TLS RIG_Counter_TLS_Key = NULL;
+
+	static void rig_counter_construct(void) ATTR_CONSTRUCTOR;
+	static void rig_counter_destruct(void) ATTR_DESTRUCTOR;
+
+	static void rig_counter_construct(void) {
+		// The TLS key must be initialized only once, only one thread can get here
+		RIG_Counter_TLS_Key = rig_tls_init();
+		NULLCHECK_EXIT(RIG_Counter_TLS_Key);
+	}
+
+	static void rig_counter_destruct(void) {
+		rig_tls_destroy(&RIG_Counter_TLS_Key);
+	}
+
+#endif
+
+static atomic_ops_uint RIG_Counter_Next_Shard = ATOMIC_OPS_UINT_INIT(0);
+
+/**
+ * Atomically add a value to the counter, returning the previous value.
+ * This is a single atomic instruction with compilers that provide one,
+ * a CAS loop otherwise; either way, it is a full memory barrier.
+ *
+ * @param value
+ *     counter value to update
+ * @param add_to_value
+ *     value to add, negative values are passed as their two's complement
+ *
+ * @return
+ *     value before the addition
+ */
+static inline size_t rig_counter_fetch_and_add(atomic_ops_uint *value, size_t add_to_value) {
+#if defined(SYSTEM_CC_GNUCC) || defined(SYSTEM_CC_CLANG) || defined(SYSTEM_CC_INTEL)
+	// atomic_ops_uint wraps a single machine word
+	return (__sync_fetch_and_add((volatile size_t *)value, add_to_value));
+#else
+	size_t count;
+
+	do {
+		count = atomic_ops_uint_load(value, ATOMIC_OPS_FENCE_NONE);
+	} while (!atomic_ops_uint_cas(value, count, count + add_to_value, ATOMIC_OPS_FENCE_FULL));
+
+	return (count);
+#endif
+}
+
+static inline size_t rig_counter_shard_index(RIG_COUNTER c);
+static bool rig_counter_central_take(RIG_COUNTER c, size_t units, atomic_ops_uint *spare);
+static bool rig_counter_shard_take(RIG_COUNTER c, size_t units);
+static void rig_counter_shard_put(RIG_COUNTER c, size_t units);
+static size_t rig_counter_shards_drain(RIG_COUNTER c);
+static size_t rig_counter_shards_fold(RIG_COUNTER c);
+
 
 /**
  * Initialize an atomic counter object, which can keep track of values between
  * 0 and a defined upper limit (with SIZE_MAX as the default and biggest value).
+ * Increments of counters without an explicit maximum are a single atomic
+ * addition, which is undone if it went out of the counter's range, instead of
+ * a compare-and-swap loop that retries under contention. Decrements, and all
+ * updates of counters with a maximum, keep the compare-and-swap loop: there,
+ * a failed update being visible until undone (a value wrapped below zero or
+ * over the maximum) could make concurrent updates fail or succeed wrongly.
  *
  * @param initial_value
  *     initial value from which to start counting, must be between 0 and max_val
@@ -36,24 +102,191 @@ struct rig_counter {
  *     - ENOMEM (insufficient memory)
  */
 RIG_COUNTER rig_counter_init(size_t initial_value, size_t maximum_value) {
+	RIG_COUNTER c = rig_mem_alloc_aligned(sizeof(*c), 0, CACHELINE_SIZE, RIG_MEM_ALLOC_ALIGN_PAD);
+	NULLCHECK_ERRET(c, ENOMEM, NULL);
+
+	if (!rig_counter_init_inline(c, initial_value, maximum_value, false)) {
+		rig_mem_free_aligned(c);
+		return (NULL);
+	}
+
+	return (c);
+}
+
+/**
+ * Initialize a sharded atomic counter object, which behaves like the one
+ * returned by rig_counter_init(), but spreads increments and decrements over
+ * per-thread shards, one cache line each, instead of serializing them all on
+ * a single shared value.
+ * Each shard reserves a small batch of units from the central value, so that
+ * most increments and decrements only touch the calling thread's own shard;
+ * the reservations always count against the maximum, which thus stays exact:
+ * when the central value runs out, the spare units are pulled back from all
+ * shards before an increment fails.
+ * Reading the value folds all shards and is only exact in the absence of
+ * concurrent updates, rig_counter_get_approx() returns a cheap upper bound.
+ * Decrementing below zero is not detected, and rig_counter_dec_and_test() is
+ * not a reliable last-reference test, so sharded counters are meant for
+ * element counts and statistics, reference counts should use normal ones.
+ *
+ * @param initial_value
+ *     initial value from which to start counting, must be between 0 and max_val
+ * @param maximum_value
+ *     biggest value the counter can hold, between 1 and SIZE_MAX, as a
+ *     convenience, 0 means to automatically use the biggest possible value
+ *
+ * @return
+ *     counter object data, NULL on error.
+ *     On error, the following error codes are set:
+ *     - EINVAL (invalid initial value passed)
+ *     - ENOMEM (insufficient memory)
+ */
+RIG_COUNTER rig_counter_init_sharded(size_t initial_value, size_t maximum_value) {
+	RIG_COUNTER c = rig_mem_alloc_aligned(sizeof(*c), 0, CACHELINE_SIZE, RIG_MEM_ALLOC_ALIGN_PAD);
+	NULLCHECK_ERRET(c, ENOMEM, NULL);
+
+	if (!rig_counter_init_inline(c, initial_value, maximum_value, true)) {
+		rig_mem_free_aligned(c);
+		return (NULL);
+	}
+
+	return (c);
+}
+
+/**
+ * Initialize an atomic counter embedded in another object, such as the element
+ * and reference counts of the data structures, saving its own allocation and a
+ * pointer dereference on every access. Its address can then be passed to all
+ * the rig_counter_*() functions, except rig_counter_destroy(), use
+ * rig_counter_destroy_inline() instead.
+ *
+ * @param c
+ *     memory for the counter object data
+ * @param initial_value
+ *     initial value from which to start counting, must be between 0 and max_val
+ * @param maximum_value
+ *     biggest value the counter can hold, between 1 and SIZE_MAX, as a
+ *     convenience, 0 means to automatically use the biggest possible value
+ * @param sharded
+ *     make it a sharded counter, like rig_counter_init_sharded() does
+ *
+ * @return
+ *     boolean indicating success.
+ *     On error, the following error codes are set:
+ *     - EINVAL (invalid initial value passed)
+ *     - ENOMEM (insufficient memory)
+ */
+bool rig_counter_init_inline(RIG_COUNTER c, size_t initial_value, size_t maximum_value, bool sharded) {
+	NULLCHECK_EXIT(c);
+
 	// max_val == 0 means to use the maximum possible size
 	if (maximum_value == 0) {
 		maximum_value = SIZE_MAX;
 	}
 
 	if (initial_value > maximum_value) {
-		ERRET(EINVAL, NULL);
+		ERRET(EINVAL, false);
 	}
 
-	RIG_COUNTER c = rig_mem_alloc_aligned(sizeof(*c), 0, CACHELINE_SIZE, RIG_MEM_ALLOC_ALIGN_PAD);
-	NULLCHECK_ERRET(c, ENOMEM, NULL);
-
 	atomic_ops_uint_store(&c->counter, initial_value, ATOMIC_OPS_FENCE_NONE);
 	c->maximum_value = maximum_value;
+	c->shards = NULL;
+	c->shards_mask = 0;
+	c->batch = 0;
+
+	if (sharded) {
+		// One shard per CPU, rounded up to a power of two for cheap indexing
+		size_t shards = 1, cpus = rig_counter_cpus();
+
+		while ((shards < cpus) && (shards < RIG_COUNTER_SHARDS_MAX)) {
+			shards <<= 1;
+		}
+
+		c->shards = rig_mem_alloc_aligned(0, shards * sizeof(*c->shards), CACHELINE_SIZE, 0);
+		NULLCHECK_ERRET(c->shards, ENOMEM, false);
+
+		for (size_t i = 0; i < shards; i++) {
+			atomic_ops_uint_store(&c->shards[i].spare, 0, ATOMIC_OPS_FENCE_NONE);
+		}
+
+		c->shards_mask = shards - 1;
+
+		// Keep the slack all shards can hold small compared to the maximum,
+		// small counters just degrade to reserving one unit at a time
+		c->batch = c->maximum_value / (shards * 4);
+
+		if (c->batch > RIG_COUNTER_SHARD_BATCH) {
+			c->batch = RIG_COUNTER_SHARD_BATCH;
+		}
+	}
 
 	atomic_ops_fence(ATOMIC_OPS_FENCE_RELEASE);
 
-	return (c);
+	return (true);
+}
+
+/**
+ * Destroy an atomic counter embedded in another object, freeing what it
+ * allocated itself, but not its own memory.
+ *
+ * @param c
+ *     counter object data
+ */
+void rig_counter_destroy_inline(RIG_COUNTER c) {
+	NULLCHECK_EXIT(c);
+
+	if (c->shards != NULL) {
+		rig_mem_free_aligned(c->shards);
+		c->shards = NULL;
+	}
+}
+
+/**
+ * INTERNAL
+ * Add a number to a counter that only a single thread ever adds to, while
+ * others only take back what it added, through rig_counter_sub_single().
+ * The value can then only shrink between the range check and the addition,
+ * so a single atomic addition does, without compare-and-swap retries.
+ * Not for sharded counters.
+ *
+ * @param c
+ *     counter object data
+ * @param add_to_value
+ *     value to add to the counter
+ *
+ * @return
+ *     boolean indicating success.
+ *     On error, the following error codes are set:
+ *     - ERANGE (addition would result in value out of counter's range)
+ */
+bool rig_counter_add_single(RIG_COUNTER c, size_t add_to_value) {
+	NULLCHECK_EXIT(c);
+
+	if ((add_to_value > c->maximum_value)
+	 || (atomic_ops_uint_load(&c->counter, ATOMIC_OPS_FENCE_NONE) > c->maximum_value - add_to_value)) {
+		ERRET(ERANGE, false);
+	}
+
+	rig_counter_fetch_and_add(&c->counter, add_to_value);
+
+	return (true);
+}
+
+/**
+ * INTERNAL
+ * Subtract a number from a counter that is known to hold at least that much,
+ * as it was added by rig_counter_add_single(), with a single atomic addition.
+ * Not for sharded counters.
+ *
+ * @param c
+ *     counter object data
+ * @param sub_from_value
+ *     value to subtract from the counter
+ */
+void rig_counter_sub_single(RIG_COUNTER c, size_t sub_from_value) {
+	NULLCHECK_EXIT(c);
+
+	rig_counter_fetch_and_add(&c->counter, (size_t)0 - sub_from_value);
 }
 
 /**
@@ -70,6 +303,8 @@ void rig_counter_destroy(RIG_COUNTER *c) {
 		return;
 	}
 
+	rig_counter_destroy_inline(*c);
+
 	rig_mem_free_aligned(*c);
 	*c = NULL;
 }
@@ -101,6 +336,28 @@ size_t rig_counter_get_max(RIG_COUNTER c) {
 size_t rig_counter_get(RIG_COUNTER c) {
 	NULLCHECK_EXIT(c);
 
+	if (c->shards != NULL) {
+		return (rig_counter_shards_fold(c));
+	}
+
+	return (atomic_ops_uint_load(&c->counter, ATOMIC_OPS_FENCE_ACQUIRE));
+}
+
+/**
+ * Get an approximation of the current value of this counter, without folding
+ * the shards of a sharded counter: the result includes the units reserved by
+ * the shards, and is thus an upper bound of the exact value, never bigger
+ * than the maximum. For normal counters this is the same as rig_counter_get().
+ *
+ * @param c
+ *     counter object data
+ *
+ * @return
+ *     approximate value of counter
+ */
+size_t rig_counter_get_approx(RIG_COUNTER c) {
+	NULLCHECK_EXIT(c);
+
 	return (atomic_ops_uint_load(&c->counter, ATOMIC_OPS_FENCE_ACQUIRE));
 }
 
@@ -127,12 +384,17 @@ bool rig_counter_get_and_set(RIG_COUNTER c, size_t new_value, size_t *old_value)
 
 	if (new_value > c->maximum_value) {
 		if (old_value != NULL) {
-			*old_value = atomic_ops_uint_load(&c->counter, ATOMIC_OPS_FENCE_ACQUIRE);
+			*old_value = rig_counter_get(c);
 		}
 
 		ERRET(ERANGE, false);
 	}
 
+	if (c->shards != NULL) {
+		// Give all reserved units back, so the central value is the value
+		rig_counter_shards_drain(c);
+	}
+
 	if (old_value != NULL) {
 		*old_value = atomic_ops_uint_swap(&c->counter, new_value, ATOMIC_OPS_FENCE_ACQUIRE);
 	}
@@ -157,12 +419,27 @@ bool rig_counter_get_and_set(RIG_COUNTER c, size_t new_value, size_t *old_value)
 bool rig_counter_inc(RIG_COUNTER c) {
 	NULLCHECK_EXIT(c);
 
+	if (c->shards != NULL) {
+		return (rig_counter_shard_take(c, 1));
+	}
+
+	if (c->maximum_value == SIZE_MAX) {
+		// Increment first, and undo it if the maximum was already reached
+		if (rig_counter_fetch_and_add(&c->counter, 1) == SIZE_MAX) {
+			rig_counter_fetch_and_add(&c->counter, (size_t)-1);
+
+			ERRET(ERANGE, false);
+		}
+
+		return (true);
+	}
+
 	size_t count;
 
 	while (true) {
 		count = atomic_ops_uint_load(&c->counter, ATOMIC_OPS_FENCE_NONE);
 
-		if (count == c->maximum_value) {
+		if (count >= c->maximum_value) {
 			ERRET(ERANGE, false);
 		}
 
@@ -188,6 +465,11 @@ bool rig_counter_inc(RIG_COUNTER c) {
 bool rig_counter_dec(RIG_COUNTER c) {
 	NULLCHECK_EXIT(c);
 
+	if (c->shards != NULL) {
+		rig_counter_shard_put(c, 1);
+		return (true);
+	}
+
 	size_t count;
 
 	while (true) {
@@ -223,6 +505,13 @@ bool rig_counter_dec(RIG_COUNTER c) {
 bool rig_counter_dec_and_test(RIG_COUNTER c) {
 	NULLCHECK_EXIT(c);
 
+	if (c->shards != NULL) {
+		rig_counter_shard_put(c, 1);
+
+		errno = 0;
+		return (rig_counter_shards_fold(c) == 0);
+	}
+
 	size_t count;
 
 	while (true) {
@@ -266,7 +555,7 @@ bool rig_counter_get_and_add(RIG_COUNTER c, ssize_t add_to_value, size_t *old_va
 	// the current value into old_value if requested.
 	if (add_to_value == 0) {
 		if (old_value != NULL) {
-			*old_value = atomic_ops_uint_load(&c->counter, ATOMIC_OPS_FENCE_ACQUIRE);
+			*old_value = rig_counter_get(c);
 		}
 
 		return (true);
@@ -277,27 +566,57 @@ bool rig_counter_get_and_add(RIG_COUNTER c, ssize_t add_to_value, size_t *old_va
 	// loop, to avoid superfluous repetition (doesn't depend on loop variables).
 	if ((add_to_value > 0) && ((size_t)add_to_value > c->maximum_value)) {
 		if (old_value != NULL) {
-			*old_value = atomic_ops_uint_load(&c->counter, ATOMIC_OPS_FENCE_ACQUIRE);
+			*old_value = rig_counter_get(c);
 		}
 
 		ERRET(ERANGE, false);
 	}
 
+	if (c->shards != NULL) {
+		if (old_value != NULL) {
+			*old_value = rig_counter_shards_fold(c);
+		}
+
+		if (add_to_value < 0) {
+			rig_counter_shard_put(c, (size_t)-add_to_value);
+			return (true);
+		}
+
+		return (rig_counter_shard_take(c, (size_t)add_to_value));
+	}
+
 	size_t count;
 
-	while (true) {
-		count = atomic_ops_uint_load(&c->counter, ATOMIC_OPS_FENCE_NONE);
+	if ((c->maximum_value == SIZE_MAX) && (add_to_value > 0)) {
+		// Add first, and undo it if the old value was too near the maximum,
+		// subtractions instead could briefly wrap the value below zero
+		count = rig_counter_fetch_and_add(&c->counter, (size_t)add_to_value);
+
+		if (count > SIZE_MAX - (size_t)add_to_value) {
+			rig_counter_fetch_and_add(&c->counter, (size_t)-add_to_value);
 
-		if ((add_to_value > 0) ? (count > c->maximum_value - (size_t)add_to_value) : (count < (size_t)-add_to_value)) {
 			if (old_value != NULL) {
 				*old_value = count;
 			}
 
 			ERRET(ERANGE, false);
 		}
+	}
+	else {
+		while (true) {
+			count = atomic_ops_uint_load(&c->counter, ATOMIC_OPS_FENCE_NONE);
 
-		if (atomic_ops_uint_cas(&c->counter, count, count + (size_t)add_to_value, ATOMIC_OPS_FENCE_FULL)) {
-			break;
+			if ((add_to_value > 0) ? (count > c->maximum_value - (size_t)add_to_value) : (count < (size_t)-add_to_value)) {
+				if (old_value != NULL) {
+					*old_value = count;
+				}
+
+				ERRET(ERANGE, false);
+			}
+
+			if (atomic_ops_uint_cas(&c->counter, count, count + (size_t)add_to_value, ATOMIC_OPS_FENCE_FULL)) {
+				break;
+			}
 		}
 	}
 
@@ -307,3 +626,243 @@ bool rig_counter_get_and_add(RIG_COUNTER c, ssize_t add_to_value, size_t *old_va
 
 	return (true);
 }
+
+/**
+ * Get the number of online CPUs, using OS-specific calls.
+ *
+ * @return
+ *     number of online CPUs, at least one
+ */
+size_t rig_counter_cpus(void) {
+	long cpus;
+
+#if defined(SYSTEM_OS_UNIX) || defined(SYSTEM_OS_MACOSX)
+	#if defined(_SC_NPROCESSORS_ONLN)
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	#else
+		cpus = 1;
+	#endif
+#elif defined(SYSTEM_OS_WIN32)
+	SYSTEM_INFO sys_info;
+	GetSystemInfo(&sys_info);
+	cpus = (long)sys_info.dwNumberOfProcessors;
+#else
+	#error System OS undefined or unsupported.
+#endif
+
+	return ((cpus < 1) ? (1) : ((size_t)cpus));
+}
+
+/**
+ * Get the shard of a sharded counter the calling thread works on.
+ * Threads get a number the first time they use any sharded counter, which
+ * spreads them evenly over the shards of all counters.
+ *
+ * @param c
+ *     counter object data
+ *
+ * @return
+ *     index of the calling thread's shard
+ */
+static inline size_t rig_counter_shard_index(RIG_COUNTER c) {
+#if defined(SYSTEM_TLS_SUPPORT)
+	size_t shard = Counter_Shard;
+#else
+	size_t shard = (size_t)rig_tls_get(RIG_Counter_TLS_Key);
+#endif
+
+	if (shard == 0) {
+		// Only a placement hint: two threads getting the same number is harmless
+		atomic_ops_uint_inc(&RIG_Counter_Next_Shard, ATOMIC_OPS_FENCE_NONE);
+		shard = atomic_ops_uint_load(&RIG_Counter_Next_Shard, ATOMIC_OPS_FENCE_NONE);
+
+		if (shard == 0) {
+			shard = 1;
+		}
+
+#if defined(SYSTEM_TLS_SUPPORT)
+		Counter_Shard = shard;
+#else
+		rig_tls_set(RIG_Counter_TLS_Key, (void *)shard);
+#endif
+	}
+
+	return ((shard - 1) & c->shards_mask);
+}
+
+/**
+ * Reserve units from the central value of a sharded counter, checking them
+ * against the maximum. Some more units than needed are reserved for the
+ * calling thread's shard, as long as there is plenty of room left.
+ *
+ * @param c
+ *     counter object data
+ * @param units
+ *     units needed, at least one
+ * @param *spare
+ *     shard to which to add the additional units reserved
+ *
+ * @return
+ *     boolean indicating success
+ */
+static bool rig_counter_central_take(RIG_COUNTER c, size_t units, atomic_ops_uint *spare) {
+	size_t count, room, extra;
+
+	while (true) {
+		count = atomic_ops_uint_load(&c->counter, ATOMIC_OPS_FENCE_NONE);
+		room = c->maximum_value - count;
+
+		if (room < units) {
+			return (false);
+		}
+
+		// Shrink reservations as the maximum comes near, so that the room
+		// left isn't parked in the shards of threads that don't need it
+		extra = (room - units) / (c->shards_mask + 1);
+
+		if (extra > c->batch) {
+			extra = c->batch;
+		}
+
+		if (atomic_ops_uint_cas(&c->counter, count, count + units + extra, ATOMIC_OPS_FENCE_FULL)) {
+			break;
+		}
+	}
+
+	if (extra != 0) {
+		size_t s;
+
+		do {
+			s = atomic_ops_uint_load(spare, ATOMIC_OPS_FENCE_NONE);
+		} while (!atomic_ops_uint_cas(spare, s, s + extra, ATOMIC_OPS_FENCE_FULL));
+	}
+
+	return (true);
+}
+
+/**
+ * Increment a sharded counter: use units already reserved by the calling
+ * thread's shard, else reserve new ones from the central value; only if that
+ * is exhausted, pull back the units reserved by all shards and try again.
+ *
+ * @param c
+ *     counter object data
+ * @param units
+ *     value to add, at least one
+ *
+ * @return
+ *     boolean indicating success.
+ *     On error, the following error codes are set:
+ *     - ERANGE (increment would result in value out of counter's range)
+ */
+static bool rig_counter_shard_take(RIG_COUNTER c, size_t units) {
+	atomic_ops_uint *spare = &c->shards[rig_counter_shard_index(c)].spare;
+	size_t s;
+
+	while (true) {
+		s = atomic_ops_uint_load(spare, ATOMIC_OPS_FENCE_NONE);
+
+		if (s < units) {
+			break;
+		}
+
+		if (atomic_ops_uint_cas(spare, s, s - units, ATOMIC_OPS_FENCE_FULL)) {
+			return (true);
+		}
+	}
+
+	if (rig_counter_central_take(c, units, spare)) {
+		return (true);
+	}
+
+	// Out of room: as long as the shards still held reserved units, give
+	// them back and retry, only fail once nothing is reserved anywhere
+	while (rig_counter_shards_drain(c) != 0) {
+		if (rig_counter_central_take(c, units, spare)) {
+			return (true);
+		}
+	}
+
+	if (rig_counter_central_take(c, units, spare)) {
+		return (true);
+	}
+
+	ERRET(ERANGE, false);
+}
+
+/**
+ * Decrement a sharded counter: the units become reserved units of the calling
+ * thread's shard, and are given back to the central value once the shard holds
+ * more than twice the batch size.
+ *
+ * @param c
+ *     counter object data
+ * @param units
+ *     value to subtract, at least one
+ */
+static void rig_counter_shard_put(RIG_COUNTER c, size_t units) {
+	atomic_ops_uint *spare = &c->shards[rig_counter_shard_index(c)].spare;
+	size_t s, give;
+
+	while (true) {
+		s = atomic_ops_uint_load(spare, ATOMIC_OPS_FENCE_NONE);
+
+		// Keep one batch around, the rest goes back to the central value
+		give = ((s + units) > (c->batch * 2)) ? (s + units - c->batch) : (0);
+
+		if (atomic_ops_uint_cas(spare, s, s + units - give, ATOMIC_OPS_FENCE_FULL)) {
+			break;
+		}
+	}
+
+	if (give != 0) {
+		rig_counter_fetch_and_add(&c->counter, (size_t)0 - give);
+	}
+}
+
+/**
+ * Give back all units reserved by the shards of a sharded counter to its
+ * central value.
+ *
+ * @param c
+ *     counter object data
+ *
+ * @return
+ *     number of units given back
+ */
+static size_t rig_counter_shards_drain(RIG_COUNTER c) {
+	size_t drained = 0;
+
+	for (size_t i = 0; i <= c->shards_mask; i++) {
+		drained += atomic_ops_uint_swap(&c->shards[i].spare, 0, ATOMIC_OPS_FENCE_FULL);
+	}
+
+	if (drained != 0) {
+		rig_counter_fetch_and_add(&c->counter, (size_t)0 - drained);
+	}
+
+	return (drained);
+}
+
+/**
+ * Compute the value of a sharded counter, the central value minus all units
+ * reserved but not yet handed out by the shards.
+ *
+ * @param c
+ *     counter object data
+ *
+ * @return
+ *     current value of counter, exact in the absence of concurrent updates
+ */
+static size_t rig_counter_shards_fold(RIG_COUNTER c) {
+	size_t spare = 0;
+
+	for (size_t i = 0; i <= c->shards_mask; i++) {
+		spare += atomic_ops_uint_load(&c->shards[i].spare, ATOMIC_OPS_FENCE_NONE);
+	}
+
+	size_t count = atomic_ops_uint_load(&c->counter, ATOMIC_OPS_FENCE_ACQUIRE);
+
+	// Concurrent updates can make the fold look negative for a moment
+	return ((spare > count) ? (0) : (count - spare));
+}
@@ -17,30 +17,51 @@
 /*
  * Rig List Data Definitions
  */
-#if RIG_LIST_SMR_TYPE == 1
-	#define SMR_HP_CURR 0
-	#define SMR_HP_PREV 1
-	#define SMR_HP_KEYN 2
-#endif
+#define SMR_HP_CURR 0
+#define SMR_HP_PREV 1
+#define SMR_HP_KEYN 2
+
+#define LIST_SMR(l) ((TEST_BITFIELD((l)->flags, RIG_LIST_SMR_EPOCH)) ? (SMR_EPOCH) \
+	: ((TEST_BITFIELD((l)->flags, RIG_LIST_SMR_IBR)) ? (SMR_IBR) \
+	: ((TEST_BITFIELD((l)->flags, RIG_LIST_SMR_QSBR)) ? (SMR_QSBR) : (SMR_HP))))
+
+#define LIST_COUNTED(l) (!TEST_BITFIELD((l)->flags, RIG_LIST_NOCOUNT))
 
 /** Types */
 typedef struct KeyNodeStruct *KeyNode;
 typedef struct NodeStruct *Node;
 
+#define KEY_INTERVAL 5 // A KeyNode is responsible for every 2^N keys
+#define MKEY_MASK_HI (((size_t)-1) << (KEY_INTERVAL))
+#define SKEY_SHIFT ((sizeof(size_t) * 8) - (KEY_INTERVAL))
+#define SKEY_MASK_LO (((size_t)-1) >> (KEY_INTERVAL))
+#define SKEY_MASK_HI (~(SKEY_MASK_LO))
+
+#define BUCKET_MIN_BITS 6 // The first bucket segment holds 2^N buckets
+#define BUCKET_SEGMENTS ((SKEY_SHIFT) - (BUCKET_MIN_BITS) + 1)
+#define BUCKET_LOAD 2 // Average number of KeyNodes per bucket before growing
+
+#define SKIP_LEVELS 24 // Maximum height of a KeyNode's skip-list tower
+
 /** Structures */
 struct rig_list {
-	KeyNode khead CACHELINE_ALIGNED;
-	RIG_COUNTER count;
-	RIG_COUNTER refcount;
+	KeyNode khead CACHELINE_ALIGNED; // read-only value, also dummy KeyNode of bucket 0
+	CACHELINE_ALONE(struct rig_counter, count);
+	struct rig_counter refcount;
+	struct rig_counter kcount; // number of regular KeyNodes
 	int (*cmp)(void *data, void *item); // comparator function
 	size_t (*hash)(void *item); // hash function
 	uint16_t flags; // read-only value
+	atomic_ops_uint buckets; // number of buckets in use, power of two
+	atomic_ops_ptr segments[BUCKET_SEGMENTS]; // bucket array, allocated incrementally
 };
 
 struct KeyNodeStruct {
 	atomic_ops_flagptr next; // Next Node (first one)
 	size_t mkey; // Master-Key
 	atomic_ops_ptr knext; // Next KeyNode
+	size_t okey; // Split-Order Key (or Master-Key if ordered)
+	atomic_ops_ptr up[]; // Next KeyNode on the upper skip-list levels (if ordered)
 };
 
 struct NodeStruct {
@@ -49,20 +70,79 @@ struct NodeStruct {
 	void *data; // Data
 };
 
-#define KEY_INTERVAL 5 // A KeyNode is responsible for every 2^N keys
-#define MKEY_MASK_HI (((size_t)-1) << (KEY_INTERVAL))
-#define SKEY_SHIFT ((sizeof(size_t) * 8) - (KEY_INTERVAL))
-#define SKEY_MASK_LO (((size_t)-1) >> (KEY_INTERVAL))
-#define SKEY_MASK_HI (~(SKEY_MASK_LO))
+/*
+ * Split-Ordered KeyNodes
+ *
+ * The KeyNodes are kept in a split-ordered list (Shalev, Shavit), so that the
+ * one responsible for a given Master-Key can be found in O(1) expected time,
+ * instead of walking all the KeyNodes before it.
+ * KeyNodes are sorted by the bit-reversed value of their Master-Key (okey),
+ * with the lowest bit set. A bucket array, indexed by the lowest bits of the
+ * Master-Key, points to dummy KeyNodes inside that same list, whose okey is
+ * the bit-reversed bucket index (lowest bit clear): all KeyNodes belonging to
+ * a bucket come right after its dummy, and before the next one.
+ * When the number of buckets doubles, each bucket splits in two, and the new
+ * one gets its dummy KeyNode inserted lazily (on first use) between the ones
+ * of the old bucket, without moving anything.
+ * Dummy KeyNodes never have any Node attached, and are thus skipped by get(),
+ * peek() and the iterators, just like emptied KeyNodes. As no KeyNode is ever
+ * removed before the whole list is destroyed, no SMR is needed for them or
+ * for the bucket array.
+ * The bucket array is made of segments, allocated on demand: the first one
+ * holds 2^BUCKET_MIN_BITS buckets, each following one as many as all the
+ * previous ones together, so existing buckets never move.
+ * Note that items are thus ordered by their split-order key, and then by their
+ * Sub-Key, not by their plain hash value.
+ *
+ * Lists created with RIG_LIST_ORDERED keep their KeyNodes sorted by plain
+ * Master-Key instead (okey == mkey), and find them through a skip-list built
+ * on top of the KeyNode list, which is the skip-list's bottom level (knext).
+ * Every KeyNode gets a tower of up to SKIP_LEVELS levels, stored inline in
+ * the KeyNode itself. Its height is derived from a hash of the Master-Key, so
+ * no random number generator state is needed, and it can be recomputed when
+ * freeing the KeyNode. A new KeyNode is linked in from the bottom up: it's
+ * part of the list as soon as it's linked on the bottom level, the upper ones
+ * only serve to find it faster. As KeyNodes are never removed, the skip-list
+ * only ever needs to support insertions, which keeps it simple.
+ */
+
+static const uint8_t list_reverse_byte[256] = {
+#define R2(n) (n), (n) + 2 * 64, (n) + 1 * 64, (n) + 3 * 64
+#define R4(n) R2(n), R2((n) + 2 * 16), R2((n) + 1 * 16), R2((n) + 3 * 16)
+#define R6(n) R4(n), R4((n) + 2 * 4), R4((n) + 1 * 4), R4((n) + 3 * 4)
+	R6(0), R6(2), R6(1), R6(3)
+#undef R6
+#undef R4
+#undef R2
+};
 
 static int list_default_cmp(void *data, void *item);
 static size_t list_default_hash(void *item);
 
-static inline void list_traverse_keynodes(const KeyNode khead, size_t mkey, KeyNode * const ekprev, KeyNode * const ekcurr) ATTR_ALWAYSINLINE;
+static inline size_t list_reverse_bits(size_t key) ATTR_ALWAYSINLINE;
+static inline size_t list_highest_bit(size_t val) ATTR_ALWAYSINLINE;
+static inline atomic_ops_ptr *list_bucket_slot(RIG_LIST l, size_t bucket, bool alloc) ATTR_ALWAYSINLINE;
+static KeyNode list_get_bucket(RIG_LIST l, size_t bucket);
+static inline KeyNode list_find_bucket(RIG_LIST l, size_t bucket) ATTR_ALWAYSINLINE;
+static inline KeyNode list_get_keynode(RIG_LIST l, size_t mkey, bool add) ATTR_ALWAYSINLINE;
+static inline void list_traverse_keynodes(const KeyNode khead, size_t okey, KeyNode * const ekprev, KeyNode * const ekcurr) ATTR_ALWAYSINLINE;
+static inline size_t list_skip_levels(size_t mkey) ATTR_ALWAYSINLINE;
+static inline size_t list_keynode_levels(RIG_LIST l, KeyNode knode) ATTR_ALWAYSINLINE;
+static inline KeyNode list_alloc_keynode(size_t levels) ATTR_ALWAYSINLINE;
+static inline void list_free_keynode(KeyNode knode, size_t levels) ATTR_ALWAYSINLINE;
+static inline atomic_ops_ptr *list_skip_next(KeyNode knode, size_t level) ATTR_ALWAYSINLINE;
+static inline void list_skip_search(const KeyNode khead, size_t okey, KeyNode preds[], KeyNode succs[]) ATTR_ALWAYSINLINE;
+static inline KeyNode list_skip_keynode(RIG_LIST l, size_t mkey, bool add) ATTR_ALWAYSINLINE;
 static inline void list_traverse_nodes(const KeyNode khead, Node head, size_t skey, void *item, int (*cmp)(void *data, void *item),
-	Node * const eprev, Node * const ecurr, size_t * const dup_count, RIG_SMR_HP_Record hprec) ATTR_ALWAYSINLINE;
-static inline KeyNode list_add_keynode(const KeyNode lhead, size_t mkey) ATTR_ALWAYSINLINE;
-static inline bool list_get_first(const KeyNode lhead, Node * const eprev, Node * const ecurr, RIG_SMR_HP_Record hprec) ATTR_ALWAYSINLINE;
+	Node * const eprev, Node * const ecurr, size_t * const dup_count, RIG_SMR_HP_Record hprec, RIG_SMR_IBR_Record ibrrec, int smr) ATTR_ALWAYSINLINE;
+static inline KeyNode list_add_keynode(const KeyNode lhead, size_t okey, size_t mkey, bool * const eadded) ATTR_ALWAYSINLINE;
+static inline bool list_get_first(const KeyNode lhead, Node * const eprev, Node * const ecurr,
+	RIG_SMR_HP_Record hprec, RIG_SMR_IBR_Record ibrrec, int smr) ATTR_ALWAYSINLINE;
+static inline bool list_add_item(RIG_LIST l, void *item, int smr) ATTR_ALWAYSINLINE;
+static inline bool list_del_item(RIG_LIST l, void *item, int smr) ATTR_ALWAYSINLINE;
+static inline bool list_find_item(RIG_LIST l, void *item, int smr) ATTR_ALWAYSINLINE;
+static inline void *list_get_item(RIG_LIST l, int smr) ATTR_ALWAYSINLINE;
+static inline void *list_peek_item(RIG_LIST l, int smr) ATTR_ALWAYSINLINE;
 
 
 /*
@@ -101,6 +181,9 @@ static size_t list_default_hash(void *item) {
 
 /**
  * Initialize a lock-free ordered list/set.
+ * Elements are kept in split-order, the order of the hash table buckets, so
+ * iteration and rig_list_get()/rig_list_peek() don't follow any order useful
+ * to the caller, unless RIG_LIST_ORDERED is set.
  * This data structure is intended for low-level, high-performance purposes, and thus only accepts and returns memory
  * addresses. Their content and its persistence is the responsibility of the application programmer.
  *
@@ -109,7 +192,22 @@ static size_t list_default_hash(void *item) {
  * @param flags
  *     flags to modify list behavior, the following are currently supported:
  *     - RIG_LIST_NOCOUNT (do not count elements, capacity is not enforced)
+ *     - RIG_LIST_SHARDED_COUNT (count elements with a sharded counter, which
+ *       scales with many threads, but makes counting them approximate while
+ *       other threads update the list, capacity stays exact)
  *     - RIG_LIST_NODUPS (disallow duplicate elements in the list)
+ *     - RIG_LIST_ORDERED (keep elements ordered by hash value, using a
+ *       skip-list instead of a hash table to find them)
+ *     - RIG_LIST_SMR_EPOCH (reclaim nodes with epochs instead of hazard
+ *       pointers)
+ *     - RIG_LIST_SMR_IBR (reclaim nodes with interval-based reclamation
+ *       instead of hazard pointers: traversals cost about as little as with
+ *       epochs, but a thread stalled inside an operation only holds back the
+ *       nodes that were in the list while it was active)
+ *     - RIG_LIST_SMR_QSBR (reclaim nodes with quiescent states instead of
+ *       hazard pointers: operations cost no SMR stores or fences, but every
+ *       thread using the list has to call rig_smr_qsbr_quiescent() regularly,
+ *       or go offline with rig_smr_qsbr_offline())
  * @param cmp
  *     comparator function, checks if the element currently being examined is the element we're searching for
  * @param hash
@@ -122,39 +220,66 @@ static size_t list_default_hash(void *item) {
  *     - ENOMEM (insufficient memory)
  */
 RIG_LIST rig_list_init(size_t capacity, uint16_t flags, int (*cmp)(void *data, void *item), size_t (*hash)(void *item)) {
-	CHECK_PERMITTED_FLAGS(flags, RIG_LIST_NOCOUNT | RIG_LIST_NODUPS);
+	CHECK_PERMITTED_FLAGS(flags, RIG_LIST_NOCOUNT | RIG_LIST_NODUPS | RIG_LIST_ORDERED
+		| RIG_LIST_SMR_EPOCH | RIG_LIST_SMR_IBR | RIG_LIST_SMR_QSBR | RIG_LIST_SHARDED_COUNT);
+
+	// Only one SMR scheme can be used
+	uint16_t smr_flags = TEST_BITFIELD(flags, RIG_LIST_SMR_EPOCH | RIG_LIST_SMR_IBR | RIG_LIST_SMR_QSBR);
+
+	if ((smr_flags & (smr_flags - 1)) != 0) {
+		ERRET(EINVAL, NULL);
+	}
 
 	// Allocate memory for the list
 	RIG_LIST l = rig_mem_alloc_aligned(sizeof(*l), 0, CACHELINE_SIZE, 0);
 	NULLCHECK_ERRET(l, ENOMEM, NULL);
 
-	// Allocate memory for the sentinel KeyNode
-	KeyNode khead = rig_mem_alloc(sizeof(*khead), 0);
+	// Allocate memory for the sentinel KeyNode (with a full tower if ordered)
+	size_t klevels = (TEST_BITFIELD(flags, RIG_LIST_ORDERED)) ? (SKIP_LEVELS) : (1);
+	KeyNode khead = list_alloc_keynode(klevels);
 	NULLCHECK_ERRET_CLEANUP(khead, ENOMEM, NULL, rig_mem_free_aligned(l));
 
-	// Initialize the counters
-	RIG_COUNTER refcount = rig_counter_init(1, 0);
-	NULLCHECK_ERRET_CLEANUP(refcount, ENOMEM, NULL, rig_mem_free_aligned(l); rig_mem_free(khead));
+	// Initialize the counters, the count stays unused if not counting elements
+	VERIFY_ERRET(rig_counter_init_inline(&l->refcount, 1, 0, false));
+	VERIFY_ERRET(rig_counter_init_inline(&l->kcount, 0, 0, false));
 
-	RIG_COUNTER count = NULL;
-	if (!TEST_BITFIELD(flags, RIG_LIST_NOCOUNT)) { // Support not counting elements
-		count = rig_counter_init(0, capacity);
-		NULLCHECK_ERRET_CLEANUP(count, ENOMEM, NULL,
-			rig_mem_free_aligned(l); rig_mem_free(khead); rig_counter_destroy(&refcount));
+	if (!rig_counter_init_inline(&l->count, 0, capacity,
+		(!TEST_BITFIELD(flags, RIG_LIST_NOCOUNT)) && (TEST_BITFIELD(flags, RIG_LIST_SHARDED_COUNT)))) {
+		rig_mem_free_aligned(l); list_free_keynode(khead, klevels);
+		ERRET(ENOMEM, NULL);
 	}
 
 	// Initialize the needed values
 	atomic_ops_flagptr_store(&khead->next, NULL, false, ATOMIC_OPS_FENCE_NONE);
 	khead->mkey = 0;
 	atomic_ops_ptr_store(&khead->knext, NULL, ATOMIC_OPS_FENCE_NONE);
+	khead->okey = 0;
+
+	for (size_t i = 1; i < klevels; i++) {
+		atomic_ops_ptr_store(&khead->up[i - 1], NULL, ATOMIC_OPS_FENCE_NONE);
+	}
 
 	l->khead = khead;
-	l->count = count;
-	l->refcount = refcount;
 	l->cmp = (cmp != NULL) ? (cmp) : (&list_default_cmp);
 	l->hash = (hash != NULL) ? (hash) : (&list_default_hash);
 	l->flags = flags;
 
+	for (size_t i = 0; i < BUCKET_SEGMENTS; i++) {
+		atomic_ops_ptr_store(&l->segments[i], NULL, ATOMIC_OPS_FENCE_NONE);
+	}
+
+	atomic_ops_uint_store(&l->buckets, ((size_t)1 << BUCKET_MIN_BITS), ATOMIC_OPS_FENCE_NONE);
+
+	if (!TEST_BITFIELD(flags, RIG_LIST_ORDERED)) { // Ordered lists need no buckets
+		// The sentinel KeyNode is the dummy of bucket 0, the first segment holding it
+		// has to exist, so that there's always a bucket to start from
+		atomic_ops_ptr *slot = list_bucket_slot(l, 0, true);
+		NULLCHECK_ERRET_CLEANUP(slot, ENOMEM, NULL,
+			rig_counter_destroy_inline(&l->count); rig_mem_free_aligned(l); list_free_keynode(khead, klevels));
+
+		atomic_ops_ptr_store(slot, khead, ATOMIC_OPS_FENCE_NONE);
+	}
+
 	atomic_ops_fence(ATOMIC_OPS_FENCE_FULL);
 
 	return (l);
@@ -172,7 +297,7 @@ RIG_LIST rig_list_init(size_t capacity, uint16_t flags, int (*cmp)(void *data, v
 RIG_LIST rig_list_newref(RIG_LIST l) {
 	NULLCHECK_EXIT(l);
 
-	rig_acheck_msg(rig_counter_inc(l->refcount), "more references than physically possible");
+	rig_acheck_msg(rig_counter_inc(&l->refcount), "more references than physically possible");
 
 	return (l);
 }
@@ -188,7 +313,9 @@ void rig_list_destroy(RIG_LIST *l) {
 	NULLCHECK_EXIT(l);
 	NULLCHECK_EXIT(*l);
 
-	if (rig_counter_dec_and_test((*l)->refcount)) {
+	int smr = LIST_SMR(*l);
+
+	if (rig_counter_dec_and_test(&(*l)->refcount)) {
 		// Traverse the list and remove all nodes (sentinel included)
 		KeyNode kcurr = (*l)->khead, ksucc = NULL;
 		Node curr = NULL, succ = NULL;
@@ -200,7 +327,7 @@ void rig_list_destroy(RIG_LIST *l) {
 				succ = atomic_ops_flagptr_load(&curr->next, NULL, ATOMIC_OPS_FENCE_NONE);
 
 				// Free directly here, as there are no shared references anymore around, no SMR is required!
-				rig_mem_free(curr);
+				rig_smr_pool_free(smr, curr);
 
 				curr = succ;
 			}
@@ -208,14 +335,24 @@ void rig_list_destroy(RIG_LIST *l) {
 			ksucc = atomic_ops_ptr_load(&kcurr->knext, ATOMIC_OPS_FENCE_NONE);
 
 			// Free directly here, as there are no shared references anymore around, no SMR is required!
-			rig_mem_free(kcurr);
+			list_free_keynode(kcurr, list_keynode_levels(*l, kcurr));
 
 			kcurr = ksucc;
 		}
 
+		// Free the bucket array segments
+		for (size_t i = 0; i < BUCKET_SEGMENTS; i++) {
+			void *segment = atomic_ops_ptr_load(&(*l)->segments[i], ATOMIC_OPS_FENCE_NONE);
+
+			if (segment != NULL) {
+				rig_mem_free_aligned(segment);
+			}
+		}
+
 		// Destroy counters and list
-		rig_counter_destroy(&(*l)->refcount);
-		rig_counter_destroy(&(*l)->count);
+		rig_counter_destroy_inline(&(*l)->refcount);
+		rig_counter_destroy_inline(&(*l)->count);
+		rig_counter_destroy_inline(&(*l)->kcount);
 		rig_mem_free_aligned(*l);
 	}
 	else {
@@ -226,10 +363,10 @@ void rig_list_destroy(RIG_LIST *l) {
 
 	atomic_ops_fence(ATOMIC_OPS_FENCE_FULL);
 
-#if RIG_LIST_SMR_TYPE == 1
-	// Explicit SMR HP scan
-	rig_smr_hp_mem_scan();
-#endif
+	if (smr == SMR_HP) {
+		// Explicit SMR HP scan
+		rig_smr_hp_mem_scan();
+	}
 }
 
 /**
@@ -246,37 +383,264 @@ void rig_list_clear(RIG_LIST l) {
 
 /**
  * INTERNAL
- * Traverse through KeyNodes, starting from khead, and search for the one with
- * the specified mkey, returning then pointers to the previous and current nodes.
+ * Reverse the order of the bits in a key.
  *
- * @param khead
- *     Starting point for traversal
+ * @param key
+ *     Key to reverse
+ *
+ * @return
+ *     bit-reversed key
+ */
+static inline size_t list_reverse_bits(size_t key) {
+	size_t rev = 0;
+
+	for (size_t i = 0; i < sizeof(size_t); i++) {
+		rev = (rev << 8) | list_reverse_byte[key & 0xFF];
+		key >>= 8;
+	}
+
+	return (rev);
+}
+
+/**
+ * INTERNAL
+ * Get the position of the highest bit set in a value.
+ *
+ * @param val
+ *     Value to examine, must not be zero
+ *
+ * @return
+ *     position of the highest bit set
+ */
+static inline size_t list_highest_bit(size_t val) {
+	size_t bit = 0;
+
+	while ((val >>= 1) != 0) {
+		bit++;
+	}
+
+	return (bit);
+}
+
+/**
+ * INTERNAL
+ * Get the bucket array slot for the specified bucket, allocating the segment
+ * that holds it if required.
+ *
+ * @param l
+ *     list pointer
+ * @param bucket
+ *     Bucket index
+ * @param alloc
+ *     whether to allocate the segment if not yet present
+ *
+ * @return
+ *     Pointer to the bucket slot, NULL if its segment doesn't exist and was
+ *     not allocated (or there wasn't enough memory to do so)
+ */
+static inline atomic_ops_ptr *list_bucket_slot(RIG_LIST l, size_t bucket, bool alloc) {
+	size_t seg = 0, offset = bucket, seg_size = ((size_t)1 << BUCKET_MIN_BITS);
+
+	if (bucket >= ((size_t)1 << BUCKET_MIN_BITS)) {
+		size_t high = list_highest_bit(bucket);
+
+		seg = high - BUCKET_MIN_BITS + 1;
+		seg_size = ((size_t)1 << high);
+		offset = bucket - seg_size;
+	}
+
+	atomic_ops_ptr *segment = atomic_ops_ptr_load(&l->segments[seg], ATOMIC_OPS_FENCE_ACQUIRE);
+
+	if (segment == NULL) {
+		if (!alloc) {
+			return (NULL);
+		}
+
+		segment = rig_mem_alloc_aligned(0, seg_size * sizeof(*segment), CACHELINE_SIZE, 0);
+		if (segment == NULL) {
+			return (NULL);
+		}
+
+		for (size_t i = 0; i < seg_size; i++) {
+			atomic_ops_ptr_store(&segment[i], NULL, ATOMIC_OPS_FENCE_NONE);
+		}
+
+		if (!atomic_ops_ptr_cas(&l->segments[seg], NULL, segment, ATOMIC_OPS_FENCE_FULL)) {
+			// Somebody else was faster, use theirs
+			rig_mem_free_aligned(segment);
+			segment = atomic_ops_ptr_load(&l->segments[seg], ATOMIC_OPS_FENCE_ACQUIRE);
+		}
+	}
+
+	return (&segment[offset]);
+}
+
+/**
+ * INTERNAL
+ * Get the dummy KeyNode of the specified bucket, initializing the bucket if
+ * it's not yet, which in turn might require its parent to be initialized
+ * first (recursion depth is bounded by the number of bits in the index).
+ *
+ * @param l
+ *     list pointer
+ * @param bucket
+ *     Bucket index
+ *
+ * @return
+ *     dummy KeyNode of the bucket, NULL on error.
+ *     On error, the following error codes are set:
+ *     - ENOMEM (insufficient memory to initialize the bucket)
+ */
+static KeyNode list_get_bucket(RIG_LIST l, size_t bucket) {
+	atomic_ops_ptr *slot = list_bucket_slot(l, bucket, true);
+	NULLCHECK_ERRET(slot, ENOMEM, NULL);
+
+	KeyNode dummy = atomic_ops_ptr_load(slot, ATOMIC_OPS_FENCE_ACQUIRE);
+
+	if (dummy != NULL) {
+		return (dummy);
+	}
+
+	// The parent bucket is the one this bucket was split from, its dummy
+	// always comes before ours in the list (bucket 0 is always initialized)
+	KeyNode pdummy = list_get_bucket(l, bucket & ~((size_t)1 << list_highest_bit(bucket)));
+	if (pdummy == NULL) {
+		return (NULL);
+	}
+
+	dummy = list_add_keynode(pdummy, list_reverse_bits(bucket), 0, NULL);
+	if (dummy == NULL) {
+		return (NULL);
+	}
+
+	// All threads find the same dummy KeyNode, so a simple store is enough
+	atomic_ops_ptr_store(slot, dummy, ATOMIC_OPS_FENCE_RELEASE);
+
+	return (dummy);
+}
+
+/**
+ * INTERNAL
+ * Get the dummy KeyNode from which to start searching the specified bucket,
+ * without initializing anything: if the bucket isn't initialized yet, the
+ * nearest initialized parent is used instead, which precedes it in the list.
+ *
+ * @param l
+ *     list pointer
+ * @param bucket
+ *     Bucket index
+ *
+ * @return
+ *     dummy KeyNode to start from
+ */
+static inline KeyNode list_find_bucket(RIG_LIST l, size_t bucket) {
+	while (true) {
+		atomic_ops_ptr *slot = list_bucket_slot(l, bucket, false);
+
+		if (slot != NULL) {
+			KeyNode dummy = atomic_ops_ptr_load(slot, ATOMIC_OPS_FENCE_ACQUIRE);
+
+			if (dummy != NULL) {
+				return (dummy);
+			}
+		}
+
+		// Bucket 0 is always initialized, so this terminates
+		bucket &= ~((size_t)1 << list_highest_bit(bucket));
+	}
+}
+
+/**
+ * INTERNAL
+ * Get the KeyNode responsible for the specified mkey, possibly adding it.
+ * When a new KeyNode is added, the number of buckets is doubled, if the
+ * average number of KeyNodes per bucket grew too big.
+ *
+ * @param l
+ *     list pointer
  * @param mkey
  *     Key to search for
+ * @param add
+ *     whether to add the KeyNode if it's not present
+ *
+ * @return
+ *     KeyNode corresponding to specified key, NULL on error.
+ *     On error, the following error codes are set:
+ *     - ENOENT (KeyNode not present, and add was false)
+ *     - ENOMEM (insufficient memory to add the new KeyNode)
+ */
+static inline KeyNode list_get_keynode(RIG_LIST l, size_t mkey, bool add) {
+	if (TEST_BITFIELD(l->flags, RIG_LIST_ORDERED)) {
+		return (list_skip_keynode(l, mkey, add));
+	}
+
+	size_t index = mkey >> KEY_INTERVAL;
+	size_t okey = list_reverse_bits(index) | 0x01;
+	size_t buckets = atomic_ops_uint_load(&l->buckets, ATOMIC_OPS_FENCE_NONE);
+
+	if (!add) {
+		KeyNode kprev = NULL, kcurr = NULL;
+
+		list_traverse_keynodes(list_find_bucket(l, index & (buckets - 1)), okey, &kprev, &kcurr);
+
+		if ((kcurr == NULL) || (kcurr->okey != okey)) {
+			// Key-node absent, which means the key doesn't exist
+			ERRET(ENOENT, NULL);
+		}
+
+		return (kcurr);
+	}
+
+	KeyNode dummy = list_get_bucket(l, index & (buckets - 1));
+	if (dummy == NULL) {
+		return (NULL);
+	}
+
+	bool added = false;
+	KeyNode knode = list_add_keynode(dummy, okey, mkey, &added);
+
+	if (added) {
+		size_t kcount = 0;
+		rig_counter_get_and_add(&l->kcount, 1, &kcount);
+
+		// Losing the race to double the buckets is fine, somebody else did
+		if (((kcount / BUCKET_LOAD) >= buckets) && (buckets < ((size_t)1 << (SKEY_SHIFT - 1)))) {
+			atomic_ops_uint_cas(&l->buckets, buckets, buckets << 1, ATOMIC_OPS_FENCE_NONE);
+		}
+	}
+
+	return (knode);
+}
+
+/**
+ * INTERNAL
+ * Traverse through KeyNodes, starting from khead, and search for the one with
+ * the specified okey, returning then pointers to the previous and current nodes.
+ *
+ * @param khead
+ *     Starting point for traversal (a dummy KeyNode preceding okey)
+ * @param okey
+ *     Split-order key to search for
  * @param *ekprev
  *     Pointer in which to store reference to previous node
  * @param *ekcurr
  *     Pointer in which to store reference to current node
  */
-static inline void list_traverse_keynodes(const KeyNode khead, size_t mkey, KeyNode * const ekprev, KeyNode * const ekcurr) {
+static inline void list_traverse_keynodes(const KeyNode khead, size_t okey, KeyNode * const ekprev, KeyNode * const ekcurr) {
 	KeyNode kprev = NULL, kcurr = NULL;
 
-	// NOTE: khead is lhead (which by virtue of being the sentinel node
-	// is always accessible)
+	// NOTE: KeyNodes are never removed while the list exists, so they're
+	// always accessible without any SMR
 	kprev = khead;
-	kcurr = atomic_ops_ptr_load(&kprev->knext, ATOMIC_OPS_FENCE_NONE);
+	kcurr = atomic_ops_ptr_load(&kprev->knext, ATOMIC_OPS_FENCE_ACQUIRE);
 
 	while (kcurr != NULL) {
-		if (kcurr->mkey == mkey) {
-			break;
-		}
-
-		if (kcurr->mkey > mkey) {
+		if (kcurr->okey >= okey) {
 			break;
 		}
 
 		kprev = kcurr;
-		kcurr = atomic_ops_ptr_load(&kcurr->knext, ATOMIC_OPS_FENCE_NONE);
+		kcurr = atomic_ops_ptr_load(&kcurr->knext, ATOMIC_OPS_FENCE_ACQUIRE);
 	}
 
 	*ekprev = kprev;
@@ -309,13 +673,14 @@ static inline void list_traverse_keynodes(const KeyNode khead, size_t mkey, KeyN
  * @param *dup_count
  *     Pointer in which to store the duplicate count
  * @param hprec
- *     Hazard Pointer Record
+ *     Hazard Pointer Record (HPs only)
+ * @param ibrrec
+ *     IBR Record (IBR only)
+ * @param smr
+ *     SMR scheme (constant)
  */
 static inline void list_traverse_nodes(const KeyNode khead, Node head, size_t skey, void *item, int (*cmp)(void *data, void *item),
-	Node * const eprev, Node * const ecurr, size_t * const dup_count, RIG_SMR_HP_Record hprec) {
-#if RIG_LIST_SMR_TYPE != 1
-	UNUSED(hprec);
-#endif
+	Node * const eprev, Node * const ecurr, size_t * const dup_count, RIG_SMR_HP_Record hprec, RIG_SMR_IBR_Record ibrrec, int smr) {
 	bool mark = false;
 	Node prev = NULL, curr = NULL, succ = NULL;
 
@@ -333,14 +698,25 @@ retry:
 	}
 
 	while (curr != NULL) {
-#if RIG_LIST_SMR_TYPE == 1
-		rig_smr_hp_set(hprec, SMR_HP_CURR, curr);
-		if (curr != atomic_ops_flagptr_load_full(&prev->next, NULL, ATOMIC_OPS_FENCE_ACQUIRE)) {
-			goto retry;
+		if (smr == SMR_HP) {
+			rig_smr_hp_set(hprec, SMR_HP_CURR, curr);
+			if (curr != atomic_ops_flagptr_load_full(&prev->next, NULL, ATOMIC_OPS_FENCE_ACQUIRE)) {
+				goto retry;
+			}
 		}
-#endif
 
-		succ = atomic_ops_flagptr_load(&curr->next, &mark, ATOMIC_OPS_FENCE_NONE);
+		// With IBR, only a new era needs validation: curr might have been
+		// allocated after our reservation ended, else it's safe as it is
+		if (smr == SMR_IBR) {
+			while (!rig_smr_ibr_protect(ibrrec)) {
+				if (curr != atomic_ops_flagptr_load_full(&prev->next, NULL, ATOMIC_OPS_FENCE_ACQUIRE)) {
+					goto retry;
+				}
+			}
+		}
+
+		// IBR needs this read to happen before its era check on the next node
+		succ = atomic_ops_flagptr_load(&curr->next, &mark, (smr == SMR_IBR) ? (ATOMIC_OPS_FENCE_ACQUIRE) : (ATOMIC_OPS_FENCE_NONE));
 
 		if (mark) {
 			// Attempt physical removal
@@ -348,13 +724,10 @@ retry:
 				goto retry;
 			}
 
-#if RIG_LIST_SMR_TYPE == 1
-			rig_smr_hp_release(hprec, SMR_HP_CURR);
-			rig_smr_hp_mem_retire(curr);
-#endif
-#if RIG_LIST_SMR_TYPE == 2
-			rig_smr_epoch_mem_retire(curr);
-#endif
+			if (smr == SMR_HP) {
+				rig_smr_hp_release(hprec, SMR_HP_CURR);
+			}
+			rig_smr_pool_retire(smr, curr);
 
 			curr = succ;
 		}
@@ -368,9 +741,9 @@ retry:
 			}
 
 			prev = curr;
-#if RIG_LIST_SMR_TYPE == 1
-			rig_smr_hp_set(hprec, SMR_HP_PREV, prev);
-#endif
+			if (smr == SMR_HP) {
+				rig_smr_hp_set(hprec, SMR_HP_PREV, prev);
+			}
 			curr = succ;
 		}
 	}
@@ -396,36 +769,257 @@ retry:
 	}
 }
 
+/**
+ * INTERNAL
+ * Get the height of the skip-list tower of the KeyNode with the specified
+ * mkey: one level, plus one for each trailing one bit of the mkey's hash,
+ * which gives the usual geometric distribution with p = 1/2.
+ *
+ * @param mkey
+ *     Master-Key of the KeyNode
+ *
+ * @return
+ *     number of levels, between 1 and SKIP_LEVELS
+ */
+static inline size_t list_skip_levels(size_t mkey) {
+	size_t x = mkey >> KEY_INTERVAL, levels = 1;
+
+	x ^= x >> 16;
+	x *= (size_t)0x45D9F3B;
+	x ^= x >> 16;
+	x *= (size_t)0x45D9F3B;
+	x ^= x >> 16;
+
+	while (((x & 0x01) != 0) && (levels < SKIP_LEVELS)) {
+		levels++;
+		x >>= 1;
+	}
+
+	return (levels);
+}
+
+/**
+ * INTERNAL
+ * Get the number of levels a KeyNode was allocated with.
+ *
+ * @param l
+ *     list pointer
+ * @param knode
+ *     KeyNode pointer
+ *
+ * @return
+ *     number of levels
+ */
+static inline size_t list_keynode_levels(RIG_LIST l, KeyNode knode) {
+	if (!TEST_BITFIELD(l->flags, RIG_LIST_ORDERED)) {
+		return (1);
+	}
+
+	if (knode == l->khead) {
+		return (SKIP_LEVELS);
+	}
+
+	return (list_skip_levels(knode->mkey));
+}
+
+/**
+ * INTERNAL
+ * Allocate memory for a KeyNode with the specified number of levels.
+ * Small KeyNodes come from the node pool, the few tall ones from the normal
+ * allocator.
+ *
+ * @param levels
+ *     number of levels
+ *
+ * @return
+ *     KeyNode pointer, NULL if there wasn't enough memory
+ */
+static inline KeyNode list_alloc_keynode(size_t levels) {
+	size_t size = sizeof(struct KeyNodeStruct) + ((levels - 1) * sizeof(atomic_ops_ptr));
+
+	if (size <= RIG_MEM_POOL_MAX) {
+		return (rig_mem_pool_alloc(size));
+	}
+
+	return (rig_mem_alloc(size, 0));
+}
+
+/**
+ * INTERNAL
+ * Free memory allocated with list_alloc_keynode().
+ *
+ * @param knode
+ *     KeyNode pointer
+ * @param levels
+ *     number of levels it was allocated with
+ */
+static inline void list_free_keynode(KeyNode knode, size_t levels) {
+	size_t size = sizeof(struct KeyNodeStruct) + ((levels - 1) * sizeof(atomic_ops_ptr));
+
+	if (size <= RIG_MEM_POOL_MAX) {
+		rig_mem_pool_free(knode);
+	}
+	else {
+		rig_mem_free(knode);
+	}
+}
+
+/**
+ * INTERNAL
+ * Get the link to the next KeyNode on the specified skip-list level, the
+ * bottom level being the KeyNode list itself.
+ *
+ * @param knode
+ *     KeyNode pointer, with more levels than level
+ * @param level
+ *     skip-list level
+ *
+ * @return
+ *     pointer to the link
+ */
+static inline atomic_ops_ptr *list_skip_next(KeyNode knode, size_t level) {
+	return ((level == 0) ? (&knode->knext) : (&knode->up[level - 1]));
+}
+
+/**
+ * INTERNAL
+ * Search the skip-list for the specified okey, returning, for every level,
+ * the last KeyNode with a smaller okey and the one following it.
+ *
+ * @param khead
+ *     Starting point for traversal (list head)
+ * @param okey
+ *     Key to search for
+ * @param preds
+ *     Array of SKIP_LEVELS in which to store the preceding KeyNodes
+ * @param succs
+ *     Array of SKIP_LEVELS in which to store the following KeyNodes
+ */
+static inline void list_skip_search(const KeyNode khead, size_t okey, KeyNode preds[], KeyNode succs[]) {
+	KeyNode kprev = khead, kcurr = NULL;
+
+	// NOTE: a KeyNode is only ever reached on the levels it has
+	for (size_t level = SKIP_LEVELS; level-- > 0; ) {
+		kcurr = atomic_ops_ptr_load(list_skip_next(kprev, level), ATOMIC_OPS_FENCE_ACQUIRE);
+
+		while ((kcurr != NULL) && (kcurr->okey < okey)) {
+			kprev = kcurr;
+			kcurr = atomic_ops_ptr_load(list_skip_next(kprev, level), ATOMIC_OPS_FENCE_ACQUIRE);
+		}
+
+		preds[level] = kprev;
+		succs[level] = kcurr;
+	}
+}
+
+/**
+ * INTERNAL
+ * Get the KeyNode responsible for the specified mkey from the skip-list,
+ * possibly adding it.
+ *
+ * @param l
+ *     list pointer
+ * @param mkey
+ *     Key to search for
+ * @param add
+ *     whether to add the KeyNode if it's not present
+ *
+ * @return
+ *     KeyNode corresponding to specified key, NULL on error.
+ *     On error, the following error codes are set:
+ *     - ENOENT (KeyNode not present, and add was false)
+ *     - ENOMEM (insufficient memory to add the new KeyNode)
+ */
+static inline KeyNode list_skip_keynode(RIG_LIST l, size_t mkey, bool add) {
+	KeyNode preds[SKIP_LEVELS], succs[SKIP_LEVELS];
+	KeyNode knode = NULL;
+	size_t levels = list_skip_levels(mkey);
+
+	while (true) {
+		list_skip_search(l->khead, mkey, preds, succs);
+
+		if ((succs[0] != NULL) && (succs[0]->okey == mkey)) {
+			// Found key-node, cleanup temporary one (if exists)
+			if (knode != NULL) {
+				list_free_keynode(knode, levels);
+			}
+
+			return (succs[0]);
+		}
+
+		if (!add) {
+			// Key-node absent, which means the key doesn't exist
+			ERRET(ENOENT, NULL);
+		}
+
+		// Key-node not present, create and add it
+		if (knode == NULL) {
+			knode = list_alloc_keynode(levels);
+			NULLCHECK_ERRET(knode, ENOMEM, NULL);
+
+			// Set the content of the new key-node
+			atomic_ops_flagptr_store(&knode->next, NULL, false, ATOMIC_OPS_FENCE_NONE);
+			knode->mkey = mkey;
+			knode->okey = mkey;
+		}
+
+		for (size_t level = 0; level < levels; level++) {
+			atomic_ops_ptr_store(list_skip_next(knode, level), succs[level], ATOMIC_OPS_FENCE_NONE);
+		}
+
+		// Link the new element in at the bottom, which adds it to the list
+		if (atomic_ops_ptr_cas(&preds[0]->knext, succs[0], knode, ATOMIC_OPS_FENCE_FULL)) {
+			break;
+		}
+	}
+
+	// Then link it in on the upper levels, searching again on failure
+	for (size_t level = 1; level < levels; level++) {
+		while (!atomic_ops_ptr_cas(list_skip_next(preds[level], level), succs[level], knode, ATOMIC_OPS_FENCE_FULL)) {
+			list_skip_search(l->khead, mkey, preds, succs);
+			atomic_ops_ptr_store(list_skip_next(knode, level), succs[level], ATOMIC_OPS_FENCE_NONE);
+		}
+	}
+
+	return (knode);
+}
+
 /**
  * INTERNAL
  * Either add a new KeyNode at the appropriate location and return it, or
  * directly return an already present, matching one.
  *
  * @param lhead
- *     Starting point for traversal (list head)
+ *     Starting point for traversal (a dummy KeyNode preceding okey)
+ * @param okey
+ *     Split-order key to search for
  * @param mkey
- *     Key to search for
- * @param hprec
- *     Hazard Pointer Record
+ *     Master-Key of the new KeyNode
+ * @param *eadded
+ *     Pointer in which to store whether a new KeyNode was added, can be NULL
  *
  * @return
  *     KeyNode corresponding to specified key, NULL on error.
  *     On error, the following error codes are set:
  *     - ENOMEM (insufficient memory to add the new KeyNode)
  */
-static inline KeyNode list_add_keynode(const KeyNode lhead, size_t mkey) {
+static inline KeyNode list_add_keynode(const KeyNode lhead, size_t okey, size_t mkey, bool * const eadded) {
 	KeyNode kprev = NULL, kcurr = NULL, khead = NULL, knode = NULL;
 
 	khead = lhead;
 
+	if (eadded != NULL) {
+		*eadded = false;
+	}
+
 	while (true) {
 		// Find first occurrence of item or the right next key (if not present)
-		list_traverse_keynodes(khead, mkey, &kprev, &kcurr);
+		list_traverse_keynodes(khead, okey, &kprev, &kcurr);
 
-		if ((kcurr != NULL) && (kcurr->mkey == mkey)) {
+		if ((kcurr != NULL) && (kcurr->okey == okey)) {
 			// Found key-node, cleanup temporary one (if exists)
 			if (knode != NULL) {
-				rig_mem_free(knode);
+				rig_mem_pool_free(knode);
 			}
 
 			break;
@@ -433,12 +1027,13 @@ static inline KeyNode list_add_keynode(const KeyNode lhead, size_t mkey) {
 
 		// Key-node not present, create and add it
 		if (knode == NULL) {
-			knode = rig_mem_alloc(sizeof(*knode), 0);
+			knode = rig_mem_pool_alloc(sizeof(*knode));
 			NULLCHECK_ERRET(knode, ENOMEM, NULL);
 
 			// Set the content of the new key-node
 			atomic_ops_flagptr_store(&knode->next, NULL, false, ATOMIC_OPS_FENCE_NONE);
 			knode->mkey = mkey;
+			knode->okey = okey;
 		}
 
 		// Link the new element in
@@ -452,6 +1047,10 @@ static inline KeyNode list_add_keynode(const KeyNode lhead, size_t mkey) {
 		// Key-node added
 		kcurr = knode;
 
+		if (eadded != NULL) {
+			*eadded = true;
+		}
+
 		break;
 	}
 
@@ -478,13 +1077,29 @@ bool rig_list_add(RIG_LIST l, void *item) {
 	NULLCHECK_EXIT(l);
 	NULLCHECK_ERRET(item, EINVAL, false);
 
+	return (SMR_DISPATCH_IBR(LIST_SMR(l), list_add_item, l, item));
+}
+
+/**
+ * INTERNAL
+ * Add a new item to the list, see rig_list_add().
+ *
+ * @param l
+ *     list pointer
+ * @param item
+ *     data pointer
+ * @param smr
+ *     SMR scheme (constant)
+ */
+static inline bool list_add_item(RIG_LIST l, void *item, int smr) {
+
 	// Allocate memory for the new element
-	Node node = rig_mem_alloc(sizeof(*node), 0);
+	Node node = rig_smr_pool_alloc(smr, sizeof(*node));
 	NULLCHECK_ERRET(node, ENOMEM, false);
 
 	// Check if there's still place for the new element
-	if ((l->count != NULL) && (!rig_counter_inc(l->count))) {
-		rig_mem_free(node);
+	if ((LIST_COUNTED(l)) && (!rig_counter_inc(&l->count))) {
+		rig_smr_pool_free(smr, node);
 
 		// List full
 		ERRET(EXFULL, false);
@@ -501,82 +1116,74 @@ bool rig_list_add(RIG_LIST l, void *item) {
 	Node prev = NULL, curr = NULL, head = NULL;
 	size_t dup_count = 0;
 
-	khead = list_add_keynode(l->khead, mkey);
+	khead = list_get_keynode(l, mkey, true);
 
 	if (khead == NULL) {
 		// Roll-back global changes
-		if (l->count != NULL) { // Counting supported
-			rig_acheck_msg(rig_counter_dec(l->count), "removing non-counted node, this should never happen!");
+		if (LIST_COUNTED(l)) { // Counting supported
+			rig_acheck_msg(rig_counter_dec(&l->count), "removing non-counted node, this should never happen!");
 		}
-		rig_mem_free(node);
+		rig_smr_pool_free(smr, node);
 
 		// Failed to allocate memory for KeyNode!
 		ERRET(ENOMEM, false);
 	}
 
-#if RIG_LIST_SMR_TYPE == 1
-	// Get pointer to this thread's RIG_SMR_HP_Record
-	RIG_SMR_HP_Record hprec = rig_smr_hp_record_get();
+	void *smrrec = rig_smr_enter(smr);
+	RIG_SMR_HP_Record hprec = (smr == SMR_HP) ? (smrrec) : (NULL);
+	RIG_SMR_IBR_Record ibrrec = (smr == SMR_IBR) ? (smrrec) : (NULL);
 
-	// khead contains the key-node, transfer its protection to SMR_HP_KEYN
-	rig_smr_hp_set(hprec, SMR_HP_KEYN, khead);
-#else
-	RIG_SMR_HP_Record hprec = NULL;
-#endif
-#if RIG_LIST_SMR_TYPE == 2
-	rig_smr_epoch_critical_enter();
-#endif
+	if (smr == SMR_HP) {
+		// khead contains the key-node, transfer its protection to SMR_HP_KEYN
+		rig_smr_hp_set(hprec, SMR_HP_KEYN, khead);
+	}
 
 	head = (Node)khead;
 
 	while (true) {
 		// Find first occurrence of item or the right next key (if not present)
 		if (TEST_BITFIELD(l->flags, RIG_LIST_NODUPS)) {
-			list_traverse_nodes(khead, head, skey, item, l->cmp, &prev, &curr, &dup_count, hprec);
+			list_traverse_nodes(khead, head, skey, item, l->cmp, &prev, &curr, &dup_count, hprec, ibrrec, smr);
 
 			if ((curr != NULL) && ((curr->skey & SKEY_MASK_HI) == skey)) {
 				// Roll-back global changes
-				if (l->count != NULL) { // Counting supported
-					rig_acheck_msg(rig_counter_dec(l->count), "removing non-counted node, this should never happen!");
+				if (LIST_COUNTED(l)) { // Counting supported
+					rig_acheck_msg(rig_counter_dec(&l->count), "removing non-counted node, this should never happen!");
 				}
-				rig_mem_free(node);
+				rig_smr_pool_free(smr, node);
 
-#if RIG_LIST_SMR_TYPE == 1
-				// Reset used Hazard Pointers
-				rig_smr_hp_release(hprec, SMR_HP_CURR);
-				rig_smr_hp_release(hprec, SMR_HP_PREV);
-				rig_smr_hp_release(hprec, SMR_HP_KEYN);
-#endif
-#if RIG_LIST_SMR_TYPE == 2
-				rig_smr_epoch_critical_exit();
-#endif
+				if (smr == SMR_HP) {
+					// Reset used Hazard Pointers
+					rig_smr_hp_release(hprec, SMR_HP_CURR);
+					rig_smr_hp_release(hprec, SMR_HP_PREV);
+					rig_smr_hp_release(hprec, SMR_HP_KEYN);
+				}
+				rig_smr_exit(smr);
 
 				// Item already exists!
 				ERRET(EEXIST, false);
 			}
 		}
 		else {
-			list_traverse_nodes(khead, head, skey, item, NULL, &prev, &curr, &dup_count, hprec);
+			list_traverse_nodes(khead, head, skey, item, NULL, &prev, &curr, &dup_count, hprec, ibrrec, smr);
 		}
 
 		// We accept duplicates, up to dup_count's maximum value (which
 		// corresponds to SKEY_MASK_LO), after that we return a generic error.
 		if (dup_count == SKEY_MASK_LO) {
 			// Roll-back global changes
-			if (l->count != NULL) { // Counting supported
-				rig_acheck_msg(rig_counter_dec(l->count), "removing non-counted node, this should never happen!");
+			if (LIST_COUNTED(l)) { // Counting supported
+				rig_acheck_msg(rig_counter_dec(&l->count), "removing non-counted node, this should never happen!");
 			}
-			rig_mem_free(node);
+			rig_smr_pool_free(smr, node);
 
-#if RIG_LIST_SMR_TYPE == 1
-			// Reset used Hazard Pointers
-			rig_smr_hp_release(hprec, SMR_HP_CURR);
-			rig_smr_hp_release(hprec, SMR_HP_PREV);
-			rig_smr_hp_release(hprec, SMR_HP_KEYN);
-#endif
-#if RIG_LIST_SMR_TYPE == 2
-			rig_smr_epoch_critical_exit();
-#endif
+			if (smr == SMR_HP) {
+				// Reset used Hazard Pointers
+				rig_smr_hp_release(hprec, SMR_HP_CURR);
+				rig_smr_hp_release(hprec, SMR_HP_PREV);
+				rig_smr_hp_release(hprec, SMR_HP_KEYN);
+			}
+			rig_smr_exit(smr);
 
 			// Maximum number of duplicates reached, hash-slot is full!
 			ERRET(EXFULL, false);
@@ -593,15 +1200,13 @@ bool rig_list_add(RIG_LIST l, void *item) {
 			continue;
 		}
 
-#if RIG_LIST_SMR_TYPE == 1
-		// Reset used Hazard Pointers
-		rig_smr_hp_release(hprec, SMR_HP_CURR);
-		rig_smr_hp_release(hprec, SMR_HP_PREV);
-		rig_smr_hp_release(hprec, SMR_HP_KEYN);
-#endif
-#if RIG_LIST_SMR_TYPE == 2
-		rig_smr_epoch_critical_exit();
-#endif
+		if (smr == SMR_HP) {
+			// Reset used Hazard Pointers
+			rig_smr_hp_release(hprec, SMR_HP_CURR);
+			rig_smr_hp_release(hprec, SMR_HP_PREV);
+			rig_smr_hp_release(hprec, SMR_HP_KEYN);
+		}
+		rig_smr_exit(smr);
 
 		// Item added
 		return (true);
@@ -626,43 +1231,51 @@ bool rig_list_del(RIG_LIST l, void *item) {
 	NULLCHECK_EXIT(l);
 	NULLCHECK_ERRET(item, EINVAL, false);
 
+	return (SMR_DISPATCH_IBR(LIST_SMR(l), list_del_item, l, item));
+}
+
+/**
+ * INTERNAL
+ * Remove the specified item from the list, see rig_list_del().
+ *
+ * @param l
+ *     list pointer
+ * @param item
+ *     data pointer
+ * @param smr
+ *     SMR scheme (constant)
+ */
+static inline bool list_del_item(RIG_LIST l, void *item, int smr) {
+
 	size_t key = (*(l->hash))(item);
 	size_t mkey = key & MKEY_MASK_HI;
 	size_t skey = key << SKEY_SHIFT;
 
-	KeyNode kprev = NULL, kcurr = NULL, khead = NULL;
+	KeyNode kcurr = NULL;
 	Node prev = NULL, curr = NULL, head = NULL;
 
-	khead = l->khead;
+	// Find the KeyNode responsible for the key
+	kcurr = list_get_keynode(l, mkey, false);
 
-	// Find first occurrence of item or the right next key (if not present)
-	list_traverse_keynodes(khead, mkey, &kprev, &kcurr);
-
-	if ((kcurr == NULL) || (kcurr->mkey != mkey)) {
+	if (kcurr == NULL) {
 		// Key-node absent, which means the key doesn't exist
 		ERRET(ENOENT, false);
 	}
 
-	khead = NULL;
+	void *smrrec = rig_smr_enter(smr);
+	RIG_SMR_HP_Record hprec = (smr == SMR_HP) ? (smrrec) : (NULL);
+	RIG_SMR_IBR_Record ibrrec = (smr == SMR_IBR) ? (smrrec) : (NULL);
 
-#if RIG_LIST_SMR_TYPE == 1
-	// Get pointer to this thread's RIG_SMR_HP_Record
-	RIG_SMR_HP_Record hprec = rig_smr_hp_record_get();
-
-	// kcurr contains the key-node, transfer its protection to SMR_HP_KEYN
-	rig_smr_hp_set(hprec, SMR_HP_KEYN, kcurr);
-#else
-	RIG_SMR_HP_Record hprec = NULL;
-#endif
-#if RIG_LIST_SMR_TYPE == 2
-	rig_smr_epoch_critical_enter();
-#endif
+	if (smr == SMR_HP) {
+		// kcurr contains the key-node, transfer its protection to SMR_HP_KEYN
+		rig_smr_hp_set(hprec, SMR_HP_KEYN, kcurr);
+	}
 
 	head = (Node)kcurr;
 
 retry:
 	// Find first occurrence of item or the right next key (if not present)
-	list_traverse_nodes(kcurr, head, skey, item, l->cmp, &prev, &curr, NULL, hprec);
+	list_traverse_nodes(kcurr, head, skey, item, l->cmp, &prev, &curr, NULL, hprec, ibrrec, smr);
 
 	if ((curr != NULL) && ((curr->skey & SKEY_MASK_HI) == skey)) {
 		// Item present, remove it
@@ -674,46 +1287,37 @@ retry:
 			goto retry;
 		}
 
-		if (l->count != NULL) { // Counting supported
-			rig_acheck_msg(rig_counter_dec(l->count), "removing non-counted node, this should never happen!");
+		if (LIST_COUNTED(l)) { // Counting supported
+			rig_acheck_msg(rig_counter_dec(&l->count), "removing non-counted node, this should never happen!");
 		}
 
 		// Attempt physical removal
 		if (atomic_ops_flagptr_cas(&prev->next, curr, false, succ, false, ATOMIC_OPS_FENCE_FULL)) {
-#if RIG_LIST_SMR_TYPE == 1
-			rig_smr_hp_release(hprec, SMR_HP_CURR);
-			rig_smr_hp_mem_retire(curr);
-#endif
-#if RIG_LIST_SMR_TYPE == 2
-			rig_smr_epoch_mem_retire(curr);
-#endif
+			if (smr == SMR_HP) {
+				rig_smr_hp_release(hprec, SMR_HP_CURR);
+			}
+			rig_smr_pool_retire(smr, curr);
 		}
-#if RIG_LIST_SMR_TYPE == 1
-		else {
+
+		if (smr == SMR_HP) {
+			// Reset used Hazard Pointers
 			rig_smr_hp_release(hprec, SMR_HP_CURR);
+			rig_smr_hp_release(hprec, SMR_HP_PREV);
+			rig_smr_hp_release(hprec, SMR_HP_KEYN);
 		}
-
-		// Reset used Hazard Pointers
-		rig_smr_hp_release(hprec, SMR_HP_PREV);
-		rig_smr_hp_release(hprec, SMR_HP_KEYN);
-#endif
-#if RIG_LIST_SMR_TYPE == 2
-		rig_smr_epoch_critical_exit();
-#endif
+		rig_smr_exit(smr);
 
 		// Item removed
 		return (true);
 	}
 
-#if RIG_LIST_SMR_TYPE == 1
-	// Reset used Hazard Pointers
-	rig_smr_hp_release(hprec, SMR_HP_CURR);
-	rig_smr_hp_release(hprec, SMR_HP_PREV);
-	rig_smr_hp_release(hprec, SMR_HP_KEYN);
-#endif
-#if RIG_LIST_SMR_TYPE == 2
-	rig_smr_epoch_critical_exit();
-#endif
+	if (smr == SMR_HP) {
+		// Reset used Hazard Pointers
+		rig_smr_hp_release(hprec, SMR_HP_CURR);
+		rig_smr_hp_release(hprec, SMR_HP_PREV);
+		rig_smr_hp_release(hprec, SMR_HP_KEYN);
+	}
+	rig_smr_exit(smr);
 
 	// Empty list
 	ERRET(ENOENT, false);
@@ -737,67 +1341,71 @@ bool rig_list_find(RIG_LIST l, void *item) {
 	NULLCHECK_EXIT(l);
 	NULLCHECK_ERRET(item, EINVAL, false);
 
+	return (SMR_DISPATCH_IBR(LIST_SMR(l), list_find_item, l, item));
+}
+
+/**
+ * INTERNAL
+ * Find the specified item in the list, see rig_list_find().
+ *
+ * @param l
+ *     list pointer
+ * @param item
+ *     data pointer
+ * @param smr
+ *     SMR scheme (constant)
+ */
+static inline bool list_find_item(RIG_LIST l, void *item, int smr) {
+
 	size_t key = (*(l->hash))(item);
 	size_t mkey = key & MKEY_MASK_HI;
 	size_t skey = key << SKEY_SHIFT;
 
-	KeyNode kprev = NULL, kcurr = NULL, khead = NULL;
+	KeyNode kcurr = NULL;
 	Node prev = NULL, curr = NULL, head = NULL;
 
-	khead = l->khead;
-
-	// Find first occurrence of item or the right next key (if not present)
-	list_traverse_keynodes(khead, mkey, &kprev, &kcurr);
+	// Find the KeyNode responsible for the key
+	kcurr = list_get_keynode(l, mkey, false);
 
-	if ((kcurr == NULL) || (kcurr->mkey != mkey)) {
+	if (kcurr == NULL) {
 		// Key-node absent, which means the key doesn't exist
 		ERRET(ENOENT, false);
 	}
 
-	khead = NULL;
-
-#if RIG_LIST_SMR_TYPE == 1
-	// Get pointer to this thread's RIG_SMR_HP_Record
-	RIG_SMR_HP_Record hprec = rig_smr_hp_record_get();
+	void *smrrec = rig_smr_enter(smr);
+	RIG_SMR_HP_Record hprec = (smr == SMR_HP) ? (smrrec) : (NULL);
+	RIG_SMR_IBR_Record ibrrec = (smr == SMR_IBR) ? (smrrec) : (NULL);
 
-	// kcurr contains the key-node, transfer its protection to SMR_HP_KEYN
-	rig_smr_hp_set(hprec, SMR_HP_KEYN, kcurr);
-#else
-	RIG_SMR_HP_Record hprec = NULL;
-#endif
-#if RIG_LIST_SMR_TYPE == 2
-	rig_smr_epoch_critical_enter();
-#endif
+	if (smr == SMR_HP) {
+		// kcurr contains the key-node, transfer its protection to SMR_HP_KEYN
+		rig_smr_hp_set(hprec, SMR_HP_KEYN, kcurr);
+	}
 
 	head = (Node)kcurr;
 
 	// Find first occurrence of item or the right next key (if not present)
-	list_traverse_nodes(kcurr, head, skey, item, l->cmp, &prev, &curr, NULL, hprec);
+	list_traverse_nodes(kcurr, head, skey, item, l->cmp, &prev, &curr, NULL, hprec, ibrrec, smr);
 
 	if ((curr != NULL) && ((curr->skey & SKEY_MASK_HI) == skey)) {
-#if RIG_LIST_SMR_TYPE == 1
-		// Reset used Hazard Pointers
-		rig_smr_hp_release(hprec, SMR_HP_CURR);
-		rig_smr_hp_release(hprec, SMR_HP_PREV);
-		rig_smr_hp_release(hprec, SMR_HP_KEYN);
-#endif
-#if RIG_LIST_SMR_TYPE == 2
-		rig_smr_epoch_critical_exit();
-#endif
+		if (smr == SMR_HP) {
+			// Reset used Hazard Pointers
+			rig_smr_hp_release(hprec, SMR_HP_CURR);
+			rig_smr_hp_release(hprec, SMR_HP_PREV);
+			rig_smr_hp_release(hprec, SMR_HP_KEYN);
+		}
+		rig_smr_exit(smr);
 
 		// Item present
 		return (true);
 	}
 
-#if RIG_LIST_SMR_TYPE == 1
-	// Reset used Hazard Pointers
-	rig_smr_hp_release(hprec, SMR_HP_CURR);
-	rig_smr_hp_release(hprec, SMR_HP_PREV);
-	rig_smr_hp_release(hprec, SMR_HP_KEYN);
-#endif
-#if RIG_LIST_SMR_TYPE == 2
-	rig_smr_epoch_critical_exit();
-#endif
+	if (smr == SMR_HP) {
+		// Reset used Hazard Pointers
+		rig_smr_hp_release(hprec, SMR_HP_CURR);
+		rig_smr_hp_release(hprec, SMR_HP_PREV);
+		rig_smr_hp_release(hprec, SMR_HP_KEYN);
+	}
+	rig_smr_exit(smr);
 
 	// Empty list
 	ERRET(ENOENT, false);
@@ -814,17 +1422,19 @@ bool rig_list_find(RIG_LIST l, void *item) {
  * @param *ecurr
  *     Pointer in which to store reference to current node
  * @param hprec
- *     Hazard Pointer Record
+ *     Hazard Pointer Record (HPs only)
+ * @param ibrrec
+ *     IBR Record (IBR only)
+ * @param smr
+ *     SMR scheme (constant)
  *
  * @return
  *     boolean indicating success.
  *     On error, the following error codes are set:
  *     - ENOENT (empty list, nothing to return)
  */
-static inline bool list_get_first(const KeyNode lhead, Node * const eprev, Node * const ecurr, RIG_SMR_HP_Record hprec) {
-#if RIG_LIST_SMR_TYPE != 1
-	UNUSED(hprec);
-#endif
+static inline bool list_get_first(const KeyNode lhead, Node * const eprev, Node * const ecurr,
+	RIG_SMR_HP_Record hprec, RIG_SMR_IBR_Record ibrrec, int smr) {
 	bool mark = false;
 	KeyNode kprev = NULL, kcurr = NULL;
 	Node prev = NULL, curr = NULL, succ = NULL;
@@ -837,23 +1447,31 @@ retry:
 		if (atomic_ops_flagptr_load(&kcurr->next, NULL, ATOMIC_OPS_FENCE_ACQUIRE) != NULL) {
 			// Found non-marked key-node with a non-empty sublist, explore it
 			prev = (Node)kcurr;
-#if RIG_LIST_SMR_TYPE == 1
-			rig_smr_hp_set(hprec, SMR_HP_PREV, prev);
-#endif
+			if (smr == SMR_HP) {
+				rig_smr_hp_set(hprec, SMR_HP_PREV, prev);
+			}
 			curr = atomic_ops_flagptr_load(&prev->next, NULL, ATOMIC_OPS_FENCE_ACQUIRE);
 			// We don't care about the mark here, because prev, being a KeyNode,
 			// will never be marked, or it possibly could be only if curr
 			// is NULL, which anyway leads to restarting from the list head.
 
 			while (curr != NULL) {
-#if RIG_LIST_SMR_TYPE == 1
-				rig_smr_hp_set(hprec, SMR_HP_CURR, curr);
-				if (curr != atomic_ops_flagptr_load_full(&prev->next, NULL, ATOMIC_OPS_FENCE_ACQUIRE)) {
-					goto retry;
+				if (smr == SMR_HP) {
+					rig_smr_hp_set(hprec, SMR_HP_CURR, curr);
+					if (curr != atomic_ops_flagptr_load_full(&prev->next, NULL, ATOMIC_OPS_FENCE_ACQUIRE)) {
+						goto retry;
+					}
+				}
+
+				if (smr == SMR_IBR) {
+					while (!rig_smr_ibr_protect(ibrrec)) {
+						if (curr != atomic_ops_flagptr_load_full(&prev->next, NULL, ATOMIC_OPS_FENCE_ACQUIRE)) {
+							goto retry;
+						}
+					}
 				}
-#endif
 
-				succ = atomic_ops_flagptr_load(&curr->next, &mark, ATOMIC_OPS_FENCE_NONE);
+				succ = atomic_ops_flagptr_load(&curr->next, &mark, (smr == SMR_IBR) ? (ATOMIC_OPS_FENCE_ACQUIRE) : (ATOMIC_OPS_FENCE_NONE));
 
 				if (mark) {
 					// Attempt physical removal
@@ -861,13 +1479,10 @@ retry:
 						goto retry;
 					}
 
-#if RIG_LIST_SMR_TYPE == 1
-					rig_smr_hp_release(hprec, SMR_HP_CURR);
-					rig_smr_hp_mem_retire(curr);
-#endif
-#if RIG_LIST_SMR_TYPE == 2
-					rig_smr_epoch_mem_retire(curr);
-#endif
+					if (smr == SMR_HP) {
+						rig_smr_hp_release(hprec, SMR_HP_CURR);
+					}
+					rig_smr_pool_retire(smr, curr);
 
 					curr = succ;
 				}
@@ -892,6 +1507,8 @@ retry:
 
 /**
  * Remove the first item from the list and return it.
+ * Which item comes first is unspecified, unless the list was created with
+ * RIG_LIST_ORDERED, in which case it's the one with the lowest hash value.
  *
  * @param l
  *     List data
@@ -904,20 +1521,27 @@ retry:
 void *rig_list_get(RIG_LIST l) {
 	NULLCHECK_EXIT(l);
 
+	return (SMR_DISPATCH_IBR(LIST_SMR(l), list_get_item, l));
+}
+
+/**
+ * INTERNAL
+ * Remove the first item from the list and return it, see rig_list_get().
+ *
+ * @param l
+ *     list pointer
+ * @param smr
+ *     SMR scheme (constant)
+ */
+static inline void *list_get_item(RIG_LIST l, int smr) {
 	Node prev = NULL, curr = NULL;
 
-#if RIG_LIST_SMR_TYPE == 1
-	// Get pointer to this thread's RIG_SMR_HP_Record
-	RIG_SMR_HP_Record hprec = rig_smr_hp_record_get();
-#else
-	RIG_SMR_HP_Record hprec = NULL;
-#endif
-#if RIG_LIST_SMR_TYPE == 2
-	rig_smr_epoch_critical_enter();
-#endif
+	void *smrrec = rig_smr_enter(smr);
+	RIG_SMR_HP_Record hprec = (smr == SMR_HP) ? (smrrec) : (NULL);
+	RIG_SMR_IBR_Record ibrrec = (smr == SMR_IBR) ? (smrrec) : (NULL);
 
 retry:
-	if (list_get_first(l->khead, &prev, &curr, hprec)) {
+	if (list_get_first(l->khead, &prev, &curr, hprec, ibrrec, smr)) {
 		// Item present, remove it
 		Node succ = atomic_ops_flagptr_load(&curr->next, NULL, ATOMIC_OPS_FENCE_NONE);
 
@@ -926,45 +1550,36 @@ retry:
 			goto retry;
 		}
 
-		if (l->count != NULL) { // Counting supported
-			rig_acheck_msg(rig_counter_dec(l->count), "removing non-counted node, this should never happen!");
+		if (LIST_COUNTED(l)) { // Counting supported
+			rig_acheck_msg(rig_counter_dec(&l->count), "removing non-counted node, this should never happen!");
 		}
 
 		void *item = curr->data;
 
 		// Attempt physical removal
 		if (atomic_ops_flagptr_cas(&prev->next, curr, false, succ, false, ATOMIC_OPS_FENCE_FULL)) {
-#if RIG_LIST_SMR_TYPE == 1
-			rig_smr_hp_release(hprec, SMR_HP_CURR);
-			rig_smr_hp_mem_retire(curr);
-#endif
-#if RIG_LIST_SMR_TYPE == 2
-			rig_smr_epoch_mem_retire(curr);
-#endif
+			if (smr == SMR_HP) {
+				rig_smr_hp_release(hprec, SMR_HP_CURR);
+			}
+			rig_smr_pool_retire(smr, curr);
 		}
-#if RIG_LIST_SMR_TYPE == 1
-		else {
+
+		if (smr == SMR_HP) {
+			// Reset used Hazard Pointers
 			rig_smr_hp_release(hprec, SMR_HP_CURR);
+			rig_smr_hp_release(hprec, SMR_HP_PREV);
 		}
-
-		// Reset used Hazard Pointers
-		rig_smr_hp_release(hprec, SMR_HP_PREV);
-#endif
-#if RIG_LIST_SMR_TYPE == 2
-		rig_smr_epoch_critical_exit();
-#endif
+		rig_smr_exit(smr);
 
 		return (item);
 	}
 
-#if RIG_LIST_SMR_TYPE == 1
-	// Reset used Hazard Pointers
-	rig_smr_hp_release(hprec, SMR_HP_CURR);
-	rig_smr_hp_release(hprec, SMR_HP_PREV);
-#endif
-#if RIG_LIST_SMR_TYPE == 2
-	rig_smr_epoch_critical_exit();
-#endif
+	if (smr == SMR_HP) {
+		// Reset used Hazard Pointers
+		rig_smr_hp_release(hprec, SMR_HP_CURR);
+		rig_smr_hp_release(hprec, SMR_HP_PREV);
+	}
+	rig_smr_exit(smr);
 
 	// Empty list
 	ERRET(ENOENT, NULL);
@@ -972,6 +1587,8 @@ retry:
 
 /**
  * Return the first item from the list, without removing it.
+ * Which item comes first is unspecified, unless the list was created with
+ * RIG_LIST_ORDERED, in which case it's the one with the lowest hash value.
  *
  * @param l
  *     List data
@@ -984,41 +1601,44 @@ retry:
 void *rig_list_peek(RIG_LIST l) {
 	NULLCHECK_EXIT(l);
 
+	return (SMR_DISPATCH_IBR(LIST_SMR(l), list_peek_item, l));
+}
+
+/**
+ * INTERNAL
+ * Return the first item from the list, see rig_list_peek().
+ *
+ * @param l
+ *     list pointer
+ * @param smr
+ *     SMR scheme (constant)
+ */
+static inline void *list_peek_item(RIG_LIST l, int smr) {
 	Node prev = NULL, curr = NULL;
 
-#if RIG_LIST_SMR_TYPE == 1
-	// Get pointer to this thread's RIG_SMR_HP_Record
-	RIG_SMR_HP_Record hprec = rig_smr_hp_record_get();
-#else
-	RIG_SMR_HP_Record hprec = NULL;
-#endif
-#if RIG_LIST_SMR_TYPE == 2
-	rig_smr_epoch_critical_enter();
-#endif
-
-	if (list_get_first(l->khead, &prev, &curr, hprec)) {
+	void *smrrec = rig_smr_enter(smr);
+	RIG_SMR_HP_Record hprec = (smr == SMR_HP) ? (smrrec) : (NULL);
+	RIG_SMR_IBR_Record ibrrec = (smr == SMR_IBR) ? (smrrec) : (NULL);
+
+	if (list_get_first(l->khead, &prev, &curr, hprec, ibrrec, smr)) {
 		void *item = curr->data;
 
-#if RIG_LIST_SMR_TYPE == 1
-		// Reset used Hazard Pointers
-		rig_smr_hp_release(hprec, SMR_HP_CURR);
-		rig_smr_hp_release(hprec, SMR_HP_PREV);
-#endif
-#if RIG_LIST_SMR_TYPE == 2
-		rig_smr_epoch_critical_exit();
-#endif
+		if (smr == SMR_HP) {
+			// Reset used Hazard Pointers
+			rig_smr_hp_release(hprec, SMR_HP_CURR);
+			rig_smr_hp_release(hprec, SMR_HP_PREV);
+		}
+		rig_smr_exit(smr);
 
 		return (item);
 	}
 
-#if RIG_LIST_SMR_TYPE == 1
-	// Reset used Hazard Pointers
-	rig_smr_hp_release(hprec, SMR_HP_CURR);
-	rig_smr_hp_release(hprec, SMR_HP_PREV);
-#endif
-#if RIG_LIST_SMR_TYPE == 2
-	rig_smr_epoch_critical_exit();
-#endif
+	if (smr == SMR_HP) {
+		// Reset used Hazard Pointers
+		rig_smr_hp_release(hprec, SMR_HP_CURR);
+		rig_smr_hp_release(hprec, SMR_HP_PREV);
+	}
+	rig_smr_exit(smr);
 
 	// Empty list
 	ERRET(ENOENT, NULL);
@@ -1036,8 +1656,8 @@ void *rig_list_peek(RIG_LIST l) {
 bool rig_list_empty(RIG_LIST l) {
 	NULLCHECK_EXIT(l);
 
-	if (l->count != NULL) { // Counting supported
-		return (rig_counter_get(l->count) == 0);
+	if (LIST_COUNTED(l)) { // Counting supported
+		return (rig_counter_get(&l->count) == 0);
 	}
 
 	return (false);
@@ -1055,8 +1675,8 @@ bool rig_list_empty(RIG_LIST l) {
 bool rig_list_full(RIG_LIST l) {
 	NULLCHECK_EXIT(l);
 
-	if (l->count != NULL) { // Counting supported
-		return (rig_counter_get(l->count) == rig_counter_get_max(l->count));
+	if (LIST_COUNTED(l)) { // Counting supported
+		return (rig_counter_get(&l->count) == rig_counter_get_max(&l->count));
 	}
 
 	return (false);
@@ -1074,8 +1694,8 @@ bool rig_list_full(RIG_LIST l) {
 size_t rig_list_count(RIG_LIST l) {
 	NULLCHECK_EXIT(l);
 
-	if (l->count != NULL) { // Counting supported
-		return (rig_counter_get(l->count));
+	if (LIST_COUNTED(l)) { // Counting supported
+		return (rig_counter_get(&l->count));
 	}
 
 	return (0);
@@ -1093,8 +1713,8 @@ size_t rig_list_count(RIG_LIST l) {
 size_t rig_list_capacity(RIG_LIST l) {
 	NULLCHECK_EXIT(l);
 
-	if (l->count != NULL) { // Counting supported
-		return (rig_counter_get_max(l->count));
+	if (LIST_COUNTED(l)) { // Counting supported
+		return (rig_counter_get_max(&l->count));
 	}
 
 	return (SIZE_MAX);
@@ -1104,15 +1724,62 @@ size_t rig_list_capacity(RIG_LIST l) {
 struct rig_list_iter {
 	RIG_LIST list;
 	size_t last_skey;
+	KeyNode kcurr; // epochs, IBR and QSBR only, HPs keep these in SMR_IHP_*
+	Node prev;
+	Node curr;
+	RIG_SMR_HP_Record hprec; // HPs only
+	RIG_SMR_IBR_Record ibrrec; // IBR only
 	bool completed;
 };
 
-#define SMR_IHP_CURR 4
-#define SMR_IHP_PREV 5
-#define SMR_IHP_KEYN 6
+#define SMR_IHP_CURR 0
+#define SMR_IHP_PREV 1
+#define SMR_IHP_KEYN 2
+
+/**
+ * INTERNAL
+ * Allocate a new iterator over a list, taking a reference to it.
+ *
+ * @param l
+ *     List to iterate over
+ *
+ * @return
+ *     List iterator data, NULL if there wasn't enough memory
+ */
+static RIG_LIST_ITER list_iter_alloc(RIG_LIST l) {
+	// Allocate memory for the iterator
+	RIG_LIST_ITER iter = rig_mem_alloc(sizeof(*iter), 0);
+	if (iter == NULL) {
+		return (NULL);
+	}
+
+	// Remember the data structure and increase the reference count
+	iter->list = rig_list_newref(l);
+	iter->last_skey = 0;
+	iter->kcurr = NULL;
+	iter->prev = NULL;
+	iter->curr = NULL;
+	iter->hprec = NULL;
+	iter->ibrrec = NULL;
+	iter->completed = false;
+
+	return (iter);
+}
 
 /**
  * Create an iterator over a list.
+ * Items are returned in an unspecified order, unless the list was created
+ * with RIG_LIST_ORDERED, in which case they come by ascending hash value.
+ * On RIG_LIST_SMR_EPOCH lists, the iterator holds an epoch critical section
+ * from here until rig_list_iter_end(), which keeps every node it can reach
+ * alive without any per-node validation: it must be ended by the same thread
+ * and shouldn't be kept around for long, as no memory retired in the meantime
+ * can be reclaimed, by any thread, until then.
+ * On RIG_LIST_SMR_IBR lists, the iterator holds an IBR critical section in
+ * the same way, and with the same restrictions, but it only keeps back what
+ * was in the list while it was active.
+ * On RIG_LIST_SMR_QSBR lists, nodes are kept alive until the calling thread's
+ * next quiescent state, which must come after rig_list_iter_end().
  *
  * @param l
  *     List to iterate over
@@ -1120,37 +1787,112 @@ struct rig_list_iter {
  * @return
  *     List iterator data, NULL on error.
  *     On error, the following error codes are set:
- *     - EALREADY (another iterator already exists)
  *     - ENOMEM (insufficient memory)
  */
 RIG_LIST_ITER rig_list_iter_begin(RIG_LIST l) {
 	NULLCHECK_EXIT(l);
 
-#if RIG_LIST_SMR_TYPE == 1
-	CHECK_ITER_HPS;
-#endif
+	if ((LIST_SMR(l) == SMR_EPOCH) || (LIST_SMR(l) == SMR_QSBR)) {
+		RIG_LIST_ITER iter = list_iter_alloc(l);
+		NULLCHECK_ERRET(iter, ENOMEM, NULL);
 
-	// Allocate memory for the iterator
-	RIG_LIST_ITER iter = rig_mem_alloc(sizeof(*iter), 0);
-	NULLCHECK_ERRET(iter, ENOMEM, NULL);
+		rig_smr_enter(LIST_SMR(l));
 
-	// Remember the data structure and increase the reference count
-	iter->list = rig_list_newref(l);
-	iter->last_skey = 0;
-	iter->completed = false;
+		return (iter);
+	}
+
+	if (LIST_SMR(l) == SMR_IBR) {
+		RIG_LIST_ITER iter = list_iter_alloc(l);
+		NULLCHECK_ERRET(iter, ENOMEM, NULL);
+
+		iter->ibrrec = rig_smr_ibr_critical_enter();
+
+		return (iter);
+	}
+
+	RIG_LIST_ITER iter = list_iter_alloc(l);
+	NULLCHECK_ERRET(iter, ENOMEM, NULL);
 
-#if RIG_LIST_SMR_TYPE == 1
-	// Set the last HP to a dummy value to ensure no other iterators can be
-	// created before this one gets dismissed, to avoid chaos with the HPs.
-	// NOTE: this does not prevent SMR from reclaiming memory, as an unaligned
-	// address never appears there, seeing as atomic operations usually expect
-	// and/or perform better on aligned addresses anyway.
-	rig_smr_hp_set(hprec, 7, (void *)0x0101);
-#endif
+	// HPs of its own, so it can't get in the way of any other iterator
+	iter->hprec = rig_smr_hp_record_acquire();
+	NULLCHECK_ERRET_CLEANUP(iter->hprec, ENOMEM, NULL, rig_list_destroy(&iter->list); rig_mem_free(iter));
 
 	return (iter);
 }
 
+/**
+ * INTERNAL
+ * Get the next node of an iteration over a list using epochs, IBR or QSBR.
+ * The iterator's critical section keeps the nodes we remember, and all their
+ * successors, from being freed, even if they get deleted in the meantime (with
+ * IBR, as long as each one is checked against the era first), and
+ * the next pointers of deleted nodes are frozen by their mark, so they still
+ * lead forward in the sub-list: there is never a reason to go back to the
+ * KeyNode and skip what we already returned.
+ * Marked nodes are skipped; if prev is still in the list we unlink them,
+ * else we can only step over them.
+ *
+ * @param iter
+ *     List iterator
+ *
+ * @return
+ *     next node, NULL if the end was reached
+ */
+static Node list_iter_next_epoch(RIG_LIST_ITER iter) {
+	bool pmark = false, mark = false;
+	KeyNode kprev = NULL, kcurr = iter->kcurr;
+	Node prev = iter->curr, curr = NULL, succ = NULL;
+
+	while (true) {
+		if (kcurr == NULL) {
+			// Find the next KeyNode with a non-empty sub-list
+			kprev = (iter->kcurr == NULL) ? (iter->list->khead) : (iter->kcurr);
+			kcurr = atomic_ops_ptr_load(&kprev->knext, ATOMIC_OPS_FENCE_NONE);
+
+			while ((kcurr != NULL) && (atomic_ops_flagptr_load(&kcurr->next, NULL, ATOMIC_OPS_FENCE_ACQUIRE) == NULL)) {
+				kcurr = atomic_ops_ptr_load(&kcurr->knext, ATOMIC_OPS_FENCE_NONE);
+			}
+
+			// kcurr might be NULL, meaning we're at the end of the list
+			if (kcurr == NULL) {
+				return (NULL);
+			}
+
+			iter->kcurr = kcurr;
+			prev = (Node)kcurr;
+		}
+
+		curr = atomic_ops_flagptr_load(&prev->next, &pmark, ATOMIC_OPS_FENCE_ACQUIRE);
+
+		// If the sub-list is done, let's skip to the next KeyNode
+		if (curr == NULL) {
+			kcurr = NULL;
+			continue;
+		}
+
+		// In a new era, curr has to be read again once it's covered
+		if ((iter->ibrrec != NULL) && (!rig_smr_ibr_protect(iter->ibrrec))) {
+			continue;
+		}
+
+		succ = atomic_ops_flagptr_load(&curr->next, &mark, ATOMIC_OPS_FENCE_NONE);
+
+		if (!mark) {
+			iter->prev = prev;
+			return (curr);
+		}
+
+		if (pmark) {
+			// prev was deleted itself, so it can't be relinked anymore
+			prev = curr;
+		}
+		else if (atomic_ops_flagptr_cas(&prev->next, curr, false, succ, false, ATOMIC_OPS_FENCE_FULL)) {
+			// Physical removal
+			rig_smr_pool_retire(LIST_SMR(iter->list), curr);
+		}
+	}
+}
+
 /**
  * Iterate over a list and get a pointer to the next data item.
  * No guarantees are made about the availability of the content the returned
@@ -1171,13 +1913,23 @@ void *rig_list_iter_next(RIG_LIST_ITER iter) {
 		ERRET(ENOENT, NULL);
 	}
 
+	if (LIST_SMR(iter->list) != SMR_HP) {
+		iter->curr = list_iter_next_epoch(iter);
+
+		if (iter->curr == NULL) {
+			iter->completed = true;
+			ERRET(ENOENT, NULL);
+		}
+
+		return (iter->curr->data);
+	}
+
 	bool mark = false;
 	KeyNode kprev = NULL, kcurr = NULL;
 	Node prev = NULL, curr = NULL, succ = NULL;
 
-#if RIG_LIST_SMR_TYPE == 1
-	// Get pointer to this thread's RIG_SMR_HP_Record
-	RIG_SMR_HP_Record hprec = rig_smr_hp_record_get();
+	// Get pointer to the iterator's own RIG_SMR_HP_Record
+	RIG_SMR_HP_Record hprec = iter->hprec;
 
 	// We first need to get a valid KeyNode to work from ...
 	if (rig_smr_hp_get(hprec, SMR_IHP_KEYN) == NULL) {
@@ -1247,7 +1999,7 @@ retrykcurr:
 			}
 
 			rig_smr_hp_release(hprec, SMR_IHP_CURR);
-			rig_smr_hp_mem_retire_noscan(curr);
+			rig_smr_hp_pool_retire_noscan(curr);
 
 			curr = succ;
 		}
@@ -1272,9 +2024,6 @@ retrykcurr:
 	iter->last_skey = curr->skey;
 
 	return (curr->data);
-#else
-	return (NULL);
-#endif
 }
 
 /**
@@ -1293,9 +2042,43 @@ void rig_list_iter_delete(RIG_LIST_ITER iter) {
 	bool mark = false;
 	Node prev = NULL, curr = NULL, succ = NULL;
 
-#if RIG_LIST_SMR_TYPE == 1
-	// Get pointer to this thread's RIG_SMR_HP_Record
-	RIG_SMR_HP_Record hprec = rig_smr_hp_record_get();
+	if (LIST_SMR(iter->list) != SMR_HP) {
+		// Only once per item returned by rig_list_iter_next()
+		if (iter->prev == NULL) {
+			return;
+		}
+
+		prev = iter->prev;
+		curr = iter->curr;
+
+		do {
+			succ = atomic_ops_flagptr_load(&curr->next, &mark, ATOMIC_OPS_FENCE_NONE);
+
+			if (mark) {
+				// Somebody else was faster
+				break;
+			}
+		} while (!atomic_ops_flagptr_cas(&curr->next, succ, false, succ, true, ATOMIC_OPS_FENCE_FULL));
+
+		if (!mark) {
+			if (LIST_COUNTED(iter->list)) { // Counting supported
+				rig_acheck_msg(rig_counter_dec(&iter->list->count),
+					"removing non-counted node, this should never happen!");
+			}
+
+			if (atomic_ops_flagptr_cas(&prev->next, curr, false, succ, false, ATOMIC_OPS_FENCE_FULL)) {
+				rig_smr_pool_retire(LIST_SMR(iter->list), curr);
+			}
+		}
+
+		iter->curr = prev;
+		iter->prev = NULL;
+
+		return;
+	}
+
+	// Get pointer to the iterator's own RIG_SMR_HP_Record
+	RIG_SMR_HP_Record hprec = iter->hprec;
 
 	if (rig_smr_hp_get(hprec, SMR_IHP_CURR) != NULL) {
 		prev = rig_smr_hp_get(hprec, SMR_IHP_PREV);
@@ -1305,14 +2088,14 @@ retrysucc:
 
 		if (!mark) {
 			if (atomic_ops_flagptr_cas(&curr->next, succ, false, succ, true, ATOMIC_OPS_FENCE_FULL)) {
-				if (iter->list->count != NULL) { // Counting supported
-					rig_acheck_msg(rig_counter_dec(iter->list->count),
+				if (LIST_COUNTED(iter->list)) { // Counting supported
+					rig_acheck_msg(rig_counter_dec(&iter->list->count),
 						"removing non-counted node, this should never happen!");
 				}
 
 				if (atomic_ops_flagptr_cas(&prev->next, curr, false, succ, false, ATOMIC_OPS_FENCE_FULL)) {
 					rig_smr_hp_release(hprec, SMR_IHP_CURR);
-					rig_smr_hp_mem_retire_noscan(curr);
+					rig_smr_hp_pool_retire_noscan(curr);
 				}
 			}
 			else {
@@ -1322,7 +2105,6 @@ retrysucc:
 
 		rig_smr_hp_set(hprec, SMR_IHP_CURR, prev);
 	}
-#endif
 }
 
 /**
@@ -1339,6 +2121,9 @@ void rig_list_iter_end(RIG_LIST_ITER *iter) {
 		return;
 	}
 
+	int smr = LIST_SMR((*iter)->list);
+	RIG_SMR_HP_Record hprec = (*iter)->hprec;
+
 	// Decrease reference count of the data structure
 	rig_list_destroy(&(*iter)->list);
 
@@ -1346,12 +2131,15 @@ void rig_list_iter_end(RIG_LIST_ITER *iter) {
 	rig_mem_free(*iter);
 	*iter = NULL;
 
-#if RIG_LIST_SMR_TYPE == 1
-	RESET_ITER_HPS;
+	if (smr != SMR_HP) {
+		rig_smr_exit(smr);
+		return;
+	}
+
+	RESET_ITER_HPS(hprec);
 
 	// Explicit SMR scan
 	rig_smr_hp_mem_scan();
-#endif
 }
 
 
@@ -1364,7 +2152,6 @@ void rig_list_iter_end(RIG_LIST_ITER *iter) {
  * @return
  *     New list copy data, NULL on error.
  *     On error, the following error codes are set:
- *     - EALREADY (iterator already present, but required for copy!)
  *     - ENOMEM (insufficient memory)
  */
 RIG_LIST rig_list_duplicate(RIG_LIST l) {
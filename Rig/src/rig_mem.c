@@ -13,6 +13,10 @@
 #include "rig_internal.h"
 #include <unistd.h>
 
+#if defined(HAVE_MALLOC_USABLE_SIZE)
+	#include <malloc.h>
+#endif
+
 
 /**
  * Allocate memory amounting to (trusted + untrusted), returning a pointer to it
@@ -107,6 +111,29 @@ void rig_mem_free(void *memory_ptr) {
 	free(memory_ptr);
 }
 
+/**
+ * INTERNAL
+ * Return the size of memory previously gotten from rig_mem_alloc() or
+ * rig_mem_realloc(), as reported by the system allocator. Where the system
+ * offers no way to know it, a nominal size of one cache-line is returned,
+ * so that callers keeping statistics still make progress.
+ *
+ * @param memory_ptr
+ *     pointer to memory to get the size of, cannot be NULL
+ *
+ * @return
+ *     usable size of the memory block in bytes (or an estimate).
+ */
+size_t rig_mem_size(void *memory_ptr) {
+	NULLCHECK_EXIT(memory_ptr);
+
+#if defined(HAVE_MALLOC_USABLE_SIZE)
+	return (malloc_usable_size(memory_ptr));
+#else
+	return (CACHELINE_SIZE);
+#endif
+}
+
 
 /**
  * Allocate memory amounting to (trusted + untrusted) and align it on the
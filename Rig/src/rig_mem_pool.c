@@ -0,0 +1,421 @@
+/**
+ * This file is part of the Rig project.
+ *
+ * For the full copyright and license information, please view the COPYING
+ * file that was distributed with this source code.
+ *
+ * @copyright  (c) the Rig project
+ * @author     Luca Longinotti <chtekk@longitekk.com>
+ * @license    BSD 2-clause
+ * @version    $Id$
+ */
+
+#include "rig_internal.h"
+#include <atomic_ops.h>
+
+#define RIG_MEM_POOL_CLASS_SIZE 16 // size-class granularity, keeps every object 16 byte aligned
+#define RIG_MEM_POOL_CLASSES (RIG_MEM_POOL_MAX / RIG_MEM_POOL_CLASS_SIZE) // 16, 32, 48 and 64 bytes
+#define RIG_MEM_POOL_SLAB_SIZE ((size_t)1 << 16) // slabs are aligned on their size (mask to find header)
+#define RIG_MEM_POOL_REMOTE_BATCH 32 // objects freed by a non-owner are handed back in batches
+
+typedef struct rig_mem_pool_record *RIG_MEM_Pool_Record;
+typedef struct rig_mem_pool_slab *RIG_MEM_Pool_Slab;
+
+/*
+ * Every thread owns a RIG_MEM_Pool_Record, which holds a private free list and
+ * a bump-allocation area for each size-class, plus a shared, push-only stack
+ * per size-class (remote_free), onto which other threads give back objects
+ * they freed but don't own. The owner only ever detaches the whole remote
+ * stack at once (CAS to NULL), so there is no ABA problem to care about.
+ * Objects are carved out of slabs, which are aligned on their own size, so
+ * the slab header (and with it owner and size-class) of any object can be
+ * found by simply masking its address.
+ * Like the SMR records, records get disabled on thread exit and adopted
+ * (together with their memory) by new threads; records and slabs are only
+ * freed at unload, once the SMR schemes can't give memory back anymore.
+ */
+struct rig_mem_pool_record {
+	atomic_ops_ptr remote_free[RIG_MEM_POOL_CLASSES] CACHELINE_ALIGNED;
+	void *free_list[RIG_MEM_POOL_CLASSES] CACHELINE_ALIGNED;
+	uint8_t *bump_ptr[RIG_MEM_POOL_CLASSES];
+	uint8_t *bump_end[RIG_MEM_POOL_CLASSES];
+	RIG_MEM_Pool_Slab slabs;
+	RIG_MEM_Pool_Record batch_owner;
+	size_t batch_class;
+	size_t batch_count;
+	void *batch_head;
+	void *batch_tail;
+	atomic_ops_uint in_use;
+	RIG_MEM_Pool_Record next;
+};
+
+struct rig_mem_pool_slab {
+	RIG_MEM_Pool_Record owner;
+	RIG_MEM_Pool_Slab next;
+	size_t size_class;
+};
+
+// Objects start at the first cache-line after the slab header
+#define RIG_MEM_POOL_SLAB_HEADER ((sizeof(struct rig_mem_pool_slab) + CACHELINE_SIZE - 1) & ~((size_t)CACHELINE_SIZE - 1))
+
+// Free objects link to each other through their first word
+#define POOL_OBJ_NEXT(obj) (*(void **)(obj))
+
+static inline RIG_MEM_Pool_Record rig_mem_pool_record_get(void) ATTR_ALWAYSINLINE;
+static inline void rig_mem_pool_batch_flush(RIG_MEM_Pool_Record pool_record) ATTR_ALWAYSINLINE;
+
+#if defined(SYSTEM_TLS_SUPPORT)
+	static SYSTEM_TLS_DECL RIG_MEM_Pool_Record Pool_Record = NULL;
+#else
+	static RIG_TLS RIG_MEM_Pool_TLS_Key = NULL;
+
+	static void rig_mem_pool_construct(void) ATTR_CONSTRUCTOR;
+
+	static void rig_mem_pool_construct(void) {
+		// The TLS key must be initialized only once, only one thread can get here
+		RIG_MEM_Pool_TLS_Key = rig_tls_init();
+		NULLCHECK_EXIT(RIG_MEM_Pool_TLS_Key);
+	}
+#endif
+
+static void rig_mem_pool_destruct(void) ATTR_DESTRUCTOR;
+
+static atomic_ops_ptr RIG_MEM_Pool_List_Head = ATOMIC_OPS_PTR_INIT(NULL);
+
+// References keeping the pool alive at unload: our own, plus one for each
+// module whose destructor may still give memory back (the SMR schemes)
+static atomic_ops_uint RIG_MEM_Pool_Refs = ATOMIC_OPS_UINT_INIT(1);
+
+static void rig_mem_pool_destruct(void) {
+	rig_mem_pool_unref();
+}
+
+
+/**
+ * INTERNAL
+ * Take a reference on the node pool, so that it isn't freed at unload before
+ * the matching rig_mem_pool_unref(). Modules whose destructors may free pool
+ * memory take one from their constructor.
+ */
+void rig_mem_pool_ref(void) {
+	atomic_ops_uint_inc(&RIG_MEM_Pool_Refs, ATOMIC_OPS_FENCE_FULL);
+}
+
+/**
+ * INTERNAL
+ * Drop a reference on the node pool. Dropping the last one (at unload) gives
+ * back the calling thread's record, and then, if no other thread still uses
+ * its own, frees all slabs and records, like the SMR schemes do.
+ */
+void rig_mem_pool_unref(void) {
+	size_t refs;
+
+	do {
+		refs = atomic_ops_uint_load(&RIG_MEM_Pool_Refs, ATOMIC_OPS_FENCE_NONE);
+	} while (!atomic_ops_uint_cas(&RIG_MEM_Pool_Refs, refs, refs - 1, ATOMIC_OPS_FENCE_FULL));
+
+	if (refs != 1) {
+		return;
+	}
+
+	rig_mem_pool_record_release();
+
+	RIG_MEM_Pool_Record curr = atomic_ops_ptr_load(&RIG_MEM_Pool_List_Head, ATOMIC_OPS_FENCE_ACQUIRE);
+
+	while (curr != NULL) {
+		if (atomic_ops_uint_load(&curr->in_use, ATOMIC_OPS_FENCE_ACQUIRE) == 1) {
+			break;
+		}
+
+		curr = curr->next;
+	}
+
+	// Records still in use may still hand out their memory, keep everything
+	if (curr == NULL) {
+		curr = atomic_ops_ptr_load(&RIG_MEM_Pool_List_Head, ATOMIC_OPS_FENCE_ACQUIRE);
+
+		atomic_ops_ptr_store(&RIG_MEM_Pool_List_Head, NULL, ATOMIC_OPS_FENCE_FULL);
+
+		while (curr != NULL) {
+			RIG_MEM_Pool_Record next = curr->next;
+
+			while (curr->slabs != NULL) {
+				RIG_MEM_Pool_Slab slab = curr->slabs;
+
+				curr->slabs = slab->next;
+				rig_mem_free_aligned(slab);
+			}
+
+			rig_mem_free_aligned(curr);
+
+			curr = next;
+		}
+	}
+
+#if !defined(SYSTEM_TLS_SUPPORT)
+	rig_tls_destroy(&RIG_MEM_Pool_TLS_Key);
+#endif
+}
+
+
+/**
+ * INTERNAL
+ * Get the calling thread's RIG_MEM_Pool_Record, adopting a disabled one or
+ * allocating a new one if the thread has none yet.
+ *
+ * @return
+ *     pool record pointer
+ */
+static inline RIG_MEM_Pool_Record rig_mem_pool_record_get(void) {
+#if !defined(SYSTEM_TLS_SUPPORT)
+	RIG_MEM_Pool_Record Pool_Record = rig_tls_get(RIG_MEM_Pool_TLS_Key);
+#endif
+
+	// If Pool_Record == NULL, this thread has not registered any RIG_MEM_Pool_Record structure
+	if (Pool_Record == NULL) {
+		// Let's search if there's any old record lying around
+		Pool_Record = atomic_ops_ptr_load(&RIG_MEM_Pool_List_Head, ATOMIC_OPS_FENCE_NONE);
+
+		while (Pool_Record != NULL) {
+			if (atomic_ops_uint_load(&Pool_Record->in_use, ATOMIC_OPS_FENCE_ACQUIRE) == 0
+			 && atomic_ops_uint_cas(&Pool_Record->in_use, 0, 1, ATOMIC_OPS_FENCE_ACQUIRE)) {
+				// Got it!
+				break;
+			}
+
+			Pool_Record = Pool_Record->next;
+		}
+
+		// Didn't find an old record, need to allocate one myself
+		if (Pool_Record == NULL) {
+			Pool_Record = rig_mem_alloc_aligned(sizeof(*Pool_Record), 0, CACHELINE_SIZE, 0);
+			NULLCHECK_EXIT(Pool_Record);
+
+			// Initialize values
+			for (size_t i = 0; i < RIG_MEM_POOL_CLASSES; i++) {
+				atomic_ops_ptr_store(&Pool_Record->remote_free[i], NULL, ATOMIC_OPS_FENCE_NONE);
+				Pool_Record->free_list[i] = NULL;
+				Pool_Record->bump_ptr[i] = NULL;
+				Pool_Record->bump_end[i] = NULL;
+			}
+
+			Pool_Record->slabs = NULL;
+			Pool_Record->batch_owner = NULL;
+			Pool_Record->batch_class = 0;
+			Pool_Record->batch_count = 0;
+			Pool_Record->batch_head = NULL;
+			Pool_Record->batch_tail = NULL;
+
+			atomic_ops_uint_store(&Pool_Record->in_use, 1, ATOMIC_OPS_FENCE_NONE);
+
+			// Link the new RIG_MEM_Pool_Record into the main RIG_MEM_Pool_List
+			while (true) {
+				RIG_MEM_Pool_Record head = atomic_ops_ptr_load(&RIG_MEM_Pool_List_Head, ATOMIC_OPS_FENCE_NONE);
+
+				Pool_Record->next = head;
+
+				if (atomic_ops_ptr_cas(&RIG_MEM_Pool_List_Head, head, Pool_Record, ATOMIC_OPS_FENCE_FULL)) {
+					break;
+				}
+			}
+		}
+
+#if !defined(SYSTEM_TLS_SUPPORT)
+		// Set the thread specific value correctly
+		rig_tls_set(RIG_MEM_Pool_TLS_Key, Pool_Record);
+#endif
+	}
+
+	return (Pool_Record);
+}
+
+/**
+ * INTERNAL
+ * Hand the pending batch of remotely freed objects back to their owner,
+ * with a single CAS on the owner's remote free stack.
+ *
+ * @param pool_record
+ *     pool record of the calling thread
+ */
+static inline void rig_mem_pool_batch_flush(RIG_MEM_Pool_Record pool_record) {
+	if (pool_record->batch_count == 0) {
+		return;
+	}
+
+	atomic_ops_ptr *remote_free = &pool_record->batch_owner->remote_free[pool_record->batch_class];
+
+	while (true) {
+		void *head = atomic_ops_ptr_load(remote_free, ATOMIC_OPS_FENCE_NONE);
+
+		POOL_OBJ_NEXT(pool_record->batch_tail) = head;
+
+		if (atomic_ops_ptr_cas(remote_free, head, pool_record->batch_head, ATOMIC_OPS_FENCE_RELEASE)) {
+			break;
+		}
+	}
+
+	pool_record->batch_owner = NULL;
+	pool_record->batch_count = 0;
+	pool_record->batch_head = NULL;
+	pool_record->batch_tail = NULL;
+}
+
+/**
+ * Disable the calling thread's node pool record, so that another thread can
+ * adopt it together with all the memory it still holds. Objects belonging
+ * to other threads, that were freed but not yet given back, are handed back
+ * to their owners first.
+ * This gets called automatically on exit by threads started with
+ * rig_thread_start(), after the SMR records have been released; other
+ * threads should call it before exiting, as a record still in use at unload
+ * keeps all the pool's memory from being freed.
+ */
+void rig_mem_pool_record_release(void) {
+#if !defined(SYSTEM_TLS_SUPPORT)
+	RIG_MEM_Pool_Record Pool_Record = rig_tls_get(RIG_MEM_Pool_TLS_Key);
+#endif
+
+	if (Pool_Record != NULL) {
+		rig_mem_pool_batch_flush(Pool_Record);
+
+		atomic_ops_uint_store(&Pool_Record->in_use, 0, ATOMIC_OPS_FENCE_RELEASE);
+
+#if defined(SYSTEM_TLS_SUPPORT)
+		Pool_Record = NULL;
+#else
+		rig_tls_set(RIG_MEM_Pool_TLS_Key, NULL);
+#endif
+
+		atomic_ops_fence(ATOMIC_OPS_FENCE_FULL);
+	}
+}
+
+/**
+ * Allocate a small, fixed-size object (such as a data structure node) from
+ * the calling thread's node pool. Objects are grouped in size-classes of
+ * 16 bytes each, and are always aligned on a 16 byte boundary.
+ * Freed objects are kept in the pool for reuse and never returned to the
+ * system allocator, so use this only for objects allocated and freed at a
+ * high rate, and rig_mem_alloc() for everything else.
+ * The memory is left uninitialized.
+ *
+ * @param size
+ *     size to allocate, between 1 and RIG_MEM_POOL_MAX
+ *
+ * @return
+ *     pointer to memory, NULL on error.
+ *     On error, the following error codes are set:
+ *     - EINVAL (invalid size passed)
+ *     - ENOMEM (insufficient memory)
+ */
+void *rig_mem_pool_alloc(size_t size) {
+	if ((size == 0) || (size > RIG_MEM_POOL_MAX)) {
+		ERRET(EINVAL, NULL);
+	}
+
+	RIG_MEM_Pool_Record pool_record = rig_mem_pool_record_get();
+	size_t size_class = (size - 1) / RIG_MEM_POOL_CLASS_SIZE;
+
+	// Fast path: reuse an object from the private free list
+	void *obj = pool_record->free_list[size_class];
+
+	if (obj != NULL) {
+		pool_record->free_list[size_class] = POOL_OBJ_NEXT(obj);
+		return (obj);
+	}
+
+	// Take back everything other threads have freed in the meantime
+	if (atomic_ops_ptr_load(&pool_record->remote_free[size_class], ATOMIC_OPS_FENCE_NONE) != NULL) {
+		while (true) {
+			obj = atomic_ops_ptr_load(&pool_record->remote_free[size_class], ATOMIC_OPS_FENCE_ACQUIRE);
+
+			if (atomic_ops_ptr_cas(&pool_record->remote_free[size_class], obj, NULL, ATOMIC_OPS_FENCE_ACQUIRE)) {
+				break;
+			}
+		}
+
+		pool_record->free_list[size_class] = POOL_OBJ_NEXT(obj);
+		return (obj);
+	}
+
+	// Carve a new object out of the current slab, getting a new slab if needed
+	size_t obj_size = (size_class + 1) * RIG_MEM_POOL_CLASS_SIZE;
+
+	if (pool_record->bump_ptr[size_class] == pool_record->bump_end[size_class]) {
+		RIG_MEM_Pool_Slab slab = rig_mem_alloc_aligned(RIG_MEM_POOL_SLAB_SIZE, 0, RIG_MEM_POOL_SLAB_SIZE, 0);
+		NULLCHECK_ERRET(slab, ENOMEM, NULL);
+
+		slab->owner = pool_record;
+		slab->size_class = size_class;
+		slab->next = pool_record->slabs;
+		pool_record->slabs = slab;
+
+		pool_record->bump_ptr[size_class] = (uint8_t *)slab + RIG_MEM_POOL_SLAB_HEADER;
+		pool_record->bump_end[size_class] = pool_record->bump_ptr[size_class]
+			+ (((RIG_MEM_POOL_SLAB_SIZE - RIG_MEM_POOL_SLAB_HEADER) / obj_size) * obj_size);
+	}
+
+	obj = pool_record->bump_ptr[size_class];
+	pool_record->bump_ptr[size_class] += obj_size;
+
+	return (obj);
+}
+
+/**
+ * INTERNAL
+ * Return the size of the size-class memory previously gotten from
+ * rig_mem_pool_alloc() belongs to, read from the header of its slab.
+ *
+ * @param memory_ptr
+ *     pointer to memory to get the size of, cannot be NULL
+ *
+ * @return
+ *     size of the object in bytes (16, 32, 48 or 64).
+ */
+size_t rig_mem_pool_size(void *memory_ptr) {
+	NULLCHECK_EXIT(memory_ptr);
+
+	RIG_MEM_Pool_Slab slab = (RIG_MEM_Pool_Slab)((uintptr_t)memory_ptr & ~(RIG_MEM_POOL_SLAB_SIZE - 1));
+
+	return ((slab->size_class + 1) * RIG_MEM_POOL_CLASS_SIZE);
+}
+
+/**
+ * Give memory previously gotten from rig_mem_pool_alloc() back to the node
+ * pool it came from. Any thread can free any object: if the calling thread
+ * doesn't own it, the object is queued and handed back to its owner in a
+ * batch together with other objects of the same owner.
+ *
+ * @param memory_ptr
+ *     pointer to memory to free, cannot be NULL
+ */
+void rig_mem_pool_free(void *memory_ptr) {
+	NULLCHECK_EXIT(memory_ptr);
+
+	RIG_MEM_Pool_Slab slab = (RIG_MEM_Pool_Slab)((uintptr_t)memory_ptr & ~(RIG_MEM_POOL_SLAB_SIZE - 1));
+	RIG_MEM_Pool_Record pool_record = rig_mem_pool_record_get();
+
+	// Own object, simply put it back on the private free list
+	if (slab->owner == pool_record) {
+		POOL_OBJ_NEXT(memory_ptr) = pool_record->free_list[slab->size_class];
+		pool_record->free_list[slab->size_class] = memory_ptr;
+		return;
+	}
+
+	// Remote object, the batch can only hold objects of one owner and size-class
+	if ((pool_record->batch_owner != slab->owner) || (pool_record->batch_class != slab->size_class)) {
+		rig_mem_pool_batch_flush(pool_record);
+
+		pool_record->batch_owner = slab->owner;
+		pool_record->batch_class = slab->size_class;
+		pool_record->batch_tail = memory_ptr;
+	}
+
+	POOL_OBJ_NEXT(memory_ptr) = pool_record->batch_head;
+	pool_record->batch_head = memory_ptr;
+	pool_record->batch_count++;
+
+	if (pool_record->batch_count == RIG_MEM_POOL_REMOTE_BATCH) {
+		rig_mem_pool_batch_flush(pool_record);
+	}
+}
@@ -16,13 +16,16 @@
 /*
  * Rig Queue Data Definitions
  */
-#if RIG_QUEUE_SMR_TYPE == 1
-	#define SMR_HP_HEAD 0
-	#define SMR_HP_HNEXT 1
-	#define SMR_HP_TAIL 0
-	// HEAD and TAIL are never used together!
-	// Only at most two distinct HPs are ever used.
-#endif
+#define SMR_HP_HEAD 0
+#define SMR_HP_HNEXT 1
+#define SMR_HP_TAIL 0
+// HEAD and TAIL are never used together!
+// Only at most two distinct HPs are ever used.
+
+#define QUEUE_SMR(q) ((TEST_BITFIELD((q)->flags, RIG_QUEUE_SMR_EPOCH)) ? (SMR_EPOCH) \
+	: ((TEST_BITFIELD((q)->flags, RIG_QUEUE_SMR_QSBR)) ? (SMR_QSBR) : (SMR_HP)))
+
+#define QUEUE_COUNTED(q) (!TEST_BITFIELD((q)->flags, RIG_QUEUE_NOCOUNT))
 
 /** Types */
 typedef struct NodeStruct *Node;
@@ -31,8 +34,10 @@ typedef struct NodeStruct *Node;
 struct rig_queue {
 	CACHELINE_ALONE(atomic_ops_ptr, head);
 	CACHELINE_ALONE(atomic_ops_ptr, tail);
-	RIG_COUNTER count;
-	RIG_COUNTER refcount;
+	CACHELINE_ALONE(struct rig_counter, count);
+	struct rig_counter refcount;
+	RIG_EVENTCOUNT events;
+	uint16_t flags; // read-only value
 };
 
 struct NodeStruct {
@@ -44,6 +49,32 @@ struct NodeStruct {
 	void *data;
 };
 
+/*
+ * Queues created with RIG_QUEUE_SPSC or RIG_QUEUE_MPSC promise that there is
+ * only ever one consumer, so get() and peek() can use the simpler producer/
+ * consumer protocol from Dmitry Vyukov's intrusive MPSC queue: producers swing
+ * tail to their new node and then link it to its predecessor, the consumer
+ * follows head->next without any CAS. With a single producer (SPSC) the tail
+ * swing is a plain store, and the element count, which only the producer
+ * increases, is a single atomic addition on either side, making both sides
+ * wait-free. For the same reason, SPSC queues never shard their count.
+ * The consumer only frees a node once it has a successor, which means its
+ * producer is done with it, so no SMR is needed and nodes are given back to
+ * the pool directly. Iterators are not supported on these queues.
+ */
+
+static inline void queue_free_chain(Node first) ATTR_ALWAYSINLINE;
+static inline Node queue_alloc_chain(void *items[], size_t count, Node * const elast) ATTR_ALWAYSINLINE;
+static inline void queue_put_chain(RIG_QUEUE q, Node first, Node last, int smr) ATTR_ALWAYSINLINE;
+static inline bool queue_get_node(RIG_QUEUE q, void ** const eitem, RIG_SMR_HP_Record hprec, int smr) ATTR_ALWAYSINLINE;
+static inline size_t queue_get_batch(RIG_QUEUE q, void *items[], size_t count, int smr) ATTR_ALWAYSINLINE;
+static inline bool queue_peek_node(RIG_QUEUE q, void ** const eitem, int smr) ATTR_ALWAYSINLINE;
+static inline void queue_put_single(RIG_QUEUE q, Node first, Node last) ATTR_ALWAYSINLINE;
+static inline size_t queue_get_single(RIG_QUEUE q, void *items[], size_t count, bool remove) ATTR_ALWAYSINLINE;
+static inline bool queue_count_add(RIG_QUEUE q, size_t count) ATTR_ALWAYSINLINE;
+static inline void queue_count_sub(RIG_QUEUE q, size_t count) ATTR_ALWAYSINLINE;
+static void *queue_get_try(void *q);
+
 
 /*
  * Rig Queue Implementation
@@ -59,6 +90,20 @@ struct NodeStruct {
  * @param flags
  *     flags to modify queue behavior, the following are currently supported:
  *     - RIG_QUEUE_NOCOUNT (do not count elements, capacity is not enforced)
+ *     - RIG_QUEUE_SHARDED_COUNT (count elements with a sharded counter, which
+ *       scales with many threads, but makes counting them approximate while
+ *       other threads update the queue, capacity stays exact, ignored for
+ *       RIG_QUEUE_SPSC)
+ *     - RIG_QUEUE_SPSC (only one thread ever puts and only one thread ever
+ *       gets/peeks, both sides are wait-free)
+ *     - RIG_QUEUE_MPSC (only one thread ever gets/peeks, the consumer side
+ *       is wait-free)
+ *     - RIG_QUEUE_SMR_EPOCH (reclaim nodes with epochs instead of hazard
+ *       pointers)
+ *     - RIG_QUEUE_SMR_QSBR (reclaim nodes with quiescent states instead of
+ *       hazard pointers: operations cost no SMR stores or fences, but every
+ *       thread using the queue has to call rig_smr_qsbr_quiescent() regularly,
+ *       or go offline with rig_smr_qsbr_offline())
  *
  * @return
  *     queue pointer, NULL on error.
@@ -67,27 +112,40 @@ struct NodeStruct {
  *     - ENOMEM (insufficient memory)
  */
 RIG_QUEUE rig_queue_init(size_t capacity, uint16_t flags) {
-	CHECK_PERMITTED_FLAGS(flags, RIG_QUEUE_NOCOUNT);
+	CHECK_PERMITTED_FLAGS(flags, RIG_QUEUE_NOCOUNT | RIG_QUEUE_SPSC | RIG_QUEUE_MPSC | RIG_QUEUE_SMR_EPOCH | RIG_QUEUE_SMR_QSBR | RIG_QUEUE_SHARDED_COUNT);
+
+	// SPSC and MPSC are mutually exclusive
+	if (TEST_BITFIELD(flags, RIG_QUEUE_SPSC) && TEST_BITFIELD(flags, RIG_QUEUE_MPSC)) {
+		ERRET(EINVAL, NULL);
+	}
+
+	// Only one SMR scheme can be used
+	if (TEST_BITFIELD(flags, RIG_QUEUE_SMR_EPOCH) && TEST_BITFIELD(flags, RIG_QUEUE_SMR_QSBR)) {
+		ERRET(EINVAL, NULL);
+	}
 
 	// Allocate memory for the queue
 	RIG_QUEUE q = rig_mem_alloc_aligned(sizeof(*q), 0, CACHELINE_SIZE, 0);
 	NULLCHECK_ERRET(q, ENOMEM, NULL);
 
 	// Allocate memory for the sentinel node
-	Node sentinel = rig_mem_alloc(sizeof(*sentinel), 0);
+	Node sentinel = rig_mem_pool_alloc(sizeof(*sentinel));
 	NULLCHECK_ERRET_CLEANUP(sentinel, ENOMEM, NULL, rig_mem_free_aligned(q));
 
-	// Initialize the counters
-	RIG_COUNTER refcount = rig_counter_init(1, 0);
-	NULLCHECK_ERRET_CLEANUP(refcount, ENOMEM, NULL, rig_mem_free_aligned(q); rig_mem_free(sentinel));
+	// Initialize the counters, the count stays unused if not counting elements
+	VERIFY_ERRET(rig_counter_init_inline(&q->refcount, 1, 0, false));
 
-	RIG_COUNTER count = NULL;
-	if (!TEST_BITFIELD(flags, RIG_QUEUE_NOCOUNT)) { // Support not counting elements
-		count = rig_counter_init(0, capacity);
-		NULLCHECK_ERRET_CLEANUP(count, ENOMEM, NULL,
-			rig_mem_free_aligned(q); rig_mem_free(sentinel); rig_counter_destroy(&refcount));
+	if (!rig_counter_init_inline(&q->count, 0, capacity,
+		(!TEST_BITFIELD(flags, RIG_QUEUE_NOCOUNT | RIG_QUEUE_SPSC)) && (TEST_BITFIELD(flags, RIG_QUEUE_SHARDED_COUNT)))) {
+		rig_mem_free_aligned(q); rig_mem_pool_free(sentinel);
+		ERRET(ENOMEM, NULL);
 	}
 
+	// Initialize the event-count, for waiting consumers
+	RIG_EVENTCOUNT events = rig_eventcount_init();
+	NULLCHECK_ERRET_CLEANUP(events, ENOMEM, NULL,
+		rig_counter_destroy_inline(&q->count); rig_mem_free_aligned(q); rig_mem_pool_free(sentinel));
+
 	// Initialize the needed values
 #if !defined(RIG_QUEUE_PRECISE_ITERATOR)
 	atomic_ops_ptr_store(&sentinel->next, NULL, ATOMIC_OPS_FENCE_NONE);
@@ -98,8 +156,8 @@ RIG_QUEUE rig_queue_init(size_t capacity, uint16_t flags) {
 
 	atomic_ops_ptr_store(&q->head, sentinel, ATOMIC_OPS_FENCE_NONE);
 	atomic_ops_ptr_store(&q->tail, sentinel, ATOMIC_OPS_FENCE_NONE);
-	q->count = count;
-	q->refcount = refcount;
+	q->events = events;
+	q->flags = flags;
 
 	atomic_ops_fence(ATOMIC_OPS_FENCE_FULL);
 
@@ -118,7 +176,7 @@ RIG_QUEUE rig_queue_init(size_t capacity, uint16_t flags) {
 RIG_QUEUE rig_queue_newref(RIG_QUEUE q) {
 	NULLCHECK_EXIT(q);
 
-	rig_acheck_msg(rig_counter_inc(q->refcount), "more references than physically possible");
+	rig_acheck_msg(rig_counter_inc(&q->refcount), "more references than physically possible");
 
 	return (q);
 }
@@ -134,25 +192,17 @@ void rig_queue_destroy(RIG_QUEUE *q) {
 	NULLCHECK_EXIT(q);
 	NULLCHECK_EXIT(*q);
 
-	if (rig_counter_dec_and_test((*q)->refcount)) {
-		// Traverse the list and remove all nodes (sentinel included)
-		Node curr = atomic_ops_ptr_load(&(*q)->head, ATOMIC_OPS_FENCE_NONE), succ = NULL;
-
-		while (curr != NULL) {
-#if !defined(RIG_QUEUE_PRECISE_ITERATOR)
-			succ = atomic_ops_ptr_load(&curr->next, ATOMIC_OPS_FENCE_NONE);
-#else
-			succ = atomic_ops_flagptr_load(&curr->next, NULL, ATOMIC_OPS_FENCE_NONE);
-#endif
-			// Free directly here, as there are no shared references anymore around, no SMR is required!
-			rig_mem_free(curr);
+	int smr = QUEUE_SMR(*q);
 
-			curr = succ;
-		}
+	if (rig_counter_dec_and_test(&(*q)->refcount)) {
+		// Traverse the list and remove all nodes (sentinel included)
+		// Free directly, as there are no shared references anymore around, no SMR is required!
+		queue_free_chain(atomic_ops_ptr_load(&(*q)->head, ATOMIC_OPS_FENCE_NONE));
 
-		// Destroy counters and queue
-		rig_counter_destroy(&(*q)->refcount);
-		rig_counter_destroy(&(*q)->count);
+		// Destroy counters, event-count and queue
+		rig_counter_destroy_inline(&(*q)->refcount);
+		rig_counter_destroy_inline(&(*q)->count);
+		rig_eventcount_destroy(&(*q)->events);
 		rig_mem_free_aligned(*q);
 	}
 	else {
@@ -163,10 +213,10 @@ void rig_queue_destroy(RIG_QUEUE *q) {
 
 	atomic_ops_fence(ATOMIC_OPS_FENCE_FULL);
 
-#if RIG_QUEUE_SMR_TYPE == 1
-	// Explicit SMR HP scan
-	rig_smr_hp_mem_scan();
-#endif
+	if (smr == SMR_HP) {
+		// Explicit SMR HP scan
+		rig_smr_hp_mem_scan();
+	}
 }
 
 /**
@@ -200,40 +250,398 @@ bool rig_queue_put(RIG_QUEUE q, void *item) {
 	NULLCHECK_EXIT(q);
 
 	// Allocate memory for the new element
-	Node node = rig_mem_alloc(sizeof(*node), 0);
+	Node node = queue_alloc_chain(&item, 1, NULL);
 	NULLCHECK_ERRET(node, ENOMEM, false);
 
 	// Check if there's still place for the new element
-	if ((q->count != NULL) && (!rig_counter_inc(q->count))) {
+	if ((QUEUE_COUNTED(q)) && (!queue_count_add(q, 1))) {
+		// Full queue
+		ERRET_CLEANUP(EXFULL, false, rig_mem_pool_free(node));
+	}
+
+	if (TEST_BITFIELD(q->flags, RIG_QUEUE_SPSC | RIG_QUEUE_MPSC)) {
+		queue_put_single(q, node, node);
+	}
+	else {
+		SMR_DISPATCH(QUEUE_SMR(q), queue_put_chain, q, node, node);
+	}
+
+	rig_eventcount_notify(q->events, 1);
+
+	return (true);
+}
+
+/**
+ * Add multiple items at the end of the queue, in the order they appear in
+ * the items array. Either all items are added, or none is.
+ * The new nodes are linked to each other privately first, and then appended
+ * to the queue with a single CAS, while capacity is checked with a single
+ * counter update for the whole batch.
+ *
+ * @param q
+ *     queue pointer
+ * @param items
+ *     array of data pointers (memory management caller responsibility)
+ * @param count
+ *     number of items to add
+ *
+ * @return
+ *     boolean indicating success.
+ *     On error, the following error codes are set:
+ *     - EINVAL (invalid count passed)
+ *     - ENOMEM (insufficient memory to add the new items)
+ *     - EXFULL (not enough capacity left to add all items)
+ */
+bool rig_queue_put_many(RIG_QUEUE q, void *items[], size_t count) {
+	NULLCHECK_EXIT(q);
+	NULLCHECK_EXIT(items);
+
+	if ((count == 0) || (count > (size_t)SSIZE_MAX)) {
+		ERRET(EINVAL, false);
+	}
+
+	// Allocate memory for the new elements and link them together
+	Node last = NULL;
+	Node first = queue_alloc_chain(items, count, &last);
+	NULLCHECK_ERRET(first, ENOMEM, false);
+
+	// Check if there's still place for all the new elements
+	if ((QUEUE_COUNTED(q)) && (!queue_count_add(q, count))) {
 		// Full queue
-		ERRET_CLEANUP(EXFULL, false, rig_mem_free(node));
+		ERRET_CLEANUP(EXFULL, false, queue_free_chain(first));
+	}
+
+	if (TEST_BITFIELD(q->flags, RIG_QUEUE_SPSC | RIG_QUEUE_MPSC)) {
+		queue_put_single(q, first, last);
+	}
+	else {
+		SMR_DISPATCH(QUEUE_SMR(q), queue_put_chain, q, first, last);
+	}
+
+	rig_eventcount_notify(q->events, count);
+
+	return (true);
+}
+
+/**
+ * Remove the first item from the front of the queue and return it.
+ *
+ * @param q
+ *     queue pointer
+ *
+ * @return
+ *     data pointer, NULL on error.
+ *     On error, the following error codes are set:
+ *     - ENOENT (empty queue, nothing to return)
+ */
+void *rig_queue_get(RIG_QUEUE q) {
+	NULLCHECK_EXIT(q);
+
+	void *item = NULL;
+
+	if (TEST_BITFIELD(q->flags, RIG_QUEUE_SPSC | RIG_QUEUE_MPSC)) {
+		if (queue_get_single(q, &item, 1, true) == 0) {
+			// Empty queue
+			ERRET(ENOENT, NULL);
+		}
+	}
+	else {
+		if (SMR_DISPATCH(QUEUE_SMR(q), queue_get_batch, q, &item, 1) == 0) {
+			// Empty queue
+			ERRET(ENOENT, NULL);
+		}
+	}
+
+	if (QUEUE_COUNTED(q)) { // Counting supported
+		queue_count_sub(q, 1);
+	}
+
+	return (item);
+}
+
+/**
+ * Remove the first item from the front of the queue and return it, waiting
+ * for one to be added if the queue is empty.
+ * After trying for a short while, the calling thread goes to sleep until an
+ * item is added or the timeout expires. Producers only ever make a system
+ * call to wake up consumers if there are any waiting.
+ * On RIG_QUEUE_SMR_QSBR queues, the calling thread is offline while it
+ * sleeps, and thus doesn't hold back reclamation for the other threads.
+ *
+ * @param q
+ *     queue pointer
+ * @param timeout
+ *     maximum time to wait in microseconds, 0 means not to wait at all,
+ *     returning right after a single try, SIZE_MAX means no limit
+ *
+ * @return
+ *     data pointer, NULL on error.
+ *     On error, the following error codes are set:
+ *     - ETIMEDOUT (empty queue, no item was added before the timeout expired)
+ */
+void *rig_queue_get_wait(RIG_QUEUE q, size_t timeout) {
+	NULLCHECK_EXIT(q);
+
+	return (rig_eventcount_await(q->events, &queue_get_try, q, (QUEUE_SMR(q) == SMR_QSBR), timeout));
+}
+
+/**
+ * Remove up to count items from the front of the queue, storing them in the
+ * items array in queue order, and return how many were removed.
+ * The SMR protection is set up once for the whole batch, and the element
+ * count is updated only once, after all items have been removed.
+ *
+ * @param q
+ *     queue pointer
+ * @param items
+ *     array in which to store the data pointers, must have room for count items
+ * @param count
+ *     maximum number of items to remove
+ *
+ * @return
+ *     number of items removed, 0 on error.
+ *     On error, the following error codes are set:
+ *     - EINVAL (invalid count passed)
+ *     - ENOENT (empty queue, nothing to return)
+ */
+size_t rig_queue_get_many(RIG_QUEUE q, void *items[], size_t count) {
+	NULLCHECK_EXIT(q);
+	NULLCHECK_EXIT(items);
+
+	if ((count == 0) || (count > (size_t)SSIZE_MAX)) {
+		ERRET(EINVAL, 0);
+	}
+
+	size_t got = 0;
+
+	if (TEST_BITFIELD(q->flags, RIG_QUEUE_SPSC | RIG_QUEUE_MPSC)) {
+		got = queue_get_single(q, items, count, true);
+	}
+	else {
+		got = SMR_DISPATCH(QUEUE_SMR(q), queue_get_batch, q, items, count);
+	}
+
+	if (got == 0) {
+		// Empty queue
+		ERRET(ENOENT, 0);
+	}
+
+	if (QUEUE_COUNTED(q)) { // Counting supported
+		queue_count_sub(q, got);
+	}
+
+	return (got);
+}
+
+/**
+ * Return the first item from the front of the queue, without removing it.
+ *
+ * @param q
+ *     queue pointer
+ *
+ * @return
+ *     data pointer, NULL on error.
+ *     On error, the following error codes are set:
+ *     - ENOENT (empty queue, nothing to return)
+ */
+void *rig_queue_peek(RIG_QUEUE q) {
+	NULLCHECK_EXIT(q);
+
+	void *item = NULL;
+
+	if (TEST_BITFIELD(q->flags, RIG_QUEUE_SPSC | RIG_QUEUE_MPSC)) {
+		if (queue_get_single(q, &item, 1, false) == 0) {
+			// Empty queue
+			ERRET(ENOENT, NULL);
+		}
+	}
+	else {
+		if (!SMR_DISPATCH(QUEUE_SMR(q), queue_peek_node, q, &item)) {
+			// Empty queue
+			ERRET(ENOENT, NULL);
+		}
+	}
+
+	return (item);
+}
+
+/**
+ * Returns true if the queue is currently empty, false otherwise.
+ *
+ * @param q
+ *     queue pointer
+ *
+ * @return
+ *     boolean indicating emptiness
+ */
+bool rig_queue_empty(RIG_QUEUE q) {
+	NULLCHECK_EXIT(q);
+
+	if (QUEUE_COUNTED(q)) { // Counting supported
+		return (rig_counter_get(&q->count) == 0);
+	}
+
+	return (false);
+}
+
+/**
+ * Returns true if the queue is currently full, false otherwise.
+ *
+ * @param q
+ *     queue pointer
+ *
+ * @return
+ *     boolean indicating fullness
+ */
+bool rig_queue_full(RIG_QUEUE q) {
+	NULLCHECK_EXIT(q);
+
+	if (QUEUE_COUNTED(q)) { // Counting supported
+		return (rig_counter_get(&q->count) == rig_counter_get_max(&q->count));
+	}
+
+	return (false);
+}
+
+/**
+ * Returns the number of items currently held in the queue.
+ *
+ * @param q
+ *     queue pointer
+ *
+ * @return
+ *     number of items in queue
+ */
+size_t rig_queue_count(RIG_QUEUE q) {
+	NULLCHECK_EXIT(q);
+
+	if (QUEUE_COUNTED(q)) { // Counting supported
+		return (rig_counter_get(&q->count));
+	}
+
+	return (0);
+}
+
+/**
+ * Returns the maximum capacity of the queue.
+ *
+ * @param q
+ *     queue pointer
+ *
+ * @return
+ *     maximum queue capacity
+ */
+size_t rig_queue_capacity(RIG_QUEUE q) {
+	NULLCHECK_EXIT(q);
+
+	if (QUEUE_COUNTED(q)) { // Counting supported
+		return (rig_counter_get_max(&q->count));
 	}
 
-	// Set the content of the new element
+	return (SIZE_MAX);
+}
+
+/**
+ * INTERNAL
+ * Free a private chain of nodes, following their next pointers.
+ *
+ * @param first
+ *     first node of the chain, can be NULL
+ */
+static inline void queue_free_chain(Node first) {
+	Node curr = first, succ = NULL;
+
+	while (curr != NULL) {
 #if !defined(RIG_QUEUE_PRECISE_ITERATOR)
-	atomic_ops_ptr_store(&node->next, NULL, ATOMIC_OPS_FENCE_NONE);
+		succ = atomic_ops_ptr_load(&curr->next, ATOMIC_OPS_FENCE_NONE);
 #else
-	atomic_ops_flagptr_store(&node->next, NULL, false, ATOMIC_OPS_FENCE_NONE);
+		succ = atomic_ops_flagptr_load(&curr->next, NULL, ATOMIC_OPS_FENCE_NONE);
 #endif
-	node->data = item;
+		rig_mem_pool_free(curr);
 
-	Node tail = NULL, next = NULL;
+		curr = succ;
+	}
+}
 
-#if RIG_QUEUE_SMR_TYPE == 1
-	RIG_SMR_HP_Record hprec = rig_smr_hp_record_get();
+/**
+ * INTERNAL
+ * Allocate and link together a private chain of nodes, holding the items.
+ *
+ * @param items
+ *     array of data pointers
+ * @param count
+ *     number of items, must be > 0
+ * @param *elast
+ *     pointer in which to store reference to the last node, can be NULL
+ *
+ * @return
+ *     first node of the chain, NULL if there wasn't enough memory
+ */
+static inline Node queue_alloc_chain(void *items[], size_t count, Node * const elast) {
+	Node first = NULL, last = NULL;
+
+	for (size_t i = 0; i < count; i++) {
+		Node node = rig_mem_pool_alloc(sizeof(*node));
+		if (node == NULL) {
+			queue_free_chain(first);
+			return (NULL);
+		}
+
+#if !defined(RIG_QUEUE_PRECISE_ITERATOR)
+		atomic_ops_ptr_store(&node->next, NULL, ATOMIC_OPS_FENCE_NONE);
+#else
+		atomic_ops_flagptr_store(&node->next, NULL, false, ATOMIC_OPS_FENCE_NONE);
 #endif
-#if RIG_QUEUE_SMR_TYPE == 2
-	rig_smr_epoch_critical_enter();
+		node->data = items[i];
+
+		if (last == NULL) {
+			first = node;
+		}
+		else {
+#if !defined(RIG_QUEUE_PRECISE_ITERATOR)
+			atomic_ops_ptr_store(&last->next, node, ATOMIC_OPS_FENCE_NONE);
+#else
+			atomic_ops_flagptr_store(&last->next, node, false, ATOMIC_OPS_FENCE_NONE);
 #endif
+		}
+
+		last = node;
+	}
+
+	if (elast != NULL) {
+		*elast = last;
+	}
+
+	return (first);
+}
+
+/**
+ * INTERNAL
+ * Append a private chain of nodes at the end of the queue, linking it with
+ * a single CAS on the current last node.
+ *
+ * @param q
+ *     queue pointer
+ * @param first
+ *     first node of the chain
+ * @param last
+ *     last node of the chain
+ * @param smr
+ *     SMR scheme (constant)
+ */
+static inline void queue_put_chain(RIG_QUEUE q, Node first, Node last, int smr) {
+	Node tail = NULL, next = NULL;
+
+	RIG_SMR_HP_Record hprec = rig_smr_enter(smr);
 
 	while (true) {
 		tail = atomic_ops_ptr_load(&q->tail, ATOMIC_OPS_FENCE_ACQUIRE);
-#if RIG_QUEUE_SMR_TYPE == 1
-		rig_smr_hp_set(hprec, SMR_HP_TAIL, tail);
-		if (tail != atomic_ops_ptr_load(&q->tail, ATOMIC_OPS_FENCE_ACQUIRE)) {
-			continue;
+		if (smr == SMR_HP) {
+			rig_smr_hp_set(hprec, SMR_HP_TAIL, tail);
+			if (tail != atomic_ops_ptr_load(&q->tail, ATOMIC_OPS_FENCE_ACQUIRE)) {
+				continue;
+			}
 		}
-#endif
 
 #if !defined(RIG_QUEUE_PRECISE_ITERATOR)
 		next = atomic_ops_ptr_load(&tail->next, ATOMIC_OPS_FENCE_NONE);
@@ -243,20 +651,19 @@ bool rig_queue_put(RIG_QUEUE q, void *item) {
 
 		if (next == NULL) {
 #if !defined(RIG_QUEUE_PRECISE_ITERATOR)
-			if (atomic_ops_ptr_cas(&tail->next, NULL, node, ATOMIC_OPS_FENCE_FULL)) {
+			if (atomic_ops_ptr_cas(&tail->next, NULL, first, ATOMIC_OPS_FENCE_FULL)) {
 #else
-			if (atomic_ops_flagptr_cas(&tail->next, NULL, false, node, false, ATOMIC_OPS_FENCE_FULL)) {
+			if (atomic_ops_flagptr_cas(&tail->next, NULL, false, first, false, ATOMIC_OPS_FENCE_FULL)) {
 #endif
-				atomic_ops_ptr_cas(&q->tail, tail, node, ATOMIC_OPS_FENCE_NONE);
+				// If this fails, tail lags behind and gets advanced node by node by others
+				atomic_ops_ptr_cas(&q->tail, tail, last, ATOMIC_OPS_FENCE_NONE);
 
-#if RIG_QUEUE_SMR_TYPE == 1
-				rig_smr_hp_release(hprec, SMR_HP_TAIL);
-#endif
-#if RIG_QUEUE_SMR_TYPE == 2
-				rig_smr_epoch_critical_exit();
-#endif
+				if (smr == SMR_HP) {
+					rig_smr_hp_release(hprec, SMR_HP_TAIL);
+				}
+				rig_smr_exit(smr);
 
-				return (true);
+				return;
 			}
 		}
 		else {
@@ -266,39 +673,38 @@ bool rig_queue_put(RIG_QUEUE q, void *item) {
 }
 
 /**
- * Remove the first item from the front of the queue and return it.
+ * INTERNAL
+ * Remove the first node from the front of the queue, getting its item.
+ * The caller must already be in a SMR critical section (epoch) and is
+ * responsible for releasing the HPs (hazard pointers) and updating the
+ * element count afterwards.
  *
  * @param q
  *     queue pointer
+ * @param *eitem
+ *     pointer in which to store the removed item
+ * @param hprec
+ *     Hazard Pointer Record (NULL for epochs and QSBR)
+ * @param smr
+ *     SMR scheme (constant)
  *
  * @return
- *     data pointer, NULL on error.
- *     On error, the following error codes are set:
- *     - ENOENT (empty queue, nothing to return)
+ *     boolean indicating success, false if the queue is empty
  */
-void *rig_queue_get(RIG_QUEUE q) {
-	NULLCHECK_EXIT(q);
-
+static inline bool queue_get_node(RIG_QUEUE q, void ** const eitem, RIG_SMR_HP_Record hprec, int smr) {
 	Node head = NULL, next = NULL;
 #if defined(RIG_QUEUE_PRECISE_ITERATOR)
 	bool mark = false;
 #endif
 
-#if RIG_QUEUE_SMR_TYPE == 1
-	RIG_SMR_HP_Record hprec = rig_smr_hp_record_get();
-#endif
-#if RIG_QUEUE_SMR_TYPE == 2
-	rig_smr_epoch_critical_enter();
-#endif
-
 	while (true) {
 		head = atomic_ops_ptr_load(&q->head, ATOMIC_OPS_FENCE_ACQUIRE);
-#if RIG_QUEUE_SMR_TYPE == 1
-		rig_smr_hp_set(hprec, SMR_HP_HEAD, head);
-		if (head != atomic_ops_ptr_load(&q->head, ATOMIC_OPS_FENCE_ACQUIRE)) {
-			continue;
+		if (smr == SMR_HP) {
+			rig_smr_hp_set(hprec, SMR_HP_HEAD, head);
+			if (head != atomic_ops_ptr_load(&q->head, ATOMIC_OPS_FENCE_ACQUIRE)) {
+				continue;
+			}
 		}
-#endif
 
 #if !defined(RIG_QUEUE_PRECISE_ITERATOR)
 		next = atomic_ops_ptr_load(&head->next, ATOMIC_OPS_FENCE_ACQUIRE);
@@ -306,20 +712,14 @@ void *rig_queue_get(RIG_QUEUE q) {
 		next = atomic_ops_flagptr_load(&head->next, &mark, ATOMIC_OPS_FENCE_ACQUIRE);
 #endif
 
-#if RIG_QUEUE_SMR_TYPE == 1
-		rig_smr_hp_set(hprec, SMR_HP_HNEXT, next);
-#endif
+		if (smr == SMR_HP) {
+			rig_smr_hp_set(hprec, SMR_HP_HNEXT, next);
+		}
 
 		if (head == atomic_ops_ptr_load(&q->head, ATOMIC_OPS_FENCE_ACQUIRE)) {
 			if (next == NULL) {
-#if RIG_QUEUE_SMR_TYPE == 1
-				rig_smr_hp_release(hprec, SMR_HP_HEAD);
-#endif
-#if RIG_QUEUE_SMR_TYPE == 2
-				rig_smr_epoch_critical_exit();
-#endif
 				// Empty queue
-				ERRET(ENOENT, NULL);
+				return (false);
 			}
 
 #if !defined(RIG_QUEUE_PRECISE_ITERATOR)
@@ -333,46 +733,24 @@ void *rig_queue_get(RIG_QUEUE q) {
 					atomic_ops_ptr_cas(&q->tail, tail, next, ATOMIC_OPS_FENCE_NONE);
 				}
 
-				if (q->count != NULL) { // Counting supported
-					rig_acheck_msg(rig_counter_dec(q->count), "removing non-counted node");
-				}
-
-				void *item = next->data;
+				*eitem = next->data;
 
 #if defined(RIG_QUEUE_PRECISE_ITERATOR)
 				// Attempt physical removal
 				if (atomic_ops_ptr_cas(&q->head, head, next, ATOMIC_OPS_FENCE_FULL)) {
 #endif
-#if RIG_QUEUE_SMR_TYPE == 1
-					rig_smr_hp_mem_retire(head);
-#endif
-#if RIG_QUEUE_SMR_TYPE == 2
-					rig_smr_epoch_mem_retire(head);
-#endif
+					rig_smr_pool_retire(smr, head);
 #if defined(RIG_QUEUE_PRECISE_ITERATOR)
 				}
 #endif
 
-#if RIG_QUEUE_SMR_TYPE == 1
-				rig_smr_hp_release(hprec, SMR_HP_HNEXT);
-				rig_smr_hp_release(hprec, SMR_HP_HEAD);
-#endif
-#if RIG_QUEUE_SMR_TYPE == 2
-				rig_smr_epoch_critical_exit();
-#endif
-
-				return (item);
+				return (true);
 			}
 
 #if defined(RIG_QUEUE_PRECISE_ITERATOR)
 			// Help out by advancing head (attempt physical removal)
 			if (atomic_ops_ptr_cas(&q->head, head, next, ATOMIC_OPS_FENCE_FULL)) {
-#if RIG_QUEUE_SMR_TYPE == 1
-				rig_smr_hp_mem_retire(head);
-#endif
-#if RIG_QUEUE_SMR_TYPE == 2
-				rig_smr_epoch_mem_retire(head);
-#endif
+				rig_smr_pool_retire(smr, head);
 			}
 #endif
 		}
@@ -380,39 +758,72 @@ void *rig_queue_get(RIG_QUEUE q) {
 }
 
 /**
- * Return the first item from the front of the queue, without removing it.
+ * INTERNAL
+ * Remove up to count nodes from the front of the queue, getting their items,
+ * inside a single SMR critical section (epoch) or with the same HPs.
+ * The caller is responsible for updating the element count afterwards.
  *
  * @param q
  *     queue pointer
+ * @param items
+ *     array in which to store the removed items
+ * @param count
+ *     maximum number of items to remove
+ * @param smr
+ *     SMR scheme (constant)
  *
  * @return
- *     data pointer, NULL on error.
- *     On error, the following error codes are set:
- *     - ENOENT (empty queue, nothing to return)
+ *     number of items removed, 0 if the queue is empty
  */
-void *rig_queue_peek(RIG_QUEUE q) {
-	NULLCHECK_EXIT(q);
+static inline size_t queue_get_batch(RIG_QUEUE q, void *items[], size_t count, int smr) {
+	size_t got = 0;
+
+	RIG_SMR_HP_Record hprec = rig_smr_enter(smr);
+
+	while ((got < count) && (queue_get_node(q, &items[got], hprec, smr))) {
+		got++;
+	}
+
+	if (smr == SMR_HP) {
+		rig_smr_hp_release(hprec, SMR_HP_HNEXT);
+		rig_smr_hp_release(hprec, SMR_HP_HEAD);
+	}
+	rig_smr_exit(smr);
+
+	return (got);
+}
 
+/**
+ * INTERNAL
+ * Get the item of the first node at the front of the queue, without
+ * removing it.
+ *
+ * @param q
+ *     queue pointer
+ * @param *eitem
+ *     pointer in which to store the item
+ * @param smr
+ *     SMR scheme (constant)
+ *
+ * @return
+ *     boolean indicating success, false if the queue is empty
+ */
+static inline bool queue_peek_node(RIG_QUEUE q, void ** const eitem, int smr) {
 	Node head = NULL, next = NULL;
 #if defined(RIG_QUEUE_PRECISE_ITERATOR)
 	bool mark = false;
 #endif
 
-#if RIG_QUEUE_SMR_TYPE == 1
-	RIG_SMR_HP_Record hprec = rig_smr_hp_record_get();
-#endif
-#if RIG_QUEUE_SMR_TYPE == 2
-	rig_smr_epoch_critical_enter();
-#endif
+	RIG_SMR_HP_Record hprec = rig_smr_enter(smr);
 
 	while (true) {
 		head = atomic_ops_ptr_load(&q->head, ATOMIC_OPS_FENCE_ACQUIRE);
-#if RIG_QUEUE_SMR_TYPE == 1
-		rig_smr_hp_set(hprec, SMR_HP_HEAD, head);
-		if (head != atomic_ops_ptr_load(&q->head, ATOMIC_OPS_FENCE_ACQUIRE)) {
-			continue;
+		if (smr == SMR_HP) {
+			rig_smr_hp_set(hprec, SMR_HP_HEAD, head);
+			if (head != atomic_ops_ptr_load(&q->head, ATOMIC_OPS_FENCE_ACQUIRE)) {
+				continue;
+			}
 		}
-#endif
 
 #if !defined(RIG_QUEUE_PRECISE_ITERATOR)
 		next = atomic_ops_ptr_load(&head->next, ATOMIC_OPS_FENCE_ACQUIRE);
@@ -420,20 +831,20 @@ void *rig_queue_peek(RIG_QUEUE q) {
 		next = atomic_ops_flagptr_load(&head->next, &mark, ATOMIC_OPS_FENCE_ACQUIRE);
 #endif
 
-#if RIG_QUEUE_SMR_TYPE == 1
-		rig_smr_hp_set(hprec, SMR_HP_HNEXT, next);
-#endif
+		if (smr == SMR_HP) {
+			rig_smr_hp_set(hprec, SMR_HP_HNEXT, next);
+		}
 
 		if (head == atomic_ops_ptr_load(&q->head, ATOMIC_OPS_FENCE_ACQUIRE)) {
 			if (next == NULL) {
-#if RIG_QUEUE_SMR_TYPE == 1
-				rig_smr_hp_release(hprec, SMR_HP_HEAD);
-#endif
-#if RIG_QUEUE_SMR_TYPE == 2
-				rig_smr_epoch_critical_exit();
-#endif
+				if (smr == SMR_HP) {
+					rig_smr_hp_release(hprec, SMR_HP_HNEXT);
+					rig_smr_hp_release(hprec, SMR_HP_HEAD);
+				}
+				rig_smr_exit(smr);
+
 				// Empty queue
-				ERRET(ENOENT, NULL);
+				return (false);
 			}
 
 #if defined(RIG_QUEUE_PRECISE_ITERATOR)
@@ -444,28 +855,21 @@ void *rig_queue_peek(RIG_QUEUE q) {
 				atomic_ops_ptr_cas(&q->tail, tail, next, ATOMIC_OPS_FENCE_NONE);
 			}
 
-			void *item = next->data;
+			*eitem = next->data;
 
-#if RIG_QUEUE_SMR_TYPE == 1
-			rig_smr_hp_release(hprec, SMR_HP_HNEXT);
-			rig_smr_hp_release(hprec, SMR_HP_HEAD);
-#endif
-#if RIG_QUEUE_SMR_TYPE == 2
-			rig_smr_epoch_critical_exit();
-#endif
+			if (smr == SMR_HP) {
+				rig_smr_hp_release(hprec, SMR_HP_HNEXT);
+				rig_smr_hp_release(hprec, SMR_HP_HEAD);
+			}
+			rig_smr_exit(smr);
 
-			return (item);
+			return (true);
 #if defined(RIG_QUEUE_PRECISE_ITERATOR)
 			}
 
 			// Help out by advancing head (attempt physical removal)
 			if (atomic_ops_ptr_cas(&q->head, head, next, ATOMIC_OPS_FENCE_FULL)) {
-#if RIG_QUEUE_SMR_TYPE == 1
-				rig_smr_hp_mem_retire(head);
-#endif
-#if RIG_QUEUE_SMR_TYPE == 2
-				rig_smr_epoch_mem_retire(head);
-#endif
+				rig_smr_pool_retire(smr, head);
 			}
 #endif
 		}
@@ -473,94 +877,199 @@ void *rig_queue_peek(RIG_QUEUE q) {
 }
 
 /**
- * Returns true if the queue is currently empty, false otherwise.
+ * INTERNAL
+ * Append a private chain of nodes at the end of a single-consumer queue.
+ * The predecessor is only ever written to (its next pointer, still NULL),
+ * and the consumer can't free it before that happens.
  *
  * @param q
  *     queue pointer
- *
- * @return
- *     boolean indicating emptiness
+ * @param first
+ *     first node of the chain
+ * @param last
+ *     last node of the chain
  */
-bool rig_queue_empty(RIG_QUEUE q) {
-	NULLCHECK_EXIT(q);
+static inline void queue_put_single(RIG_QUEUE q, Node first, Node last) {
+	Node prev = atomic_ops_ptr_load(&q->tail, ATOMIC_OPS_FENCE_NONE);
 
-	if (q->count != NULL) { // Counting supported
-		return (rig_counter_get(q->count) == 0);
+	if (TEST_BITFIELD(q->flags, RIG_QUEUE_SPSC)) {
+		// Single producer: tail is private to it
+		atomic_ops_ptr_store(&q->tail, last, ATOMIC_OPS_FENCE_NONE);
+	}
+	else {
+		// Multiple producers: serialize on tail, prev is never dereferenced before
+		// the CAS succeeds, so it doesn't need to be protected
+		while (!atomic_ops_ptr_cas(&q->tail, prev, last, ATOMIC_OPS_FENCE_FULL)) {
+			prev = atomic_ops_ptr_load(&q->tail, ATOMIC_OPS_FENCE_NONE);
+		}
 	}
 
-	return (false);
+	// Link the new nodes, making them visible to the consumer
+#if !defined(RIG_QUEUE_PRECISE_ITERATOR)
+	atomic_ops_ptr_store(&prev->next, first, ATOMIC_OPS_FENCE_RELEASE);
+#else
+	atomic_ops_flagptr_store(&prev->next, first, false, ATOMIC_OPS_FENCE_RELEASE);
+#endif
 }
 
 /**
- * Returns true if the queue is currently full, false otherwise.
+ * INTERNAL
+ * Get (or peek at) up to count items from the front of a single-consumer
+ * queue. Must only ever be called by the one consumer thread.
+ * The caller is responsible for updating the element count afterwards.
  *
  * @param q
  *     queue pointer
+ * @param items
+ *     array in which to store the data pointers
+ * @param count
+ *     maximum number of items to get, must be 1 when peeking
+ * @param remove
+ *     remove the items (get) or not (peek)
  *
  * @return
- *     boolean indicating fullness
+ *     number of items gotten, 0 if the queue is empty (or a producer swung
+ *     tail but didn't link its nodes yet)
  */
-bool rig_queue_full(RIG_QUEUE q) {
-	NULLCHECK_EXIT(q);
+static inline size_t queue_get_single(RIG_QUEUE q, void *items[], size_t count, bool remove) {
+	Node head = atomic_ops_ptr_load(&q->head, ATOMIC_OPS_FENCE_NONE), next = NULL;
+	size_t got = 0;
+
+	while (got < count) {
+#if !defined(RIG_QUEUE_PRECISE_ITERATOR)
+		next = atomic_ops_ptr_load(&head->next, ATOMIC_OPS_FENCE_ACQUIRE);
+#else
+		next = atomic_ops_flagptr_load(&head->next, NULL, ATOMIC_OPS_FENCE_ACQUIRE);
+#endif
 
-	if (q->count != NULL) { // Counting supported
-		return (rig_counter_get(q->count) == rig_counter_get_max(q->count));
+		if (next == NULL) {
+			break;
+		}
+
+		items[got++] = next->data;
+
+		if (!remove) {
+			return (got);
+		}
+
+		// Free directly here, the old head has a successor, so no producer references it anymore!
+		rig_mem_pool_free(head);
+
+		head = next;
 	}
 
-	return (false);
+	if (remove) {
+		atomic_ops_ptr_store(&q->head, head, ATOMIC_OPS_FENCE_NONE);
+	}
+
+	return (got);
 }
 
 /**
- * Returns the number of items currently held in the queue.
+ * INTERNAL
+ * Reserve room for count new items in the element count, before adding them.
+ * The only producer of a SPSC queue can't race others past the capacity.
  *
  * @param q
  *     queue pointer
+ * @param count
+ *     number of items to add
  *
  * @return
- *     number of items in queue
+ *     boolean, false if the queue doesn't have enough room left
  */
-size_t rig_queue_count(RIG_QUEUE q) {
-	NULLCHECK_EXIT(q);
+static inline bool queue_count_add(RIG_QUEUE q, size_t count) {
+	if (TEST_BITFIELD(q->flags, RIG_QUEUE_SPSC)) {
+		return (rig_counter_add_single(&q->count, count));
+	}
 
-	if (q->count != NULL) { // Counting supported
-		return (rig_counter_get(q->count));
+	if (count == 1) {
+		return (rig_counter_inc(&q->count));
 	}
 
-	return (0);
+	return (rig_counter_add(&q->count, (ssize_t)count));
 }
 
 /**
- * Returns the maximum capacity of the queue.
+ * INTERNAL
+ * Take count removed items out of the element count.
  *
  * @param q
  *     queue pointer
- *
- * @return
- *     maximum queue capacity
+ * @param count
+ *     number of items removed
  */
-size_t rig_queue_capacity(RIG_QUEUE q) {
-	NULLCHECK_EXIT(q);
-
-	if (q->count != NULL) { // Counting supported
-		return (rig_counter_get_max(q->count));
+static inline void queue_count_sub(RIG_QUEUE q, size_t count) {
+	if (TEST_BITFIELD(q->flags, RIG_QUEUE_SPSC)) {
+		rig_counter_sub_single(&q->count, count);
+	}
+	else if (count == 1) {
+		rig_acheck_msg(rig_counter_dec(&q->count), "removing non-counted node");
+	}
+	else {
+		rig_acheck_msg(rig_counter_add(&q->count, -(ssize_t)count), "removing non-counted nodes");
 	}
-
-	return (SIZE_MAX);
 }
 
-
-#if defined(RIG_QUEUE_PRECISE_ITERATOR)
+/**
+ * INTERNAL
+ * Remove the first item from the front of the queue, for rig_eventcount_await().
+ *
+ * @param q
+ *     queue pointer
+ *
+ * @return
+ *     data pointer, NULL if the queue is empty
+ */
+static void *queue_get_try(void *q) {
+	return (rig_queue_get(q));
+}
 
 struct rig_queue_iter {
 	RIG_QUEUE queue;
+	Node curr; // epochs only, HPs keep it in SMR_IHP_CURR
+	RIG_SMR_HP_Record hprec; // HPs only
 	bool completed;
 };
 
-#define SMR_IHP_CURR 4
-#define SMR_IHP_PREV 5
+#define SMR_IHP_CURR 0
+#define SMR_IHP_PREV 1
+
+/**
+ * INTERNAL
+ * Allocate a new iterator over a queue, taking a reference to it.
+ *
+ * @param q
+ *     queue pointer
+ *
+ * @return
+ *     queue iterator pointer, NULL if there wasn't enough memory
+ */
+static RIG_QUEUE_ITER queue_iter_alloc(RIG_QUEUE q) {
+	// Allocate memory for the iterator
+	RIG_QUEUE_ITER iter = rig_mem_alloc(sizeof(*iter), 0);
+	if (iter == NULL) {
+		return (NULL);
+	}
+
+	// Remember the data structure and increase the reference count
+	iter->queue = rig_queue_newref(q);
+	iter->curr = NULL;
+	iter->hprec = NULL;
+	iter->completed = false;
+
+	return (iter);
+}
 
 /**
  * Create an iterator over a queue.
+ * On RIG_QUEUE_SMR_EPOCH queues, the iterator holds an epoch critical section
+ * from here until rig_queue_iter_end(), which keeps every node it can reach
+ * alive without any per-node validation: it must be ended by the same thread
+ * and shouldn't be kept around for long, as no memory retired in the meantime
+ * can be reclaimed, by any thread, until then.
+ * On RIG_QUEUE_SMR_QSBR queues, the same holds until the calling thread's
+ * next quiescent state, which must come after rig_queue_iter_end().
  *
  * @param q
  *     queue pointer
@@ -568,34 +1077,89 @@ struct rig_queue_iter {
  * @return
  *     queue iterator pointer, NULL on error.
  *     On error, the following error codes are set:
- *     - EALREADY (another iterator already exists)
+ *     - ENAVAIL (not available on RIG_QUEUE_SPSC/MPSC queues)
  *     - ENOMEM (insufficient memory)
  */
 RIG_QUEUE_ITER rig_queue_iter_begin(RIG_QUEUE q) {
 	NULLCHECK_EXIT(q);
 
-#if RIG_QUEUE_SMR_TYPE == 1
-	CHECK_ITER_HPS;
-#endif
+	if (TEST_BITFIELD(q->flags, RIG_QUEUE_SPSC | RIG_QUEUE_MPSC)) {
+		ERRET(ENAVAIL, NULL);
+	}
 
-	// Allocate memory for the iterator
-	RIG_QUEUE_ITER iter = rig_mem_alloc(sizeof(*iter), 0);
+	if (QUEUE_SMR(q) != SMR_HP) {
+		RIG_QUEUE_ITER iter = queue_iter_alloc(q);
+		NULLCHECK_ERRET(iter, ENOMEM, NULL);
+
+		rig_smr_enter(QUEUE_SMR(q));
+
+		return (iter);
+	}
+
+#if defined(RIG_QUEUE_PRECISE_ITERATOR)
+	RIG_QUEUE_ITER iter = queue_iter_alloc(q);
 	NULLCHECK_ERRET(iter, ENOMEM, NULL);
 
-	// Remember the data structure and increase the reference count
-	iter->queue = rig_queue_newref(q);
-	iter->completed = false;
+	// HPs of its own, so it can't get in the way of any other iterator
+	iter->hprec = rig_smr_hp_record_acquire();
+	NULLCHECK_ERRET_CLEANUP(iter->hprec, ENOMEM, NULL, rig_queue_destroy(&iter->queue); rig_mem_free(iter));
 
-#if RIG_QUEUE_SMR_TYPE == 1
-	// Set the last HP to a dummy value to ensure no other iterators can be
-	// created before this one gets dismissed, to avoid chaos with the HPs.
-	// NOTE: this does not prevent SMR from reclaiming memory, as an unaligned
-	// address never appears there, seeing as atomic operations usually expect
-	// and/or perform better on aligned addresses anyway.
-	rig_smr_hp_set(hprec, 7, (void *)0x0101);
+	return (iter);
+#else
+	// The hazard pointer walk relies on marked nodes
+	ERRET(ENAVAIL, NULL);
 #endif
+}
 
-	return (iter);
+/**
+ * INTERNAL
+ * Get the next node of an iteration over a queue using epochs or QSBR.
+ * The iterator's critical section (or, with QSBR, the calling thread not
+ * passing through a quiescent state) keeps both the node we're on and all its
+ * successors from being freed, even if they get removed from the queue in
+ * the meantime, and the next pointers of removed nodes still lead forward,
+ * so after the first node there is nothing to verify.
+ *
+ * @param iter
+ *     queue iterator pointer
+ *
+ * @return
+ *     next node, NULL if the end was reached
+ */
+static Node queue_iter_next_epoch(RIG_QUEUE_ITER iter) {
+	Node prev = iter->curr, curr = NULL;
+
+	if (prev == NULL) {
+#if !defined(RIG_QUEUE_PRECISE_ITERATOR)
+		prev = atomic_ops_ptr_load(&iter->queue->head, ATOMIC_OPS_FENCE_ACQUIRE);
+		curr = atomic_ops_ptr_load(&prev->next, ATOMIC_OPS_FENCE_ACQUIRE);
+#else
+		bool mark = false;
+
+		while (true) {
+			prev = atomic_ops_ptr_load(&iter->queue->head, ATOMIC_OPS_FENCE_ACQUIRE);
+			curr = atomic_ops_flagptr_load(&prev->next, &mark, ATOMIC_OPS_FENCE_ACQUIRE);
+
+			if (!mark) {
+				break;
+			}
+
+			// The first node was already taken, help out by advancing head
+			if (atomic_ops_ptr_cas(&iter->queue->head, prev, curr, ATOMIC_OPS_FENCE_FULL)) {
+				rig_smr_pool_retire(QUEUE_SMR(iter->queue), prev);
+			}
+		}
+#endif
+	}
+	else {
+#if !defined(RIG_QUEUE_PRECISE_ITERATOR)
+		curr = atomic_ops_ptr_load(&prev->next, ATOMIC_OPS_FENCE_ACQUIRE);
+#else
+		curr = atomic_ops_flagptr_load(&prev->next, NULL, ATOMIC_OPS_FENCE_ACQUIRE);
+#endif
+	}
+
+	return (curr);
 }
 
 /*
@@ -631,12 +1195,23 @@ void *rig_queue_iter_next(RIG_QUEUE_ITER iter) {
 		ERRET(ENOENT, NULL);
 	}
 
+	if (QUEUE_SMR(iter->queue) != SMR_HP) {
+		iter->curr = queue_iter_next_epoch(iter);
+
+		if (iter->curr == NULL) {
+			iter->completed = true;
+			ERRET(ENOENT, NULL);
+		}
+
+		return (iter->curr->data);
+	}
+
+#if defined(RIG_QUEUE_PRECISE_ITERATOR)
 	bool mark = false;
 	Node prev = NULL, curr = NULL;
 
-#if RIG_QUEUE_SMR_TYPE == 1
-	// Get pointer to this thread's RIG_SMR_HP_Record
-	RIG_SMR_HP_Record hprec = rig_smr_hp_record_get();
+	// Get pointer to the iterator's own RIG_SMR_HP_Record
+	RIG_SMR_HP_Record hprec = iter->hprec;
 
 	if (rig_smr_hp_get(hprec, SMR_IHP_CURR) == NULL) {
 restarthead:
@@ -653,7 +1228,7 @@ restarthead:
 		if (mark) {
 			if (atomic_ops_ptr_cas(&iter->queue->head, prev, curr, ATOMIC_OPS_FENCE_FULL)) {
 				rig_smr_hp_release(hprec, SMR_IHP_PREV);
-				rig_smr_hp_mem_retire_noscan(prev);
+				rig_smr_hp_pool_retire_noscan(prev);
 			}
 
 			goto restarthead;
@@ -682,7 +1257,7 @@ restarthead:
 
 	return (curr->data);
 #else
-	return (NULL);
+	ERRET(ENAVAIL, NULL);
 #endif
 }
 
@@ -700,6 +1275,9 @@ void rig_queue_iter_end(RIG_QUEUE_ITER *iter) {
 		return;
 	}
 
+	int smr = QUEUE_SMR((*iter)->queue);
+	RIG_SMR_HP_Record hprec = (*iter)->hprec;
+
 	// Decrease reference count of the data structure
 	rig_queue_destroy(&(*iter)->queue);
 
@@ -707,49 +1285,19 @@ void rig_queue_iter_end(RIG_QUEUE_ITER *iter) {
 	rig_mem_free(*iter);
 	*iter = NULL;
 
-#if RIG_QUEUE_SMR_TYPE == 1
-	RESET_ITER_HPS;
+	if (smr != SMR_HP) {
+		rig_smr_exit(smr);
+		return;
+	}
+
+#if defined(RIG_QUEUE_PRECISE_ITERATOR)
+	RESET_ITER_HPS(hprec);
 
 	// Explicit SMR scan
 	rig_smr_hp_mem_scan();
 #endif
 }
 
-#else
-
-/**
- * ITERATOR NOT SUPPORTED!
- *
- * @return
- *     NULL, error ENAVAIL (not available)
- */
-RIG_QUEUE_ITER rig_queue_iter_begin(RIG_QUEUE q) {
-	NULLCHECK_EXIT(q);
-
-	ERRET(ENAVAIL, NULL);
-}
-
-/**
- * ITERATOR NOT SUPPORTED!
- *
- * @return
- *     NULL, error ENAVAIL (not available)
- */
-void *rig_queue_iter_next(RIG_QUEUE_ITER iter) {
-	NULLCHECK_EXIT(iter);
-
-	ERRET(ENAVAIL, NULL);
-}
-
-/**
- * ITERATOR NOT SUPPORTED!
- */
-void rig_queue_iter_end(RIG_QUEUE_ITER *iter) {
-	NULLCHECK_EXIT(iter);
-}
-
-#endif
-
 
 /**
  * Create a full copy of a lock-free queue.
@@ -760,7 +1308,7 @@ void rig_queue_iter_end(RIG_QUEUE_ITER *iter) {
  * @return
  *     new queue pointer, NULL on error.
  *     On error, the following error codes are set:
- *     - EALREADY (iterator already present, but required for copy!)
+ *     - ENAVAIL (iterator not available, but required for copy!)
  *     - ENOMEM (insufficient memory)
  */
 RIG_QUEUE rig_queue_duplicate(RIG_QUEUE q) {
@@ -769,7 +1317,7 @@ RIG_QUEUE rig_queue_duplicate(RIG_QUEUE q) {
 	// Needed functions: ds_init, ds_destroy, ds_capacity,
 	// ds_iter_begin, ds_iter_end, ds_iter_next, ds_push/put/add
 
-	RIG_QUEUE dup_q = rig_queue_init(rig_queue_capacity(q), (q->count == NULL) ? (RIG_QUEUE_NOCOUNT) : (0));
+	RIG_QUEUE dup_q = rig_queue_init(rig_queue_capacity(q), q->flags);
 	NULLCHECK_ERRET(dup_q, ENOMEM, NULL);
 
 	RIG_QUEUE_ITER iter = rig_queue_iter_begin(q);
@@ -0,0 +1,469 @@
+/**
+ * This file is part of the Rig project.
+ *
+ * For the full copyright and license information, please view the COPYING
+ * file that was distributed with this source code.
+ *
+ * @copyright  (c) the Rig project
+ * @author     Luca Longinotti <chtekk@longitekk.com>
+ * @license    BSD 2-clause
+ * @version    $Id$
+ */
+
+#include "rig_internal.h"
+#include <atomic_ops.h>
+
+/*
+ * Rig Ring Data Definitions
+ */
+
+/** Types */
+typedef struct CellStruct *Cell;
+
+/** Structures */
+struct rig_ring {
+	atomic_ops_uint enqueue_pos CACHELINE_ALIGNED;
+	uintptr_t dequeue_pos_cache; // producer-private (SPSC only)
+	atomic_ops_uint dequeue_pos CACHELINE_ALIGNED;
+	uintptr_t enqueue_pos_cache; // consumer-private (SPSC only)
+	size_t mask CACHELINE_ALIGNED; // read-only value
+	RIG_COUNTER refcount;
+	Cell cells; // read-only value
+	uint16_t flags; // read-only value
+};
+
+struct CellStruct {
+	atomic_ops_uint sequence;
+	void *data;
+};
+
+/*
+ * Every cell carries a sequence number, which tells producers and consumers
+ * if it's their turn to use it: a cell at position pos is free for the
+ * producer when its sequence equals pos, and holds data for the consumer
+ * when it equals pos + 1. After a get(), the sequence is advanced by the
+ * ring size, making the cell available to the producer of the next round.
+ * Producers and consumers only ever synchronize through the CAS on their
+ * respective position counter, which live on separate cache-lines, and on
+ * the sequence number of the cell they're working with.
+ * The cells are never freed while the ring exists, so no SMR is required.
+ *
+ * Rings created with RIG_RING_SPSC use Lamport's single-producer/single-
+ * consumer ring instead: each side owns its position counter and only
+ * publishes it with a release store, no CAS and no sequence numbers are
+ * needed. Each side also keeps a private copy of the other's position,
+ * and only re-reads the shared one when that copy says full (or empty),
+ * so the counters' cache-lines aren't bounced around on every operation.
+ */
+
+static inline bool ring_put_spsc(RIG_RING r, void *item) ATTR_ALWAYSINLINE;
+static inline void *ring_get_spsc(RIG_RING r, bool remove) ATTR_ALWAYSINLINE;
+
+
+/*
+ * Rig Ring Implementation
+ */
+
+/**
+ * Initialize a lock-free, bounded ring (FIFO data structure), backed by an
+ * array allocated once at initialization.
+ * This data structure is intended for low-level, high-performance purposes, and thus only accepts and returns memory
+ * addresses. Their content and its persistence is the responsibility of the application programmer.
+ *
+ * @param capacity
+ *     maximum number of elements the ring can contain, must be > 0, gets
+ *     rounded up to the next power of two
+ * @param flags
+ *     flags to modify ring behavior, the following are currently supported:
+ *     - RIG_RING_SPSC (only one thread ever puts and only one thread ever
+ *       gets/peeks, both sides are wait-free)
+ *
+ * @return
+ *     ring pointer, NULL on error.
+ *     On error, the following error codes are set:
+ *     - EINVAL (invalid arguments passed)
+ *     - ENOMEM (insufficient memory)
+ */
+RIG_RING rig_ring_init(size_t capacity, uint16_t flags) {
+	CHECK_PERMITTED_FLAGS(flags, RIG_RING_SPSC);
+
+	// Round capacity up to the next power of two, so positions map to cells by masking
+	if ((capacity == 0) || (capacity > ((SIZE_MAX >> 1) / sizeof(struct CellStruct)))) {
+		ERRET(EINVAL, NULL);
+	}
+
+	size_t ring_size = 1;
+	while (ring_size < capacity) {
+		ring_size <<= 1;
+	}
+
+	// Allocate memory for the ring
+	RIG_RING r = rig_mem_alloc_aligned(sizeof(*r), 0, CACHELINE_SIZE, 0);
+	NULLCHECK_ERRET(r, ENOMEM, NULL);
+
+	// Allocate memory for the cells
+	Cell cells = rig_mem_alloc_aligned(0, ring_size * sizeof(*cells), CACHELINE_SIZE, 0);
+	NULLCHECK_ERRET_CLEANUP(cells, ENOMEM, NULL, rig_mem_free_aligned(r));
+
+	// Initialize the counters
+	RIG_COUNTER refcount = rig_counter_init(1, 0);
+	NULLCHECK_ERRET_CLEANUP(refcount, ENOMEM, NULL, rig_mem_free_aligned(r); rig_mem_free_aligned(cells));
+
+	// Initialize the needed values
+	for (size_t i = 0; i < ring_size; i++) {
+		atomic_ops_uint_store(&cells[i].sequence, i, ATOMIC_OPS_FENCE_NONE);
+		cells[i].data = NULL;
+	}
+
+	atomic_ops_uint_store(&r->enqueue_pos, 0, ATOMIC_OPS_FENCE_NONE);
+	atomic_ops_uint_store(&r->dequeue_pos, 0, ATOMIC_OPS_FENCE_NONE);
+	r->dequeue_pos_cache = 0;
+	r->enqueue_pos_cache = 0;
+	r->mask = ring_size - 1;
+	r->refcount = refcount;
+	r->cells = cells;
+	r->flags = flags;
+
+	atomic_ops_fence(ATOMIC_OPS_FENCE_FULL);
+
+	return (r);
+}
+
+/**
+ * Get a new reference to the ring, increasing the reference count by one.
+ *
+ * @param r
+ *     ring pointer
+ *
+ * @return
+ *     ring pointer
+ */
+RIG_RING rig_ring_newref(RIG_RING r) {
+	NULLCHECK_EXIT(r);
+
+	rig_acheck_msg(rig_counter_inc(r->refcount), "more references than physically possible");
+
+	return (r);
+}
+
+/**
+ * Destroy specified ring reference and set pointer to NULL.
+ * If reference count reaches zero, proceed to full destruction.
+ *
+ * @param *r
+ *     pointer to ring pointer
+ */
+void rig_ring_destroy(RIG_RING *r) {
+	NULLCHECK_EXIT(r);
+	NULLCHECK_EXIT(*r);
+
+	if (rig_counter_dec_and_test((*r)->refcount)) {
+		// Destroy counters, cells and ring
+		rig_counter_destroy(&(*r)->refcount);
+		rig_mem_free_aligned((*r)->cells);
+		rig_mem_free_aligned(*r);
+	}
+	else {
+		rig_acheck_msg(errno == 0, "reference count already zero, uncounted references exist");
+	}
+
+	*r = NULL;
+
+	atomic_ops_fence(ATOMIC_OPS_FENCE_FULL);
+}
+
+/**
+ * Clear the ring by getting elements from it until it's empty.
+ *
+ * @param r
+ *     ring pointer
+ */
+void rig_ring_clear(RIG_RING r) {
+	NULLCHECK_EXIT(r);
+
+	while (rig_ring_get(r) != NULL) { ; }
+}
+
+/**
+ * Add a new item at the end of the ring.
+ *
+ * @param r
+ *     ring pointer
+ * @param item
+ *     data pointer (memory management caller responsibility)
+ *
+ * @return
+ *     boolean indicating success.
+ *     On error, the following error codes are set:
+ *     - EXFULL (maximum capacity reached)
+ */
+bool rig_ring_put(RIG_RING r, void *item) {
+	NULLCHECK_EXIT(r);
+
+	if (TEST_BITFIELD(r->flags, RIG_RING_SPSC)) {
+		return (ring_put_spsc(r, item));
+	}
+
+	Cell cell = NULL;
+	uintptr_t pos = atomic_ops_uint_load(&r->enqueue_pos, ATOMIC_OPS_FENCE_NONE);
+
+	while (true) {
+		cell = &r->cells[pos & r->mask];
+
+		uintptr_t seq = atomic_ops_uint_load(&cell->sequence, ATOMIC_OPS_FENCE_ACQUIRE);
+		intptr_t diff = (intptr_t)(seq - pos);
+
+		if (diff == 0) {
+			// Cell is free for this round, try to claim it
+			if (atomic_ops_uint_cas(&r->enqueue_pos, pos, pos + 1, ATOMIC_OPS_FENCE_NONE)) {
+				break;
+			}
+		}
+		else if (diff < 0) {
+			// Cell still holds data from the previous round: full ring
+			ERRET(EXFULL, false);
+		}
+
+		// Someone else claimed the cell, retry with the updated position
+		pos = atomic_ops_uint_load(&r->enqueue_pos, ATOMIC_OPS_FENCE_NONE);
+	}
+
+	cell->data = item;
+
+	// Publish the data to the consumer
+	atomic_ops_uint_store(&cell->sequence, pos + 1, ATOMIC_OPS_FENCE_RELEASE);
+
+	return (true);
+}
+
+/**
+ * Remove the first item from the front of the ring and return it.
+ *
+ * @param r
+ *     ring pointer
+ *
+ * @return
+ *     data pointer, NULL on error.
+ *     On error, the following error codes are set:
+ *     - ENOENT (empty ring, nothing to return)
+ */
+void *rig_ring_get(RIG_RING r) {
+	NULLCHECK_EXIT(r);
+
+	if (TEST_BITFIELD(r->flags, RIG_RING_SPSC)) {
+		return (ring_get_spsc(r, true));
+	}
+
+	Cell cell = NULL;
+	uintptr_t pos = atomic_ops_uint_load(&r->dequeue_pos, ATOMIC_OPS_FENCE_NONE);
+
+	while (true) {
+		cell = &r->cells[pos & r->mask];
+
+		uintptr_t seq = atomic_ops_uint_load(&cell->sequence, ATOMIC_OPS_FENCE_ACQUIRE);
+		intptr_t diff = (intptr_t)(seq - (pos + 1));
+
+		if (diff == 0) {
+			// Cell holds data for this round, try to claim it
+			if (atomic_ops_uint_cas(&r->dequeue_pos, pos, pos + 1, ATOMIC_OPS_FENCE_NONE)) {
+				break;
+			}
+		}
+		else if (diff < 0) {
+			// Cell wasn't filled yet: empty ring
+			ERRET(ENOENT, NULL);
+		}
+
+		// Someone else claimed the cell, retry with the updated position
+		pos = atomic_ops_uint_load(&r->dequeue_pos, ATOMIC_OPS_FENCE_NONE);
+	}
+
+	void *item = cell->data;
+
+	// Give the cell back to the producer of the next round
+	atomic_ops_uint_store(&cell->sequence, pos + r->mask + 1, ATOMIC_OPS_FENCE_RELEASE);
+
+	return (item);
+}
+
+/**
+ * Return the first item from the front of the ring, without removing it.
+ *
+ * @param r
+ *     ring pointer
+ *
+ * @return
+ *     data pointer, NULL on error.
+ *     On error, the following error codes are set:
+ *     - ENOENT (empty ring, nothing to return)
+ */
+void *rig_ring_peek(RIG_RING r) {
+	NULLCHECK_EXIT(r);
+
+	if (TEST_BITFIELD(r->flags, RIG_RING_SPSC)) {
+		return (ring_get_spsc(r, false));
+	}
+
+	while (true) {
+		uintptr_t pos = atomic_ops_uint_load(&r->dequeue_pos, ATOMIC_OPS_FENCE_ACQUIRE);
+		Cell cell = &r->cells[pos & r->mask];
+
+		uintptr_t seq = atomic_ops_uint_load(&cell->sequence, ATOMIC_OPS_FENCE_ACQUIRE);
+		intptr_t diff = (intptr_t)(seq - (pos + 1));
+
+		if (diff < 0) {
+			// Cell wasn't filled yet: empty ring
+			ERRET(ENOENT, NULL);
+		}
+
+		if (diff == 0) {
+			void *item = cell->data;
+
+			// The cell memory is always valid, but its content is only
+			// trustworthy if nobody got it in the meantime
+			if ((seq == atomic_ops_uint_load(&cell->sequence, ATOMIC_OPS_FENCE_ACQUIRE))
+			 && (pos == atomic_ops_uint_load(&r->dequeue_pos, ATOMIC_OPS_FENCE_ACQUIRE))) {
+				return (item);
+			}
+		}
+	}
+}
+
+/**
+ * Returns true if the ring is currently empty, false otherwise.
+ *
+ * @param r
+ *     ring pointer
+ *
+ * @return
+ *     boolean indicating emptiness
+ */
+bool rig_ring_empty(RIG_RING r) {
+	NULLCHECK_EXIT(r);
+
+	return (rig_ring_count(r) == 0);
+}
+
+/**
+ * Returns true if the ring is currently full, false otherwise.
+ *
+ * @param r
+ *     ring pointer
+ *
+ * @return
+ *     boolean indicating fullness
+ */
+bool rig_ring_full(RIG_RING r) {
+	NULLCHECK_EXIT(r);
+
+	return (rig_ring_count(r) == rig_ring_capacity(r));
+}
+
+/**
+ * Returns the number of items currently held in the ring.
+ *
+ * @param r
+ *     ring pointer
+ *
+ * @return
+ *     number of items in ring
+ */
+size_t rig_ring_count(RIG_RING r) {
+	NULLCHECK_EXIT(r);
+
+	// Load dequeue_pos first, so that count can't go negative
+	uintptr_t dequeue_pos = atomic_ops_uint_load(&r->dequeue_pos, ATOMIC_OPS_FENCE_ACQUIRE);
+	uintptr_t enqueue_pos = atomic_ops_uint_load(&r->enqueue_pos, ATOMIC_OPS_FENCE_ACQUIRE);
+
+	size_t count = enqueue_pos - dequeue_pos;
+
+	// Claimed positions can run ahead of the cells actually filled/emptied
+	return ((count > r->mask) ? (r->mask + 1) : (count));
+}
+
+/**
+ * Returns the maximum capacity of the ring.
+ *
+ * @param r
+ *     ring pointer
+ *
+ * @return
+ *     maximum ring capacity
+ */
+size_t rig_ring_capacity(RIG_RING r) {
+	NULLCHECK_EXIT(r);
+
+	return (r->mask + 1);
+}
+
+/**
+ * INTERNAL
+ * Add a new item at the end of a single-producer/single-consumer ring.
+ * Must only ever be called by the one producer thread.
+ *
+ * @param r
+ *     ring pointer
+ * @param item
+ *     data pointer
+ *
+ * @return
+ *     boolean indicating success.
+ *     On error, the following error codes are set:
+ *     - EXFULL (maximum capacity reached)
+ */
+static inline bool ring_put_spsc(RIG_RING r, void *item) {
+	uintptr_t pos = atomic_ops_uint_load(&r->enqueue_pos, ATOMIC_OPS_FENCE_NONE);
+
+	if ((pos - r->dequeue_pos_cache) > r->mask) {
+		// Looks full, refresh the consumer's position
+		r->dequeue_pos_cache = atomic_ops_uint_load(&r->dequeue_pos, ATOMIC_OPS_FENCE_ACQUIRE);
+
+		if ((pos - r->dequeue_pos_cache) > r->mask) {
+			ERRET(EXFULL, false);
+		}
+	}
+
+	r->cells[pos & r->mask].data = item;
+
+	// Publish the data to the consumer
+	atomic_ops_uint_store(&r->enqueue_pos, pos + 1, ATOMIC_OPS_FENCE_RELEASE);
+
+	return (true);
+}
+
+/**
+ * INTERNAL
+ * Get or peek at the first item of a single-producer/single-consumer ring.
+ * Must only ever be called by the one consumer thread.
+ *
+ * @param r
+ *     ring pointer
+ * @param remove
+ *     remove the item (get) or not (peek)
+ *
+ * @return
+ *     data pointer, NULL on error.
+ *     On error, the following error codes are set:
+ *     - ENOENT (empty ring, nothing to return)
+ */
+static inline void *ring_get_spsc(RIG_RING r, bool remove) {
+	uintptr_t pos = atomic_ops_uint_load(&r->dequeue_pos, ATOMIC_OPS_FENCE_NONE);
+
+	if (pos == r->enqueue_pos_cache) {
+		// Looks empty, refresh the producer's position
+		r->enqueue_pos_cache = atomic_ops_uint_load(&r->enqueue_pos, ATOMIC_OPS_FENCE_ACQUIRE);
+
+		if (pos == r->enqueue_pos_cache) {
+			ERRET(ENOENT, NULL);
+		}
+	}
+
+	void *item = r->cells[pos & r->mask].data;
+
+	if (remove) {
+		// Give the cell back to the producer
+		atomic_ops_uint_store(&r->dequeue_pos, pos + 1, ATOMIC_OPS_FENCE_RELEASE);
+	}
+
+	return (item);
+}
@@ -15,51 +15,113 @@
 #include <stdio.h>
 #include "support/array_stack.c"
 
-#define RIG_SMR_EPOCH_THRESHOLD 64 // multiple of 32
+#define RIG_SMR_EPOCH_THRESHOLD 64 // Minimum retired pointers before advancing, multiple of 32
+#define RIG_SMR_EPOCH_THRESHOLD_FACTOR 8 // Default k in R = k * N, N being the live records
+#define RIG_SMR_EPOCH_MAX_BYTES ((size_t)1 << 20) // Default per-thread cap on unreclaimed bytes (1 MiB)
 
 typedef struct rig_smr_epoch_record *RIG_SMR_Epoch_Record;
 
 static inline RIG_SMR_Epoch_Record rig_smr_epoch_record_get(void);
+static inline size_t rig_smr_epoch_threshold_get(void);
 static inline void rig_smr_epoch_advance(RIG_SMR_Epoch_Record epoch_record);
 static inline uintptr_t rig_smr_epoch_update(RIG_SMR_Epoch_Record epoch_record);
 static inline void rig_smr_epoch_free_memory(RIG_SMR_Epoch_Record epoch_record, uintptr_t delta);
+static inline void rig_smr_epoch_limbo_free(ARRAY_STACK limbo_list);
+static void rig_smr_epoch_reclaim(RIG_SMR_Block block);
 
 struct rig_smr_epoch_record {
 	atomic_ops_uint critical_section CACHELINE_ALIGNED;
 	atomic_ops_uint local_epoch;
 	atomic_ops_uint in_use;
 	size_t current_retire_list;
-	struct array_stack retire_lists[3];
+	struct array_stack retire_lists[3]; // Entries retired with a destructor take three slots
+	size_t retire_bytes[3]; // Bytes held back by each retire list
 	RIG_SMR_Epoch_Record next;
 };
 
+typedef struct rig_smr_epoch_block *RIG_SMR_Epoch_Block;
+
+// Limbo list handed over to the reclaimer thread, everything in it can be freed
+struct rig_smr_epoch_block {
+	struct rig_smr_block header;
+	struct array_stack limbo_list;
+};
+
 #if defined(SYSTEM_TLS_SUPPORT)
 	static SYSTEM_TLS_DECL RIG_SMR_Epoch_Record Epoch_Record = NULL;
 #else
 	static RIG_TLS RIG_SMR_Epoch_TLS_Key = NULL;
+#endif
+
+static void rig_smr_epoch_construct(void) ATTR_CONSTRUCTOR;
+static void rig_smr_epoch_destruct(void) ATTR_DESTRUCTOR;
+
+static atomic_ops_uint RIG_SMR_Epoch_Global_Epoch = ATOMIC_OPS_UINT_INIT(0);
+
+static atomic_ops_ptr  RIG_SMR_Epoch_List_Head = ATOMIC_OPS_PTR_INIT(NULL);
+static atomic_ops_uint RIG_SMR_Epoch_List_Length = ATOMIC_OPS_UINT_INIT(0);
+static atomic_ops_uint RIG_SMR_Epoch_Live_Records = ATOMIC_OPS_UINT_INIT(0);
+static atomic_ops_uint RIG_SMR_Epoch_Threshold_Factor = ATOMIC_OPS_UINT_INIT(RIG_SMR_EPOCH_THRESHOLD_FACTOR);
+static atomic_ops_uint RIG_SMR_Epoch_Max_Bytes = ATOMIC_OPS_UINT_INIT(RIG_SMR_EPOCH_MAX_BYTES);
+
+static void rig_smr_epoch_construct(void) {
+	// Retired memory may come from the node pool, which must outlive our destructor
+	rig_mem_pool_ref();
 
-	static void rig_smr_epoch_construct(void) ATTR_CONSTRUCTOR;
+#if !defined(SYSTEM_TLS_SUPPORT)
+	// The TLS key must be initialized only once, only one thread can get here
+	RIG_SMR_Epoch_TLS_Key = rig_tls_init();
+	NULLCHECK_EXIT(RIG_SMR_Epoch_TLS_Key);
+#endif
+}
 
-	static void rig_smr_epoch_construct(void) {
-		// The TLS key must be initialized only once, only one thread can get here
-		RIG_SMR_Epoch_TLS_Key = rig_tls_init();
-		NULLCHECK_EXIT(RIG_SMR_Epoch_TLS_Key);
+static void rig_smr_epoch_destruct(void) {
+	// Nothing may run in the background anymore
+	rig_smr_reclaimer_shutdown();
+
+	// Give back our own record, which frees all its memory, then check if
+	// other threads still use theirs; if not, all records can be freed,
+	// as giving them back already emptied their retire lists
+	rig_smr_epoch_record_release();
+
+	RIG_SMR_Epoch_Record curr = atomic_ops_ptr_load(&RIG_SMR_Epoch_List_Head, ATOMIC_OPS_FENCE_ACQUIRE);
+
+	while (curr != NULL) {
+		if (atomic_ops_uint_load(&curr->in_use, ATOMIC_OPS_FENCE_ACQUIRE) == 1) {
+			break;
+		}
+
+		curr = curr->next;
 	}
 
-	static void rig_smr_epoch_destruct(void) ATTR_DESTRUCTOR;
+	if (curr == NULL) {
+		curr = atomic_ops_ptr_load(&RIG_SMR_Epoch_List_Head, ATOMIC_OPS_FENCE_ACQUIRE);
 
-	static void rig_smr_epoch_destruct(void) {
-		// TODO: check sanity of remaining records (critical_section == 0)
-		// TODO: cleanup array_stack (using array_stack_destroy())
-		// TODO: cleanup epoch_records themselves
-		rig_tls_destroy(&RIG_SMR_Epoch_TLS_Key);
+		atomic_ops_ptr_store(&RIG_SMR_Epoch_List_Head, NULL, ATOMIC_OPS_FENCE_NONE);
+		atomic_ops_uint_store(&RIG_SMR_Epoch_List_Length, 0, ATOMIC_OPS_FENCE_FULL);
+
+		while (curr != NULL) {
+			RIG_SMR_Epoch_Record next = curr->next;
+
+			rig_acheck_msg(atomic_ops_uint_load(&curr->critical_section, ATOMIC_OPS_FENCE_NONE) == 0,
+				"critical section of an unused record still open");
+
+			array_stack_destroy(&curr->retire_lists[0]);
+			array_stack_destroy(&curr->retire_lists[1]);
+			array_stack_destroy(&curr->retire_lists[2]);
+
+			rig_mem_free_aligned(curr);
+
+			curr = next;
+		}
 	}
-#endif
 
-static atomic_ops_uint RIG_SMR_Epoch_Global_Epoch = ATOMIC_OPS_UINT_INIT(0);
+#if !defined(SYSTEM_TLS_SUPPORT)
+	rig_tls_destroy(&RIG_SMR_Epoch_TLS_Key);
+#endif
 
-static atomic_ops_ptr  RIG_SMR_Epoch_List_Head = ATOMIC_OPS_PTR_INIT(NULL);
-static atomic_ops_uint RIG_SMR_Epoch_List_Length = ATOMIC_OPS_UINT_INIT(0);
+	rig_mem_pool_unref();
+}
 
 
 static inline RIG_SMR_Epoch_Record rig_smr_epoch_record_get(void) {
@@ -93,9 +155,13 @@ static inline RIG_SMR_Epoch_Record rig_smr_epoch_record_get(void) {
 			atomic_ops_uint_store(&Epoch_Record->in_use, 1, ATOMIC_OPS_FENCE_NONE);
 			Epoch_Record->current_retire_list = 0;
 
-			array_stack_init(&Epoch_Record->retire_lists[0], sizeof(void *));
-			array_stack_init(&Epoch_Record->retire_lists[1], sizeof(void *));
-			array_stack_init(&Epoch_Record->retire_lists[2], sizeof(void *));
+			array_stack_init(&Epoch_Record->retire_lists[0], sizeof(RIG_SMR_Retired));
+			array_stack_init(&Epoch_Record->retire_lists[1], sizeof(RIG_SMR_Retired));
+			array_stack_init(&Epoch_Record->retire_lists[2], sizeof(RIG_SMR_Retired));
+
+			Epoch_Record->retire_bytes[0] = 0;
+			Epoch_Record->retire_bytes[1] = 0;
+			Epoch_Record->retire_bytes[2] = 0;
 
 			// Link the new RIG_SMR_Epoch_Record into the main RIG_SMR_Epoch_List
 			atomic_ops_uint_inc(&RIG_SMR_Epoch_List_Length, ATOMIC_OPS_FENCE_FULL);
@@ -111,6 +177,9 @@ static inline RIG_SMR_Epoch_Record rig_smr_epoch_record_get(void) {
 			}
 		}
 
+		// Live records determine the retire threshold
+		atomic_ops_uint_inc(&RIG_SMR_Epoch_Live_Records, ATOMIC_OPS_FENCE_NONE);
+
 #if !defined(SYSTEM_TLS_SUPPORT)
 		// Set the thread specific value correctly
 		rig_tls_set(RIG_SMR_Epoch_TLS_Key, Epoch_Record);
@@ -130,14 +199,19 @@ void rig_smr_epoch_record_release(void) {
 			"unclosed critical section (perhaps incorrect recursion?)");
 
 		// Empty all lists by freeing memory after at last three epochs have passed, helping along if needed.
-		uintptr_t delta = rig_smr_epoch_update(Epoch_Record);
+		// Repeat as long as destructors called while doing so retire more memory.
+		do {
+			uintptr_t delta = rig_smr_epoch_update(Epoch_Record);
 
-		while (delta < 3) {
-			rig_smr_epoch_advance(Epoch_Record);
-			delta += rig_smr_epoch_update(Epoch_Record);
-		}
+			while (delta < 3) {
+				rig_smr_epoch_advance(Epoch_Record);
+				delta += rig_smr_epoch_update(Epoch_Record);
+			}
 
-		rig_smr_epoch_free_memory(Epoch_Record, delta);
+			rig_smr_epoch_free_memory(Epoch_Record, delta);
+		} while ((array_stack_count(&Epoch_Record->retire_lists[0]) != 0)
+			|| (array_stack_count(&Epoch_Record->retire_lists[1]) != 0)
+			|| (array_stack_count(&Epoch_Record->retire_lists[2]) != 0));
 
 		rig_acheck_msg(array_stack_count(&Epoch_Record->retire_lists[0]) == 0, "retire list 0 not empty");
 		rig_acheck_msg(array_stack_count(&Epoch_Record->retire_lists[1]) == 0, "retire list 1 not empty");
@@ -147,6 +221,8 @@ void rig_smr_epoch_record_release(void) {
 		atomic_ops_uint_store(&Epoch_Record->local_epoch, 0, ATOMIC_OPS_FENCE_NONE);
 		Epoch_Record->current_retire_list = 0;
 
+		atomic_ops_uint_dec(&RIG_SMR_Epoch_Live_Records, ATOMIC_OPS_FENCE_NONE);
+
 		atomic_ops_uint_store(&Epoch_Record->in_use, 0, ATOMIC_OPS_FENCE_RELEASE);
 
 #if defined(SYSTEM_TLS_SUPPORT)
@@ -159,6 +235,39 @@ void rig_smr_epoch_record_release(void) {
 	}
 }
 
+/**
+ * Tune when retired memory gets reclaimed: a thread tries to advance the
+ * global epoch once it has retired factor * N pointers in the current epoch,
+ * N being the number of live records, as an advance has to look at all of
+ * them. Independently, an advance is tried once a thread holds back
+ * max_bytes bytes over all its retire lists.
+ *
+ * @param factor
+ *     retired pointers per live record before advancing, 0 restores the default
+ * @param max_bytes
+ *     per-thread cap on unreclaimed bytes, 0 disables it
+ */
+void rig_smr_epoch_threshold_set(size_t factor, size_t max_bytes) {
+	if (factor == 0) {
+		factor = RIG_SMR_EPOCH_THRESHOLD_FACTOR;
+	}
+
+	atomic_ops_uint_store(&RIG_SMR_Epoch_Threshold_Factor, factor, ATOMIC_OPS_FENCE_NONE);
+	atomic_ops_uint_store(&RIG_SMR_Epoch_Max_Bytes, max_bytes, ATOMIC_OPS_FENCE_FULL);
+}
+
+static inline size_t rig_smr_epoch_threshold_get(void) {
+	size_t factor = atomic_ops_uint_load(&RIG_SMR_Epoch_Threshold_Factor, ATOMIC_OPS_FENCE_NONE);
+	size_t records = atomic_ops_uint_load(&RIG_SMR_Epoch_Live_Records, ATOMIC_OPS_FENCE_NONE);
+
+	// Saturate instead of overflowing with absurd factors
+	if (records > (SIZE_MAX / factor)) {
+		return (SIZE_MAX);
+	}
+
+	return (((factor * records) > RIG_SMR_EPOCH_THRESHOLD) ? (factor * records) : (RIG_SMR_EPOCH_THRESHOLD));
+}
+
 static inline void rig_smr_epoch_advance(RIG_SMR_Epoch_Record epoch_record) {
 	uintptr_t global_epoch = atomic_ops_uint_load(&RIG_SMR_Epoch_Global_Epoch, ATOMIC_OPS_FENCE_NONE);
 
@@ -212,10 +321,40 @@ static inline void rig_smr_epoch_free_memory(RIG_SMR_Epoch_Record epoch_record,
 			epoch_record->current_retire_list = 0;
 		}
 
-		// Clear the current list before using it anew
-		void **ptr;
-		while ((ptr = array_stack_pop(&epoch_record->retire_lists[epoch_record->current_retire_list])) != NULL) {
-			rig_mem_free(*ptr);
+		// Clear the current list before using it anew. Destructors may retire
+		// more memory, which must go to a fresh list and not be freed with the
+		// old one, so the old list is taken out while it's being cleared.
+		// With the reclaimer running, it gets the old list to clear instead.
+		size_t curr_list = epoch_record->current_retire_list;
+		struct array_stack limbo_list = epoch_record->retire_lists[curr_list];
+		size_t limbo_bytes = epoch_record->retire_bytes[curr_list];
+		RIG_SMR_Epoch_Block block = NULL;
+
+		if ((array_stack_count(&limbo_list) != 0) && rig_smr_reclaimer_offload()) {
+			block = rig_mem_alloc(sizeof(*block), 0);
+		}
+
+		array_stack_init(&epoch_record->retire_lists[curr_list], sizeof(RIG_SMR_Retired));
+		epoch_record->retire_bytes[curr_list] = 0;
+
+		if (block != NULL) {
+			block->header.reclaim = &rig_smr_epoch_reclaim;
+			block->header.bytes = limbo_bytes;
+			block->limbo_list = limbo_list;
+
+			rig_smr_reclaimer_handoff(&block->header);
+		}
+		else {
+			rig_smr_epoch_limbo_free(&limbo_list);
+
+			// Keep the old list and its memory around, unless destructors started a new one
+			if (array_stack_count(&epoch_record->retire_lists[curr_list]) == 0) {
+				array_stack_destroy(&epoch_record->retire_lists[curr_list]);
+				epoch_record->retire_lists[curr_list] = limbo_list;
+			}
+			else {
+				array_stack_destroy(&limbo_list);
+			}
 		}
 
 		// If several epochs have passed, we can also cleanup the other retire lists
@@ -229,6 +368,33 @@ static inline void rig_smr_epoch_free_memory(RIG_SMR_Epoch_Record epoch_record,
 	}
 }
 
+static inline void rig_smr_epoch_limbo_free(ARRAY_STACK limbo_list) {
+	RIG_SMR_Retired *slot;
+
+	while ((slot = array_stack_pop(limbo_list)) != NULL) {
+		// Entries are pushed last slot first, so the tagged pointer pops first
+		RIG_SMR_Retired retired[3];
+
+		retired[0] = *slot;
+
+		if (SMR_FN_TAGGED(retired[0].ptr)) {
+			retired[1] = *(RIG_SMR_Retired *)array_stack_pop(limbo_list);
+			retired[2] = *(RIG_SMR_Retired *)array_stack_pop(limbo_list);
+		}
+
+		SMR_RETIRED_FREE(retired);
+	}
+}
+
+static void rig_smr_epoch_reclaim(RIG_SMR_Block block) {
+	RIG_SMR_Epoch_Block epoch_block = (RIG_SMR_Epoch_Block)block;
+
+	rig_smr_epoch_limbo_free(&epoch_block->limbo_list);
+	array_stack_destroy(&epoch_block->limbo_list);
+
+	rig_mem_free(epoch_block);
+}
+
 void rig_smr_epoch_critical_enter(void) {
 	RIG_SMR_Epoch_Record epoch_record = rig_smr_epoch_record_get();
 
@@ -259,7 +425,14 @@ void rig_smr_epoch_critical_exit(void) {
 	// If over the threshold, try to advance the global epoch. If you fail because someone else did,
 	// no worry, the system made progress. If you fail because not everyone active has yet observed
 	// the current epoch, just wait, it'll happen.
-	if (array_stack_count(&epoch_record->retire_lists[epoch_record->current_retire_list]) >= RIG_SMR_EPOCH_THRESHOLD) {
+	// Holding back too much memory also warrants a try, as long as something
+	// new was retired in this epoch (else we already tried and are waiting).
+	size_t count = array_stack_count(&epoch_record->retire_lists[epoch_record->current_retire_list]);
+	size_t max_bytes = atomic_ops_uint_load(&RIG_SMR_Epoch_Max_Bytes, ATOMIC_OPS_FENCE_NONE);
+
+	if ((count >= rig_smr_epoch_threshold_get())
+	 || ((max_bytes != 0) && (count != 0)
+	  && ((epoch_record->retire_bytes[0] + epoch_record->retire_bytes[1] + epoch_record->retire_bytes[2]) >= max_bytes))) {
 		rig_smr_epoch_advance(epoch_record);
 	}
 }
@@ -269,8 +442,55 @@ void rig_smr_epoch_mem_retire(void *memory_ptr) {
 	if (memory_ptr != NULL) {
 		RIG_SMR_Epoch_Record epoch_record = rig_smr_epoch_record_get();
 
+		RIG_SMR_Retired retired = { .ptr = memory_ptr };
+
 		// Push the pointer onto the current retire list
-		array_stack_push(&epoch_record->retire_lists[epoch_record->current_retire_list], &memory_ptr);
+		array_stack_push(&epoch_record->retire_lists[epoch_record->current_retire_list], &retired);
+		epoch_record->retire_bytes[epoch_record->current_retire_list] += SMR_MEM_SIZE(memory_ptr);
+	}
+}
+
+/**
+ * Retire memory that has to be reclaimed by calling a destructor, instead
+ * of rig_mem_free(), once all threads have left the epoch it was retired in.
+ * This way any object, be it pooled, aligned or part of a bigger structure,
+ * can be reclaimed. The destructor may run in any thread, the one that
+ * retired the memory or, once rig_smr_reclaimer_start() was called, the
+ * background reclaimer, and may itself retire more memory.
+ *
+ * @param memory_ptr
+ *     pointer to retire, at least 4 byte aligned, NULL does nothing
+ * @param fn
+ *     destructor, called with memory_ptr and ctx, cannot be NULL
+ * @param ctx
+ *     context passed on to the destructor
+ */
+void rig_smr_epoch_retire_fn(void *memory_ptr, void (*fn)(void *ptr, void *ctx), void *ctx) {
+	// If pointer is NULL, we do nothing at all, same as the standard free()
+	if (memory_ptr != NULL) {
+		NULLCHECK_EXIT(fn);
+		rig_acheck_msg(SMR_UNTAG(memory_ptr) == memory_ptr, "retired pointer not 4 byte aligned");
+
+		RIG_SMR_Epoch_Record epoch_record = rig_smr_epoch_record_get();
+		ARRAY_STACK retire_list = &epoch_record->retire_lists[epoch_record->current_retire_list];
+		RIG_SMR_Retired retired;
+
+		// Push the entry last slot first, so that the tagged pointer pops first
+		retired.ptr = ctx;
+		array_stack_push(retire_list, &retired);
+		retired.fn = fn;
+		array_stack_push(retire_list, &retired);
+		retired.ptr = SMR_FN_TAG(memory_ptr);
+		array_stack_push(retire_list, &retired);
+
+		epoch_record->retire_bytes[epoch_record->current_retire_list] += SMR_MEM_SIZE(retired.ptr);
+	}
+}
+
+void rig_smr_epoch_pool_retire(void *memory_ptr) {
+	// Memory from the node pool is tagged, so that it's given back there once freed
+	if (memory_ptr != NULL) {
+		rig_smr_epoch_mem_retire(SMR_POOL_TAG(memory_ptr));
 	}
 }
 
@@ -297,7 +517,9 @@ void rig_smr_epoch_debug_info(bool print_list) {
 			printf("current_retire_list = %zu\n", curr->current_retire_list);
 			printf("retire list 0 count = %zu\n", array_stack_count(&curr->retire_lists[0]));
 			printf("retire list 1 count = %zu\n", array_stack_count(&curr->retire_lists[1]));
-			printf("retire list 2 count = %zu\n\n", array_stack_count(&curr->retire_lists[2]));
+			printf("retire list 2 count = %zu\n", array_stack_count(&curr->retire_lists[2]));
+			printf("retire lists bytes = %zu\n\n",
+				curr->retire_bytes[0] + curr->retire_bytes[1] + curr->retire_bytes[2]);
 
 			curr = curr->next;
 		}
@@ -13,105 +13,210 @@
 #include "rig_internal.h"
 #include <atomic_ops.h>
 #include <stdio.h>
-#include "support/array_stack.c"
+#include <string.h>
 
-#define RIG_SMR_HP_COUNT 8 // HP[0]: curr, HP[1]: prev, HP[2]: misc, HP[3]: misc (*2 for iterators)
-#define RIG_SMR_HP_THRESHOLD 64 // based on RIG_SMR_HP_COUNT * expected thread number (8), multiple of 32
-
-static int rig_smr_hp_ptr_cmp(const void *a, const void *b);
+#define RIG_SMR_HP_COUNT 4 // HP[0]: curr, HP[1]: prev, HP[2]: misc, HP[3]: misc
+#define RIG_SMR_HP_THRESHOLD 64 // Minimum retired pointers before a scan, multiple of 32
+#define RIG_SMR_HP_THRESHOLD_FACTOR 2 // Default k in R = k * H, H being all HPs of live records
+#define RIG_SMR_HP_MAX_BYTES ((size_t)1 << 20) // Default per-thread cap on unreclaimed bytes (1 MiB)
+#define RIG_SMR_HP_SET_MIN_BITS 6 // Minimum size of the HP hash set (64 slots)
 
 struct rig_smr_hp_record {
 	atomic_ops_ptr HP[RIG_SMR_HP_COUNT] CACHELINE_ALIGNED;
-	struct array_stack retire_list;
+	RIG_SMR_Retired *retire_list; // Retired pointers, owned by the thread using the record
+	size_t retire_count; // Slots in use, entries retired with a destructor take three
+	size_t retire_size;
+	size_t retire_bytes; // Bytes held back by the retire list
+	size_t scan_kept; // Slots still hazardous at the end of the last scan
+	bool scanning; // Destructors may retire more memory, but not start a nested scan
+	void **hp_set; // Scratch space for scans: open-addressing hash set of HPs
+	size_t hp_set_bits;
 	atomic_ops_uint in_use;
 	RIG_SMR_HP_Record next;
 };
 
+typedef struct rig_smr_hp_block *RIG_SMR_HP_Block;
+
+// Retire list handed over to the reclaimer thread, or orphaned by a thread giving its record back
+struct rig_smr_hp_block {
+	struct rig_smr_block header;
+	RIG_SMR_Retired *retire_list;
+	size_t retire_count;
+};
+
+static RIG_SMR_HP_Record rig_smr_hp_record_claim(void);
+static inline size_t rig_smr_hp_threshold_get(void) ATTR_ALWAYSINLINE;
+static inline void rig_smr_hp_retire_push(RIG_SMR_HP_Record hp_record, RIG_SMR_Retired *retired, size_t slots) ATTR_ALWAYSINLINE;
+static inline void rig_smr_hp_retire_check(RIG_SMR_HP_Record hp_record) ATTR_ALWAYSINLINE;
+static void rig_smr_hp_handoff(RIG_SMR_HP_Record hp_record);
+static void rig_smr_hp_reclaim(RIG_SMR_Block block);
+static void rig_smr_hp_orphan(RIG_SMR_HP_Record hp_record);
+static void rig_smr_hp_adopt(RIG_SMR_HP_Record hp_record);
+static bool rig_smr_hp_all_reclaimed(void);
+static inline size_t rig_smr_hp_set_slot(void *ptr, size_t bits) ATTR_ALWAYSINLINE;
+static inline void rig_smr_hp_set_add(void **hp_set, size_t bits, void *ptr) ATTR_ALWAYSINLINE;
+static inline bool rig_smr_hp_set_contains(void **hp_set, size_t bits, void *ptr) ATTR_ALWAYSINLINE;
+static size_t rig_smr_hp_set_build(RIG_SMR_HP_Record hp_record);
+
 #if defined(SYSTEM_TLS_SUPPORT)
 	static SYSTEM_TLS_DECL RIG_SMR_HP_Record HP_Record = NULL;
 #else
 	static RIG_TLS RIG_SMR_HP_TLS_Key = NULL;
-
-	static void rig_smr_hp_construct(void) ATTR_CONSTRUCTOR;
-
-	static void rig_smr_hp_construct(void) {
-		// The TLS key must be initialized only once, only one thread can get here
-		RIG_SMR_HP_TLS_Key = rig_tls_init();
-		NULLCHECK_EXIT(RIG_SMR_HP_TLS_Key);
-	}
 #endif
 
+static void rig_smr_hp_construct(void) ATTR_CONSTRUCTOR;
 static void rig_smr_hp_destruct(void) ATTR_DESTRUCTOR;
 
-static void rig_smr_hp_destruct(void) {
-	rig_smr_hp_mem_scan_full();
-	// TODO: check sanity of remaining records (HPs all NULL)
-	// TODO: cleanup array_stack (using array_stack_destroy())
-	// TODO: cleanup hp_records themselves
+static atomic_ops_ptr  RIG_SMR_HP_List_Head = ATOMIC_OPS_PTR_INIT(NULL);
+static atomic_ops_ptr  RIG_SMR_HP_Orphans = ATOMIC_OPS_PTR_INIT(NULL);
+static atomic_ops_uint RIG_SMR_HP_List_Length = ATOMIC_OPS_UINT_INIT(0);
+static atomic_ops_uint RIG_SMR_HP_Live_Records = ATOMIC_OPS_UINT_INIT(0);
+static atomic_ops_uint RIG_SMR_HP_Threshold_Factor = ATOMIC_OPS_UINT_INIT(RIG_SMR_HP_THRESHOLD_FACTOR);
+static atomic_ops_uint RIG_SMR_HP_Max_Bytes = ATOMIC_OPS_UINT_INIT(RIG_SMR_HP_MAX_BYTES);
+
+static void rig_smr_hp_construct(void) {
+	// Retired memory may come from the node pool, which must outlive our destructor
+	rig_mem_pool_ref();
 
 #if !defined(SYSTEM_TLS_SUPPORT)
-	rig_tls_destroy(&RIG_SMR_HP_TLS_Key);
+	// The TLS key must be initialized only once, only one thread can get here
+	RIG_SMR_HP_TLS_Key = rig_tls_init();
+	NULLCHECK_EXIT(RIG_SMR_HP_TLS_Key);
 #endif
 }
 
-static atomic_ops_ptr  RIG_SMR_HP_List_Head = ATOMIC_OPS_PTR_INIT(NULL);
-static atomic_ops_uint RIG_SMR_HP_List_Length = ATOMIC_OPS_UINT_INIT(0);
+static void rig_smr_hp_destruct(void) {
+	// Nothing may run in the background anymore
+	rig_smr_reclaimer_shutdown();
 
+	// Give back our own record, then check if other threads still use theirs
+	rig_smr_hp_record_release();
+
+	RIG_SMR_HP_Record curr = atomic_ops_ptr_load(&RIG_SMR_HP_List_Head, ATOMIC_OPS_FENCE_ACQUIRE);
+
+	while (curr != NULL) {
+		if (atomic_ops_uint_load(&curr->in_use, ATOMIC_OPS_FENCE_ACQUIRE) == 1) {
+			break;
+		}
+
+		curr = curr->next;
+	}
+
+	if (curr != NULL) {
+		// They may still use HPs, so the records must stay around, just free what's possible
+		rig_smr_hp_mem_scan_full();
+	}
+	else {
+		// No HPs can be set anymore, so scanning frees everything; repeat until
+		// destructors called by the scans stop retiring more, then free the records
+		do {
+			rig_smr_hp_mem_scan_full();
+		} while (!rig_smr_hp_all_reclaimed());
+
+		curr = atomic_ops_ptr_load(&RIG_SMR_HP_List_Head, ATOMIC_OPS_FENCE_ACQUIRE);
+
+		atomic_ops_ptr_store(&RIG_SMR_HP_List_Head, NULL, ATOMIC_OPS_FENCE_NONE);
+		atomic_ops_uint_store(&RIG_SMR_HP_List_Length, 0, ATOMIC_OPS_FENCE_FULL);
+
+		while (curr != NULL) {
+			RIG_SMR_HP_Record next = curr->next;
+
+			for (size_t i = 0; i < RIG_SMR_HP_COUNT; i++) {
+				rig_acheck_msg(atomic_ops_ptr_load(&curr->HP[i], ATOMIC_OPS_FENCE_NONE) == NULL,
+					"Hazard Pointer of an unused record not NULL");
+			}
+
+			if (curr->retire_list != NULL) {
+				rig_mem_free(curr->retire_list);
+			}
+
+			if (curr->hp_set != NULL) {
+				rig_mem_free(curr->hp_set);
+			}
+
+			rig_mem_free_aligned(curr);
+
+			curr = next;
+		}
+	}
 
-RIG_SMR_HP_Record rig_smr_hp_record_get(void) {
 #if !defined(SYSTEM_TLS_SUPPORT)
-	// Then we check if we already have a RIG_SMR_HP_Record saved for this thread
-	RIG_SMR_HP_Record HP_Record = rig_tls_get(RIG_SMR_HP_TLS_Key);
+	rig_tls_destroy(&RIG_SMR_HP_TLS_Key);
 #endif
 
-	// If HP_Record == NULL, this thread has not registered any RIG_SMR_HP_Record structure
-	if (HP_Record == NULL) {
-		// Let's search if there's any old record lying around
-		HP_Record = atomic_ops_ptr_load(&RIG_SMR_HP_List_Head, ATOMIC_OPS_FENCE_NONE);
+	rig_mem_pool_unref();
+}
 
-		while (HP_Record != NULL) {
-			if (atomic_ops_uint_load(&HP_Record->in_use, ATOMIC_OPS_FENCE_ACQUIRE) == 0
-			 && atomic_ops_uint_cas(&HP_Record->in_use, 0, 1, ATOMIC_OPS_FENCE_ACQUIRE)) {
-				// Got it!
-				break;
-			}
 
-			HP_Record = HP_Record->next;
+static RIG_SMR_HP_Record rig_smr_hp_record_claim(void) {
+	// Let's search if there's any old record lying around
+	RIG_SMR_HP_Record hp_record = atomic_ops_ptr_load(&RIG_SMR_HP_List_Head, ATOMIC_OPS_FENCE_NONE);
+
+	while (hp_record != NULL) {
+		if (atomic_ops_uint_load(&hp_record->in_use, ATOMIC_OPS_FENCE_ACQUIRE) == 0
+		 && atomic_ops_uint_cas(&hp_record->in_use, 0, 1, ATOMIC_OPS_FENCE_ACQUIRE)) {
+			// Got it!
+			break;
 		}
 
-		// Didn't find an old record, need to allocate one myself
-		if (HP_Record == NULL) {
-			HP_Record = rig_mem_alloc_aligned(sizeof(*HP_Record), 0, CACHELINE_SIZE, 0);
-			NULLCHECK_EXIT(HP_Record);
+		hp_record = hp_record->next;
+	}
 
-			// Initialize values
-			// UNROLLED LOOP FOLLOWS (based on RIG_SMR_HP_COUNT)
-			atomic_ops_ptr_store(&HP_Record->HP[0], NULL, ATOMIC_OPS_FENCE_NONE);
-			atomic_ops_ptr_store(&HP_Record->HP[1], NULL, ATOMIC_OPS_FENCE_NONE);
-			atomic_ops_ptr_store(&HP_Record->HP[2], NULL, ATOMIC_OPS_FENCE_NONE);
-			atomic_ops_ptr_store(&HP_Record->HP[3], NULL, ATOMIC_OPS_FENCE_NONE);
-			atomic_ops_ptr_store(&HP_Record->HP[4], NULL, ATOMIC_OPS_FENCE_NONE);
-			atomic_ops_ptr_store(&HP_Record->HP[5], NULL, ATOMIC_OPS_FENCE_NONE);
-			atomic_ops_ptr_store(&HP_Record->HP[6], NULL, ATOMIC_OPS_FENCE_NONE);
-			atomic_ops_ptr_store(&HP_Record->HP[7], NULL, ATOMIC_OPS_FENCE_NONE);
+	// Didn't find an old record, need to allocate one myself
+	if (hp_record == NULL) {
+		hp_record = rig_mem_alloc_aligned(sizeof(*hp_record), 0, CACHELINE_SIZE, 0);
+		if (hp_record == NULL) {
+			return (NULL);
+		}
 
-			array_stack_init(&HP_Record->retire_list, sizeof(void *));
+		// Initialize values
+		// UNROLLED LOOP FOLLOWS (based on RIG_SMR_HP_COUNT)
+		atomic_ops_ptr_store(&hp_record->HP[0], NULL, ATOMIC_OPS_FENCE_NONE);
+		atomic_ops_ptr_store(&hp_record->HP[1], NULL, ATOMIC_OPS_FENCE_NONE);
+		atomic_ops_ptr_store(&hp_record->HP[2], NULL, ATOMIC_OPS_FENCE_NONE);
+		atomic_ops_ptr_store(&hp_record->HP[3], NULL, ATOMIC_OPS_FENCE_NONE);
 
-			atomic_ops_uint_store(&HP_Record->in_use, 1, ATOMIC_OPS_FENCE_NONE);
+		hp_record->retire_list = NULL;
+		hp_record->retire_count = 0;
+		hp_record->retire_size = 0;
+		hp_record->retire_bytes = 0;
+		hp_record->scan_kept = 0;
+		hp_record->scanning = false;
+		hp_record->hp_set = NULL;
+		hp_record->hp_set_bits = 0;
 
-			// Link the new RIG_SMR_HP_Record into the main RIG_SMR_HP_List
-			atomic_ops_uint_inc(&RIG_SMR_HP_List_Length, ATOMIC_OPS_FENCE_FULL);
+		atomic_ops_uint_store(&hp_record->in_use, 1, ATOMIC_OPS_FENCE_NONE);
 
-			while (true) {
-				RIG_SMR_HP_Record head = atomic_ops_ptr_load(&RIG_SMR_HP_List_Head, ATOMIC_OPS_FENCE_NONE);
+		// Link the new RIG_SMR_HP_Record into the main RIG_SMR_HP_List
+		atomic_ops_uint_inc(&RIG_SMR_HP_List_Length, ATOMIC_OPS_FENCE_FULL);
 
-				HP_Record->next = head;
+		while (true) {
+			RIG_SMR_HP_Record head = atomic_ops_ptr_load(&RIG_SMR_HP_List_Head, ATOMIC_OPS_FENCE_NONE);
 
-				if (atomic_ops_ptr_cas(&RIG_SMR_HP_List_Head, head, HP_Record, ATOMIC_OPS_FENCE_FULL)) {
-					break;
-				}
+			hp_record->next = head;
+
+			if (atomic_ops_ptr_cas(&RIG_SMR_HP_List_Head, head, hp_record, ATOMIC_OPS_FENCE_FULL)) {
+				break;
 			}
 		}
+	}
+
+	// Live records determine the retire threshold
+	atomic_ops_uint_inc(&RIG_SMR_HP_Live_Records, ATOMIC_OPS_FENCE_NONE);
+
+	return (hp_record);
+}
+
+RIG_SMR_HP_Record rig_smr_hp_record_get(void) {
+#if !defined(SYSTEM_TLS_SUPPORT)
+	// Then we check if we already have a RIG_SMR_HP_Record saved for this thread
+	RIG_SMR_HP_Record HP_Record = rig_tls_get(RIG_SMR_HP_TLS_Key);
+#endif
+
+	// If HP_Record == NULL, this thread has not registered any RIG_SMR_HP_Record structure
+	if (HP_Record == NULL) {
+		HP_Record = rig_smr_hp_record_claim();
+		NULLCHECK_EXIT(HP_Record);
 
 #if !defined(SYSTEM_TLS_SUPPORT)
 		// Set the thread specific value correctly
@@ -140,10 +245,15 @@ void rig_smr_hp_record_release(void) {
 				"failed to set all Hazard Pointers back to NULL");
 		}
 
-		// Try to free what you can
+		// Try to free what you can, what's left is still protected by other
+		// threads' HPs, and goes to the orphans, for active threads to adopt
 		rig_smr_hp_mem_scan();
 
-		// TODO: what to do with left-over memory? (we can retire once no HPs reference it anymore)
+		if (HP_Record->retire_count != 0) {
+			rig_smr_hp_orphan(HP_Record);
+		}
+
+		atomic_ops_uint_dec(&RIG_SMR_HP_Live_Records, ATOMIC_OPS_FENCE_NONE);
 
 		atomic_ops_uint_store(&HP_Record->in_use, 0, ATOMIC_OPS_FENCE_RELEASE);
 
@@ -157,6 +267,25 @@ void rig_smr_hp_record_release(void) {
 	}
 }
 
+RIG_SMR_HP_Record rig_smr_hp_record_acquire(void) {
+	// A record of its own, not bound to the calling thread: it only protects
+	// pointers, retired memory always goes to the thread's record
+	return (rig_smr_hp_record_claim());
+}
+
+void rig_smr_hp_record_yield(RIG_SMR_HP_Record hp_record) {
+	NULLCHECK_EXIT(hp_record);
+
+	for (size_t i = 0; i < RIG_SMR_HP_COUNT; i++) {
+		rig_acheck_msg(atomic_ops_ptr_load(&hp_record->HP[i], ATOMIC_OPS_FENCE_NONE) == NULL,
+			"failed to set all Hazard Pointers back to NULL");
+	}
+
+	atomic_ops_uint_dec(&RIG_SMR_HP_Live_Records, ATOMIC_OPS_FENCE_NONE);
+
+	atomic_ops_uint_store(&hp_record->in_use, 0, ATOMIC_OPS_FENCE_RELEASE);
+}
+
 void *rig_smr_hp_get(RIG_SMR_HP_Record hp_record, size_t hp) {
 	NULLCHECK_EXIT(hp_record);
 	rig_acheck_msg(hp < RIG_SMR_HP_COUNT, "HP value too high");
@@ -182,14 +311,12 @@ void rig_smr_hp_mem_retire(void *memory_ptr) {
 	// If pointer is NULL, we do nothing at all, same as the standard free()
 	if (memory_ptr != NULL) {
 		RIG_SMR_HP_Record hp_record = rig_smr_hp_record_get();
+		RIG_SMR_Retired retired = { .ptr = memory_ptr };
 
 		// Push the pointer onto the retire list and execute a scan of it,
 		// if the retired pointers threshold was reached
-		array_stack_push(&hp_record->retire_list, &memory_ptr);
-
-		if (array_stack_count(&hp_record->retire_list) >= RIG_SMR_HP_THRESHOLD) {
-			rig_smr_hp_mem_scan();
-		}
+		rig_smr_hp_retire_push(hp_record, &retired, 1);
+		rig_smr_hp_retire_check(hp_record);
 	}
 }
 
@@ -197,14 +324,362 @@ void rig_smr_hp_mem_retire_noscan(void *memory_ptr) {
 	// If pointer is NULL, we do nothing at all, same as the standard free()
 	if (memory_ptr != NULL) {
 		RIG_SMR_HP_Record hp_record = rig_smr_hp_record_get();
+		RIG_SMR_Retired retired = { .ptr = memory_ptr };
 
 		// Push the pointer onto the retire list, but don't execute any scan
-		array_stack_push(&hp_record->retire_list, &memory_ptr);
+		rig_smr_hp_retire_push(hp_record, &retired, 1);
+	}
+}
+
+/**
+ * Retire memory that has to be reclaimed by calling a destructor, instead
+ * of rig_mem_free(), once no HP references it anymore. This way any object,
+ * be it pooled, aligned or part of a bigger structure, can be reclaimed.
+ * The destructor runs in the thread that scans the retire list and may
+ * itself retire more memory.
+ *
+ * @param memory_ptr
+ *     pointer to retire, at least 4 byte aligned, NULL does nothing
+ * @param fn
+ *     destructor, called with memory_ptr and ctx, cannot be NULL
+ * @param ctx
+ *     context passed on to the destructor
+ */
+void rig_smr_hp_retire_fn(void *memory_ptr, void (*fn)(void *ptr, void *ctx), void *ctx) {
+	// If pointer is NULL, we do nothing at all, same as the standard free()
+	if (memory_ptr != NULL) {
+		NULLCHECK_EXIT(fn);
+		rig_acheck_msg(SMR_UNTAG(memory_ptr) == memory_ptr, "retired pointer not 4 byte aligned");
+
+		RIG_SMR_HP_Record hp_record = rig_smr_hp_record_get();
+		RIG_SMR_Retired retired[3];
+
+		retired[0].ptr = SMR_FN_TAG(memory_ptr);
+		retired[1].fn = fn;
+		retired[2].ptr = ctx;
+
+		rig_smr_hp_retire_push(hp_record, retired, 3);
+		rig_smr_hp_retire_check(hp_record);
+	}
+}
+
+void rig_smr_hp_pool_retire(void *memory_ptr) {
+	// Memory from the node pool is tagged, so that the scan gives it back there
+	if (memory_ptr != NULL) {
+		rig_smr_hp_mem_retire(SMR_POOL_TAG(memory_ptr));
+	}
+}
+
+void rig_smr_hp_pool_retire_noscan(void *memory_ptr) {
+	// Memory from the node pool is tagged, so that the scan gives it back there
+	if (memory_ptr != NULL) {
+		rig_smr_hp_mem_retire_noscan(SMR_POOL_TAG(memory_ptr));
+	}
+}
+
+/**
+ * Tune when retired memory gets scanned: a scan happens once a thread has
+ * retired factor * H pointers, H being the number of HPs of all live records,
+ * so that each scan frees at least (factor - 1) / factor of what it examines,
+ * and its cost stays constant per retired pointer whatever the thread count.
+ * Independently, a scan is forced once a thread holds back max_bytes bytes.
+ *
+ * @param factor
+ *     retired pointers per HP before a scan, 0 restores the default
+ * @param max_bytes
+ *     per-thread cap on unreclaimed bytes, 0 disables it
+ */
+void rig_smr_hp_threshold_set(size_t factor, size_t max_bytes) {
+	if (factor == 0) {
+		factor = RIG_SMR_HP_THRESHOLD_FACTOR;
+	}
+
+	atomic_ops_uint_store(&RIG_SMR_HP_Threshold_Factor, factor, ATOMIC_OPS_FENCE_NONE);
+	atomic_ops_uint_store(&RIG_SMR_HP_Max_Bytes, max_bytes, ATOMIC_OPS_FENCE_FULL);
+}
+
+static inline size_t rig_smr_hp_threshold_get(void) {
+	size_t factor = atomic_ops_uint_load(&RIG_SMR_HP_Threshold_Factor, ATOMIC_OPS_FENCE_NONE);
+	size_t hp_count = atomic_ops_uint_load(&RIG_SMR_HP_Live_Records, ATOMIC_OPS_FENCE_NONE) * RIG_SMR_HP_COUNT;
+
+	// Saturate instead of overflowing with absurd factors
+	if (hp_count > (SIZE_MAX / factor)) {
+		return (SIZE_MAX);
+	}
+
+	return (((factor * hp_count) > RIG_SMR_HP_THRESHOLD) ? (factor * hp_count) : (RIG_SMR_HP_THRESHOLD));
+}
+
+static inline void rig_smr_hp_retire_push(RIG_SMR_HP_Record hp_record, RIG_SMR_Retired *retired, size_t slots) {
+	// The retire list only ever grows, so that after a while pushing to it
+	// and scanning it don't need any more memory allocations
+	if ((hp_record->retire_count + slots) > hp_record->retire_size) {
+		size_t new_size = (hp_record->retire_size == 0) ? (RIG_SMR_HP_THRESHOLD) : (hp_record->retire_size * 2);
+		RIG_SMR_Retired *new_list;
+
+		if (hp_record->retire_list == NULL) {
+			new_list = rig_mem_alloc(0, new_size * sizeof(RIG_SMR_Retired));
+		}
+		else {
+			new_list = rig_mem_realloc(hp_record->retire_list, 0, new_size * sizeof(RIG_SMR_Retired));
+		}
+		NULLCHECK_EXIT(new_list);
+
+		hp_record->retire_list = new_list;
+		hp_record->retire_size = new_size;
+	}
+
+	memcpy(&hp_record->retire_list[hp_record->retire_count], retired, slots * sizeof(RIG_SMR_Retired));
+	hp_record->retire_count += slots;
+	hp_record->retire_bytes += SMR_MEM_SIZE(retired[0].ptr);
+}
+
+static inline void rig_smr_hp_retire_check(RIG_SMR_HP_Record hp_record) {
+	// Destructors called by a scan can retire memory, but the list is busy
+	if (hp_record->scanning) {
+		return;
+	}
+
+	// Scan if the retired pointers threshold was reached, or if the retire
+	// list holds back too much memory and something new was added to it
+	// since the last scan (what the last scan kept is still hazardous).
+	// With the reclaimer running, it gets the list to scan instead.
+	size_t max_bytes = atomic_ops_uint_load(&RIG_SMR_HP_Max_Bytes, ATOMIC_OPS_FENCE_NONE);
+
+	if ((hp_record->retire_count >= rig_smr_hp_threshold_get())
+	 || ((max_bytes != 0) && (hp_record->retire_bytes >= max_bytes)
+	  && (hp_record->retire_count > hp_record->scan_kept))) {
+		if (rig_smr_reclaimer_offload()) {
+			rig_smr_hp_handoff(hp_record);
+		}
+		else {
+			rig_smr_hp_mem_scan();
+		}
+	}
+}
+
+static void rig_smr_hp_handoff(RIG_SMR_HP_Record hp_record) {
+	// The retire list goes to the reclaimer as it is, and is replaced by
+	// a new one of the same size; if there's no memory for that, scan inline
+	RIG_SMR_HP_Block block = rig_mem_alloc(sizeof(*block), 0);
+	RIG_SMR_Retired *new_list = rig_mem_alloc(0, hp_record->retire_size * sizeof(RIG_SMR_Retired));
+
+	if ((block == NULL) || (new_list == NULL)) {
+		if (block != NULL) {
+			rig_mem_free(block);
+		}
+
+		if (new_list != NULL) {
+			rig_mem_free(new_list);
+		}
+
+		rig_smr_hp_mem_scan();
+		return;
+	}
+
+	block->header.reclaim = &rig_smr_hp_reclaim;
+	block->header.bytes = hp_record->retire_bytes;
+	block->retire_list = hp_record->retire_list;
+	block->retire_count = hp_record->retire_count;
+
+	hp_record->retire_list = new_list;
+	hp_record->retire_count = 0;
+	hp_record->retire_bytes = 0;
+	hp_record->scan_kept = 0;
+
+	rig_smr_reclaimer_handoff(&block->header);
+}
+
+static void rig_smr_hp_reclaim(RIG_SMR_Block block) {
+	RIG_SMR_HP_Block hp_block = (RIG_SMR_HP_Block)block;
+	RIG_SMR_HP_Record hp_record = rig_smr_hp_record_get();
+
+	// Take the pointers over into our own retire list, and scan it
+	for (size_t i = 0; i < hp_block->retire_count; ) {
+		size_t slots = SMR_RETIRED_SLOTS(hp_block->retire_list[i].ptr);
+
+		rig_smr_hp_retire_push(hp_record, &hp_block->retire_list[i], slots);
+		i += slots;
 	}
+
+	rig_mem_free(hp_block->retire_list);
+	rig_mem_free(hp_block);
+
+	rig_smr_hp_mem_scan();
+}
+
+static inline size_t rig_smr_hp_set_slot(void *ptr, size_t bits) {
+	// Fibonacci hashing: multiply and take the top bits, so that the alignment
+	// zeros in the low bits of the pointers don't matter
+#if SIZEOF_SIZE_T == 8
+	return ((size_t)(((uint64_t)(uintptr_t)ptr * UINT64_C(0x9E3779B97F4A7C15)) >> (64 - bits)));
+#else
+	return ((size_t)(((uint32_t)(uintptr_t)ptr * UINT32_C(0x9E3779B9)) >> (32 - bits)));
+#endif
 }
 
-static int rig_smr_hp_ptr_cmp(const void *a, const void *b) {
-	return ((*(const void * const *)a > *(const void * const *)b) - (*(const void * const *)a < *(const void * const *)b));
+static inline void rig_smr_hp_set_add(void **hp_set, size_t bits, void *ptr) {
+	size_t mask = ((size_t)1 << bits) - 1;
+	size_t slot = rig_smr_hp_set_slot(ptr, bits);
+
+	// Linear probing, the set is never more than half full
+	while ((hp_set[slot] != NULL) && (hp_set[slot] != ptr)) {
+		slot = (slot + 1) & mask;
+	}
+
+	hp_set[slot] = ptr;
+}
+
+static inline bool rig_smr_hp_set_contains(void **hp_set, size_t bits, void *ptr) {
+	size_t mask = ((size_t)1 << bits) - 1;
+	size_t slot = rig_smr_hp_set_slot(ptr, bits);
+
+	while (hp_set[slot] != NULL) {
+		if (hp_set[slot] == ptr) {
+			return (true);
+		}
+
+		slot = (slot + 1) & mask;
+	}
+
+	return (false);
+}
+
+static size_t rig_smr_hp_set_build(RIG_SMR_HP_Record hp_record) {
+	size_t hp_count;
+
+retry:
+	// Size the set so it's at most half full, given the HPs of all records,
+	// it's kept in the record and only has to grow when new records appear
+	hp_count = atomic_ops_uint_load(&RIG_SMR_HP_List_Length, ATOMIC_OPS_FENCE_ACQUIRE) * RIG_SMR_HP_COUNT;
+
+	if ((hp_record->hp_set == NULL) || ((hp_count * 2) > ((size_t)1 << hp_record->hp_set_bits))) {
+		size_t bits = RIG_SMR_HP_SET_MIN_BITS;
+
+		while ((hp_count * 2) > ((size_t)1 << bits)) {
+			bits++;
+		}
+
+		if (hp_record->hp_set != NULL) {
+			rig_mem_free(hp_record->hp_set);
+		}
+
+		hp_record->hp_set = rig_mem_alloc(0, ((size_t)1 << bits) * sizeof(void *));
+		NULLCHECK_EXIT(hp_record->hp_set);
+
+		hp_record->hp_set_bits = bits;
+	}
+
+	memset(hp_record->hp_set, 0, ((size_t)1 << hp_record->hp_set_bits) * sizeof(void *));
+
+	// Copy all hazard pointer values from active RIG_SMR_HP_Records
+	RIG_SMR_HP_Record curr = atomic_ops_ptr_load(&RIG_SMR_HP_List_Head, ATOMIC_OPS_FENCE_ACQUIRE);
+	size_t hp_set_len = 0, walked = 0;
+
+	while (curr != NULL) {
+		// Records added after the set was sized: start over with a bigger one
+		if (++walked > (hp_count / RIG_SMR_HP_COUNT)) {
+			goto retry;
+		}
+
+		if (atomic_ops_uint_load(&curr->in_use, ATOMIC_OPS_FENCE_ACQUIRE) == 1) {
+			for (size_t i = 0; i < RIG_SMR_HP_COUNT; i++) {
+				void *hp = atomic_ops_ptr_load(&curr->HP[i], ATOMIC_OPS_FENCE_NONE);
+
+				if (hp != NULL) {
+					rig_smr_hp_set_add(hp_record->hp_set, hp_record->hp_set_bits, hp);
+					hp_set_len++;
+				}
+			}
+		}
+
+		curr = curr->next;
+	}
+
+	return (hp_set_len);
+}
+
+static void rig_smr_hp_orphan(RIG_SMR_HP_Record hp_record) {
+	// If there's no memory for this, the pointers simply stay with the record,
+	// where the next thread using it, or rig_smr_hp_mem_scan_full(), finds them
+	RIG_SMR_HP_Block block = rig_mem_alloc(sizeof(*block), 0);
+
+	if (block == NULL) {
+		return;
+	}
+
+	block->header.reclaim = &rig_smr_hp_reclaim;
+	block->header.bytes = hp_record->retire_bytes;
+	block->retire_list = hp_record->retire_list;
+	block->retire_count = hp_record->retire_count;
+
+	hp_record->retire_list = NULL;
+	hp_record->retire_count = 0;
+	hp_record->retire_size = 0;
+	hp_record->retire_bytes = 0;
+	hp_record->scan_kept = 0;
+
+	while (true) {
+		RIG_SMR_Block head = atomic_ops_ptr_load(&RIG_SMR_HP_Orphans, ATOMIC_OPS_FENCE_NONE);
+
+		block->header.next = head;
+
+		if (atomic_ops_ptr_cas(&RIG_SMR_HP_Orphans, head, block, ATOMIC_OPS_FENCE_FULL)) {
+			break;
+		}
+	}
+}
+
+static void rig_smr_hp_adopt(RIG_SMR_HP_Record hp_record) {
+	RIG_SMR_HP_Block orphans;
+
+	// Take all orphaned retire lists at once, so there's no ABA problem
+	while (true) {
+		orphans = atomic_ops_ptr_load(&RIG_SMR_HP_Orphans, ATOMIC_OPS_FENCE_ACQUIRE);
+
+		if (orphans == NULL) {
+			return;
+		}
+
+		if (atomic_ops_ptr_cas(&RIG_SMR_HP_Orphans, orphans, NULL, ATOMIC_OPS_FENCE_FULL)) {
+			break;
+		}
+	}
+
+	while (orphans != NULL) {
+		RIG_SMR_HP_Block next = (RIG_SMR_HP_Block)orphans->header.next;
+
+		for (size_t i = 0; i < orphans->retire_count; ) {
+			size_t slots = SMR_RETIRED_SLOTS(orphans->retire_list[i].ptr);
+
+			rig_smr_hp_retire_push(hp_record, &orphans->retire_list[i], slots);
+			i += slots;
+		}
+
+		rig_mem_free(orphans->retire_list);
+		rig_mem_free(orphans);
+
+		orphans = next;
+	}
+}
+
+static bool rig_smr_hp_all_reclaimed(void) {
+	if (atomic_ops_ptr_load(&RIG_SMR_HP_Orphans, ATOMIC_OPS_FENCE_ACQUIRE) != NULL) {
+		return (false);
+	}
+
+	RIG_SMR_HP_Record curr = atomic_ops_ptr_load(&RIG_SMR_HP_List_Head, ATOMIC_OPS_FENCE_ACQUIRE);
+
+	while (curr != NULL) {
+		// Only unused records can be looked at, they have no more HPs set
+		if ((atomic_ops_uint_load(&curr->in_use, ATOMIC_OPS_FENCE_ACQUIRE) == 0) && (curr->retire_count != 0)) {
+			return (false);
+		}
+
+		curr = curr->next;
+	}
+
+	return (true);
 }
 
 void rig_smr_hp_mem_scan(void) {
@@ -216,88 +691,59 @@ void rig_smr_hp_mem_scan(void) {
 	// the pointers in the thread specific retire list into consideration here,
 	// for a more forceful/complete approach, see rig_smr_hp_mem_scan_full().
 	// Also check that we have pointers in retire list to actually check, as it's
-	// possible there are none, and that would trigger the zero-heap check.
-	if ((HP_Record != NULL) && (array_stack_count(&HP_Record->retire_list) != 0)) {
-		// Pop all pointers from the thread specific retire list
-		size_t tmp_retire_list_length = 0;
-		void **tmp_retire_list = rig_mem_alloc(0, array_stack_count(&HP_Record->retire_list) * sizeof(void *));
-		NULLCHECK_EXIT(tmp_retire_list);
-
-		void **ptr;
-		while ((ptr = array_stack_pop(&HP_Record->retire_list)) != NULL) {
-			tmp_retire_list[tmp_retire_list_length] = *ptr;
-			tmp_retire_list_length++;
-		}
-
-		// Get the global data
-		RIG_SMR_HP_Record curr = atomic_ops_ptr_load(&RIG_SMR_HP_List_Head, ATOMIC_OPS_FENCE_ACQUIRE);
-
-		// Copy all hazard pointer values from active RIG_SMR_HP_Records
-		size_t tmp_hp_list_len = 0;
-		void **tmp_hp_list = rig_mem_alloc(0, atomic_ops_uint_load(&RIG_SMR_HP_List_Length, ATOMIC_OPS_FENCE_NONE) * RIG_SMR_HP_COUNT * sizeof(void *));
-		NULLCHECK_EXIT(tmp_hp_list);
+	// possible there are none, and then there's no need to look at the HPs.
+	// The whole scan is O(H + R) and works in the record's own memory: the HPs
+	// go into a hash set, then the retire list is compacted in place.
+	// Destructors called from here can retire more memory, which gets appended
+	// to the list past the part being scanned and is kept for the next scan.
+	// Retire lists orphaned by threads that gave their record back are adopted first.
+	if ((HP_Record != NULL) && (!HP_Record->scanning)) {
+		rig_smr_hp_adopt(HP_Record);
+	}
 
-		while (curr != NULL) {
-			if (atomic_ops_uint_load(&curr->in_use, ATOMIC_OPS_FENCE_ACQUIRE) == 1) {
-				// UNROLLED LOOP FOLLOWS (based on RIG_SMR_HP_COUNT)
-				tmp_hp_list[tmp_hp_list_len] = atomic_ops_ptr_load(&curr->HP[0], ATOMIC_OPS_FENCE_NONE);
-				tmp_hp_list_len++;
-				tmp_hp_list[tmp_hp_list_len] = atomic_ops_ptr_load(&curr->HP[1], ATOMIC_OPS_FENCE_NONE);
-				tmp_hp_list_len++;
-				tmp_hp_list[tmp_hp_list_len] = atomic_ops_ptr_load(&curr->HP[2], ATOMIC_OPS_FENCE_NONE);
-				tmp_hp_list_len++;
-				tmp_hp_list[tmp_hp_list_len] = atomic_ops_ptr_load(&curr->HP[3], ATOMIC_OPS_FENCE_NONE);
-				tmp_hp_list_len++;
-				tmp_hp_list[tmp_hp_list_len] = atomic_ops_ptr_load(&curr->HP[4], ATOMIC_OPS_FENCE_NONE);
-				tmp_hp_list_len++;
-				tmp_hp_list[tmp_hp_list_len] = atomic_ops_ptr_load(&curr->HP[5], ATOMIC_OPS_FENCE_NONE);
-				tmp_hp_list_len++;
-				tmp_hp_list[tmp_hp_list_len] = atomic_ops_ptr_load(&curr->HP[6], ATOMIC_OPS_FENCE_NONE);
-				tmp_hp_list_len++;
-				tmp_hp_list[tmp_hp_list_len] = atomic_ops_ptr_load(&curr->HP[7], ATOMIC_OPS_FENCE_NONE);
-				tmp_hp_list_len++;
-			}
+	if ((HP_Record != NULL) && (HP_Record->retire_count != 0) && (!HP_Record->scanning)) {
+		HP_Record->scanning = true;
 
-			curr = curr->next;
-		}
+		// If there are no active HPs at all, we can just free everything
+		bool hazards = (rig_smr_hp_set_build(HP_Record) != 0);
 
-		// Save pointer to tmp_hp_list for later freeing, before it gets changed
-		void *tmp_hp_list_orig = tmp_hp_list;
+		// Lookup retire list values in the HP set, if not present, we can safely
+		// recycle the memory (free() it), else we keep it in the retire list
+		// for later scan passes to examine
+		size_t scan_end = HP_Record->retire_count;
+		size_t scan_bytes = HP_Record->retire_bytes;
+		size_t kept = 0;
+		size_t kept_bytes = 0;
 
-		// Sort values in tmp_hp_list for faster lookup later
-		qsort(tmp_hp_list, tmp_hp_list_len, sizeof(void *), &rig_smr_hp_ptr_cmp);
+		for (size_t i = 0; i < scan_end; ) {
+			// Copy the entry out, as a destructor pushing memory may move the list
+			RIG_SMR_Retired retired[3];
+			size_t slots = SMR_RETIRED_SLOTS(HP_Record->retire_list[i].ptr);
 
-		// Discard NULL values at the front, shrinking the size of tmp_hp_list as
-		// you go, if tmp_hp_list_len reaches 0, there are no active HPs at all left
-		while ((*tmp_hp_list == NULL) && (tmp_hp_list_len > 0)) {
-			tmp_hp_list++;
-			tmp_hp_list_len--;
-		}
+			memcpy(retired, &HP_Record->retire_list[i], slots * sizeof(RIG_SMR_Retired));
 
-		if (tmp_hp_list_len == 0) {
-			// If there are no active HPs at all, we can just free everything
-			// directly, as you can't find elements in an empty array!
-			for (size_t i = 0; i < tmp_retire_list_length; i++) {
-				rig_mem_free(tmp_retire_list[i]);
+			// HPs always hold the plain pointer, never the tagged one
+			if (hazards && rig_smr_hp_set_contains(HP_Record->hp_set, HP_Record->hp_set_bits, SMR_UNTAG(retired[0].ptr))) {
+				memmove(&HP_Record->retire_list[kept], retired, slots * sizeof(RIG_SMR_Retired));
+				kept += slots;
+				kept_bytes += SMR_MEM_SIZE(retired[0].ptr);
 			}
-		}
-		else {
-			// Lookup retire list values in tmp_hp_list, if not present, we can safely
-			// recycle the memory (free() it), else we re-add it back to the retire list
-			// for later scan passes to examine
-			for (size_t i = 0; i < tmp_retire_list_length; i++) {
-				if (bsearch(&tmp_retire_list[i], tmp_hp_list, tmp_hp_list_len, sizeof(void *), &rig_smr_hp_ptr_cmp) == NULL) {
-					rig_mem_free(tmp_retire_list[i]);
-				}
-				else {
-					array_stack_push(&HP_Record->retire_list, &tmp_retire_list[i]);
-				}
+			else {
+				SMR_RETIRED_FREE(retired);
 			}
+
+			i += slots;
 		}
 
-		// Free used resources
-		rig_mem_free(tmp_retire_list);
-		rig_mem_free(tmp_hp_list_orig);
+		// Move down whatever the destructors retired meanwhile
+		memmove(&HP_Record->retire_list[kept], &HP_Record->retire_list[scan_end],
+			(HP_Record->retire_count - scan_end) * sizeof(RIG_SMR_Retired));
+
+		HP_Record->retire_count = kept + (HP_Record->retire_count - scan_end);
+		HP_Record->retire_bytes = kept_bytes + (HP_Record->retire_bytes - scan_bytes);
+		HP_Record->scan_kept = kept;
+
+		HP_Record->scanning = false;
 	}
 }
 
@@ -328,6 +774,11 @@ void rig_smr_hp_mem_scan_full(void) {
 
 		// Set this so we can retire this record once finished
 		hp_record_borrowed = true;
+
+#if !defined(SYSTEM_TLS_SUPPORT)
+		// The scan works on the calling thread's record
+		rig_tls_set(RIG_SMR_HP_TLS_Key, HP_Record);
+#endif
 	}
 
 	// Lets search for other inactive RIG_SMR_HP_Records, lock them, pop their
@@ -338,11 +789,17 @@ void rig_smr_hp_mem_scan_full(void) {
 		if (atomic_ops_uint_load(&curr->in_use, ATOMIC_OPS_FENCE_ACQUIRE) == 0
 		 && atomic_ops_uint_cas(&curr->in_use, 0, 1, ATOMIC_OPS_FENCE_ACQUIRE)) {
 			// Locked it! Lets pop its pointers ...
-			void **ptr;
-			while ((ptr = array_stack_pop(&curr->retire_list)) != NULL) {
-				array_stack_push(&HP_Record->retire_list, ptr);
+			for (size_t i = 0; i < curr->retire_count; ) {
+				size_t slots = SMR_RETIRED_SLOTS(curr->retire_list[i].ptr);
+
+				rig_smr_hp_retire_push(HP_Record, &curr->retire_list[i], slots);
+				i += slots;
 			}
 
+			curr->retire_count = 0;
+			curr->retire_bytes = 0;
+			curr->scan_kept = 0;
+
 			atomic_ops_uint_store(&curr->in_use, 0, ATOMIC_OPS_FENCE_RELEASE);
 		}
 
@@ -359,9 +816,11 @@ void rig_smr_hp_mem_scan_full(void) {
 
 #if defined(SYSTEM_TLS_SUPPORT)
 		HP_Record = NULL;
+#else
+		rig_tls_set(RIG_SMR_HP_TLS_Key, NULL);
+#endif
 
 		atomic_ops_fence(ATOMIC_OPS_FENCE_FULL);
-#endif
 	}
 }
 
@@ -381,7 +840,8 @@ void rig_smr_hp_debug_info(bool print_list) {
 				printf("HP[%zu] = %p\n", i, atomic_ops_ptr_load(&curr->HP[i], ATOMIC_OPS_FENCE_NONE));
 			}
 
-			printf("retire list count = %zu\n", array_stack_count(&curr->retire_list));
+			printf("retire list count = %zu\n", curr->retire_count);
+			printf("retire list bytes = %zu\n", curr->retire_bytes);
 
 			printf("in_use = %zu\n\n", atomic_ops_uint_load(&curr->in_use, ATOMIC_OPS_FENCE_NONE));
 
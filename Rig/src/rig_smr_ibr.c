@@ -0,0 +1,826 @@
+/**
+ * This file is part of the Rig project.
+ *
+ * For the full copyright and license information, please view the COPYING
+ * file that was distributed with this source code.
+ *
+ * @copyright  (c) the Rig project
+ * @author     Luca Longinotti <chtekk@longitekk.com>
+ * @license    BSD 2-clause
+ * @version    $Id$
+ */
+
+#include "rig_internal.h"
+#include <atomic_ops.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Interval-Based Reclamation (2GE-IBR, Wen et al.)
+ *
+ * A global era advances with allocations and retirements. Node memory
+ * records the era it was allocated in (its birth era) in a small header,
+ * and the era it was retired in is stored along with it in the retire list.
+ * A thread in a critical section reserves the interval of eras [lower, upper]:
+ * lower is set once on entering, upper follows the global era, and is updated
+ * before a pointer read in a newer era can be used (rig_smr_ibr_protect()),
+ * which happens once per era change, not once per pointer like with HPs.
+ * Retired memory can be freed once its [birth, retire] interval doesn't
+ * intersect any reservation: a thread stalled inside a critical section only
+ * holds back what was alive while it was active, not everything retired
+ * after it stopped, as it would with epochs.
+ */
+
+#define RIG_SMR_IBR_THRESHOLD 64 // Minimum retired pointers before a scan, multiple of 32
+#define RIG_SMR_IBR_THRESHOLD_FACTOR 8 // Default k in R = k * N, N being the live records
+#define RIG_SMR_IBR_MAX_BYTES ((size_t)1 << 20) // Default per-thread cap on unreclaimed bytes (1 MiB)
+#define RIG_SMR_IBR_ERA_FREQUENCY 128 // Allocations and retirements per thread between era increments
+#define RIG_SMR_IBR_IDLE UINTPTR_MAX // Reservation of records not in a critical section
+#define RIG_SMR_IBR_HEADER sizeof(uintptr_t) // Birth era, in front of memory from rig_smr_ibr_pool_alloc()
+
+typedef struct rig_smr_ibr_retired {
+	RIG_SMR_Retired retired[3]; // Only entries retired with a destructor use all three
+	uintptr_t birth_era;
+	uintptr_t retire_era;
+} RIG_SMR_IBR_Retired;
+
+struct rig_smr_ibr_record {
+	atomic_ops_uint lower CACHELINE_ALIGNED; // Reservation, read by all scans
+	atomic_ops_uint upper;
+	atomic_ops_uint in_use;
+	size_t critical_section; // Nesting level, only the owner looks at it
+	size_t era_count; // Allocations and retirements since the last era increment
+	RIG_SMR_IBR_Retired *retire_list; // Retired pointers, owned by the thread using the record
+	size_t retire_count;
+	size_t retire_size;
+	size_t retire_bytes; // Bytes held back by the retire list
+	size_t scan_kept; // Entries still reserved at the end of the last scan
+	bool scanning; // Destructors may retire more memory, but not start a nested scan
+	uintptr_t *reservations; // Scratch space for scans: lower and upper of all active records
+	size_t reservations_size;
+	RIG_SMR_IBR_Record next;
+};
+
+typedef struct rig_smr_ibr_block *RIG_SMR_IBR_Block;
+
+// Retire list handed over to the reclaimer thread, or orphaned by a thread giving its record back
+struct rig_smr_ibr_block {
+	struct rig_smr_block header;
+	RIG_SMR_IBR_Retired *retire_list;
+	size_t retire_count;
+};
+
+static RIG_SMR_IBR_Record rig_smr_ibr_record_claim(void);
+static inline void rig_smr_ibr_era_tick(RIG_SMR_IBR_Record ibr_record) ATTR_ALWAYSINLINE;
+static inline size_t rig_smr_ibr_threshold_get(void) ATTR_ALWAYSINLINE;
+static inline void rig_smr_ibr_retire_push(RIG_SMR_IBR_Record ibr_record, RIG_SMR_IBR_Retired *retired) ATTR_ALWAYSINLINE;
+static void rig_smr_ibr_retire(RIG_SMR_IBR_Retired *retired);
+static inline void rig_smr_ibr_retire_check(RIG_SMR_IBR_Record ibr_record) ATTR_ALWAYSINLINE;
+static void rig_smr_ibr_handoff(RIG_SMR_IBR_Record ibr_record);
+static void rig_smr_ibr_reclaim(RIG_SMR_Block block);
+static void rig_smr_ibr_orphan(RIG_SMR_IBR_Record ibr_record);
+static void rig_smr_ibr_adopt(RIG_SMR_IBR_Record ibr_record);
+static size_t rig_smr_ibr_reservations_build(RIG_SMR_IBR_Record ibr_record);
+
+#if defined(SYSTEM_TLS_SUPPORT)
+	static SYSTEM_TLS_DECL RIG_SMR_IBR_Record IBR_Record = NULL;
+#else
+	static RIG_TLS RIG_SMR_IBR_TLS_Key = NULL;
+#endif
+
+static void rig_smr_ibr_construct(void) ATTR_CONSTRUCTOR;
+static void rig_smr_ibr_destruct(void) ATTR_DESTRUCTOR;
+
+static atomic_ops_uint RIG_SMR_IBR_Global_Era = ATOMIC_OPS_UINT_INIT(0);
+
+static atomic_ops_ptr  RIG_SMR_IBR_List_Head = ATOMIC_OPS_PTR_INIT(NULL);
+static atomic_ops_ptr  RIG_SMR_IBR_Orphans = ATOMIC_OPS_PTR_INIT(NULL);
+static atomic_ops_uint RIG_SMR_IBR_List_Length = ATOMIC_OPS_UINT_INIT(0);
+static atomic_ops_uint RIG_SMR_IBR_Live_Records = ATOMIC_OPS_UINT_INIT(0);
+static atomic_ops_uint RIG_SMR_IBR_Threshold_Factor = ATOMIC_OPS_UINT_INIT(RIG_SMR_IBR_THRESHOLD_FACTOR);
+static atomic_ops_uint RIG_SMR_IBR_Max_Bytes = ATOMIC_OPS_UINT_INIT(RIG_SMR_IBR_MAX_BYTES);
+
+static void rig_smr_ibr_construct(void) {
+	// Retired memory may come from the node pool, which must outlive our destructor
+	rig_mem_pool_ref();
+
+#if !defined(SYSTEM_TLS_SUPPORT)
+	// The TLS key must be initialized only once, only one thread can get here
+	RIG_SMR_IBR_TLS_Key = rig_tls_init();
+	NULLCHECK_EXIT(RIG_SMR_IBR_TLS_Key);
+#endif
+}
+
+static void rig_smr_ibr_destruct(void) {
+	// Nothing may run in the background anymore
+	rig_smr_reclaimer_shutdown();
+
+	// Give back our own record, then check if other threads still use theirs
+	rig_smr_ibr_record_release();
+
+	RIG_SMR_IBR_Record curr = atomic_ops_ptr_load(&RIG_SMR_IBR_List_Head, ATOMIC_OPS_FENCE_ACQUIRE);
+
+	while (curr != NULL) {
+		if (atomic_ops_uint_load(&curr->in_use, ATOMIC_OPS_FENCE_ACQUIRE) == 1) {
+			break;
+		}
+
+		curr = curr->next;
+	}
+
+	if (curr == NULL) {
+		// Nobody holds a reservation anymore, so scanning frees everything; take over
+		// what's left in the unused records and the orphans, and repeat until the
+		// destructors called by the scans stop retiring more, then free the records
+		RIG_SMR_IBR_Record ibr_record = rig_smr_ibr_record_get();
+
+		do {
+			curr = atomic_ops_ptr_load(&RIG_SMR_IBR_List_Head, ATOMIC_OPS_FENCE_ACQUIRE);
+
+			while (curr != NULL) {
+				if ((curr != ibr_record) && (curr->retire_count != 0)) {
+					for (size_t i = 0; i < curr->retire_count; i++) {
+						rig_smr_ibr_retire_push(ibr_record, &curr->retire_list[i]);
+					}
+
+					curr->retire_count = 0;
+					curr->retire_bytes = 0;
+					curr->scan_kept = 0;
+				}
+
+				curr = curr->next;
+			}
+
+			rig_smr_ibr_mem_scan();
+		} while ((ibr_record->retire_count != 0) || (atomic_ops_ptr_load(&RIG_SMR_IBR_Orphans, ATOMIC_OPS_FENCE_ACQUIRE) != NULL));
+
+#if defined(SYSTEM_TLS_SUPPORT)
+		IBR_Record = NULL;
+#else
+		rig_tls_set(RIG_SMR_IBR_TLS_Key, NULL);
+#endif
+
+		curr = atomic_ops_ptr_load(&RIG_SMR_IBR_List_Head, ATOMIC_OPS_FENCE_ACQUIRE);
+
+		atomic_ops_ptr_store(&RIG_SMR_IBR_List_Head, NULL, ATOMIC_OPS_FENCE_NONE);
+		atomic_ops_uint_store(&RIG_SMR_IBR_List_Length, 0, ATOMIC_OPS_FENCE_NONE);
+		atomic_ops_uint_store(&RIG_SMR_IBR_Live_Records, 0, ATOMIC_OPS_FENCE_FULL);
+
+		while (curr != NULL) {
+			RIG_SMR_IBR_Record next = curr->next;
+
+			rig_acheck_msg(curr->critical_section == 0, "critical section of an unused record still open");
+
+			if (curr->retire_list != NULL) {
+				rig_mem_free(curr->retire_list);
+			}
+
+			if (curr->reservations != NULL) {
+				rig_mem_free(curr->reservations);
+			}
+
+			rig_mem_free_aligned(curr);
+
+			curr = next;
+		}
+	}
+
+#if !defined(SYSTEM_TLS_SUPPORT)
+	rig_tls_destroy(&RIG_SMR_IBR_TLS_Key);
+#endif
+
+	rig_mem_pool_unref();
+}
+
+
+static RIG_SMR_IBR_Record rig_smr_ibr_record_claim(void) {
+	// Let's search if there's any old record lying around
+	RIG_SMR_IBR_Record ibr_record = atomic_ops_ptr_load(&RIG_SMR_IBR_List_Head, ATOMIC_OPS_FENCE_NONE);
+
+	while (ibr_record != NULL) {
+		if (atomic_ops_uint_load(&ibr_record->in_use, ATOMIC_OPS_FENCE_ACQUIRE) == 0
+		 && atomic_ops_uint_cas(&ibr_record->in_use, 0, 1, ATOMIC_OPS_FENCE_ACQUIRE)) {
+			// Got it!
+			break;
+		}
+
+		ibr_record = ibr_record->next;
+	}
+
+	// Didn't find an old record, need to allocate one myself
+	if (ibr_record == NULL) {
+		ibr_record = rig_mem_alloc_aligned(sizeof(*ibr_record), 0, CACHELINE_SIZE, 0);
+		if (ibr_record == NULL) {
+			return (NULL);
+		}
+
+		// Initialize values
+		atomic_ops_uint_store(&ibr_record->lower, RIG_SMR_IBR_IDLE, ATOMIC_OPS_FENCE_NONE);
+		atomic_ops_uint_store(&ibr_record->upper, RIG_SMR_IBR_IDLE, ATOMIC_OPS_FENCE_NONE);
+
+		ibr_record->critical_section = 0;
+		ibr_record->era_count = 0;
+		ibr_record->retire_list = NULL;
+		ibr_record->retire_count = 0;
+		ibr_record->retire_size = 0;
+		ibr_record->retire_bytes = 0;
+		ibr_record->scan_kept = 0;
+		ibr_record->scanning = false;
+		ibr_record->reservations = NULL;
+		ibr_record->reservations_size = 0;
+
+		atomic_ops_uint_store(&ibr_record->in_use, 1, ATOMIC_OPS_FENCE_NONE);
+
+		// Link the new RIG_SMR_IBR_Record into the main RIG_SMR_IBR_List
+		atomic_ops_uint_inc(&RIG_SMR_IBR_List_Length, ATOMIC_OPS_FENCE_FULL);
+
+		while (true) {
+			RIG_SMR_IBR_Record head = atomic_ops_ptr_load(&RIG_SMR_IBR_List_Head, ATOMIC_OPS_FENCE_NONE);
+
+			ibr_record->next = head;
+
+			if (atomic_ops_ptr_cas(&RIG_SMR_IBR_List_Head, head, ibr_record, ATOMIC_OPS_FENCE_FULL)) {
+				break;
+			}
+		}
+	}
+
+	// Live records determine the retire threshold
+	atomic_ops_uint_inc(&RIG_SMR_IBR_Live_Records, ATOMIC_OPS_FENCE_NONE);
+
+	return (ibr_record);
+}
+
+RIG_SMR_IBR_Record rig_smr_ibr_record_get(void) {
+#if !defined(SYSTEM_TLS_SUPPORT)
+	RIG_SMR_IBR_Record IBR_Record = rig_tls_get(RIG_SMR_IBR_TLS_Key);
+#endif
+
+	// If IBR_Record == NULL, this thread has not registered any RIG_SMR_IBR_Record structure
+	if (IBR_Record == NULL) {
+		IBR_Record = rig_smr_ibr_record_claim();
+		NULLCHECK_EXIT(IBR_Record);
+
+#if !defined(SYSTEM_TLS_SUPPORT)
+		// Set the thread specific value correctly
+		rig_tls_set(RIG_SMR_IBR_TLS_Key, IBR_Record);
+#endif
+	}
+
+	return (IBR_Record);
+}
+
+void rig_smr_ibr_record_release(void) {
+#if !defined(SYSTEM_TLS_SUPPORT)
+	RIG_SMR_IBR_Record IBR_Record = rig_tls_get(RIG_SMR_IBR_TLS_Key);
+#endif
+
+	if (IBR_Record != NULL) {
+		rig_acheck_msg(IBR_Record->critical_section == 0, "unclosed critical section (perhaps incorrect recursion?)");
+
+		// Try to free what you can, what's left is still reserved by other
+		// threads, and goes to the orphans, for active threads to adopt
+		rig_smr_ibr_mem_scan();
+
+		if (IBR_Record->retire_count != 0) {
+			rig_smr_ibr_orphan(IBR_Record);
+		}
+
+		atomic_ops_uint_dec(&RIG_SMR_IBR_Live_Records, ATOMIC_OPS_FENCE_NONE);
+
+		atomic_ops_uint_store(&IBR_Record->in_use, 0, ATOMIC_OPS_FENCE_RELEASE);
+
+#if defined(SYSTEM_TLS_SUPPORT)
+		IBR_Record = NULL;
+#else
+		rig_tls_set(RIG_SMR_IBR_TLS_Key, NULL);
+#endif
+
+		atomic_ops_fence(ATOMIC_OPS_FENCE_FULL);
+	}
+}
+
+/**
+ * Enter a critical section: from here until rig_smr_ibr_critical_exit(),
+ * memory reached through pointers read inside it can't be freed, as long as
+ * each pointer read is followed by rig_smr_ibr_protect().
+ * Critical sections can be nested.
+ *
+ * @return
+ *     the calling thread's record, to pass to rig_smr_ibr_protect()
+ */
+RIG_SMR_IBR_Record rig_smr_ibr_critical_enter(void) {
+	RIG_SMR_IBR_Record ibr_record = rig_smr_ibr_record_get();
+
+	if (ibr_record->critical_section >= 1) {
+		ibr_record->critical_section++;
+		return (ibr_record);
+	}
+
+	ibr_record->critical_section = 1;
+
+	// upper first, so that scans never see a lower without a valid upper
+	uintptr_t era = atomic_ops_uint_load(&RIG_SMR_IBR_Global_Era, ATOMIC_OPS_FENCE_ACQUIRE);
+
+	atomic_ops_uint_store(&ibr_record->upper, era, ATOMIC_OPS_FENCE_NONE);
+	atomic_ops_uint_store(&ibr_record->lower, era, ATOMIC_OPS_FENCE_FULL);
+
+	return (ibr_record);
+}
+
+void rig_smr_ibr_critical_exit(void) {
+	RIG_SMR_IBR_Record ibr_record = rig_smr_ibr_record_get();
+
+	rig_acheck_msg(ibr_record->critical_section >= 1, "exiting from critical section that was never entered");
+
+	if (ibr_record->critical_section > 1) {
+		ibr_record->critical_section--;
+		return;
+	}
+
+	ibr_record->critical_section = 0;
+
+	// Clearing lower is what makes scans ignore the record
+	atomic_ops_uint_store(&ibr_record->lower, RIG_SMR_IBR_IDLE, ATOMIC_OPS_FENCE_FULL);
+	atomic_ops_uint_store(&ibr_record->upper, RIG_SMR_IBR_IDLE, ATOMIC_OPS_FENCE_RELEASE);
+
+	// What was retired inside the critical section only gets checked now,
+	// as our own reservation would have kept most of it anyway
+	rig_smr_ibr_retire_check(ibr_record);
+}
+
+/**
+ * Protect the memory a pointer, just read inside a critical section, points
+ * to: if the global era didn't change since the reservation was last updated,
+ * the memory was allocated in a reserved era and nothing has to be done.
+ * Else the reservation is extended to the current era, and the pointer has to
+ * be read, and validated, again, followed by another call to this function.
+ *
+ * @param ibr_record
+ *     record returned by rig_smr_ibr_critical_enter()
+ *
+ * @return
+ *     true if the pointer can be used, false if it has to be read again
+ */
+bool rig_smr_ibr_protect(RIG_SMR_IBR_Record ibr_record) {
+	NULLCHECK_EXIT(ibr_record);
+
+	uintptr_t era = atomic_ops_uint_load(&RIG_SMR_IBR_Global_Era, ATOMIC_OPS_FENCE_ACQUIRE);
+
+	if (atomic_ops_uint_load(&ibr_record->upper, ATOMIC_OPS_FENCE_NONE) == era) {
+		return (true);
+	}
+
+	atomic_ops_uint_store(&ibr_record->upper, era, ATOMIC_OPS_FENCE_FULL);
+
+	return (false);
+}
+
+static inline void rig_smr_ibr_era_tick(RIG_SMR_IBR_Record ibr_record) {
+	// The era has to advance even while some thread is stalled in a critical
+	// section, else what's retired later would still intersect its reservation
+	if (++ibr_record->era_count == RIG_SMR_IBR_ERA_FREQUENCY) {
+		ibr_record->era_count = 0;
+
+		atomic_ops_uint_inc(&RIG_SMR_IBR_Global_Era, ATOMIC_OPS_FENCE_FULL);
+	}
+}
+
+/**
+ * Allocate node memory from the calling thread's node pool, marked with the
+ * current era, so that it can be retired with rig_smr_ibr_pool_retire().
+ * Memory that never became visible to other threads can be given back
+ * directly with rig_smr_ibr_pool_free().
+ *
+ * @param size
+ *     size to allocate, between 1 and RIG_MEM_POOL_MAX - sizeof(uintptr_t)
+ *
+ * @return
+ *     pointer to memory (aligned to sizeof(uintptr_t)), NULL on error.
+ *     On error, the following error codes are set:
+ *     - EINVAL (invalid size passed)
+ *     - ENOMEM (insufficient memory)
+ */
+void *rig_smr_ibr_pool_alloc(size_t size) {
+	if ((size == 0) || (size > (RIG_MEM_POOL_MAX - RIG_SMR_IBR_HEADER))) {
+		ERRET(EINVAL, NULL);
+	}
+
+	uintptr_t *memory_ptr = rig_mem_pool_alloc(size + RIG_SMR_IBR_HEADER);
+	NULLCHECK_ERRET(memory_ptr, ENOMEM, NULL);
+
+	rig_smr_ibr_era_tick(rig_smr_ibr_record_get());
+
+	memory_ptr[0] = atomic_ops_uint_load(&RIG_SMR_IBR_Global_Era, ATOMIC_OPS_FENCE_ACQUIRE);
+
+	return (&memory_ptr[1]);
+}
+
+void rig_smr_ibr_pool_free(void *memory_ptr) {
+	if (memory_ptr != NULL) {
+		rig_mem_pool_free((uintptr_t *)memory_ptr - 1);
+	}
+}
+
+void rig_smr_ibr_mem_retire(void *memory_ptr) {
+	// If pointer is NULL, we do nothing at all, same as the standard free()
+	if (memory_ptr != NULL) {
+		// Not allocated by us, so it might have been born in any era
+		RIG_SMR_IBR_Retired retired = { .retired[0].ptr = memory_ptr, .birth_era = 0 };
+
+		rig_smr_ibr_retire(&retired);
+	}
+}
+
+/**
+ * Retire memory that has to be reclaimed by calling a destructor, instead
+ * of rig_mem_free(), once no reservation intersects its lifetime anymore.
+ * As its allocation era is unknown, it's considered to be alive since the
+ * first one, like all memory retired with rig_smr_ibr_mem_retire(). The
+ * destructor runs in the thread that scans the retire list and may itself
+ * retire more memory.
+ *
+ * @param memory_ptr
+ *     pointer to retire, at least 4 byte aligned, NULL does nothing
+ * @param fn
+ *     destructor, called with memory_ptr and ctx, cannot be NULL
+ * @param ctx
+ *     context passed on to the destructor
+ */
+void rig_smr_ibr_retire_fn(void *memory_ptr, void (*fn)(void *ptr, void *ctx), void *ctx) {
+	// If pointer is NULL, we do nothing at all, same as the standard free()
+	if (memory_ptr != NULL) {
+		NULLCHECK_EXIT(fn);
+		rig_acheck_msg(SMR_UNTAG(memory_ptr) == memory_ptr, "retired pointer not 4 byte aligned");
+
+		RIG_SMR_IBR_Retired retired;
+
+		retired.retired[0].ptr = SMR_FN_TAG(memory_ptr);
+		retired.retired[1].fn = fn;
+		retired.retired[2].ptr = ctx;
+		retired.birth_era = 0;
+
+		rig_smr_ibr_retire(&retired);
+	}
+}
+
+void rig_smr_ibr_pool_retire(void *memory_ptr) {
+	// Memory from rig_smr_ibr_pool_alloc(), its birth era is right in front of it,
+	// and what goes back to the node pool is the whole thing
+	if (memory_ptr != NULL) {
+		uintptr_t *pool_ptr = (uintptr_t *)memory_ptr - 1;
+		RIG_SMR_IBR_Retired retired = { .retired[0].ptr = SMR_POOL_TAG(pool_ptr), .birth_era = pool_ptr[0] };
+
+		rig_smr_ibr_retire(&retired);
+	}
+}
+
+/**
+ * Tune when retired memory gets scanned: a scan happens once a thread has
+ * retired factor * N pointers, N being the number of live records, as a scan
+ * has to look at the reservations of all of them. Independently, a scan is
+ * forced once a thread holds back max_bytes bytes.
+ *
+ * @param factor
+ *     retired pointers per live record before a scan, 0 restores the default
+ * @param max_bytes
+ *     per-thread cap on unreclaimed bytes, 0 disables it
+ */
+void rig_smr_ibr_threshold_set(size_t factor, size_t max_bytes) {
+	if (factor == 0) {
+		factor = RIG_SMR_IBR_THRESHOLD_FACTOR;
+	}
+
+	atomic_ops_uint_store(&RIG_SMR_IBR_Threshold_Factor, factor, ATOMIC_OPS_FENCE_NONE);
+	atomic_ops_uint_store(&RIG_SMR_IBR_Max_Bytes, max_bytes, ATOMIC_OPS_FENCE_FULL);
+}
+
+static inline size_t rig_smr_ibr_threshold_get(void) {
+	size_t factor = atomic_ops_uint_load(&RIG_SMR_IBR_Threshold_Factor, ATOMIC_OPS_FENCE_NONE);
+	size_t records = atomic_ops_uint_load(&RIG_SMR_IBR_Live_Records, ATOMIC_OPS_FENCE_NONE);
+
+	// Saturate instead of overflowing with absurd factors
+	if (records > (SIZE_MAX / factor)) {
+		return (SIZE_MAX);
+	}
+
+	return (((factor * records) > RIG_SMR_IBR_THRESHOLD) ? (factor * records) : (RIG_SMR_IBR_THRESHOLD));
+}
+
+static inline void rig_smr_ibr_retire_push(RIG_SMR_IBR_Record ibr_record, RIG_SMR_IBR_Retired *retired) {
+	// The retire list only ever grows, so that after a while pushing to it
+	// and scanning it don't need any more memory allocations
+	if (ibr_record->retire_count == ibr_record->retire_size) {
+		size_t new_size = (ibr_record->retire_size == 0) ? (RIG_SMR_IBR_THRESHOLD) : (ibr_record->retire_size * 2);
+		RIG_SMR_IBR_Retired *new_list;
+
+		if (ibr_record->retire_list == NULL) {
+			new_list = rig_mem_alloc(0, new_size * sizeof(RIG_SMR_IBR_Retired));
+		}
+		else {
+			new_list = rig_mem_realloc(ibr_record->retire_list, 0, new_size * sizeof(RIG_SMR_IBR_Retired));
+		}
+		NULLCHECK_EXIT(new_list);
+
+		ibr_record->retire_list = new_list;
+		ibr_record->retire_size = new_size;
+	}
+
+	ibr_record->retire_list[ibr_record->retire_count++] = *retired;
+	ibr_record->retire_bytes += SMR_MEM_SIZE(retired->retired[0].ptr);
+}
+
+static void rig_smr_ibr_retire(RIG_SMR_IBR_Retired *retired) {
+	RIG_SMR_IBR_Record ibr_record = rig_smr_ibr_record_get();
+
+	// The retire era is read after the memory was made unreachable, so
+	// any thread that could still reach it has a lower at or before it
+	rig_smr_ibr_era_tick(ibr_record);
+
+	retired->retire_era = atomic_ops_uint_load(&RIG_SMR_IBR_Global_Era, ATOMIC_OPS_FENCE_FULL);
+
+	rig_smr_ibr_retire_push(ibr_record, retired);
+
+	// Inside a critical section the check waits for its end
+	if (ibr_record->critical_section == 0) {
+		rig_smr_ibr_retire_check(ibr_record);
+	}
+}
+
+static inline void rig_smr_ibr_retire_check(RIG_SMR_IBR_Record ibr_record) {
+	// Destructors called by a scan can retire memory, but the list is busy
+	if (ibr_record->scanning) {
+		return;
+	}
+
+	// Scan if the retired pointers threshold was reached, or if the retire
+	// list holds back too much memory and something new was added to it
+	// since the last scan (what the last scan kept is still reserved).
+	// With the reclaimer running, it gets the list to scan instead.
+	size_t max_bytes = atomic_ops_uint_load(&RIG_SMR_IBR_Max_Bytes, ATOMIC_OPS_FENCE_NONE);
+
+	if ((ibr_record->retire_count >= rig_smr_ibr_threshold_get())
+	 || ((max_bytes != 0) && (ibr_record->retire_bytes >= max_bytes)
+	  && (ibr_record->retire_count > ibr_record->scan_kept))) {
+		if (rig_smr_reclaimer_offload()) {
+			rig_smr_ibr_handoff(ibr_record);
+		}
+		else {
+			rig_smr_ibr_mem_scan();
+		}
+	}
+}
+
+static void rig_smr_ibr_handoff(RIG_SMR_IBR_Record ibr_record) {
+	// The retire list goes to the reclaimer as it is, and is replaced by
+	// a new one of the same size; if there's no memory for that, scan inline
+	RIG_SMR_IBR_Block block = rig_mem_alloc(sizeof(*block), 0);
+	RIG_SMR_IBR_Retired *new_list = rig_mem_alloc(0, ibr_record->retire_size * sizeof(RIG_SMR_IBR_Retired));
+
+	if ((block == NULL) || (new_list == NULL)) {
+		if (block != NULL) {
+			rig_mem_free(block);
+		}
+
+		if (new_list != NULL) {
+			rig_mem_free(new_list);
+		}
+
+		rig_smr_ibr_mem_scan();
+		return;
+	}
+
+	block->header.reclaim = &rig_smr_ibr_reclaim;
+	block->header.bytes = ibr_record->retire_bytes;
+	block->retire_list = ibr_record->retire_list;
+	block->retire_count = ibr_record->retire_count;
+
+	ibr_record->retire_list = new_list;
+	ibr_record->retire_count = 0;
+	ibr_record->retire_bytes = 0;
+	ibr_record->scan_kept = 0;
+
+	rig_smr_reclaimer_handoff(&block->header);
+}
+
+static void rig_smr_ibr_reclaim(RIG_SMR_Block block) {
+	RIG_SMR_IBR_Block ibr_block = (RIG_SMR_IBR_Block)block;
+	RIG_SMR_IBR_Record ibr_record = rig_smr_ibr_record_get();
+
+	// Take the entries over into our own retire list, and scan it
+	for (size_t i = 0; i < ibr_block->retire_count; i++) {
+		rig_smr_ibr_retire_push(ibr_record, &ibr_block->retire_list[i]);
+	}
+
+	rig_mem_free(ibr_block->retire_list);
+	rig_mem_free(ibr_block);
+
+	rig_smr_ibr_mem_scan();
+}
+
+static void rig_smr_ibr_orphan(RIG_SMR_IBR_Record ibr_record) {
+	// If there's no memory for this, the entries simply stay with the record,
+	// where the next thread using it finds them
+	RIG_SMR_IBR_Block block = rig_mem_alloc(sizeof(*block), 0);
+
+	if (block == NULL) {
+		return;
+	}
+
+	block->header.reclaim = &rig_smr_ibr_reclaim;
+	block->header.bytes = ibr_record->retire_bytes;
+	block->retire_list = ibr_record->retire_list;
+	block->retire_count = ibr_record->retire_count;
+
+	ibr_record->retire_list = NULL;
+	ibr_record->retire_count = 0;
+	ibr_record->retire_size = 0;
+	ibr_record->retire_bytes = 0;
+	ibr_record->scan_kept = 0;
+
+	while (true) {
+		RIG_SMR_Block head = atomic_ops_ptr_load(&RIG_SMR_IBR_Orphans, ATOMIC_OPS_FENCE_NONE);
+
+		block->header.next = head;
+
+		if (atomic_ops_ptr_cas(&RIG_SMR_IBR_Orphans, head, block, ATOMIC_OPS_FENCE_FULL)) {
+			break;
+		}
+	}
+}
+
+static void rig_smr_ibr_adopt(RIG_SMR_IBR_Record ibr_record) {
+	RIG_SMR_IBR_Block orphans;
+
+	// Take all orphaned retire lists at once, so there's no ABA problem
+	while (true) {
+		orphans = atomic_ops_ptr_load(&RIG_SMR_IBR_Orphans, ATOMIC_OPS_FENCE_ACQUIRE);
+
+		if (orphans == NULL) {
+			return;
+		}
+
+		if (atomic_ops_ptr_cas(&RIG_SMR_IBR_Orphans, orphans, NULL, ATOMIC_OPS_FENCE_FULL)) {
+			break;
+		}
+	}
+
+	while (orphans != NULL) {
+		RIG_SMR_IBR_Block next = (RIG_SMR_IBR_Block)orphans->header.next;
+
+		for (size_t i = 0; i < orphans->retire_count; i++) {
+			rig_smr_ibr_retire_push(ibr_record, &orphans->retire_list[i]);
+		}
+
+		rig_mem_free(orphans->retire_list);
+		rig_mem_free(orphans);
+
+		orphans = next;
+	}
+}
+
+static size_t rig_smr_ibr_reservations_build(RIG_SMR_IBR_Record ibr_record) {
+	size_t records;
+
+retry:
+	// Room for the reservations of all records, it's kept in the record
+	// and only has to grow when new records appear
+	records = atomic_ops_uint_load(&RIG_SMR_IBR_List_Length, ATOMIC_OPS_FENCE_ACQUIRE);
+
+	if ((records * 2) > ibr_record->reservations_size) {
+		if (ibr_record->reservations != NULL) {
+			rig_mem_free(ibr_record->reservations);
+		}
+
+		ibr_record->reservations = rig_mem_alloc(0, records * 2 * sizeof(uintptr_t));
+		NULLCHECK_EXIT(ibr_record->reservations);
+
+		ibr_record->reservations_size = records * 2;
+	}
+
+	// Copy the reservations of all records currently in a critical section
+	RIG_SMR_IBR_Record curr = atomic_ops_ptr_load(&RIG_SMR_IBR_List_Head, ATOMIC_OPS_FENCE_ACQUIRE);
+	size_t reservations_len = 0, walked = 0;
+
+	while (curr != NULL) {
+		// Records added after the space was sized: start over with more
+		if (++walked > records) {
+			goto retry;
+		}
+
+		// lower first: a valid one is always followed by a valid upper, at worst
+		// an idle one if the record just left, which reserves more, not less
+		uintptr_t lower = atomic_ops_uint_load(&curr->lower, ATOMIC_OPS_FENCE_ACQUIRE);
+
+		if (lower != RIG_SMR_IBR_IDLE) {
+			ibr_record->reservations[reservations_len++] = lower;
+			ibr_record->reservations[reservations_len++] = atomic_ops_uint_load(&curr->upper, ATOMIC_OPS_FENCE_ACQUIRE);
+		}
+
+		curr = curr->next;
+	}
+
+	return (reservations_len);
+}
+
+void rig_smr_ibr_mem_scan(void) {
+#if !defined(SYSTEM_TLS_SUPPORT)
+	RIG_SMR_IBR_Record IBR_Record = rig_tls_get(RIG_SMR_IBR_TLS_Key);
+#endif
+
+	// We only scan if the RIG_SMR_IBR_Record is defined, and only the
+	// calling thread's retire list. Retire lists orphaned by threads that
+	// gave their record back are adopted first.
+	// An entry can be freed if no reservation intersects its [birth, retire]
+	// interval; most entries are outside of the span of all reservations,
+	// and are freed without looking at each reservation in turn.
+	// Destructors called from here can retire more memory, which gets appended
+	// to the list past the part being scanned and is kept for the next scan.
+	if ((IBR_Record != NULL) && (!IBR_Record->scanning)) {
+		rig_smr_ibr_adopt(IBR_Record);
+	}
+
+	if ((IBR_Record != NULL) && (IBR_Record->retire_count != 0) && (!IBR_Record->scanning)) {
+		IBR_Record->scanning = true;
+
+		size_t reservations_len = rig_smr_ibr_reservations_build(IBR_Record);
+		uintptr_t min_lower = RIG_SMR_IBR_IDLE, max_upper = 0;
+
+		for (size_t j = 0; j < reservations_len; j += 2) {
+			if (IBR_Record->reservations[j] < min_lower) {
+				min_lower = IBR_Record->reservations[j];
+			}
+
+			if (IBR_Record->reservations[j + 1] > max_upper) {
+				max_upper = IBR_Record->reservations[j + 1];
+			}
+		}
+
+		size_t scan_end = IBR_Record->retire_count;
+		size_t scan_bytes = IBR_Record->retire_bytes;
+		size_t kept = 0;
+		size_t kept_bytes = 0;
+
+		for (size_t i = 0; i < scan_end; i++) {
+			// Copy the entry out, as a destructor pushing memory may move the list
+			RIG_SMR_IBR_Retired retired = IBR_Record->retire_list[i];
+			bool reserved = false;
+
+			if ((retired.retire_era >= min_lower) && (retired.birth_era <= max_upper)) {
+				for (size_t j = 0; j < reservations_len; j += 2) {
+					if ((IBR_Record->reservations[j] <= retired.retire_era)
+					 && (IBR_Record->reservations[j + 1] >= retired.birth_era)) {
+						reserved = true;
+						break;
+					}
+				}
+			}
+
+			if (reserved) {
+				IBR_Record->retire_list[kept++] = retired;
+				kept_bytes += SMR_MEM_SIZE(retired.retired[0].ptr);
+			}
+			else {
+				SMR_RETIRED_FREE(retired.retired);
+			}
+		}
+
+		// Move down whatever the destructors retired meanwhile
+		memmove(&IBR_Record->retire_list[kept], &IBR_Record->retire_list[scan_end],
+			(IBR_Record->retire_count - scan_end) * sizeof(RIG_SMR_IBR_Retired));
+
+		IBR_Record->retire_count = kept + (IBR_Record->retire_count - scan_end);
+		IBR_Record->retire_bytes = kept_bytes + (IBR_Record->retire_bytes - scan_bytes);
+		IBR_Record->scan_kept = kept;
+
+		IBR_Record->scanning = false;
+	}
+}
+
+void rig_smr_ibr_debug_info(bool print_list) {
+	RIG_SMR_IBR_Record curr = atomic_ops_ptr_load(&RIG_SMR_IBR_List_Head, ATOMIC_OPS_FENCE_ACQUIRE);
+
+	printf("SMR_IBR global Era = %zu\n\n",
+		atomic_ops_uint_load(&RIG_SMR_IBR_Global_Era, ATOMIC_OPS_FENCE_NONE));
+
+	printf("SMR_IBR list head address: %p\n", (void *)&RIG_SMR_IBR_List_Head);
+	printf("SMR_IBR list head value: %p\n", (void *)curr);
+	printf("SMR_IBR list length address: %p\n", (void *)&RIG_SMR_IBR_List_Length);
+	printf("SMR_IBR list length value: %zu\n\n", atomic_ops_uint_load(&RIG_SMR_IBR_List_Length, ATOMIC_OPS_FENCE_NONE));
+
+	if (print_list) {
+		while (curr != NULL) {
+			printf("== SMR_IBR_Record at %p ==\n", (void *)curr);
+
+			printf("lower = %zu\n", atomic_ops_uint_load(&curr->lower, ATOMIC_OPS_FENCE_NONE));
+			printf("upper = %zu\n", atomic_ops_uint_load(&curr->upper, ATOMIC_OPS_FENCE_NONE));
+
+			printf("retire list count = %zu\n", curr->retire_count);
+			printf("retire list bytes = %zu\n", curr->retire_bytes);
+
+			printf("in_use = %zu\n\n", atomic_ops_uint_load(&curr->in_use, ATOMIC_OPS_FENCE_NONE));
+
+			curr = curr->next;
+		}
+	}
+}
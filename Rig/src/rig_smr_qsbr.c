@@ -0,0 +1,722 @@
+/**
+ * This file is part of the Rig project.
+ *
+ * For the full copyright and license information, please view the COPYING
+ * file that was distributed with this source code.
+ *
+ * @copyright  (c) the Rig project
+ * @author     Luca Longinotti <chtekk@longitekk.com>
+ * @license    BSD 2-clause
+ * @version    $Id$
+ */
+
+#include "rig_internal.h"
+#include <atomic_ops.h>
+#include <stdio.h>
+#include "support/array_stack.c"
+
+/*
+ * Quiescent-State-Based Reclamation
+ *
+ * Same global epoch and three retire lists per thread as with epochs, but an
+ * online thread is always treated as if it were inside a critical section:
+ * it doesn't announce anything per data structure operation, instead it
+ * announces quiescent states, points where it holds no references to shared
+ * nodes, by calling rig_smr_qsbr_quiescent(), for example once per event
+ * loop iteration. Its local epoch is only written, and fenced, when the
+ * global epoch moved since the last one.
+ * Threads become online on their first operation on a data structure using
+ * QSBR, or with rig_smr_qsbr_online(), and should go offline with
+ * rig_smr_qsbr_offline() before blocking for long, as an online thread that
+ * doesn't pass through quiescent states stops all reclamation.
+ */
+
+#define RIG_SMR_QSBR_THRESHOLD 64 // Minimum retired pointers before advancing, multiple of 32
+#define RIG_SMR_QSBR_THRESHOLD_FACTOR 8 // Default k in R = k * N, N being the live records
+#define RIG_SMR_QSBR_MAX_BYTES ((size_t)1 << 20) // Default per-thread cap on unreclaimed bytes (1 MiB)
+
+typedef struct rig_smr_qsbr_record *RIG_SMR_QSBR_Record;
+typedef struct rig_smr_qsbr_block *RIG_SMR_QSBR_Block;
+
+static inline RIG_SMR_QSBR_Record rig_smr_qsbr_record_get(void);
+static inline size_t rig_smr_qsbr_threshold_get(void);
+static inline void rig_smr_qsbr_advance(RIG_SMR_QSBR_Record qsbr_record);
+static inline void rig_smr_qsbr_retire_check(RIG_SMR_QSBR_Record qsbr_record);
+static inline uintptr_t rig_smr_qsbr_update(RIG_SMR_QSBR_Record qsbr_record);
+static inline void rig_smr_qsbr_free_memory(RIG_SMR_QSBR_Record qsbr_record, uintptr_t delta);
+static inline void rig_smr_qsbr_retire_push(RIG_SMR_QSBR_Record qsbr_record, RIG_SMR_Retired *retired);
+static inline void rig_smr_qsbr_limbo_free(ARRAY_STACK limbo_list);
+static void rig_smr_qsbr_reclaim(RIG_SMR_Block block);
+static void rig_smr_qsbr_orphan(RIG_SMR_QSBR_Record qsbr_record);
+static RIG_SMR_QSBR_Block rig_smr_qsbr_orphans_take(void);
+static void rig_smr_qsbr_adopt(RIG_SMR_QSBR_Record qsbr_record);
+
+struct rig_smr_qsbr_record {
+	atomic_ops_uint online CACHELINE_ALIGNED;
+	atomic_ops_uint local_epoch;
+	atomic_ops_uint in_use;
+	size_t current_retire_list;
+	struct array_stack retire_lists[3]; // Entries retired with a destructor take three slots
+	size_t retire_bytes[3]; // Bytes held back by each retire list
+	RIG_SMR_QSBR_Record next;
+};
+
+// Limbo list handed over to the reclaimer thread, everything in it can be freed,
+// or retire list orphaned by a thread giving its record back, for others to adopt
+struct rig_smr_qsbr_block {
+	struct rig_smr_block header;
+	struct array_stack limbo_list;
+};
+
+#if defined(SYSTEM_TLS_SUPPORT)
+	static SYSTEM_TLS_DECL RIG_SMR_QSBR_Record QSBR_Record = NULL;
+#else
+	static RIG_TLS RIG_SMR_QSBR_TLS_Key = NULL;
+#endif
+
+static void rig_smr_qsbr_construct(void) ATTR_CONSTRUCTOR;
+static void rig_smr_qsbr_destruct(void) ATTR_DESTRUCTOR;
+
+static atomic_ops_uint RIG_SMR_QSBR_Global_Epoch = ATOMIC_OPS_UINT_INIT(0);
+
+static atomic_ops_ptr  RIG_SMR_QSBR_List_Head = ATOMIC_OPS_PTR_INIT(NULL);
+static atomic_ops_ptr  RIG_SMR_QSBR_Orphans = ATOMIC_OPS_PTR_INIT(NULL);
+static atomic_ops_uint RIG_SMR_QSBR_List_Length = ATOMIC_OPS_UINT_INIT(0);
+static atomic_ops_uint RIG_SMR_QSBR_Live_Records = ATOMIC_OPS_UINT_INIT(0);
+static atomic_ops_uint RIG_SMR_QSBR_Threshold_Factor = ATOMIC_OPS_UINT_INIT(RIG_SMR_QSBR_THRESHOLD_FACTOR);
+static atomic_ops_uint RIG_SMR_QSBR_Max_Bytes = ATOMIC_OPS_UINT_INIT(RIG_SMR_QSBR_MAX_BYTES);
+
+static void rig_smr_qsbr_construct(void) {
+	// Retired memory may come from the node pool, which must outlive our destructor
+	rig_mem_pool_ref();
+
+#if !defined(SYSTEM_TLS_SUPPORT)
+	// The TLS key must be initialized only once, only one thread can get here
+	RIG_SMR_QSBR_TLS_Key = rig_tls_init();
+	NULLCHECK_EXIT(RIG_SMR_QSBR_TLS_Key);
+#endif
+}
+
+static void rig_smr_qsbr_destruct(void) {
+	// Nothing may run in the background anymore
+	rig_smr_reclaimer_shutdown();
+
+	// Give back our own record, then check if other threads still use theirs
+	rig_smr_qsbr_record_release();
+
+	RIG_SMR_QSBR_Record curr = atomic_ops_ptr_load(&RIG_SMR_QSBR_List_Head, ATOMIC_OPS_FENCE_ACQUIRE);
+
+	while (curr != NULL) {
+		if (atomic_ops_uint_load(&curr->in_use, ATOMIC_OPS_FENCE_ACQUIRE) == 1) {
+			break;
+		}
+
+		curr = curr->next;
+	}
+
+	if (curr == NULL) {
+		// Nobody is online anymore, so all retired memory can be freed right away.
+		// Destructors may retire more, which lands in a record again: repeat until
+		// nothing is left, then free the records.
+		bool freed;
+
+		do {
+			freed = false;
+
+			RIG_SMR_QSBR_Block orphans = rig_smr_qsbr_orphans_take();
+
+			while (orphans != NULL) {
+				RIG_SMR_QSBR_Block next = (RIG_SMR_QSBR_Block)orphans->header.next;
+
+				rig_smr_qsbr_reclaim(&orphans->header);
+				freed = true;
+
+				orphans = next;
+			}
+
+			curr = atomic_ops_ptr_load(&RIG_SMR_QSBR_List_Head, ATOMIC_OPS_FENCE_ACQUIRE);
+
+			while (curr != NULL) {
+				for (size_t i = 0; i < 3; i++) {
+					if (array_stack_count(&curr->retire_lists[i]) != 0) {
+						struct array_stack limbo_list = curr->retire_lists[i];
+
+						array_stack_init(&curr->retire_lists[i], sizeof(RIG_SMR_Retired));
+						curr->retire_bytes[i] = 0;
+
+						rig_smr_qsbr_limbo_free(&limbo_list);
+						array_stack_destroy(&limbo_list);
+						freed = true;
+					}
+				}
+
+				curr = curr->next;
+			}
+		} while (freed);
+
+#if defined(SYSTEM_TLS_SUPPORT)
+		QSBR_Record = NULL;
+#else
+		rig_tls_set(RIG_SMR_QSBR_TLS_Key, NULL);
+#endif
+
+		curr = atomic_ops_ptr_load(&RIG_SMR_QSBR_List_Head, ATOMIC_OPS_FENCE_ACQUIRE);
+
+		atomic_ops_ptr_store(&RIG_SMR_QSBR_List_Head, NULL, ATOMIC_OPS_FENCE_NONE);
+		atomic_ops_uint_store(&RIG_SMR_QSBR_List_Length, 0, ATOMIC_OPS_FENCE_NONE);
+		atomic_ops_uint_store(&RIG_SMR_QSBR_Live_Records, 0, ATOMIC_OPS_FENCE_FULL);
+
+		while (curr != NULL) {
+			RIG_SMR_QSBR_Record next = curr->next;
+
+			array_stack_destroy(&curr->retire_lists[0]);
+			array_stack_destroy(&curr->retire_lists[1]);
+			array_stack_destroy(&curr->retire_lists[2]);
+
+			rig_mem_free_aligned(curr);
+
+			curr = next;
+		}
+	}
+
+#if !defined(SYSTEM_TLS_SUPPORT)
+	rig_tls_destroy(&RIG_SMR_QSBR_TLS_Key);
+#endif
+
+	rig_mem_pool_unref();
+}
+
+
+static inline RIG_SMR_QSBR_Record rig_smr_qsbr_record_get(void) {
+#if !defined(SYSTEM_TLS_SUPPORT)
+	RIG_SMR_QSBR_Record QSBR_Record = rig_tls_get(RIG_SMR_QSBR_TLS_Key);
+#endif
+
+	// If QSBR_Record == NULL, this thread has not registered any RIG_SMR_QSBR_Record structure
+	if (QSBR_Record == NULL) {
+		// Let's search if there's any old record lying around
+		QSBR_Record = atomic_ops_ptr_load(&RIG_SMR_QSBR_List_Head, ATOMIC_OPS_FENCE_NONE);
+
+		while (QSBR_Record != NULL) {
+			if (atomic_ops_uint_load(&QSBR_Record->in_use, ATOMIC_OPS_FENCE_ACQUIRE) == 0
+			 && atomic_ops_uint_cas(&QSBR_Record->in_use, 0, 1, ATOMIC_OPS_FENCE_ACQUIRE)) {
+				// Got it!
+				break;
+			}
+
+			QSBR_Record = QSBR_Record->next;
+		}
+
+		// Didn't find an old record, need to allocate one myself
+		if (QSBR_Record == NULL) {
+			QSBR_Record = rig_mem_alloc_aligned(sizeof(*QSBR_Record), 0, CACHELINE_SIZE, 0);
+			NULLCHECK_EXIT(QSBR_Record);
+
+			// Initialize values, records start offline
+			atomic_ops_uint_store(&QSBR_Record->online, 0, ATOMIC_OPS_FENCE_NONE);
+			atomic_ops_uint_store(&QSBR_Record->local_epoch, 0, ATOMIC_OPS_FENCE_NONE);
+			atomic_ops_uint_store(&QSBR_Record->in_use, 1, ATOMIC_OPS_FENCE_NONE);
+			QSBR_Record->current_retire_list = 0;
+
+			array_stack_init(&QSBR_Record->retire_lists[0], sizeof(RIG_SMR_Retired));
+			array_stack_init(&QSBR_Record->retire_lists[1], sizeof(RIG_SMR_Retired));
+			array_stack_init(&QSBR_Record->retire_lists[2], sizeof(RIG_SMR_Retired));
+
+			QSBR_Record->retire_bytes[0] = 0;
+			QSBR_Record->retire_bytes[1] = 0;
+			QSBR_Record->retire_bytes[2] = 0;
+
+			// Link the new RIG_SMR_QSBR_Record into the main RIG_SMR_QSBR_List
+			atomic_ops_uint_inc(&RIG_SMR_QSBR_List_Length, ATOMIC_OPS_FENCE_FULL);
+
+			while (true) {
+				RIG_SMR_QSBR_Record head = atomic_ops_ptr_load(&RIG_SMR_QSBR_List_Head, ATOMIC_OPS_FENCE_NONE);
+
+				QSBR_Record->next = head;
+
+				if (atomic_ops_ptr_cas(&RIG_SMR_QSBR_List_Head, head, QSBR_Record, ATOMIC_OPS_FENCE_FULL)) {
+					break;
+				}
+			}
+		}
+
+		// Live records determine the retire threshold
+		atomic_ops_uint_inc(&RIG_SMR_QSBR_Live_Records, ATOMIC_OPS_FENCE_NONE);
+
+#if !defined(SYSTEM_TLS_SUPPORT)
+		// Set the thread specific value correctly
+		rig_tls_set(RIG_SMR_QSBR_TLS_Key, QSBR_Record);
+#endif
+	}
+
+	return (QSBR_Record);
+}
+
+void rig_smr_qsbr_record_release(void) {
+#if !defined(SYSTEM_TLS_SUPPORT)
+	RIG_SMR_QSBR_Record QSBR_Record = rig_tls_get(RIG_SMR_QSBR_TLS_Key);
+#endif
+
+	if (QSBR_Record != NULL) {
+		// A thread giving its record back holds no references anymore
+		atomic_ops_uint_store(&QSBR_Record->online, 0, ATOMIC_OPS_FENCE_FULL);
+
+		// Free what can be freed without waiting on the online threads: a thread
+		// exiting must not depend on them passing through a quiescent state, they
+		// may well be waiting on it. What's left goes to the orphans, for them to adopt.
+		for (size_t i = 0; i < 3; i++) {
+			rig_smr_qsbr_free_memory(QSBR_Record, rig_smr_qsbr_update(QSBR_Record));
+			rig_smr_qsbr_advance(QSBR_Record);
+		}
+
+		rig_smr_qsbr_free_memory(QSBR_Record, rig_smr_qsbr_update(QSBR_Record));
+
+		rig_smr_qsbr_orphan(QSBR_Record);
+
+		// Reset to initial values
+		QSBR_Record->current_retire_list = 0;
+
+		atomic_ops_uint_dec(&RIG_SMR_QSBR_Live_Records, ATOMIC_OPS_FENCE_NONE);
+
+		atomic_ops_uint_store(&QSBR_Record->in_use, 0, ATOMIC_OPS_FENCE_RELEASE);
+
+#if defined(SYSTEM_TLS_SUPPORT)
+		QSBR_Record = NULL;
+#else
+		rig_tls_set(RIG_SMR_QSBR_TLS_Key, NULL);
+#endif
+
+		atomic_ops_fence(ATOMIC_OPS_FENCE_FULL);
+	}
+}
+
+/**
+ * Announce a quiescent state: the calling thread holds no references to
+ * nodes of data structures using QSBR anymore, nor any open iterator on them.
+ * This is cheap enough to be called once per event loop iteration: unless the
+ * global epoch moved since the last call, it's a couple of loads, no stores.
+ * The calling thread is online afterwards.
+ */
+void rig_smr_qsbr_quiescent(void) {
+	RIG_SMR_QSBR_Record qsbr_record = rig_smr_qsbr_record_get();
+
+	uintptr_t delta = rig_smr_qsbr_update(qsbr_record);
+
+	if (delta != 0) {
+		rig_smr_qsbr_free_memory(qsbr_record, delta);
+		rig_smr_qsbr_adopt(qsbr_record);
+	}
+
+	if (atomic_ops_uint_load(&qsbr_record->online, ATOMIC_OPS_FENCE_NONE) == 0) {
+		atomic_ops_uint_store(&qsbr_record->online, 1, ATOMIC_OPS_FENCE_FULL);
+	}
+
+	// If over the threshold, try to advance the global epoch, exactly like
+	// epochs do on leaving a critical section
+	rig_smr_qsbr_retire_check(qsbr_record);
+}
+
+/**
+ * Stop taking part in QSBR, for example before blocking for a long time:
+ * offline threads don't hold back any reclamation, but must not reference
+ * nodes of data structures using QSBR until they go online again.
+ * Any operation on such a data structure brings the thread back online.
+ */
+void rig_smr_qsbr_offline(void) {
+	RIG_SMR_QSBR_Record qsbr_record = rig_smr_qsbr_record_get();
+
+	rig_acheck_msg(atomic_ops_uint_load(&qsbr_record->online, ATOMIC_OPS_FENCE_NONE) == 1,
+		"going offline while not online");
+
+	rig_smr_qsbr_retire_check(qsbr_record);
+
+	atomic_ops_uint_store(&qsbr_record->online, 0, ATOMIC_OPS_FENCE_FULL);
+}
+
+/**
+ * Start taking part in QSBR again after rig_smr_qsbr_offline(). The calling
+ * thread then has to regularly call rig_smr_qsbr_quiescent().
+ */
+void rig_smr_qsbr_online(void) {
+	RIG_SMR_QSBR_Record qsbr_record = rig_smr_qsbr_record_get();
+
+	rig_acheck_msg(atomic_ops_uint_load(&qsbr_record->online, ATOMIC_OPS_FENCE_NONE) == 0,
+		"going online while already online");
+
+	rig_smr_qsbr_free_memory(qsbr_record, rig_smr_qsbr_update(qsbr_record));
+	rig_smr_qsbr_adopt(qsbr_record);
+
+	atomic_ops_uint_store(&qsbr_record->online, 1, ATOMIC_OPS_FENCE_FULL);
+}
+
+void rig_smr_qsbr_enter(void) {
+	RIG_SMR_QSBR_Record qsbr_record = rig_smr_qsbr_record_get();
+
+	// Only our own thread writes this, no fence needed to look at it
+	if (atomic_ops_uint_load(&qsbr_record->online, ATOMIC_OPS_FENCE_NONE) == 0) {
+		rig_smr_qsbr_online();
+	}
+}
+
+bool rig_smr_qsbr_is_online(void) {
+	RIG_SMR_QSBR_Record qsbr_record = rig_smr_qsbr_record_get();
+
+	return (atomic_ops_uint_load(&qsbr_record->online, ATOMIC_OPS_FENCE_NONE) == 1);
+}
+
+/**
+ * Tune when retired memory gets reclaimed: a thread tries to advance the
+ * global epoch once it has retired factor * N pointers in the current epoch,
+ * N being the number of live records, as an advance has to look at all of
+ * them. Independently, an advance is tried once a thread holds back
+ * max_bytes bytes over all its retire lists.
+ *
+ * @param factor
+ *     retired pointers per live record before advancing, 0 restores the default
+ * @param max_bytes
+ *     per-thread cap on unreclaimed bytes, 0 disables it
+ */
+void rig_smr_qsbr_threshold_set(size_t factor, size_t max_bytes) {
+	if (factor == 0) {
+		factor = RIG_SMR_QSBR_THRESHOLD_FACTOR;
+	}
+
+	atomic_ops_uint_store(&RIG_SMR_QSBR_Threshold_Factor, factor, ATOMIC_OPS_FENCE_NONE);
+	atomic_ops_uint_store(&RIG_SMR_QSBR_Max_Bytes, max_bytes, ATOMIC_OPS_FENCE_FULL);
+}
+
+static inline size_t rig_smr_qsbr_threshold_get(void) {
+	size_t factor = atomic_ops_uint_load(&RIG_SMR_QSBR_Threshold_Factor, ATOMIC_OPS_FENCE_NONE);
+	size_t records = atomic_ops_uint_load(&RIG_SMR_QSBR_Live_Records, ATOMIC_OPS_FENCE_NONE);
+
+	// Saturate instead of overflowing with absurd factors
+	if (records > (SIZE_MAX / factor)) {
+		return (SIZE_MAX);
+	}
+
+	return (((factor * records) > RIG_SMR_QSBR_THRESHOLD) ? (factor * records) : (RIG_SMR_QSBR_THRESHOLD));
+}
+
+static inline void rig_smr_qsbr_advance(RIG_SMR_QSBR_Record qsbr_record) {
+	uintptr_t global_epoch = atomic_ops_uint_load(&RIG_SMR_QSBR_Global_Epoch, ATOMIC_OPS_FENCE_NONE);
+
+	// Check if someone advanced the global epoch already in the meantime
+	if (atomic_ops_uint_load(&qsbr_record->local_epoch, ATOMIC_OPS_FENCE_NONE) != global_epoch) {
+		// Epoch did go forward, not by us, but it did!
+		return;
+	}
+
+	RIG_SMR_QSBR_Record curr = atomic_ops_ptr_load(&RIG_SMR_QSBR_List_Head, ATOMIC_OPS_FENCE_NONE);
+
+	while (curr != NULL) {
+		if (atomic_ops_uint_load(&curr->in_use, ATOMIC_OPS_FENCE_ACQUIRE) == 1
+		 && atomic_ops_uint_load(&curr->online, ATOMIC_OPS_FENCE_ACQUIRE) == 1
+		 && atomic_ops_uint_load(&curr->local_epoch, ATOMIC_OPS_FENCE_ACQUIRE) != global_epoch) {
+			// Can't advance epoch, since someone online hasn't passed through a
+			// quiescent state in it yet
+			return;
+		}
+
+		curr = curr->next;
+	}
+
+	// We don't care if this fails or not, as failure means the system advanced anyway by someone else!
+	atomic_ops_uint_cas(&RIG_SMR_QSBR_Global_Epoch, global_epoch, global_epoch + 1, ATOMIC_OPS_FENCE_FULL);
+}
+
+static inline void rig_smr_qsbr_retire_check(RIG_SMR_QSBR_Record qsbr_record) {
+	// Holding back too much memory also warrants a try, as long as something
+	// new was retired in this epoch (else we already tried and are waiting).
+	size_t count = array_stack_count(&qsbr_record->retire_lists[qsbr_record->current_retire_list]);
+	size_t max_bytes = atomic_ops_uint_load(&RIG_SMR_QSBR_Max_Bytes, ATOMIC_OPS_FENCE_NONE);
+
+	if ((count >= rig_smr_qsbr_threshold_get())
+	 || ((max_bytes != 0) && (count != 0)
+	  && ((qsbr_record->retire_bytes[0] + qsbr_record->retire_bytes[1] + qsbr_record->retire_bytes[2]) >= max_bytes))) {
+		rig_smr_qsbr_advance(qsbr_record);
+	}
+}
+
+static inline uintptr_t rig_smr_qsbr_update(RIG_SMR_QSBR_Record qsbr_record) {
+	uintptr_t global_epoch = atomic_ops_uint_load(&RIG_SMR_QSBR_Global_Epoch, ATOMIC_OPS_FENCE_NONE);
+
+	// If the epoch didn't change, there's nothing to update
+	if (atomic_ops_uint_load(&qsbr_record->local_epoch, ATOMIC_OPS_FENCE_NONE) == global_epoch) {
+		return (0);
+	}
+
+	// Calculate difference between global and local epochs
+	uintptr_t delta = global_epoch - atomic_ops_uint_load(&qsbr_record->local_epoch, ATOMIC_OPS_FENCE_NONE);
+
+	// Update local epoch to global one: all reads of shared nodes done before
+	// have to be complete when it's seen, and all done after must not happen
+	// before it's seen, as there is no critical section to do this for us
+	atomic_ops_fence(ATOMIC_OPS_FENCE_FULL);
+	atomic_ops_uint_store(&qsbr_record->local_epoch, global_epoch, ATOMIC_OPS_FENCE_FULL);
+
+	return (delta);
+}
+
+static inline void rig_smr_qsbr_free_memory(RIG_SMR_QSBR_Record qsbr_record, uintptr_t delta) {
+	if (delta != 0) {
+		// Always jump to next limbo list, wrapping around at three
+		qsbr_record->current_retire_list++;
+
+		if (qsbr_record->current_retire_list == 3) {
+			qsbr_record->current_retire_list = 0;
+		}
+
+		// Clear the current list before using it anew. Destructors may retire
+		// more memory, which must go to a fresh list and not be freed with the
+		// old one, so the old list is taken out while it's being cleared.
+		// With the reclaimer running, it gets the old list to clear instead.
+		size_t curr_list = qsbr_record->current_retire_list;
+		struct array_stack limbo_list = qsbr_record->retire_lists[curr_list];
+		size_t limbo_bytes = qsbr_record->retire_bytes[curr_list];
+		RIG_SMR_QSBR_Block block = NULL;
+
+		if ((array_stack_count(&limbo_list) != 0) && rig_smr_reclaimer_offload()) {
+			block = rig_mem_alloc(sizeof(*block), 0);
+		}
+
+		array_stack_init(&qsbr_record->retire_lists[curr_list], sizeof(RIG_SMR_Retired));
+		qsbr_record->retire_bytes[curr_list] = 0;
+
+		if (block != NULL) {
+			block->header.reclaim = &rig_smr_qsbr_reclaim;
+			block->header.bytes = limbo_bytes;
+			block->limbo_list = limbo_list;
+
+			rig_smr_reclaimer_handoff(&block->header);
+		}
+		else {
+			rig_smr_qsbr_limbo_free(&limbo_list);
+
+			// Keep the old list and its memory around, unless destructors started a new one
+			if (array_stack_count(&qsbr_record->retire_lists[curr_list]) == 0) {
+				array_stack_destroy(&qsbr_record->retire_lists[curr_list]);
+				qsbr_record->retire_lists[curr_list] = limbo_list;
+			}
+			else {
+				array_stack_destroy(&limbo_list);
+			}
+		}
+
+		// If several epochs have passed, we can also cleanup the other retire lists
+		if (delta >= 2) {
+			rig_smr_qsbr_free_memory(qsbr_record, 1);
+
+			if (delta >= 3) {
+				rig_smr_qsbr_free_memory(qsbr_record, 1);
+			}
+		}
+	}
+}
+
+static inline void rig_smr_qsbr_retire_push(RIG_SMR_QSBR_Record qsbr_record, RIG_SMR_Retired *retired) {
+	ARRAY_STACK retire_list = &qsbr_record->retire_lists[qsbr_record->current_retire_list];
+
+	// Push the entry last slot first, so that the tagged pointer pops first
+	for (size_t i = SMR_RETIRED_SLOTS(retired[0].ptr); i > 0; i--) {
+		array_stack_push(retire_list, &retired[i - 1]);
+	}
+
+	qsbr_record->retire_bytes[qsbr_record->current_retire_list] += SMR_MEM_SIZE(retired[0].ptr);
+}
+
+static inline void rig_smr_qsbr_limbo_free(ARRAY_STACK limbo_list) {
+	RIG_SMR_Retired *slot;
+
+	while ((slot = array_stack_pop(limbo_list)) != NULL) {
+		// Entries are pushed last slot first, so the tagged pointer pops first
+		RIG_SMR_Retired retired[3];
+
+		retired[0] = *slot;
+
+		if (SMR_FN_TAGGED(retired[0].ptr)) {
+			retired[1] = *(RIG_SMR_Retired *)array_stack_pop(limbo_list);
+			retired[2] = *(RIG_SMR_Retired *)array_stack_pop(limbo_list);
+		}
+
+		SMR_RETIRED_FREE(retired);
+	}
+}
+
+static void rig_smr_qsbr_reclaim(RIG_SMR_Block block) {
+	RIG_SMR_QSBR_Block qsbr_block = (RIG_SMR_QSBR_Block)block;
+
+	rig_smr_qsbr_limbo_free(&qsbr_block->limbo_list);
+	array_stack_destroy(&qsbr_block->limbo_list);
+
+	rig_mem_free(qsbr_block);
+}
+
+static void rig_smr_qsbr_orphan(RIG_SMR_QSBR_Record qsbr_record) {
+	for (size_t i = 0; i < 3; i++) {
+		if (array_stack_count(&qsbr_record->retire_lists[i]) == 0) {
+			continue;
+		}
+
+		RIG_SMR_QSBR_Block block = rig_mem_alloc(sizeof(*block), 0);
+		NULLCHECK_EXIT(block);
+
+		block->header.reclaim = &rig_smr_qsbr_reclaim;
+		block->header.bytes = qsbr_record->retire_bytes[i];
+		block->limbo_list = qsbr_record->retire_lists[i];
+
+		array_stack_init(&qsbr_record->retire_lists[i], sizeof(RIG_SMR_Retired));
+		qsbr_record->retire_bytes[i] = 0;
+
+		while (true) {
+			RIG_SMR_Block head = atomic_ops_ptr_load(&RIG_SMR_QSBR_Orphans, ATOMIC_OPS_FENCE_NONE);
+
+			block->header.next = head;
+
+			if (atomic_ops_ptr_cas(&RIG_SMR_QSBR_Orphans, head, block, ATOMIC_OPS_FENCE_FULL)) {
+				break;
+			}
+		}
+	}
+}
+
+static RIG_SMR_QSBR_Block rig_smr_qsbr_orphans_take(void) {
+	RIG_SMR_QSBR_Block orphans;
+
+	// Take all orphaned retire lists at once, so there's no ABA problem
+	do {
+		orphans = atomic_ops_ptr_load(&RIG_SMR_QSBR_Orphans, ATOMIC_OPS_FENCE_ACQUIRE);
+
+		if (orphans == NULL) {
+			return (NULL);
+		}
+	} while (!atomic_ops_ptr_cas(&RIG_SMR_QSBR_Orphans, orphans, NULL, ATOMIC_OPS_FENCE_FULL));
+
+	return (orphans);
+}
+
+static void rig_smr_qsbr_adopt(RIG_SMR_QSBR_Record qsbr_record) {
+	// Entries of orphaned retire lists go to our current retire list: it's
+	// freed later than whatever epoch they were retired in, so that's safe
+	RIG_SMR_QSBR_Block orphans = rig_smr_qsbr_orphans_take();
+
+	while (orphans != NULL) {
+		RIG_SMR_QSBR_Block next = (RIG_SMR_QSBR_Block)orphans->header.next;
+		RIG_SMR_Retired *slot;
+
+		while ((slot = array_stack_pop(&orphans->limbo_list)) != NULL) {
+			RIG_SMR_Retired retired[3];
+
+			retired[0] = *slot;
+
+			if (SMR_FN_TAGGED(retired[0].ptr)) {
+				retired[1] = *(RIG_SMR_Retired *)array_stack_pop(&orphans->limbo_list);
+				retired[2] = *(RIG_SMR_Retired *)array_stack_pop(&orphans->limbo_list);
+			}
+
+			rig_smr_qsbr_retire_push(qsbr_record, retired);
+		}
+
+		array_stack_destroy(&orphans->limbo_list);
+		rig_mem_free(orphans);
+
+		orphans = next;
+	}
+}
+
+static void rig_smr_qsbr_retire(RIG_SMR_Retired *retired) {
+	RIG_SMR_QSBR_Record qsbr_record = rig_smr_qsbr_record_get();
+
+	// Offline threads don't keep their local epoch current, catch up first so
+	// that the memory isn't filed under an old epoch and freed too early.
+	// They also don't pass through quiescent states, so they check here if
+	// the global epoch should advance.
+	if (atomic_ops_uint_load(&qsbr_record->online, ATOMIC_OPS_FENCE_NONE) == 0) {
+		rig_smr_qsbr_free_memory(qsbr_record, rig_smr_qsbr_update(qsbr_record));
+		rig_smr_qsbr_retire_push(qsbr_record, retired);
+		rig_smr_qsbr_retire_check(qsbr_record);
+	}
+	else {
+		rig_smr_qsbr_retire_push(qsbr_record, retired);
+	}
+}
+
+void rig_smr_qsbr_mem_retire(void *memory_ptr) {
+	// If pointer is NULL, we do nothing at all, same as the standard free()
+	if (memory_ptr != NULL) {
+		RIG_SMR_Retired retired[1] = { { .ptr = memory_ptr } };
+
+		rig_smr_qsbr_retire(retired);
+	}
+}
+
+/**
+ * Retire memory that has to be reclaimed by calling a destructor, instead
+ * of rig_mem_free(), once all online threads have passed through a quiescent
+ * state. This way any object, be it pooled, aligned or part of a bigger
+ * structure, can be reclaimed. The destructor may run in the thread that
+ * retired the memory, or in another one, and may itself retire more memory.
+ *
+ * @param memory_ptr
+ *     pointer to retire, at least 4 byte aligned, NULL does nothing
+ * @param fn
+ *     destructor, called with memory_ptr and ctx, cannot be NULL
+ * @param ctx
+ *     context passed on to the destructor
+ */
+void rig_smr_qsbr_retire_fn(void *memory_ptr, void (*fn)(void *ptr, void *ctx), void *ctx) {
+	// If pointer is NULL, we do nothing at all, same as the standard free()
+	if (memory_ptr != NULL) {
+		NULLCHECK_EXIT(fn);
+		rig_acheck_msg(SMR_UNTAG(memory_ptr) == memory_ptr, "retired pointer not 4 byte aligned");
+
+		RIG_SMR_Retired retired[3];
+
+		retired[0].ptr = SMR_FN_TAG(memory_ptr);
+		retired[1].fn = fn;
+		retired[2].ptr = ctx;
+
+		rig_smr_qsbr_retire(retired);
+	}
+}
+
+void rig_smr_qsbr_pool_retire(void *memory_ptr) {
+	// Memory from the node pool is tagged, so that it's given back there once freed
+	if (memory_ptr != NULL) {
+		rig_smr_qsbr_mem_retire(SMR_POOL_TAG(memory_ptr));
+	}
+}
+
+void rig_smr_qsbr_debug_info(bool print_list) {
+	printf("SMR_QSBR global Epoch (before) = %zu\n\n",
+		atomic_ops_uint_load(&RIG_SMR_QSBR_Global_Epoch, ATOMIC_OPS_FENCE_ACQUIRE));
+
+	RIG_SMR_QSBR_Record curr = atomic_ops_ptr_load(&RIG_SMR_QSBR_List_Head, ATOMIC_OPS_FENCE_ACQUIRE);
+
+	printf("SMR_QSBR list head address: %p\n", (void *)&RIG_SMR_QSBR_List_Head);
+	printf("SMR_QSBR list head value: %p\n", (void *)curr);
+	printf("SMR_QSBR list length address: %p\n", (void *)&RIG_SMR_QSBR_List_Length);
+	printf("SMR_QSBR list length value: %zu\n", atomic_ops_uint_load(&RIG_SMR_QSBR_List_Length, ATOMIC_OPS_FENCE_NONE));
+	printf("SMR_QSBR orphans: %p\n\n", atomic_ops_ptr_load(&RIG_SMR_QSBR_Orphans, ATOMIC_OPS_FENCE_NONE));
+
+	if (print_list) {
+		while (curr != NULL) {
+			printf("== SMR_QSBR_Record at %p ==\n", (void *)curr);
+
+			printf("online = %zu\n", atomic_ops_uint_load(&curr->online, ATOMIC_OPS_FENCE_NONE));
+			printf("local_epoch = %zu\n", atomic_ops_uint_load(&curr->local_epoch, ATOMIC_OPS_FENCE_NONE));
+			printf("in_use = %zu\n", atomic_ops_uint_load(&curr->in_use, ATOMIC_OPS_FENCE_NONE));
+
+			printf("current_retire_list = %zu\n", curr->current_retire_list);
+			printf("retire list 0 count = %zu\n", array_stack_count(&curr->retire_lists[0]));
+			printf("retire list 1 count = %zu\n", array_stack_count(&curr->retire_lists[1]));
+			printf("retire list 2 count = %zu\n", array_stack_count(&curr->retire_lists[2]));
+			printf("retire lists bytes = %zu\n\n",
+				curr->retire_bytes[0] + curr->retire_bytes[1] + curr->retire_bytes[2]);
+
+			curr = curr->next;
+		}
+	}
+
+	printf("SMR_QSBR global Epoch (after) = %zu\n\n",
+		atomic_ops_uint_load(&RIG_SMR_QSBR_Global_Epoch, ATOMIC_OPS_FENCE_RELEASE));
+}
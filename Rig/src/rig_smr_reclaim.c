@@ -0,0 +1,353 @@
+/**
+ * This file is part of the Rig project.
+ *
+ * For the full copyright and license information, please view the COPYING
+ * file that was distributed with this source code.
+ *
+ * @copyright  (c) the Rig project
+ * @author     Luca Longinotti <chtekk@longitekk.com>
+ * @license    BSD 2-clause
+ * @version    $Id$
+ */
+
+#include "rig_internal.h"
+#include <atomic_ops.h>
+
+#define RIG_SMR_RECLAIMER_PERIOD 10000 // Rescan what's still hazardous at least every 10ms
+
+#define RIG_SMR_RECLAIMER_STOPPED 0
+#define RIG_SMR_RECLAIMER_CHANGING 1
+#define RIG_SMR_RECLAIMER_RUNNING 2
+
+static void *rig_smr_reclaimer_run(void *arg);
+static void *rig_smr_reclaimer_take(void *arg);
+static void rig_smr_reclaimer_drain(RIG_SMR_Block blocks);
+
+/*
+ * The reclaimer is a single background thread, to which threads retiring
+ * memory hand whole blocks of it (a retire list), instead of scanning or
+ * freeing them inline. The channel is a lock-free LIFO list, to which any
+ * thread can push, and from which only whole lists are taken, so there is
+ * no ABA problem; an event-count lets the reclaimer sleep while it's empty.
+ * Blocks pushed while the reclaimer is stopping are drained by whoever
+ * notices, so nothing is left behind.
+ */
+static atomic_ops_uint RIG_SMR_Reclaimer_State = ATOMIC_OPS_UINT_INIT(RIG_SMR_RECLAIMER_STOPPED);
+static atomic_ops_uint RIG_SMR_Reclaimer_ThreadID = ATOMIC_OPS_UINT_INIT(0);
+static atomic_ops_ptr  RIG_SMR_Reclaimer_Channel = ATOMIC_OPS_PTR_INIT(NULL);
+static RIG_EVENTCOUNT  RIG_SMR_Reclaimer_EC = NULL; // Never destroyed while running, producers may notify late
+static RIG_THREAD      RIG_SMR_Reclaimer_Thread = NULL;
+
+// Statistics, the hand-off ones are updated by all threads, the rest only by the reclaimer
+static atomic_ops_uint RIG_SMR_Reclaimer_Blocks = ATOMIC_OPS_UINT_INIT(0);
+static atomic_ops_uint RIG_SMR_Reclaimer_Bytes = ATOMIC_OPS_UINT_INIT(0);
+static atomic_ops_uint RIG_SMR_Reclaimer_Reclaimed = ATOMIC_OPS_UINT_INIT(0);
+static atomic_ops_uint RIG_SMR_Reclaimer_Lag_Sum = ATOMIC_OPS_UINT_INIT(0);
+static atomic_ops_uint RIG_SMR_Reclaimer_Lag_Max = ATOMIC_OPS_UINT_INIT(0);
+
+static void rig_smr_reclaimer_construct(void) ATTR_CONSTRUCTOR;
+static void rig_smr_reclaimer_destruct(void) ATTR_DESTRUCTOR;
+
+static void rig_smr_reclaimer_construct(void) {
+	// Reclaiming may free node pool memory, which must outlive our destructor
+	rig_mem_pool_ref();
+}
+
+static void rig_smr_reclaimer_destruct(void) {
+	rig_smr_reclaimer_shutdown();
+
+	rig_eventcount_destroy(&RIG_SMR_Reclaimer_EC);
+
+	rig_mem_pool_unref();
+}
+
+
+/**
+ * Start the background reclaimer thread. From then on, threads retiring
+ * memory through any of the SMR schemes (hazard pointers, epochs, QSBR or
+ * IBR) don't scan and free it themselves anymore once over the threshold,
+ * but hand their retire or limbo lists over to the reclaimer, which does
+ * that work off the hot path.
+ *
+ * @return
+ *     boolean indicating success.
+ *     On error, the following error codes are set:
+ *     - EAGAIN (insufficient resources, other than memory)
+ *     - EALREADY (reclaimer already running or being started/stopped)
+ *     - ENOMEM (insufficient memory)
+ */
+bool rig_smr_reclaimer_start(void) {
+	if (!atomic_ops_uint_cas(&RIG_SMR_Reclaimer_State, RIG_SMR_RECLAIMER_STOPPED, RIG_SMR_RECLAIMER_CHANGING, ATOMIC_OPS_FENCE_FULL)) {
+		ERRET(EALREADY, false);
+	}
+
+	if (RIG_SMR_Reclaimer_EC == NULL) {
+		RIG_SMR_Reclaimer_EC = rig_eventcount_init();
+		NULLCHECK_ERRET_CLEANUP(RIG_SMR_Reclaimer_EC, ENOMEM, false,
+			atomic_ops_uint_store(&RIG_SMR_Reclaimer_State, RIG_SMR_RECLAIMER_STOPPED, ATOMIC_OPS_FENCE_RELEASE));
+	}
+
+	RIG_SMR_Reclaimer_Thread = rig_thread_init(0, 1);
+	NULLCHECK_ERRET_CLEANUP(RIG_SMR_Reclaimer_Thread, ENOMEM, false,
+		atomic_ops_uint_store(&RIG_SMR_Reclaimer_State, RIG_SMR_RECLAIMER_STOPPED, ATOMIC_OPS_FENCE_RELEASE));
+
+	// The reclaimer only exits once it sees the state isn't running anymore
+	atomic_ops_uint_store(&RIG_SMR_Reclaimer_State, RIG_SMR_RECLAIMER_RUNNING, ATOMIC_OPS_FENCE_FULL);
+
+	if (!rig_thread_start(RIG_SMR_Reclaimer_Thread, &rig_smr_reclaimer_run, NULL)) {
+		int errno_save = errno;
+
+		rig_thread_destroy(&RIG_SMR_Reclaimer_Thread);
+		atomic_ops_uint_store(&RIG_SMR_Reclaimer_State, RIG_SMR_RECLAIMER_STOPPED, ATOMIC_OPS_FENCE_FULL);
+
+		// Blocks may have been handed off in the meantime
+		rig_smr_reclaimer_drain(rig_smr_reclaimer_take(NULL));
+
+		ERRET(errno_save, false);
+	}
+
+	return (true);
+}
+
+/**
+ * Stop the background reclaimer thread, waiting for it to finish reclaiming
+ * all the blocks handed over to it. Threads go back to scanning and freeing
+ * their retired memory inline.
+ *
+ * @return
+ *     boolean indicating success.
+ *     On error, the following error codes are set:
+ *     - EDEADLK (called from the reclaimer itself, by a destructor)
+ *     - EINVAL (reclaimer not running or being started/stopped)
+ */
+bool rig_smr_reclaimer_stop(void) {
+	if (atomic_ops_uint_load(&RIG_SMR_Reclaimer_ThreadID, ATOMIC_OPS_FENCE_ACQUIRE) == rig_thread_id()) {
+		ERRET(EDEADLK, false);
+	}
+
+	if (!atomic_ops_uint_cas(&RIG_SMR_Reclaimer_State, RIG_SMR_RECLAIMER_RUNNING, RIG_SMR_RECLAIMER_CHANGING, ATOMIC_OPS_FENCE_FULL)) {
+		ERRET(EINVAL, false);
+	}
+
+	// Wake the reclaimer up, so it notices it has to stop
+	rig_eventcount_notify(RIG_SMR_Reclaimer_EC, 1);
+
+	rig_acheck_msg(rig_thread_join(RIG_SMR_Reclaimer_Thread, NULL), "failed to join reclaimer thread");
+	rig_thread_destroy(&RIG_SMR_Reclaimer_Thread);
+
+	// Whatever got handed off after the reclaimer's last look
+	rig_smr_reclaimer_drain(rig_smr_reclaimer_take(NULL));
+
+	atomic_ops_uint_store(&RIG_SMR_Reclaimer_State, RIG_SMR_RECLAIMER_STOPPED, ATOMIC_OPS_FENCE_FULL);
+
+	return (true);
+}
+
+/**
+ * Get statistics about the background reclaimer, accumulated since the
+ * library was loaded. The lag is the time between a thread handing a block
+ * of retired memory over and the reclaimer being done with it, which, for
+ * hazard pointers, means having scanned it (what's still hazardous stays
+ * with the reclaimer until a later scan).
+ *
+ * @param stats
+ *     structure to fill with the current statistics
+ */
+void rig_smr_reclaimer_stats(struct rig_smr_stats *stats) {
+	NULLCHECK_EXIT(stats);
+
+	stats->blocks = atomic_ops_uint_load(&RIG_SMR_Reclaimer_Blocks, ATOMIC_OPS_FENCE_ACQUIRE);
+	stats->bytes = atomic_ops_uint_load(&RIG_SMR_Reclaimer_Bytes, ATOMIC_OPS_FENCE_NONE);
+
+	size_t reclaimed = atomic_ops_uint_load(&RIG_SMR_Reclaimer_Reclaimed, ATOMIC_OPS_FENCE_NONE);
+
+	stats->pending = (stats->blocks > reclaimed) ? (stats->blocks - reclaimed) : (0);
+	stats->lag_avg_us = (reclaimed != 0) ? (atomic_ops_uint_load(&RIG_SMR_Reclaimer_Lag_Sum, ATOMIC_OPS_FENCE_NONE) / reclaimed) : (0);
+	stats->lag_max_us = atomic_ops_uint_load(&RIG_SMR_Reclaimer_Lag_Max, ATOMIC_OPS_FENCE_NONE);
+}
+
+/**
+ * INTERNAL
+ * Stop the reclaimer if it's running, so that the SMR schemes can free all
+ * their data at library unload, whatever order that happens in.
+ */
+void rig_smr_reclaimer_shutdown(void) {
+	if (atomic_ops_uint_load(&RIG_SMR_Reclaimer_State, ATOMIC_OPS_FENCE_ACQUIRE) == RIG_SMR_RECLAIMER_RUNNING) {
+		rig_smr_reclaimer_stop();
+	}
+}
+
+/**
+ * INTERNAL
+ * Check if the calling thread should hand its retired memory over to the
+ * reclaimer, which is the case if it's running and we're not it.
+ *
+ * @return
+ *     true if retired memory should go to rig_smr_reclaimer_handoff()
+ */
+bool rig_smr_reclaimer_offload(void) {
+	if (atomic_ops_uint_load(&RIG_SMR_Reclaimer_State, ATOMIC_OPS_FENCE_NONE) != RIG_SMR_RECLAIMER_RUNNING) {
+		return (false);
+	}
+
+	return (atomic_ops_uint_load(&RIG_SMR_Reclaimer_ThreadID, ATOMIC_OPS_FENCE_NONE) != rig_thread_id());
+}
+
+/**
+ * INTERNAL
+ * Hand a block of retired memory over to the reclaimer, which will call its
+ * reclaim() function. If the reclaimer is being stopped, the block may get
+ * reclaimed right away, in the calling thread.
+ *
+ * @param block
+ *     block of retired memory, reclaim() and bytes must be set
+ */
+void rig_smr_reclaimer_handoff(RIG_SMR_Block block) {
+	NULLCHECK_EXIT(block);
+
+	block->handoff_us = rig_time_us();
+
+	atomic_ops_uint_inc(&RIG_SMR_Reclaimer_Blocks, ATOMIC_OPS_FENCE_NONE);
+
+	// Not atomic as a whole, but these are just statistics
+	while (true) {
+		size_t bytes = atomic_ops_uint_load(&RIG_SMR_Reclaimer_Bytes, ATOMIC_OPS_FENCE_NONE);
+
+		if (atomic_ops_uint_cas(&RIG_SMR_Reclaimer_Bytes, bytes, bytes + block->bytes, ATOMIC_OPS_FENCE_NONE)) {
+			break;
+		}
+	}
+
+	while (true) {
+		RIG_SMR_Block head = atomic_ops_ptr_load(&RIG_SMR_Reclaimer_Channel, ATOMIC_OPS_FENCE_NONE);
+
+		block->next = head;
+
+		if (atomic_ops_ptr_cas(&RIG_SMR_Reclaimer_Channel, head, block, ATOMIC_OPS_FENCE_FULL)) {
+			break;
+		}
+	}
+
+	rig_eventcount_notify(RIG_SMR_Reclaimer_EC, 1);
+
+	// The reclaimer might have already had its last look at the channel
+	if (atomic_ops_uint_load(&RIG_SMR_Reclaimer_State, ATOMIC_OPS_FENCE_ACQUIRE) != RIG_SMR_RECLAIMER_RUNNING) {
+		rig_smr_reclaimer_drain(rig_smr_reclaimer_take(NULL));
+	}
+}
+
+/**
+ * INTERNAL
+ * Take all blocks out of the channel at once.
+ *
+ * @param arg
+ *     void * for compatibility with rig_eventcount_await(), not used
+ *
+ * @return
+ *     list of blocks, most recently handed off first, NULL if none
+ */
+static void *rig_smr_reclaimer_take(void *arg) {
+	UNUSED(arg);
+
+	while (true) {
+		RIG_SMR_Block head = atomic_ops_ptr_load(&RIG_SMR_Reclaimer_Channel, ATOMIC_OPS_FENCE_ACQUIRE);
+
+		if (head == NULL) {
+			return (NULL);
+		}
+
+		if (atomic_ops_ptr_cas(&RIG_SMR_Reclaimer_Channel, head, NULL, ATOMIC_OPS_FENCE_FULL)) {
+			return (head);
+		}
+	}
+}
+
+/**
+ * INTERNAL
+ * Reclaim a list of blocks, oldest first, and account for the lag.
+ *
+ * @param blocks
+ *     list of blocks, as returned by rig_smr_reclaimer_take()
+ */
+static void rig_smr_reclaimer_drain(RIG_SMR_Block blocks) {
+	RIG_SMR_Block oldest = NULL;
+
+	// Reverse the list, so that blocks are reclaimed in hand-off order
+	while (blocks != NULL) {
+		RIG_SMR_Block next = blocks->next;
+
+		blocks->next = oldest;
+		oldest = blocks;
+		blocks = next;
+	}
+
+	while (oldest != NULL) {
+		RIG_SMR_Block next = oldest->next;
+		uint64_t handoff_us = oldest->handoff_us;
+
+		// Frees the block itself too
+		(*oldest->reclaim)(oldest);
+
+		size_t lag = (size_t)(rig_time_us() - handoff_us);
+
+		while (true) {
+			size_t lag_sum = atomic_ops_uint_load(&RIG_SMR_Reclaimer_Lag_Sum, ATOMIC_OPS_FENCE_NONE);
+
+			if (atomic_ops_uint_cas(&RIG_SMR_Reclaimer_Lag_Sum, lag_sum, lag_sum + lag, ATOMIC_OPS_FENCE_NONE)) {
+				break;
+			}
+		}
+
+		while (true) {
+			size_t lag_max = atomic_ops_uint_load(&RIG_SMR_Reclaimer_Lag_Max, ATOMIC_OPS_FENCE_NONE);
+
+			if ((lag <= lag_max) || atomic_ops_uint_cas(&RIG_SMR_Reclaimer_Lag_Max, lag_max, lag, ATOMIC_OPS_FENCE_NONE)) {
+				break;
+			}
+		}
+
+		atomic_ops_uint_inc(&RIG_SMR_Reclaimer_Reclaimed, ATOMIC_OPS_FENCE_RELEASE);
+
+		oldest = next;
+	}
+}
+
+/**
+ * INTERNAL
+ * Reclaimer thread: wait for blocks and reclaim them, periodically rescanning
+ * hazard pointers and IBR reservations, and passing through an epoch critical
+ * section, so that whatever couldn't be freed yet gets another chance. On exit, the thread
+ * cleanup gives its SMR records back, freeing what it can.
+ *
+ * @param arg
+ *     void * for compatibility, not used, is always NULL
+ *
+ * @return
+ *     always NULL
+ */
+static void *rig_smr_reclaimer_run(void *arg) {
+	UNUSED(arg);
+
+	atomic_ops_uint_store(&RIG_SMR_Reclaimer_ThreadID, rig_thread_id(), ATOMIC_OPS_FENCE_FULL);
+
+	while (true) {
+		RIG_SMR_Block blocks = rig_eventcount_await(RIG_SMR_Reclaimer_EC, &rig_smr_reclaimer_take, NULL, false, RIG_SMR_RECLAIMER_PERIOD);
+
+		rig_smr_reclaimer_drain(blocks);
+
+		rig_smr_hp_mem_scan();
+		rig_smr_ibr_mem_scan();
+
+		rig_smr_epoch_critical_enter();
+		rig_smr_epoch_critical_exit();
+
+		if ((blocks == NULL)
+		 && (atomic_ops_uint_load(&RIG_SMR_Reclaimer_State, ATOMIC_OPS_FENCE_ACQUIRE) != RIG_SMR_RECLAIMER_RUNNING)) {
+			break;
+		}
+	}
+
+	atomic_ops_uint_store(&RIG_SMR_Reclaimer_ThreadID, 0, ATOMIC_OPS_FENCE_FULL);
+
+	return (NULL);
+}
@@ -17,18 +17,33 @@
 /*
  * Rig Stack Data Definitions
  */
-#if RIG_STACK_SMR_TYPE == 1
-	#define SMR_HP_TOP 0
-#endif
+#define SMR_HP_TOP 0
+
+#define STACK_SMR(s) ((TEST_BITFIELD((s)->flags, RIG_STACK_SMR_EPOCH)) ? (SMR_EPOCH) \
+	: ((TEST_BITFIELD((s)->flags, RIG_STACK_SMR_QSBR)) ? (SMR_QSBR) : (SMR_HP)))
+#define STACK_COUNTED(s) (!TEST_BITFIELD((s)->flags, RIG_STACK_NOCOUNT))
+// Chains from pop_all() remember the SMR scheme of their stack in the lowest two bits
+#define CHAIN_EPOCH ((uintptr_t)0x01)
+#define CHAIN_QSBR ((uintptr_t)0x02)
+#define CHAIN_SMR_MASK ((uintptr_t)0x03)
+
+#define ELIM_SLOTS 16 // power of two
+#define ELIM_SPIN 128
+#define ELIM_WAITING ((uintptr_t)0x01)
 
 /** Types */
 typedef struct NodeStruct *Node;
+typedef struct SlotStruct *Slot;
 
 /** Structures */
 struct rig_stack {
 	CACHELINE_ALONE(atomic_ops_ptr, top);
-	RIG_COUNTER count;
-	RIG_COUNTER refcount;
+	CACHELINE_ALONE(struct rig_counter, count);
+	struct rig_counter refcount;
+	RIG_EVENTCOUNT events;
+	Slot elim; // read-only value, NULL if elimination is disabled
+	atomic_ops_uint elim_range;
+	uint16_t flags; // read-only value
 };
 
 struct NodeStruct {
@@ -40,6 +55,39 @@ struct NodeStruct {
 	void* data;
 };
 
+struct SlotStruct {
+	atomic_ops_ptr exchange CACHELINE_ALIGNED;
+};
+
+/*
+ * Elimination
+ *
+ * A push() and a pop() happening at the same time cancel each other out, so
+ * when the CAS on Top fails because of contention, they can try to meet in a
+ * side array of exchange slots instead, and hand the node over directly,
+ * without ever touching Top (Hendler, Shavit, Yerushalmi).
+ * A slot is either empty (NULL), holds a node offered by a waiting push(),
+ * holds ELIM_WAITING for a waiting pop(), or holds a node tagged with
+ * ELIM_WAITING, which a push() delivered to the pop() waiting there.
+ * Whoever fills an empty slot owns it until it's empty again, and only the
+ * owner of a node ever puts it into a slot, so a successful CAS on a slot is
+ * always enough to establish ownership of the node it contains, and no SMR is
+ * needed, nodes that were exchanged never reach the stack itself.
+ * Only the first elim_range slots are used: the range grows when a slot is
+ * found taken by an operation of the same kind, and shrinks when nobody shows
+ * up to be eliminated with, so that push()es and pop()s keep colliding.
+ */
+
+static inline void stack_free_chain(Node first) ATTR_ALWAYSINLINE;
+static inline void stack_retire_node(Node node, int smr) ATTR_ALWAYSINLINE;
+static inline bool stack_pop_node(RIG_STACK s, void ** const eitem, int smr) ATTR_ALWAYSINLINE;
+static inline bool stack_peek_node(RIG_STACK s, void ** const eitem, int smr) ATTR_ALWAYSINLINE;
+static inline Slot stack_elim_slot(RIG_STACK s, Node top) ATTR_ALWAYSINLINE;
+static inline void stack_elim_adjust(RIG_STACK s, bool grow) ATTR_ALWAYSINLINE;
+static inline bool stack_elim_push(RIG_STACK s, Node node, Node top) ATTR_ALWAYSINLINE;
+static inline Node stack_elim_pop(RIG_STACK s, Node top) ATTR_ALWAYSINLINE;
+static void *stack_pop_try(void *s);
+
 
 /*
  * Rig Stack Implementation
@@ -55,6 +103,17 @@ struct NodeStruct {
  * @param flags
  *     flags to modify stack behavior, the following are currently supported:
  *     - RIG_STACK_NOCOUNT (do not count elements, capacity is not enforced)
+ *     - RIG_STACK_SHARDED_COUNT (count elements with a sharded counter, which
+ *       scales with many threads, but makes counting them approximate while
+ *       other threads update the stack, capacity stays exact)
+ *     - RIG_STACK_ELIMINATION (let concurrent push/pop pairs exchange their
+ *       items directly under contention, instead of retrying on the top)
+ *     - RIG_STACK_SMR_EPOCH (reclaim nodes with epochs instead of hazard
+ *       pointers)
+ *     - RIG_STACK_SMR_QSBR (reclaim nodes with quiescent states instead of
+ *       hazard pointers: operations cost no SMR stores or fences, but every
+ *       thread using the stack has to call rig_smr_qsbr_quiescent() regularly,
+ *       or go offline with rig_smr_qsbr_offline())
  *
  * @return
  *     stack pointer, NULL on error.
@@ -63,26 +122,47 @@ struct NodeStruct {
  *     - ENOMEM (insufficient memory)
  */
 RIG_STACK rig_stack_init(size_t capacity, uint16_t flags) {
-	CHECK_PERMITTED_FLAGS(flags, RIG_STACK_NOCOUNT);
+	CHECK_PERMITTED_FLAGS(flags, RIG_STACK_NOCOUNT | RIG_STACK_ELIMINATION | RIG_STACK_SMR_EPOCH | RIG_STACK_SMR_QSBR | RIG_STACK_SHARDED_COUNT);
+
+	// Only one SMR scheme can be used
+	if (TEST_BITFIELD(flags, RIG_STACK_SMR_EPOCH) && TEST_BITFIELD(flags, RIG_STACK_SMR_QSBR)) {
+		ERRET(EINVAL, NULL);
+	}
 
 	// Allocate memory for the stack
 	RIG_STACK s = rig_mem_alloc_aligned(sizeof(*s), 0, CACHELINE_SIZE, 0);
 	NULLCHECK_ERRET(s, ENOMEM, NULL);
 
-	// Initialize the counters
-	RIG_COUNTER refcount = rig_counter_init(1, 0);
-	NULLCHECK_ERRET_CLEANUP(refcount, ENOMEM, NULL, rig_mem_free_aligned(s));
+	// Initialize the counters, the count stays unused if not counting elements
+	VERIFY_ERRET(rig_counter_init_inline(&s->refcount, 1, 0, false));
+
+	if (!rig_counter_init_inline(&s->count, 0, capacity,
+		(!TEST_BITFIELD(flags, RIG_STACK_NOCOUNT)) && (TEST_BITFIELD(flags, RIG_STACK_SHARDED_COUNT)))) {
+		rig_mem_free_aligned(s);
+		ERRET(ENOMEM, NULL);
+	}
+
+	// Initialize the event-count, for waiting consumers
+	RIG_EVENTCOUNT events = rig_eventcount_init();
+	NULLCHECK_ERRET_CLEANUP(events, ENOMEM, NULL, rig_counter_destroy_inline(&s->count); rig_mem_free_aligned(s));
+
+	Slot elim = NULL;
+	if (TEST_BITFIELD(flags, RIG_STACK_ELIMINATION)) { // Support elimination
+		elim = rig_mem_alloc_aligned(sizeof(*elim) * ELIM_SLOTS, 0, CACHELINE_SIZE, 0);
+		NULLCHECK_ERRET_CLEANUP(elim, ENOMEM, NULL,
+			rig_counter_destroy_inline(&s->count); rig_mem_free_aligned(s); rig_eventcount_destroy(&events));
 
-	RIG_COUNTER count = NULL;
-	if (!TEST_BITFIELD(flags, RIG_STACK_NOCOUNT)) { // Support not counting elements
-		count = rig_counter_init(0, capacity);
-		NULLCHECK_ERRET_CLEANUP(count, ENOMEM, NULL, rig_mem_free_aligned(s); rig_counter_destroy(&refcount));
+		for (size_t i = 0; i < ELIM_SLOTS; i++) {
+			atomic_ops_ptr_store(&elim[i].exchange, NULL, ATOMIC_OPS_FENCE_NONE);
+		}
 	}
 
 	// Initialize the needed values
 	atomic_ops_ptr_store(&s->top, NULL, ATOMIC_OPS_FENCE_NONE);
-	s->count = count;
-	s->refcount = refcount;
+	s->events = events;
+	s->elim = elim;
+	atomic_ops_uint_store(&s->elim_range, 1, ATOMIC_OPS_FENCE_NONE);
+	s->flags = flags;
 
 	atomic_ops_fence(ATOMIC_OPS_FENCE_FULL);
 
@@ -101,7 +181,7 @@ RIG_STACK rig_stack_init(size_t capacity, uint16_t flags) {
 RIG_STACK rig_stack_newref(RIG_STACK s) {
 	NULLCHECK_EXIT(s);
 
-	rig_acheck_msg(rig_counter_inc(s->refcount), "more references than physically possible");
+	rig_acheck_msg(rig_counter_inc(&s->refcount), "more references than physically possible");
 
 	return (s);
 }
@@ -117,25 +197,20 @@ void rig_stack_destroy(RIG_STACK *s) {
 	NULLCHECK_EXIT(s);
 	NULLCHECK_EXIT(*s);
 
-	if (rig_counter_dec_and_test((*s)->refcount)) {
-		// Traverse the list and remove all nodes
-		Node curr = atomic_ops_ptr_load(&(*s)->top, ATOMIC_OPS_FENCE_NONE), succ = NULL;
-
-		while (curr != NULL) {
-#if !defined(RIG_STACK_PRECISE_ITERATOR)
-			succ = curr->next;
-#else
-			succ = atomic_ops_flagptr_load(&curr->next, NULL, ATOMIC_OPS_FENCE_NONE);
-#endif
-			// Free directly here, as there are no shared references anymore around, no SMR is required!
-			rig_mem_free(curr);
+	int smr = STACK_SMR(*s);
 
-			curr = succ;
+	if (rig_counter_dec_and_test(&(*s)->refcount)) {
+		// Traverse the list and remove all nodes
+		// Free directly here, as there are no shared references anymore around, no SMR is required!
+		stack_free_chain(atomic_ops_ptr_load(&(*s)->top, ATOMIC_OPS_FENCE_NONE));
+
+		// Destroy counters, event-count, elimination slots and stack
+		rig_counter_destroy_inline(&(*s)->refcount);
+		rig_counter_destroy_inline(&(*s)->count);
+		rig_eventcount_destroy(&(*s)->events);
+		if ((*s)->elim != NULL) {
+			rig_mem_free_aligned((*s)->elim);
 		}
-
-		// Destroy counters and stack
-		rig_counter_destroy(&(*s)->refcount);
-		rig_counter_destroy(&(*s)->count);
 		rig_mem_free_aligned(*s);
 	}
 	else {
@@ -147,14 +222,14 @@ void rig_stack_destroy(RIG_STACK *s) {
 
 	atomic_ops_fence(ATOMIC_OPS_FENCE_FULL);
 
-#if RIG_STACK_SMR_TYPE == 1
-	// Explicit SMR HP scan
-	rig_smr_hp_mem_scan();
-#endif
+	if (smr == SMR_HP) {
+		// Explicit SMR HP scan
+		rig_smr_hp_mem_scan();
+	}
 }
 
 /**
- * Clear the stack by popping elements from it until it's empty.
+ * Clear the stack by detaching all its elements at once.
  *
  * @param s
  *     stack pointer
@@ -162,7 +237,8 @@ void rig_stack_destroy(RIG_STACK *s) {
 void rig_stack_clear(RIG_STACK s) {
 	NULLCHECK_EXIT(s);
 
-	while (rig_stack_pop(s) != NULL) { ; }
+	RIG_STACK_CHAIN chain = rig_stack_pop_all(s);
+	rig_stack_chain_end(&chain);
 }
 
 /**
@@ -184,13 +260,13 @@ bool rig_stack_push(RIG_STACK s, void *item) {
 	NULLCHECK_EXIT(s);
 
 	// Allocate memory for the new element
-	Node node = rig_mem_alloc(sizeof(*node), 0);
+	Node node = rig_mem_pool_alloc(sizeof(*node));
 	NULLCHECK_ERRET(node, ENOMEM, false);
 
 	// Check if there's still place for the new element
-	if ((s->count != NULL) && (!rig_counter_inc(s->count))) {
+	if ((STACK_COUNTED(s)) && (!rig_counter_inc(&s->count))) {
 		// Full stack
-		ERRET_CLEANUP(EXFULL, false, rig_mem_free(node));
+		ERRET_CLEANUP(EXFULL, false, rig_mem_pool_free(node));
 	}
 
 	// Set the content of the new element
@@ -208,6 +284,90 @@ bool rig_stack_push(RIG_STACK s, void *item) {
 #endif
 
 		if (atomic_ops_ptr_cas(&s->top, top, node, ATOMIC_OPS_FENCE_FULL)) {
+			rig_eventcount_notify(s->events, 1);
+
+			return (true);
+		}
+
+		// Contention on Top, try to hand the node to a concurrent pop() instead
+		if ((s->elim != NULL) && (stack_elim_push(s, node, top))) {
+			return (true);
+		}
+	}
+}
+
+/**
+ * Add multiple items at the top of the stack, in the order they appear in
+ * the items array, so that the last one ends up at the top, as if they had
+ * been pushed one by one. Either all items are added, or none is.
+ * The new nodes are linked to each other privately first, and then put at
+ * the top of the stack with a single CAS, while capacity is checked with a
+ * single counter update for the whole batch.
+ *
+ * @param s
+ *     stack pointer
+ * @param items
+ *     array of data pointers (memory management caller responsibility)
+ * @param count
+ *     number of items to add
+ *
+ * @return
+ *     boolean indicating success.
+ *     On error, the following error codes are set:
+ *     - EINVAL (invalid count passed)
+ *     - ENOMEM (insufficient memory to add the new items)
+ *     - EXFULL (not enough capacity left to add all items)
+ */
+bool rig_stack_push_chain(RIG_STACK s, void *items[], size_t count) {
+	NULLCHECK_EXIT(s);
+	NULLCHECK_EXIT(items);
+
+	if ((count == 0) || (count > (size_t)SSIZE_MAX)) {
+		ERRET(EINVAL, false);
+	}
+
+	// Allocate memory for the new elements and link them together, from the
+	// top of the chain (last item) down to its bottom (first item)
+	Node first = NULL, last = NULL;
+
+	for (size_t i = 0; i < count; i++) {
+		Node node = rig_mem_pool_alloc(sizeof(*node));
+		NULLCHECK_ERRET_CLEANUP(node, ENOMEM, false, stack_free_chain(first));
+
+		node->data = items[i];
+#if !defined(RIG_STACK_PRECISE_ITERATOR)
+		node->next = first;
+#else
+		atomic_ops_flagptr_store(&node->next, first, false, ATOMIC_OPS_FENCE_NONE);
+#endif
+
+		if (last == NULL) {
+			last = node;
+		}
+
+		first = node;
+	}
+
+	// Check if there's still place for all the new elements
+	if ((STACK_COUNTED(s)) && (!rig_counter_add(&s->count, (ssize_t)count))) {
+		// Full stack
+		ERRET_CLEANUP(EXFULL, false, stack_free_chain(first));
+	}
+
+	Node top = NULL;
+
+	while (true) {
+		top = atomic_ops_ptr_load(&s->top, ATOMIC_OPS_FENCE_NONE);
+
+#if !defined(RIG_STACK_PRECISE_ITERATOR)
+		last->next = top;
+#else
+		atomic_ops_flagptr_store(&last->next, top, false, ATOMIC_OPS_FENCE_NONE);
+#endif
+
+		if (atomic_ops_ptr_cas(&s->top, top, first, ATOMIC_OPS_FENCE_FULL)) {
+			rig_eventcount_notify(s->events, count);
+
 			return (true);
 		}
 	}
@@ -227,34 +387,54 @@ bool rig_stack_push(RIG_STACK s, void *item) {
 void *rig_stack_pop(RIG_STACK s) {
 	NULLCHECK_EXIT(s);
 
+	void *item = NULL;
+
+	if (!SMR_DISPATCH(STACK_SMR(s), stack_pop_node, s, &item)) {
+		// Empty stack
+		ERRET(ENOENT, NULL);
+	}
+
+	return (item);
+}
+
+/**
+ * INTERNAL
+ * Remove the top node from the stack, getting its item, either from the
+ * stack itself or from a concurrent push() through elimination.
+ *
+ * @param s
+ *     stack pointer
+ * @param *eitem
+ *     pointer in which to store the removed item
+ * @param smr
+ *     SMR scheme (constant)
+ *
+ * @return
+ *     boolean indicating success, false if the stack is empty
+ */
+static inline bool stack_pop_node(RIG_STACK s, void ** const eitem, int smr) {
 	Node top = NULL;
 #if defined(RIG_STACK_PRECISE_ITERATOR)
 	Node next = NULL;
 	bool mark = false;
 #endif
 
-#if RIG_STACK_SMR_TYPE == 1
-	RIG_SMR_HP_Record hprec = rig_smr_hp_record_get();
-#endif
-#if RIG_STACK_SMR_TYPE == 2
-	rig_smr_epoch_critical_enter();
-#endif
+	RIG_SMR_HP_Record hprec = rig_smr_enter(smr);
 
 	while (true) {
 		top = atomic_ops_ptr_load(&s->top, ATOMIC_OPS_FENCE_ACQUIRE);
-#if RIG_STACK_SMR_TYPE == 1
-		rig_smr_hp_set(hprec, SMR_HP_TOP, top);
-		if (top != atomic_ops_ptr_load(&s->top, ATOMIC_OPS_FENCE_ACQUIRE)) {
-			continue;
+		if (smr == SMR_HP) {
+			rig_smr_hp_set(hprec, SMR_HP_TOP, top);
+			if (top != atomic_ops_ptr_load(&s->top, ATOMIC_OPS_FENCE_ACQUIRE)) {
+				continue;
+			}
 		}
-#endif
 
 		if (top == NULL) {
-#if RIG_STACK_SMR_TYPE == 2
-			rig_smr_epoch_critical_exit();
-#endif
+			rig_smr_exit(smr);
+
 			// Empty stack
-			ERRET(ENOENT, NULL);
+			return (false);
 		}
 
 #if !defined(RIG_STACK_PRECISE_ITERATOR)
@@ -265,48 +445,457 @@ void *rig_stack_pop(RIG_STACK s) {
 		// Mark node for deletion (logical removal)
 		if ((!mark) && (atomic_ops_flagptr_cas(&top->next, next, false, next, true, ATOMIC_OPS_FENCE_FULL))) {
 #endif
-			if (s->count != NULL) { // Counting supported
-				rig_acheck_msg(rig_counter_dec(s->count), "removing non-counted node");
+			if (STACK_COUNTED(s)) { // Counting supported
+				rig_acheck_msg(rig_counter_dec(&s->count), "removing non-counted node");
 			}
 
-			void *item = top->data;
+			*eitem = top->data;
 
 #if defined(RIG_STACK_PRECISE_ITERATOR)
 			// Attempt physical removal
 			if (atomic_ops_ptr_cas(&s->top, top, next, ATOMIC_OPS_FENCE_FULL)) {
 #endif
-#if RIG_STACK_SMR_TYPE == 1
-				rig_smr_hp_mem_retire(top);
-#endif
-#if RIG_STACK_SMR_TYPE == 2
-				rig_smr_epoch_mem_retire(top);
-#endif
+				rig_smr_pool_retire(smr, top);
 #if defined(RIG_STACK_PRECISE_ITERATOR)
 			}
 #endif
 
-#if RIG_STACK_SMR_TYPE == 1
-			rig_smr_hp_release(hprec, SMR_HP_TOP);
-#endif
-#if RIG_STACK_SMR_TYPE == 2
-			rig_smr_epoch_critical_exit();
-#endif
+			if (smr == SMR_HP) {
+				rig_smr_hp_release(hprec, SMR_HP_TOP);
+			}
+			rig_smr_exit(smr);
 
-			return (item);
+			return (true);
 		}
 
 #if defined(RIG_STACK_PRECISE_ITERATOR)
 		// Help out by advancing top (attempt physical removal)
 		if (atomic_ops_ptr_cas(&s->top, top, next, ATOMIC_OPS_FENCE_FULL)) {
-#if RIG_STACK_SMR_TYPE == 1
-			rig_smr_hp_mem_retire(top);
+			rig_smr_pool_retire(smr, top);
+		}
 #endif
-#if RIG_STACK_SMR_TYPE == 2
-			rig_smr_epoch_mem_retire(top);
+
+		// Contention on Top, try to take a node from a concurrent push() instead
+		if (s->elim != NULL) {
+			Node node = stack_elim_pop(s, top);
+
+			if (node != NULL) {
+				if (STACK_COUNTED(s)) { // Counting supported
+					rig_acheck_msg(rig_counter_dec(&s->count), "removing non-counted node");
+				}
+
+				*eitem = node->data;
+
+				// The node never was on the stack, nobody else can reference it
+				rig_mem_pool_free(node);
+
+				if (smr == SMR_HP) {
+					rig_smr_hp_release(hprec, SMR_HP_TOP);
+				}
+				rig_smr_exit(smr);
+
+				return (true);
+			}
+		}
+	}
+}
+
+/**
+ * Remove all items from the stack at once, and return them as a private
+ * chain, to be consumed with rig_stack_chain_next(), top item first.
+ * The whole stack is detached with a single atomic operation, no matter how
+ * many items it holds, so this is much cheaper than popping them one by one
+ * when draining the stack completely.
+ * The chain must be either consumed until its end, or released with
+ * rig_stack_chain_end().
+ *
+ * @param s
+ *     stack pointer
+ *
+ * @return
+ *     chain pointer, NULL on error.
+ *     On error, the following error codes are set:
+ *     - ENOENT (empty stack, nothing to return)
+ */
+RIG_STACK_CHAIN rig_stack_pop_all(RIG_STACK s) {
+	NULLCHECK_EXIT(s);
+
+	Node top = NULL;
+	int smr = STACK_SMR(s);
+
+	if (smr != SMR_HP) {
+		rig_smr_enter(smr);
+	}
+
+	// Detach the whole stack: no other thread can reach its nodes anymore
+	// afterwards, but they may still be looking at the ones they already had
+	do {
+		top = atomic_ops_ptr_load(&s->top, ATOMIC_OPS_FENCE_NONE);
+	} while ((top != NULL) && (!atomic_ops_ptr_cas(&s->top, top, NULL, ATOMIC_OPS_FENCE_FULL)));
+
+	Node first = NULL, last = NULL, curr = top, succ = NULL;
+	size_t items = 0;
+
+	while (curr != NULL) {
+#if !defined(RIG_STACK_PRECISE_ITERATOR)
+		succ = curr->next;
+#else
+		bool mark = false;
+		succ = atomic_ops_flagptr_load(&curr->next, &mark, ATOMIC_OPS_FENCE_ACQUIRE);
+
+		if (mark) {
+			// A pop() already took this item (see "Marked nodes left behind"),
+			// and can't physically remove the node anymore, so we retire it
+			stack_retire_node(curr, smr);
+
+			curr = succ;
+			continue;
+		}
+
+		// Mark the node as ours: this also stops iterators from relinking its
+		// successor, retry if one did so in the meantime, or a pop() took it
+		if (!atomic_ops_flagptr_cas(&curr->next, succ, false, succ, true, ATOMIC_OPS_FENCE_FULL)) {
+			continue;
+		}
+
+		// Skip the retired nodes in our chain
+		if (last != NULL) {
+			atomic_ops_flagptr_store(&last->next, curr, true, ATOMIC_OPS_FENCE_NONE);
+		}
 #endif
+
+		if (first == NULL) {
+			first = curr;
 		}
+
+		last = curr;
+		items++;
+
+		curr = succ;
+	}
+
+#if defined(RIG_STACK_PRECISE_ITERATOR)
+	if (last != NULL) {
+		atomic_ops_flagptr_store(&last->next, NULL, true, ATOMIC_OPS_FENCE_NONE);
+	}
+#endif
+
+	if (smr != SMR_HP) {
+		rig_smr_exit(smr);
+	}
+
+	if (first == NULL) {
+		// Empty stack
+		ERRET(ENOENT, NULL);
+	}
+
+	if (STACK_COUNTED(s)) { // Counting supported
+		rig_acheck_msg(rig_counter_add(&s->count, -(ssize_t)items), "removing non-counted nodes");
+	}
+
+	if (smr == SMR_EPOCH) {
+		return ((RIG_STACK_CHAIN)((uintptr_t)first | CHAIN_EPOCH));
+	}
+
+	if (smr == SMR_QSBR) {
+		return ((RIG_STACK_CHAIN)((uintptr_t)first | CHAIN_QSBR));
+	}
+
+	return ((RIG_STACK_CHAIN)first);
+}
+
+/**
+ * Get the next item from a chain returned by rig_stack_pop_all().
+ * When the end is reached, the chain pointer is set to NULL.
+ *
+ * @param *chain
+ *     pointer to chain pointer
+ *
+ * @return
+ *     data pointer, NULL on error.
+ *     On error, the following error codes are set:
+ *     - ENOENT (empty chain, end reached)
+ */
+void *rig_stack_chain_next(RIG_STACK_CHAIN *chain) {
+	NULLCHECK_EXIT(chain);
+
+	uintptr_t tag = (uintptr_t)*chain & CHAIN_SMR_MASK;
+	Node curr = (Node)((uintptr_t)*chain & ~CHAIN_SMR_MASK), succ = NULL;
+
+	if (curr == NULL) {
+		ERRET(ENOENT, NULL);
+	}
+
+#if !defined(RIG_STACK_PRECISE_ITERATOR)
+	succ = curr->next;
+#else
+	succ = atomic_ops_flagptr_load(&curr->next, NULL, ATOMIC_OPS_FENCE_NONE);
+#endif
+
+	*chain = (succ == NULL) ? (NULL) : ((RIG_STACK_CHAIN)((uintptr_t)succ | tag));
+
+	void *item = curr->data;
+
+	stack_retire_node(curr, (tag == CHAIN_EPOCH) ? (SMR_EPOCH) : ((tag == CHAIN_QSBR) ? (SMR_QSBR) : (SMR_HP)));
+
+	return (item);
+}
+
+/**
+ * Release a chain returned by rig_stack_pop_all(), dropping all its
+ * remaining items, and set pointer to NULL.
+ *
+ * @param *chain
+ *     pointer to chain pointer
+ */
+void rig_stack_chain_end(RIG_STACK_CHAIN *chain) {
+	NULLCHECK_EXIT(chain);
+
+	while (*chain != NULL) {
+		rig_stack_chain_next(chain);
+	}
+}
+
+/**
+ * Remove the top item from the stack and return it, waiting for one to be
+ * pushed if the stack is empty.
+ * After trying for a short while, the calling thread goes to sleep until an
+ * item is pushed or the timeout expires. Producers only ever make a system
+ * call to wake up consumers if there are any waiting.
+ * On RIG_STACK_SMR_QSBR stacks, the calling thread is offline while it
+ * sleeps, and thus doesn't hold back reclamation for the other threads.
+ *
+ * @param s
+ *     stack pointer
+ * @param timeout
+ *     maximum time to wait in microseconds, 0 means not to wait at all,
+ *     returning right after a single try, SIZE_MAX means no limit
+ *
+ * @return
+ *     data pointer, NULL on error.
+ *     On error, the following error codes are set:
+ *     - ETIMEDOUT (empty stack, no item was pushed before the timeout expired)
+ */
+void *rig_stack_pop_wait(RIG_STACK s, size_t timeout) {
+	NULLCHECK_EXIT(s);
+
+	return (rig_eventcount_await(s->events, &stack_pop_try, s, (STACK_SMR(s) == SMR_QSBR), timeout));
+}
+
+/**
+ * INTERNAL
+ * Remove the top item from the stack, for rig_eventcount_await().
+ *
+ * @param s
+ *     stack pointer
+ *
+ * @return
+ *     data pointer, NULL if the stack is empty
+ */
+static void *stack_pop_try(void *s) {
+	return (rig_stack_pop(s));
+}
+
+/**
+ * INTERNAL
+ * Free a private chain of nodes, that no other thread can reference.
+ *
+ * @param first
+ *     first node of the chain, can be NULL
+ */
+static inline void stack_free_chain(Node first) {
+	Node curr = first, succ = NULL;
+
+	while (curr != NULL) {
+#if !defined(RIG_STACK_PRECISE_ITERATOR)
+		succ = curr->next;
+#else
+		succ = atomic_ops_flagptr_load(&curr->next, NULL, ATOMIC_OPS_FENCE_NONE);
 #endif
+		rig_mem_pool_free(curr);
+
+		curr = succ;
+	}
+}
+
+/**
+ * INTERNAL
+ * Retire a node that was removed from the stack, but that other threads
+ * may still be looking at.
+ *
+ * @param node
+ *     node pointer
+ * @param smr
+ *     SMR scheme
+ */
+static inline void stack_retire_node(Node node, int smr) {
+	if (smr == SMR_EPOCH) {
+		// Retire with an up-to-date epoch, the chain may come from another thread
+		rig_smr_epoch_critical_enter();
+		rig_smr_epoch_pool_retire(node);
+		rig_smr_epoch_critical_exit();
+	}
+	else if (smr == SMR_QSBR) {
+		// Offline threads catch up with the global epoch on retiring by themselves
+		rig_smr_qsbr_pool_retire(node);
+	}
+	else {
+		rig_smr_hp_pool_retire(node);
+	}
+}
+
+/**
+ * INTERNAL
+ * Select the elimination slot to use, among the ones currently in range.
+ * The thread ID spreads threads over the slots, the current Top varies it
+ * between attempts, without needing any per-thread random state.
+ *
+ * @param s
+ *     stack pointer
+ * @param top
+ *     value of Top observed by the failed operation
+ *
+ * @return
+ *     elimination slot pointer
+ */
+static inline Slot stack_elim_slot(RIG_STACK s, Node top) {
+	size_t range = atomic_ops_uint_load(&s->elim_range, ATOMIC_OPS_FENCE_NONE);
+	size_t hash = (rig_thread_id() * (size_t)0x9E3779B9) ^ ((uintptr_t)top >> 4);
+
+	return (&s->elim[(hash ^ (hash >> 7)) % range]);
+}
+
+/**
+ * INTERNAL
+ * Adapt the range of elimination slots in use to the current contention.
+ * This is only a hint, lost updates don't matter.
+ *
+ * @param s
+ *     stack pointer
+ * @param grow
+ *     true to use one more slot, false to use one less
+ */
+static inline void stack_elim_adjust(RIG_STACK s, bool grow) {
+	size_t range = atomic_ops_uint_load(&s->elim_range, ATOMIC_OPS_FENCE_NONE);
+
+	if ((grow) && (range < ELIM_SLOTS)) {
+		atomic_ops_uint_store(&s->elim_range, range + 1, ATOMIC_OPS_FENCE_NONE);
+	}
+	else if ((!grow) && (range > 1)) {
+		atomic_ops_uint_store(&s->elim_range, range - 1, ATOMIC_OPS_FENCE_NONE);
+	}
+}
+
+/**
+ * INTERNAL
+ * Try to eliminate a push() with a concurrent pop(), by handing its node over
+ * to a pop() already waiting in an elimination slot, or by offering it in an
+ * empty slot and waiting a short while for a pop() to take it.
+ *
+ * @param s
+ *     stack pointer
+ * @param node
+ *     fully initialized node to hand over
+ * @param top
+ *     value of Top observed by the failed push()
+ *
+ * @return
+ *     boolean indicating if the node was taken by a pop()
+ */
+static inline bool stack_elim_push(RIG_STACK s, Node node, Node top) {
+	Slot slot = stack_elim_slot(s, top);
+	void *value = atomic_ops_ptr_load(&slot->exchange, ATOMIC_OPS_FENCE_NONE);
+
+	if ((uintptr_t)value == ELIM_WAITING) {
+		// A pop() is waiting, deliver the node to it
+		return (atomic_ops_ptr_cas(&slot->exchange, value, (void *)((uintptr_t)node | ELIM_WAITING),
+			ATOMIC_OPS_FENCE_FULL));
 	}
+
+	if (value != NULL) {
+		// Another push() is already waiting here
+		stack_elim_adjust(s, true);
+		return (false);
+	}
+
+	// Offer the node and wait for a pop() to take it
+	if (!atomic_ops_ptr_cas(&slot->exchange, NULL, node, ATOMIC_OPS_FENCE_FULL)) {
+		return (false);
+	}
+
+	for (size_t spin = 0; spin < ELIM_SPIN; spin++) {
+		if (atomic_ops_ptr_load(&slot->exchange, ATOMIC_OPS_FENCE_NONE) != node) {
+			atomic_ops_fence(ATOMIC_OPS_FENCE_ACQUIRE);
+			return (true);
+		}
+	}
+
+	// Nobody came, withdraw the offer, unless a pop() took it in the meantime
+	if (atomic_ops_ptr_cas(&slot->exchange, node, NULL, ATOMIC_OPS_FENCE_FULL)) {
+		stack_elim_adjust(s, false);
+		return (false);
+	}
+
+	return (true);
+}
+
+/**
+ * INTERNAL
+ * Try to eliminate a pop() with a concurrent push(), by taking the node
+ * offered by a push() already waiting in an elimination slot, or by waiting
+ * in an empty slot for a short while for a push() to deliver one.
+ *
+ * @param s
+ *     stack pointer
+ * @param top
+ *     value of Top observed by the failed pop()
+ *
+ * @return
+ *     node handed over by a push(), now owned by the caller, NULL if none
+ */
+static inline Node stack_elim_pop(RIG_STACK s, Node top) {
+	Slot slot = stack_elim_slot(s, top);
+	void *value = atomic_ops_ptr_load(&slot->exchange, ATOMIC_OPS_FENCE_NONE);
+
+	if (value != NULL) {
+		if (((uintptr_t)value & ELIM_WAITING) == 0) {
+			// A push() is waiting, take its node
+			if (atomic_ops_ptr_cas(&slot->exchange, value, NULL, ATOMIC_OPS_FENCE_FULL)) {
+				return (value);
+			}
+		}
+		else {
+			// Another pop() is already waiting here
+			stack_elim_adjust(s, true);
+		}
+
+		return (NULL);
+	}
+
+	// Announce that we're waiting for a push() to deliver a node
+	if (!atomic_ops_ptr_cas(&slot->exchange, NULL, (void *)ELIM_WAITING, ATOMIC_OPS_FENCE_FULL)) {
+		return (NULL);
+	}
+
+	for (size_t spin = 0; spin < ELIM_SPIN; spin++) {
+		value = atomic_ops_ptr_load(&slot->exchange, ATOMIC_OPS_FENCE_NONE);
+
+		if ((uintptr_t)value != ELIM_WAITING) {
+			break;
+		}
+	}
+
+	// Nobody came, withdraw, unless a push() delivered a node in the meantime
+	if (atomic_ops_ptr_cas(&slot->exchange, (void *)ELIM_WAITING, NULL, ATOMIC_OPS_FENCE_FULL)) {
+		stack_elim_adjust(s, false);
+		return (NULL);
+	}
+
+	// We still own the slot, so the delivered node can't change anymore
+	value = atomic_ops_ptr_load(&slot->exchange, ATOMIC_OPS_FENCE_ACQUIRE);
+	atomic_ops_ptr_store(&slot->exchange, NULL, ATOMIC_OPS_FENCE_RELEASE);
+
+	return ((Node)((uintptr_t)value & ~ELIM_WAITING));
 }
 
 /**
@@ -323,34 +912,53 @@ void *rig_stack_pop(RIG_STACK s) {
 void *rig_stack_peek(RIG_STACK s) {
 	NULLCHECK_EXIT(s);
 
+	void *item = NULL;
+
+	if (!SMR_DISPATCH(STACK_SMR(s), stack_peek_node, s, &item)) {
+		// Empty stack
+		ERRET(ENOENT, NULL);
+	}
+
+	return (item);
+}
+
+/**
+ * INTERNAL
+ * Get the item of the top node of the stack, without removing it.
+ *
+ * @param s
+ *     stack pointer
+ * @param *eitem
+ *     pointer in which to store the item
+ * @param smr
+ *     SMR scheme (constant)
+ *
+ * @return
+ *     boolean indicating success, false if the stack is empty
+ */
+static inline bool stack_peek_node(RIG_STACK s, void ** const eitem, int smr) {
 	Node top = NULL;
 #if defined(RIG_STACK_PRECISE_ITERATOR)
 	Node next = NULL;
 	bool mark = false;
 #endif
 
-#if RIG_STACK_SMR_TYPE == 1
-	RIG_SMR_HP_Record hprec = rig_smr_hp_record_get();
-#endif
-#if RIG_STACK_SMR_TYPE == 2
-	rig_smr_epoch_critical_enter();
-#endif
+	RIG_SMR_HP_Record hprec = rig_smr_enter(smr);
 
 	while (true) {
 		top = atomic_ops_ptr_load(&s->top, ATOMIC_OPS_FENCE_ACQUIRE);
-#if RIG_STACK_SMR_TYPE == 1
-		rig_smr_hp_set(hprec, SMR_HP_TOP, top);
-		if (top != atomic_ops_ptr_load(&s->top, ATOMIC_OPS_FENCE_ACQUIRE)) {
-			continue;
+		if (smr == SMR_HP) {
+			rig_smr_hp_set(hprec, SMR_HP_TOP, top);
+			if (top != atomic_ops_ptr_load(&s->top, ATOMIC_OPS_FENCE_ACQUIRE)) {
+				continue;
+			}
 		}
-#endif
 
 		if (top == NULL) {
-#if RIG_STACK_SMR_TYPE == 2
-			rig_smr_epoch_critical_exit();
-#endif
+			rig_smr_exit(smr);
+
 			// Empty stack
-			ERRET(ENOENT, NULL);
+			return (false);
 		}
 
 #if defined(RIG_STACK_PRECISE_ITERATOR)
@@ -358,27 +966,20 @@ void *rig_stack_peek(RIG_STACK s) {
 
 		if (!mark) {
 #endif
-		void *item = top->data;
+		*eitem = top->data;
 
-#if RIG_STACK_SMR_TYPE == 1
-		rig_smr_hp_release(hprec, SMR_HP_TOP);
-#endif
-#if RIG_STACK_SMR_TYPE == 2
-		rig_smr_epoch_critical_exit();
-#endif
+		if (smr == SMR_HP) {
+			rig_smr_hp_release(hprec, SMR_HP_TOP);
+		}
+		rig_smr_exit(smr);
 
-		return (item);
+		return (true);
 #if defined(RIG_STACK_PRECISE_ITERATOR)
 		}
 
 		// Help out by advancing top (attempt physical removal)
 		if (atomic_ops_ptr_cas(&s->top, top, next, ATOMIC_OPS_FENCE_FULL)) {
-#if RIG_STACK_SMR_TYPE == 1
-			rig_smr_hp_mem_retire(top);
-#endif
-#if RIG_STACK_SMR_TYPE == 2
-			rig_smr_epoch_mem_retire(top);
-#endif
+			rig_smr_pool_retire(smr, top);
 		}
 #endif
 	}
@@ -396,8 +997,8 @@ void *rig_stack_peek(RIG_STACK s) {
 bool rig_stack_empty(RIG_STACK s) {
 	NULLCHECK_EXIT(s);
 
-	if (s->count != NULL) { // Counting supported
-		return (rig_counter_get(s->count) == 0);
+	if (STACK_COUNTED(s)) { // Counting supported
+		return (rig_counter_get(&s->count) == 0);
 	}
 
 	return (false);
@@ -415,8 +1016,8 @@ bool rig_stack_empty(RIG_STACK s) {
 bool rig_stack_full(RIG_STACK s) {
 	NULLCHECK_EXIT(s);
 
-	if (s->count != NULL) { // Counting supported
-		return (rig_counter_get(s->count) == rig_counter_get_max(s->count));
+	if (STACK_COUNTED(s)) { // Counting supported
+		return (rig_counter_get(&s->count) == rig_counter_get_max(&s->count));
 	}
 
 	return (false);
@@ -434,8 +1035,8 @@ bool rig_stack_full(RIG_STACK s) {
 size_t rig_stack_count(RIG_STACK s) {
 	NULLCHECK_EXIT(s);
 
-	if (s->count != NULL) { // Counting supported
-		return (rig_counter_get(s->count));
+	if (STACK_COUNTED(s)) { // Counting supported
+		return (rig_counter_get(&s->count));
 	}
 
 	return (0);
@@ -453,26 +1054,59 @@ size_t rig_stack_count(RIG_STACK s) {
 size_t rig_stack_capacity(RIG_STACK s) {
 	NULLCHECK_EXIT(s);
 
-	if (s->count != NULL) { // Counting supported
-		return (rig_counter_get_max(s->count));
+	if (STACK_COUNTED(s)) { // Counting supported
+		return (rig_counter_get_max(&s->count));
 	}
 
 	return (SIZE_MAX);
 }
 
 
-#if defined(RIG_STACK_PRECISE_ITERATOR)
-
 struct rig_stack_iter {
 	RIG_STACK stack;
+	Node curr; // epochs and QSBR only, HPs keep it in SMR_IHP_CURR
+	RIG_SMR_HP_Record hprec; // HPs only
 	bool completed;
 };
 
-#define SMR_IHP_CURR 4
-#define SMR_IHP_PREV 5
+#define SMR_IHP_CURR 0
+#define SMR_IHP_PREV 1
+
+/**
+ * INTERNAL
+ * Allocate a new iterator over a stack, taking a reference to it.
+ *
+ * @param s
+ *     stack pointer
+ *
+ * @return
+ *     stack iterator pointer, NULL if there wasn't enough memory
+ */
+static RIG_STACK_ITER stack_iter_alloc(RIG_STACK s) {
+	// Allocate memory for the iterator
+	RIG_STACK_ITER iter = rig_mem_alloc(sizeof(*iter), 0);
+	if (iter == NULL) {
+		return (NULL);
+	}
+
+	// Remember the data structure and increase the reference count
+	iter->stack = rig_stack_newref(s);
+	iter->curr = NULL;
+	iter->hprec = NULL;
+	iter->completed = false;
+
+	return (iter);
+}
 
 /**
  * Create an iterator over a stack.
+ * On RIG_STACK_SMR_EPOCH stacks, the iterator holds an epoch critical section
+ * from here until rig_stack_iter_end(), which keeps every node it can reach
+ * alive without any per-node validation: it must be ended by the same thread
+ * and shouldn't be kept around for long, as no memory retired in the meantime
+ * can be reclaimed, by any thread, until then.
+ * On RIG_STACK_SMR_QSBR stacks, the same holds until the calling thread's
+ * next quiescent state, which must come after rig_stack_iter_end().
  *
  * @param s
  *     stack pointer
@@ -480,34 +1114,34 @@ struct rig_stack_iter {
  * @return
  *     stack iterator pointer, NULL on error.
  *     On error, the following error codes are set:
- *     - EALREADY (another iterator already exists)
+ *     - ENAVAIL (not available, hazard pointers need precise iterators)
  *     - ENOMEM (insufficient memory)
  */
 RIG_STACK_ITER rig_stack_iter_begin(RIG_STACK s) {
 	NULLCHECK_EXIT(s);
 
-#if RIG_STACK_SMR_TYPE == 1
-	CHECK_ITER_HPS;
-#endif
+	if (STACK_SMR(s) != SMR_HP) {
+		RIG_STACK_ITER iter = stack_iter_alloc(s);
+		NULLCHECK_ERRET(iter, ENOMEM, NULL);
 
-	// Allocate memory for the iterator
-	RIG_STACK_ITER iter = rig_mem_alloc(sizeof(*iter), 0);
-	NULLCHECK_ERRET(iter, ENOMEM, NULL);
+		rig_smr_enter(STACK_SMR(s));
 
-	// Remember the data structure and increase the reference count
-	iter->stack = rig_stack_newref(s);
-	iter->completed = false;
+		return (iter);
+	}
 
-#if RIG_STACK_SMR_TYPE == 1
-	// Set the last HP to a dummy value to ensure no other iterators can be
-	// created before this one gets dismissed, to avoid chaos with the HPs.
-	// NOTE: this does not prevent SMR from reclaiming memory, as an unaligned
-	// address never appears there, seeing as atomic operations usually expect
-	// and/or perform better on aligned addresses anyway.
-	rig_smr_hp_set(hprec, 7, (void *)0x0101);
-#endif
+#if defined(RIG_STACK_PRECISE_ITERATOR)
+	RIG_STACK_ITER iter = stack_iter_alloc(s);
+	NULLCHECK_ERRET(iter, ENOMEM, NULL);
+
+	// HPs of its own, so it can't get in the way of any other iterator
+	iter->hprec = rig_smr_hp_record_acquire();
+	NULLCHECK_ERRET_CLEANUP(iter->hprec, ENOMEM, NULL, rig_stack_destroy(&iter->stack); rig_mem_free(iter));
 
 	return (iter);
+#else
+	// The hazard pointer walk relies on marked nodes
+	ERRET(ENAVAIL, NULL);
+#endif
 }
 
 /*
@@ -526,6 +1160,74 @@ RIG_STACK_ITER rig_stack_iter_begin(RIG_STACK s) {
  * Only the Iterator needs to specifically check for this case and handle it.
  */
 
+/**
+ * INTERNAL
+ * Get the next node of an iteration over a stack using epochs or QSBR.
+ * The iterator's critical section (or, with QSBR, the calling thread not
+ * passing through a quiescent state) keeps both the node we're on and all its
+ * successors from being freed, even if they get popped in the meantime, and
+ * the next pointers of popped nodes still lead to the rest of the stack, so
+ * there is never a reason to restart from Top.
+ * Marked nodes are skipped; if prev is still in the stack we unlink them
+ * (see "Marked nodes left behind"), else we can only step over them.
+ *
+ * @param iter
+ *     stack iterator pointer
+ *
+ * @return
+ *     next node, NULL if the end was reached
+ */
+static Node stack_iter_next_epoch(RIG_STACK_ITER iter) {
+	Node prev = iter->curr, curr = NULL;
+
+#if !defined(RIG_STACK_PRECISE_ITERATOR)
+	if (prev == NULL) {
+		curr = atomic_ops_ptr_load(&iter->stack->top, ATOMIC_OPS_FENCE_ACQUIRE);
+	}
+	else {
+		curr = prev->next;
+	}
+#else
+	bool pmark = false, mark = false;
+	Node succ = NULL;
+
+	while (true) {
+		if (prev == NULL) {
+			curr = atomic_ops_ptr_load(&iter->stack->top, ATOMIC_OPS_FENCE_ACQUIRE);
+		}
+		else {
+			curr = atomic_ops_flagptr_load(&prev->next, &pmark, ATOMIC_OPS_FENCE_ACQUIRE);
+		}
+
+		if (curr == NULL) {
+			break;
+		}
+
+		succ = atomic_ops_flagptr_load(&curr->next, &mark, ATOMIC_OPS_FENCE_NONE);
+
+		if (!mark) {
+			break;
+		}
+
+		if (prev == NULL) {
+			// Help out by advancing top, then retry from it
+			if (atomic_ops_ptr_cas(&iter->stack->top, curr, succ, ATOMIC_OPS_FENCE_FULL)) {
+				rig_smr_pool_retire(STACK_SMR(iter->stack), curr);
+			}
+		}
+		else if (pmark) {
+			// prev was popped itself, so it can't be relinked anymore
+			prev = curr;
+		}
+		else if (atomic_ops_flagptr_cas(&prev->next, curr, false, succ, false, ATOMIC_OPS_FENCE_FULL)) {
+			rig_smr_pool_retire(STACK_SMR(iter->stack), curr);
+		}
+	}
+#endif
+
+	return (curr);
+}
+
 /**
  * Iterate over a stack and get a pointer to the next data item.
  * No guarantees are made about the availability of the content the returned
@@ -546,12 +1248,23 @@ void *rig_stack_iter_next(RIG_STACK_ITER iter) {
 		ERRET(ENOENT, NULL);
 	}
 
+	if (STACK_SMR(iter->stack) != SMR_HP) {
+		iter->curr = stack_iter_next_epoch(iter);
+
+		if (iter->curr == NULL) {
+			iter->completed = true;
+			ERRET(ENOENT, NULL);
+		}
+
+		return (iter->curr->data);
+	}
+
+#if defined(RIG_STACK_PRECISE_ITERATOR)
 	bool mark = false;
 	Node prev = NULL, curr = NULL, succ = NULL;
 
-#if RIG_STACK_SMR_TYPE == 1
-	// Get pointer to this thread's RIG_SMR_HP_Record
-	RIG_SMR_HP_Record hprec = rig_smr_hp_record_get();
+	// Get pointer to the iterator's own RIG_SMR_HP_Record
+	RIG_SMR_HP_Record hprec = iter->hprec;
 
 	if (rig_smr_hp_get(hprec, SMR_IHP_CURR) == NULL) {
 restarttop:
@@ -586,7 +1299,7 @@ restarttop:
 		if (mark) {
 			if (atomic_ops_ptr_cas(&iter->stack->top, curr, succ, ATOMIC_OPS_FENCE_FULL)) {
 				rig_smr_hp_release(hprec, SMR_IHP_CURR);
-				rig_smr_hp_mem_retire_noscan(curr);
+				rig_smr_hp_pool_retire_noscan(curr);
 			}
 
 			goto restarttop;
@@ -626,7 +1339,8 @@ retrycurr:
 		 *    so we can just retry to get curr, protect it and verify it.
 		 *    There is no need for a restart from top.
 		 * 3) No change in pointer, Flag changed:
-		 *     This means prev was pop()ed from the stack, so we can't trust
+		 *     This means prev was pop()ed from the stack (or detached by
+		 *     pop_all()), so we can't trust
 		 *     what it has to say about curr (prev->next) anymore: it might be
 		 *     the new Top, or it may already have been removed by other pop()s,
 		 *     even before we set the HP to it, so it may even have been fully
@@ -637,7 +1351,7 @@ retrycurr:
 		 *     because we can't trust what it tells us curr (prev->next) should
 		 *     be, so we restart from the top as the only safe place.
 		 */
-		if (curr != atomic_ops_flagptr_load_full(&prev->next, &mark, ATOMIC_OPS_FENCE_ACQUIRE)) {
+		if ((curr != atomic_ops_flagptr_load_full(&prev->next, &mark, ATOMIC_OPS_FENCE_ACQUIRE)) || (mark)) {
 			if (mark) {
 				goto restarttop;
 			}
@@ -661,7 +1375,7 @@ retrycurr:
 		if (mark) {
 			if (atomic_ops_flagptr_cas(&prev->next, curr, false, succ, false, ATOMIC_OPS_FENCE_FULL)) {
 				rig_smr_hp_release(hprec, SMR_IHP_CURR);
-				rig_smr_hp_mem_retire_noscan(curr);
+				rig_smr_hp_pool_retire_noscan(curr);
 			}
 
 			goto retrycurr;
@@ -670,7 +1384,7 @@ retrycurr:
 
 	return (curr->data);
 #else
-	return (NULL);
+	ERRET(ENAVAIL, NULL);
 #endif
 }
 
@@ -688,6 +1402,9 @@ void rig_stack_iter_end(RIG_STACK_ITER *iter) {
 		return;
 	}
 
+	int smr = STACK_SMR((*iter)->stack);
+	RIG_SMR_HP_Record hprec = (*iter)->hprec;
+
 	// Decrease reference count of the data structure
 	rig_stack_destroy(&(*iter)->stack);
 
@@ -695,49 +1412,19 @@ void rig_stack_iter_end(RIG_STACK_ITER *iter) {
 	rig_mem_free(*iter);
 	*iter = NULL;
 
-#if RIG_STACK_SMR_TYPE == 1
-	RESET_ITER_HPS;
+	if (smr != SMR_HP) {
+		rig_smr_exit(smr);
+		return;
+	}
+
+#if defined(RIG_STACK_PRECISE_ITERATOR)
+	RESET_ITER_HPS(hprec);
 
 	// Explicit SMR scan
 	rig_smr_hp_mem_scan();
 #endif
 }
 
-#else
-
-/**
- * ITERATOR NOT SUPPORTED!
- *
- * @return
- *     NULL, error ENAVAIL (not available)
- */
-RIG_STACK_ITER rig_stack_iter_begin(RIG_STACK s) {
-	NULLCHECK_EXIT(s);
-
-	ERRET(ENAVAIL, NULL);
-}
-
-/**
- * ITERATOR NOT SUPPORTED!
- *
- * @return
- *     NULL, error ENAVAIL (not available)
- */
-void *rig_stack_iter_next(RIG_STACK_ITER iter) {
-	NULLCHECK_EXIT(iter);
-
-	ERRET(ENAVAIL, NULL);
-}
-
-/**
- * ITERATOR NOT SUPPORTED!
- */
-void rig_stack_iter_end(RIG_STACK_ITER *iter) {
-	NULLCHECK_EXIT(iter);
-}
-
-#endif
-
 
 /**
  * Create a full copy of a lock-free stack.
@@ -748,7 +1435,7 @@ void rig_stack_iter_end(RIG_STACK_ITER *iter) {
  * @return
  *     new stack pointer, NULL on error.
  *     On error, the following error codes are set:
- *     - EALREADY (iterator already present, but required for copy!)
+ *     - ENAVAIL (iterator not available, but required for copy!)
  *     - ENOMEM (insufficient memory)
  */
 RIG_STACK rig_stack_duplicate(RIG_STACK s) {
@@ -757,7 +1444,7 @@ RIG_STACK rig_stack_duplicate(RIG_STACK s) {
 	// Needed functions: ds_init, ds_destroy, ds_capacity,
 	// ds_iter_begin, ds_iter_end, ds_iter_next, ds_push/put/add
 
-	RIG_STACK dup_s = rig_stack_init(rig_stack_capacity(s), (s->count == NULL) ? (RIG_STACK_NOCOUNT) : (0));
+	RIG_STACK dup_s = rig_stack_init(rig_stack_capacity(s), s->flags);
 	NULLCHECK_ERRET(dup_s, ENOMEM, NULL);
 
 	RIG_STACK_ITER iter = rig_stack_iter_begin(s);
@@ -33,6 +33,10 @@ static inline bool thread_ops_condvar_destroy(RIG_CONDVAR cond);
 static inline bool thread_ops_rwlock_init(RIG_RWLOCK rwl);
 static inline bool thread_ops_rwlock_destroy(RIG_RWLOCK rwl);
 
+static inline uint64_t thread_ops_time_us(void);
+static inline void thread_ops_futex_wait(atomic_ops_uint *addr, uintptr_t val, size_t timeout_us);
+static inline void thread_ops_futex_wake(atomic_ops_uint *addr, size_t count);
+
 static void *rig_thread_starter(void *thr);
 static void rig_thread_cleanup(void *arg);
 
@@ -49,7 +53,8 @@ static void rig_thread_cleanup(void *arg);
 /**
  * INTERNAL
  * General thread cleanup function. Currently takes care of:
- * - SMR cleanup (retire HP and Epoch records)
+ * - SMR cleanup (retire HP, Epoch, IBR and QSBR records)
+ * - Node pool cleanup (retire pool record, after SMR gave back its memory)
  *
  * @param arg
  *     void * for compatibility, not used, is always NULL
@@ -62,6 +67,15 @@ static void rig_thread_cleanup(void *arg) {
 
 	// Retire EpochRecord
 	rig_smr_epoch_record_release();
+
+	// Retire IBRRecord (implicit scan)
+	rig_smr_ibr_record_release();
+
+	// Retire QSBRRecord (goes offline)
+	rig_smr_qsbr_record_release();
+
+	// Retire PoolRecord
+	rig_mem_pool_record_release();
 }
 
 
@@ -315,6 +329,17 @@ size_t rig_thread_id(void) {
 	return (thread_id);
 }
 
+/**
+ * INTERNAL
+ * Get a monotonic time-stamp, for time measurements inside Rig.
+ *
+ * @return
+ *     time-stamp in microseconds, from an unspecified starting point
+ */
+uint64_t rig_time_us(void) {
+	return (thread_ops_time_us());
+}
+
 
 /**
  * Initialize and return a TLS (Thread Local Storage) key.
@@ -512,15 +537,33 @@ bool rig_rwlock_destroy(RIG_RWLOCK *rwl) {
 
 
 // Micro-lock static configuration
+#define RIG_MLOCK_SPIN_MIN 16
 #define RIG_MLOCK_SPIN_MAX 20000
 
+// Micro-lock states
+#define RIG_MLOCK_UNLOCKED 0
+#define RIG_MLOCK_LOCKED 1
+#define RIG_MLOCK_CONTENDED 2 // Locked, and there may be threads sleeping on it
+
 // Micro-lock data
 struct rig_mlock {
 	atomic_ops_uint mlock CACHELINE_ALIGNED;
 	atomic_ops_uint owner_id;
+	atomic_ops_uint spin; // Average spins it took to get the lock, when spinning did
+	size_t recursion; // only accessed by the owner
 	uint16_t flags; // read-only value
 };
 
+/*
+ * The Micro-lock is a three-state futex mutex: threads that can't get it right
+ * away spin for a while, then mark it as contended and sleep on it (a futex on
+ * Linux), so that only unlocking a contended lock costs a system call.
+ * How long to spin adapts to how long waiting for the lock usually takes: a
+ * running average of the spins that were needed, when spinning was enough to
+ * get it, which reflects the length of the critical sections, while having to
+ * sleep (long critical sections, owner preempted) shortens spinning.
+ */
+
 /**
  * Initialize and return a Micro-Lock.
  *
@@ -540,8 +583,10 @@ RIG_MLOCK rig_mlock_init(uint16_t flags) {
 	RIG_MLOCK ml = rig_mem_alloc_aligned(sizeof(*ml), 0, CACHELINE_SIZE, RIG_MEM_ALLOC_ALIGN_PAD);
 	NULLCHECK_ERRET(ml, ENOMEM, NULL);
 
-	atomic_ops_uint_store(&ml->mlock, 0, ATOMIC_OPS_FENCE_NONE);
+	atomic_ops_uint_store(&ml->mlock, RIG_MLOCK_UNLOCKED, ATOMIC_OPS_FENCE_NONE);
 	atomic_ops_uint_store(&ml->owner_id, 0, ATOMIC_OPS_FENCE_NONE);
+	atomic_ops_uint_store(&ml->spin, RIG_MLOCK_SPIN_MIN, ATOMIC_OPS_FENCE_NONE);
+	ml->recursion = 0;
 	ml->flags = flags;
 
 	atomic_ops_fence(ATOMIC_OPS_FENCE_RELEASE);
@@ -569,7 +614,7 @@ bool rig_mlock_destroy(RIG_MLOCK *ml) {
 	}
 
 	// Detect if the lock is still used somewhere
-	if (atomic_ops_uint_load(&(*ml)->mlock, ATOMIC_OPS_FENCE_ACQUIRE) != 0) {
+	if (atomic_ops_uint_load(&(*ml)->mlock, ATOMIC_OPS_FENCE_ACQUIRE) != RIG_MLOCK_UNLOCKED) {
 		ERRET(EBUSY, false);
 	}
 
@@ -600,11 +645,11 @@ bool rig_mlock_lock(RIG_MLOCK ml) {
 	if (atomic_ops_uint_load(&ml->owner_id, ATOMIC_OPS_FENCE_NONE) == tid) {
 		if (TEST_BITFIELD(ml->flags, RIG_MLOCK_RECURSIVE)) {
 			// I'm the owner, recursive locking, if possible!
-			if (atomic_ops_uint_load(&ml->mlock, ATOMIC_OPS_FENCE_NONE) == SIZE_MAX) {
+			if (ml->recursion == SIZE_MAX) {
 				ERRET(EAGAIN, false);
 			}
 
-			atomic_ops_uint_inc(&ml->mlock, ATOMIC_OPS_FENCE_ACQUIRE);
+			ml->recursion++;
 
 			return (true);
 		}
@@ -613,23 +658,46 @@ bool rig_mlock_lock(RIG_MLOCK ml) {
 		}
 	}
 
-	size_t spin = 0;
+	if (!atomic_ops_uint_cas(&ml->mlock, RIG_MLOCK_UNLOCKED, RIG_MLOCK_LOCKED, ATOMIC_OPS_FENCE_ACQUIRE)) {
+		size_t average = atomic_ops_uint_load(&ml->spin, ATOMIC_OPS_FENCE_NONE);
+		size_t spin_limit = (average * 2) + RIG_MLOCK_SPIN_MIN;
+		size_t spin = 0;
 
-	while (true) {
-		if ((atomic_ops_uint_load(&ml->mlock, ATOMIC_OPS_FENCE_NONE) == 0)
-		 && (atomic_ops_uint_cas(&ml->mlock, 0, 1, ATOMIC_OPS_FENCE_NONE))) {
-			atomic_ops_uint_store(&ml->owner_id, tid, ATOMIC_OPS_FENCE_ACQUIRE);
-
-			return (true);
+		if (spin_limit > RIG_MLOCK_SPIN_MAX) {
+			spin_limit = RIG_MLOCK_SPIN_MAX;
 		}
 
-		spin++;
+		while (spin < spin_limit) {
+			if ((atomic_ops_uint_load(&ml->mlock, ATOMIC_OPS_FENCE_NONE) == RIG_MLOCK_UNLOCKED)
+			 && (atomic_ops_uint_cas(&ml->mlock, RIG_MLOCK_UNLOCKED, RIG_MLOCK_LOCKED, ATOMIC_OPS_FENCE_ACQUIRE))) {
+				break;
+			}
 
-		if (spin == RIG_MLOCK_SPIN_MAX) {
-			spin = 0;
-			rig_thread_yield();
+			spin++;
+		}
+
+		if (spin < spin_limit) {
+			// Spinning paid off, move the average towards what it took
+			atomic_ops_uint_store(&ml->spin, (size_t)((ssize_t)average + (((ssize_t)spin - (ssize_t)average) / 8)),
+				ATOMIC_OPS_FENCE_NONE);
+		}
+		else {
+			// Spinning was useless, spin less next time
+			atomic_ops_uint_store(&ml->spin, average - (average / 8), ATOMIC_OPS_FENCE_NONE);
+
+			// Mark the lock as contended and sleep, until we're the ones that
+			// find it unlocked; as we can't know if other threads are still
+			// sleeping, it then stays marked, so our unlock wakes them up
+			while (atomic_ops_uint_swap(&ml->mlock, RIG_MLOCK_CONTENDED, ATOMIC_OPS_FENCE_FULL) != RIG_MLOCK_UNLOCKED) {
+				thread_ops_futex_wait(&ml->mlock, RIG_MLOCK_CONTENDED, SIZE_MAX);
+			}
 		}
 	}
+
+	atomic_ops_uint_store(&ml->owner_id, tid, ATOMIC_OPS_FENCE_NONE);
+	ml->recursion = 1;
+
+	return (true);
 }
 
 /**
@@ -654,11 +722,11 @@ bool rig_mlock_trylock(RIG_MLOCK ml) {
 	if (atomic_ops_uint_load(&ml->owner_id, ATOMIC_OPS_FENCE_NONE) == tid) {
 		if (TEST_BITFIELD(ml->flags, RIG_MLOCK_RECURSIVE)) {
 			// I'm the owner, recursive locking, if possible!
-			if (atomic_ops_uint_load(&ml->mlock, ATOMIC_OPS_FENCE_NONE) == SIZE_MAX) {
+			if (ml->recursion == SIZE_MAX) {
 				ERRET(EAGAIN, false);
 			}
 
-			atomic_ops_uint_inc(&ml->mlock, ATOMIC_OPS_FENCE_ACQUIRE);
+			ml->recursion++;
 
 			return (true);
 		}
@@ -667,9 +735,10 @@ bool rig_mlock_trylock(RIG_MLOCK ml) {
 		}
 	}
 
-	if ((atomic_ops_uint_load(&ml->mlock, ATOMIC_OPS_FENCE_NONE) == 0)
-	 && (atomic_ops_uint_cas(&ml->mlock, 0, 1, ATOMIC_OPS_FENCE_NONE))) {
-		atomic_ops_uint_store(&ml->owner_id, tid, ATOMIC_OPS_FENCE_ACQUIRE);
+	if ((atomic_ops_uint_load(&ml->mlock, ATOMIC_OPS_FENCE_NONE) == RIG_MLOCK_UNLOCKED)
+	 && (atomic_ops_uint_cas(&ml->mlock, RIG_MLOCK_UNLOCKED, RIG_MLOCK_LOCKED, ATOMIC_OPS_FENCE_ACQUIRE))) {
+		atomic_ops_uint_store(&ml->owner_id, tid, ATOMIC_OPS_FENCE_NONE);
+		ml->recursion = 1;
 
 		return (true);
 	}
@@ -691,9 +760,7 @@ bool rig_mlock_trylock(RIG_MLOCK ml) {
 bool rig_mlock_unlock(RIG_MLOCK ml) {
 	NULLCHECK_EXIT(ml);
 
-	size_t mlock = atomic_ops_uint_load(&ml->mlock, ATOMIC_OPS_FENCE_NONE);
-
-	if (mlock == 0) {
+	if (atomic_ops_uint_load(&ml->mlock, ATOMIC_OPS_FENCE_NONE) == RIG_MLOCK_UNLOCKED) {
 		ERRET(EPERM, false);
 	}
 
@@ -701,11 +768,16 @@ bool rig_mlock_unlock(RIG_MLOCK ml) {
 		ERRET(EPERM, false);
 	}
 
-	if (mlock == 1) {
-		atomic_ops_uint_store(&ml->owner_id, 0, ATOMIC_OPS_FENCE_NONE);
+	if (--ml->recursion != 0) {
+		return (true);
 	}
 
-	atomic_ops_uint_dec(&ml->mlock, ATOMIC_OPS_FENCE_RELEASE);
+	atomic_ops_uint_store(&ml->owner_id, 0, ATOMIC_OPS_FENCE_NONE);
+
+	// Only a contended lock can have sleepers to wake up
+	if (atomic_ops_uint_swap(&ml->mlock, RIG_MLOCK_UNLOCKED, ATOMIC_OPS_FENCE_FULL) == RIG_MLOCK_CONTENDED) {
+		thread_ops_futex_wake(&ml->mlock, 1);
+	}
 
 	return (true);
 }
@@ -722,7 +794,7 @@ bool rig_mlock_unlock(RIG_MLOCK ml) {
 bool rig_mlock_islocked(RIG_MLOCK ml) {
 	NULLCHECK_EXIT(ml);
 
-	return (atomic_ops_uint_load(&ml->mlock, ATOMIC_OPS_FENCE_ACQUIRE) != 0);
+	return (atomic_ops_uint_load(&ml->mlock, ATOMIC_OPS_FENCE_ACQUIRE) != RIG_MLOCK_UNLOCKED);
 }
 
 
@@ -741,24 +813,51 @@ bool rig_mlock_islocked(RIG_MLOCK ml) {
  *           read-locks will be handed out, the writer thread waits for 1 0...0
  *
  * --- owned (thread-local) ---
- * 0 0...0   the thread holds no locks
- * 0 X...X   the thread holds X read-locks (if not recursive, X == 1)
- * 1 0...0   NOT USED
- * 1 X...X   the thread holds X write-locks (if not recursive, X == 1)
+ * 0 0 0...0   the thread holds no locks
+ * 0 0 X...X   the thread holds X read-locks (if not recursive, X == 1)
+ * 0 1 X...X   the thread holds X read-locks through its reader slot
+ * 1 0 0...0   NOT USED
+ * 1 0 X...X   the thread holds X write-locks (if not recursive, X == 1)
  *
+ * Read-biased locks (RIG_MRWLOCK_READ_BIASED) add an array of reader slots,
+ * one cache-line each, one per CPU (threads are spread over them by their ID),
+ * following the BRAVO design: while reader bias is on, readers just count
+ * themselves in their slot, never touching the shared mrwlock variable.
+ * Writers first get the lock through mrwlock as usual, then revoke the bias
+ * and wait for the slots to drain. Readers that find the bias revoked go
+ * through mrwlock, and turn the bias back on once enough time has passed,
+ * proportional to how long the last revocation took, so frequent writers
+ * don't pay for revoking it each time.
  */
 
 // Micro-Read/Write lock static configuration
 #define RIG_MRWLOCK_SPIN_MAX 20000
+#define RIG_MRWLOCK_SLOTS_MAX 64
+#define RIG_MRWLOCK_BIAS_INHIBIT 9 // Times the revocation took, before re-enabling the bias
 #define RIG_MRWLOCK_WRLOCK_BIT ((size_t)1 << ((sizeof(size_t) * 8) - 1))
+#define RIG_MRWLOCK_SLOT_BIT (RIG_MRWLOCK_WRLOCK_BIT >> 1)
+
+// Micro-Read/Write lock reader slot
+struct rig_mrwlock_slot {
+	atomic_ops_uint readers CACHELINE_ALIGNED;
+};
 
 // Micro-Read/Write lock data
 struct rig_mrwlock {
 	atomic_ops_uint mrwlock CACHELINE_ALIGNED;
+	uint64_t bias_inhibit_us; // protected by mrwlock, no reader bias until then
+	atomic_ops_uint bias CACHELINE_ALIGNED; // readers may use their slot
+	struct rig_mrwlock_slot *slots; // read-only value, NULL if not read-biased
+	size_t slots_mask; // read-only value
 	struct rig_tls owned; // Directly embed rig_tls for performance and locality
 	uint16_t flags; // read-only value
 };
 
+static inline bool rig_mrwlock_slot_rdlock(RIG_MRWLOCK mrwl);
+static inline void rig_mrwlock_bias_enable(RIG_MRWLOCK mrwl);
+static bool rig_mrwlock_bias_revoke(RIG_MRWLOCK mrwl, bool wait);
+static bool rig_mrwlock_slots_busy(RIG_MRWLOCK mrwl);
+
 /**
  * Initialize and return a Micro-Read/Write (MRW) lock.
  *
@@ -768,6 +867,8 @@ struct rig_mrwlock {
  *     - RIG_MRWLOCK_RECURSIVE_READ: support recursive read-side lock acquisition
  *     - RIG_MRWLOCK_RECURSIVE_WRITE: support recursive write-side lock acquisition
  *     - RIG_MRWLOCK_RECURSIVE: support recursive lock acquisition (read & write)
+ *     - RIG_MRWLOCK_READ_BIASED: uncontended read-side acquisition only touches
+ *       per-CPU memory, making writers more expensive (read-mostly data)
  *
  * @return
  *     Micro-Read/Write (MRW) lock data, NULL on error.
@@ -776,13 +877,40 @@ struct rig_mrwlock {
  *     - ENOMEM (insufficient memory)
  */
 RIG_MRWLOCK rig_mrwlock_init(uint16_t flags) {
-	CHECK_PERMITTED_FLAGS(flags, RIG_MRWLOCK_RECURSIVE_READ | RIG_MRWLOCK_RECURSIVE_WRITE);
+	CHECK_PERMITTED_FLAGS(flags, RIG_MRWLOCK_RECURSIVE_READ | RIG_MRWLOCK_RECURSIVE_WRITE | RIG_MRWLOCK_READ_BIASED);
 
 	RIG_MRWLOCK mrwl = rig_mem_alloc_aligned(sizeof(*mrwl), 0, CACHELINE_SIZE, RIG_MEM_ALLOC_ALIGN_PAD);
 	NULLCHECK_ERRET(mrwl, ENOMEM, NULL);
 
 	atomic_ops_uint_store(&mrwl->mrwlock, 0, ATOMIC_OPS_FENCE_NONE);
+	mrwl->bias_inhibit_us = 0;
+	atomic_ops_uint_store(&mrwl->bias, 0, ATOMIC_OPS_FENCE_NONE);
+	mrwl->slots = NULL;
+	mrwl->slots_mask = 0;
+
+	if (TEST_BITFIELD(flags, RIG_MRWLOCK_READ_BIASED)) {
+		// One slot per CPU, rounded up to a power of two for cheap indexing
+		size_t slots = 1, cpus = rig_counter_cpus();
+
+		while ((slots < cpus) && (slots < RIG_MRWLOCK_SLOTS_MAX)) {
+			slots <<= 1;
+		}
+
+		mrwl->slots = rig_mem_alloc_aligned(0, slots * sizeof(*mrwl->slots), CACHELINE_SIZE, 0);
+		NULLCHECK_ERRET_CLEANUP(mrwl->slots, ENOMEM, NULL, rig_mem_free_aligned(mrwl));
+
+		for (size_t i = 0; i < slots; i++) {
+			atomic_ops_uint_store(&mrwl->slots[i].readers, 0, ATOMIC_OPS_FENCE_NONE);
+		}
+
+		mrwl->slots_mask = slots - 1;
+		atomic_ops_uint_store(&mrwl->bias, 1, ATOMIC_OPS_FENCE_NONE);
+	}
+
 	if (!thread_ops_tls_init(&mrwl->owned)) {
+		if (mrwl->slots != NULL) {
+			rig_mem_free_aligned(mrwl->slots);
+		}
 		rig_mem_free_aligned(mrwl);
 		ERRET(errno, NULL);
 	}
@@ -813,12 +941,17 @@ bool rig_mrwlock_destroy(RIG_MRWLOCK *mrwl) {
 	}
 
 	// Detect if the lock is still used somewhere
-	if (atomic_ops_uint_load(&(*mrwl)->mrwlock, ATOMIC_OPS_FENCE_ACQUIRE) != 0) {
+	if ((atomic_ops_uint_load(&(*mrwl)->mrwlock, ATOMIC_OPS_FENCE_ACQUIRE) != 0)
+	 || (rig_mrwlock_slots_busy(*mrwl))) {
 		ERRET(EBUSY, false);
 	}
 
 	thread_ops_tls_destroy(&(*mrwl)->owned);
 
+	if ((*mrwl)->slots != NULL) {
+		rig_mem_free_aligned((*mrwl)->slots);
+	}
+
 	rig_mem_free_aligned(*mrwl);
 	*mrwl = NULL;
 
@@ -855,7 +988,7 @@ bool rig_mrwlock_rdlock(RIG_MRWLOCK mrwl) {
 	// already holds a read-lock, we can recursively read-lock right away
 	if ((size_t)owned > 0) {
 		if (TEST_BITFIELD(mrwl->flags, RIG_MRWLOCK_RECURSIVE_READ)) {
-			if ((size_t)owned == (RIG_MRWLOCK_WRLOCK_BIT - 1)) {
+			if (((size_t)owned & ~RIG_MRWLOCK_SLOT_BIT) == (RIG_MRWLOCK_SLOT_BIT - 1)) {
 				ERRET(EAGAIN, false);
 			}
 
@@ -868,7 +1001,14 @@ bool rig_mrwlock_rdlock(RIG_MRWLOCK mrwl) {
 		}
 	}
 
-	// The thread held nothing, so we must obtain the lock fully
+	// The thread held nothing, so we must obtain the lock fully,
+	// through its reader slot if possible
+	if (rig_mrwlock_slot_rdlock(mrwl)) {
+		rig_tls_set(&mrwl->owned, (void *)(RIG_MRWLOCK_SLOT_BIT + 1));
+
+		return (true);
+	}
+
 	size_t spin = 0;
 	size_t mrwlock;
 
@@ -881,6 +1021,8 @@ bool rig_mrwlock_rdlock(RIG_MRWLOCK mrwl) {
 
 			atomic_ops_fence(ATOMIC_OPS_FENCE_ACQUIRE);
 
+			rig_mrwlock_bias_enable(mrwl);
+
 			return (true);
 		}
 		else if (mrwlock == (RIG_MRWLOCK_WRLOCK_BIT - 1)) {
@@ -928,7 +1070,7 @@ bool rig_mrwlock_tryrdlock(RIG_MRWLOCK mrwl) {
 	// already holds a read-lock, we can recursively read-lock right away
 	if ((size_t)owned > 0) {
 		if (TEST_BITFIELD(mrwl->flags, RIG_MRWLOCK_RECURSIVE_READ)) {
-			if ((size_t)owned == (RIG_MRWLOCK_WRLOCK_BIT - 1)) {
+			if (((size_t)owned & ~RIG_MRWLOCK_SLOT_BIT) == (RIG_MRWLOCK_SLOT_BIT - 1)) {
 				ERRET(EAGAIN, false);
 			}
 
@@ -941,7 +1083,14 @@ bool rig_mrwlock_tryrdlock(RIG_MRWLOCK mrwl) {
 		}
 	}
 
-	// The thread held nothing, so we must obtain the lock fully
+	// The thread held nothing, so we must obtain the lock fully,
+	// through its reader slot if possible
+	if (rig_mrwlock_slot_rdlock(mrwl)) {
+		rig_tls_set(&mrwl->owned, (void *)(RIG_MRWLOCK_SLOT_BIT + 1));
+
+		return (true);
+	}
+
 	size_t mrwlock = atomic_ops_uint_load(&mrwl->mrwlock, ATOMIC_OPS_FENCE_NONE);
 
 	if ((mrwlock < (RIG_MRWLOCK_WRLOCK_BIT - 1))
@@ -950,6 +1099,8 @@ bool rig_mrwlock_tryrdlock(RIG_MRWLOCK mrwl) {
 
 		atomic_ops_fence(ATOMIC_OPS_FENCE_ACQUIRE);
 
+		rig_mrwlock_bias_enable(mrwl);
+
 		return (true);
 	}
 	else if (mrwlock == (RIG_MRWLOCK_WRLOCK_BIT - 1)) {
@@ -1013,6 +1164,8 @@ bool rig_mrwlock_wrlock(RIG_MRWLOCK mrwl) {
 
 		if ((mrwlock == 0)
 		 && (atomic_ops_uint_cas(&mrwl->mrwlock, 0, RIG_MRWLOCK_WRLOCK_BIT, ATOMIC_OPS_FENCE_NONE))) {
+			rig_mrwlock_bias_revoke(mrwl, true);
+
 			rig_tls_set(&mrwl->owned, (void *)(RIG_MRWLOCK_WRLOCK_BIT + 1));
 
 			atomic_ops_fence(ATOMIC_OPS_FENCE_ACQUIRE);
@@ -1033,6 +1186,8 @@ bool rig_mrwlock_wrlock(RIG_MRWLOCK mrwl) {
 				}
 			}
 
+			rig_mrwlock_bias_revoke(mrwl, true);
+
 			rig_tls_set(&mrwl->owned, (void *)(RIG_MRWLOCK_WRLOCK_BIT + 1));
 
 			atomic_ops_fence(ATOMIC_OPS_FENCE_ACQUIRE);
@@ -1100,6 +1255,13 @@ bool rig_mrwlock_trywrlock(RIG_MRWLOCK mrwl) {
 
 	if ((mrwlock == 0)
 	 && (atomic_ops_uint_cas(&mrwl->mrwlock, 0, RIG_MRWLOCK_WRLOCK_BIT, ATOMIC_OPS_FENCE_NONE))) {
+		// Readers may still hold their slots, can't wait for them here
+		if (!rig_mrwlock_bias_revoke(mrwl, false)) {
+			atomic_ops_uint_store(&mrwl->mrwlock, 0, ATOMIC_OPS_FENCE_RELEASE);
+
+			ERRET(EBUSY, false);
+		}
+
 		rig_tls_set(&mrwl->owned, (void *)(RIG_MRWLOCK_WRLOCK_BIT + 1));
 
 		atomic_ops_fence(ATOMIC_OPS_FENCE_ACQUIRE);
@@ -1124,16 +1286,29 @@ bool rig_mrwlock_trywrlock(RIG_MRWLOCK mrwl) {
 bool rig_mrwlock_unlock(RIG_MRWLOCK mrwl) {
 	NULLCHECK_EXIT(mrwl);
 
-	size_t mrwlock = atomic_ops_uint_load(&mrwl->mrwlock, ATOMIC_OPS_FENCE_NONE);
+	// Get thread-local lock status data
+	void *owned = rig_tls_get(&mrwl->owned);
 
-	if (mrwlock == 0) {
+	if ((size_t)owned == 0) {
 		ERRET(EPERM, false);
 	}
 
-	// Get thread-local lock status data
-	void *owned = rig_tls_get(&mrwl->owned);
+	// Read-locks gotten through the reader slot never touched mrwlock
+	if ((size_t)owned & RIG_MRWLOCK_SLOT_BIT) {
+		if ((size_t)owned == (RIG_MRWLOCK_SLOT_BIT + 1)) {
+			rig_tls_set(&mrwl->owned, (void *)((size_t)0));
+			atomic_ops_uint_dec(&mrwl->slots[(rig_thread_id() - 1) & mrwl->slots_mask].readers, ATOMIC_OPS_FENCE_RELEASE);
+		}
+		else {
+			rig_tls_set(&mrwl->owned, (void *)((size_t)owned - 1));
+		}
 
-	if ((size_t)owned == 0) {
+		return (true);
+	}
+
+	size_t mrwlock = atomic_ops_uint_load(&mrwl->mrwlock, ATOMIC_OPS_FENCE_NONE);
+
+	if (mrwlock == 0) {
 		ERRET(EPERM, false);
 	}
 
@@ -1171,7 +1346,8 @@ bool rig_mrwlock_unlock(RIG_MRWLOCK mrwl) {
 bool rig_mrwlock_islocked(RIG_MRWLOCK mrwl) {
 	NULLCHECK_EXIT(mrwl);
 
-	return (atomic_ops_uint_load(&mrwl->mrwlock, ATOMIC_OPS_FENCE_ACQUIRE) != 0);
+	return ((atomic_ops_uint_load(&mrwl->mrwlock, ATOMIC_OPS_FENCE_ACQUIRE) != 0)
+		 || (rig_mrwlock_slots_busy(mrwl)));
 }
 
 /**
@@ -1189,7 +1365,8 @@ bool rig_mrwlock_isrdlocked(RIG_MRWLOCK mrwl) {
 
 	size_t mrwlock = atomic_ops_uint_load(&mrwl->mrwlock, ATOMIC_OPS_FENCE_ACQUIRE);
 
-	return ((mrwlock != 0) && (mrwlock != RIG_MRWLOCK_WRLOCK_BIT));
+	return (((mrwlock != 0) && (mrwlock != RIG_MRWLOCK_WRLOCK_BIT))
+		 || (rig_mrwlock_slots_busy(mrwl)));
 }
 
 /**
@@ -1205,5 +1382,329 @@ bool rig_mrwlock_isrdlocked(RIG_MRWLOCK mrwl) {
 bool rig_mrwlock_iswrlocked(RIG_MRWLOCK mrwl) {
 	NULLCHECK_EXIT(mrwl);
 
-	return (atomic_ops_uint_load(&mrwl->mrwlock, ATOMIC_OPS_FENCE_ACQUIRE) == RIG_MRWLOCK_WRLOCK_BIT);
+	// A writer still waiting for the reader slots to drain doesn't hold it yet
+	return ((atomic_ops_uint_load(&mrwl->mrwlock, ATOMIC_OPS_FENCE_ACQUIRE) == RIG_MRWLOCK_WRLOCK_BIT)
+		 && (!rig_mrwlock_slots_busy(mrwl)));
+}
+
+/**
+ * Read-lock a read-biased Micro-Read/Write (MRW) lock through the calling
+ * thread's reader slot, if the reader bias is on.
+ *
+ * @param mrwl
+ *     Micro-Read/Write lock data
+ *
+ * @return
+ *     boolean indicating success, false if the lock must be gotten through mrwlock.
+ */
+static inline bool rig_mrwlock_slot_rdlock(RIG_MRWLOCK mrwl) {
+	if ((mrwl->slots == NULL) || (atomic_ops_uint_load(&mrwl->bias, ATOMIC_OPS_FENCE_NONE) == 0)) {
+		return (false);
+	}
+
+	atomic_ops_uint *readers = &mrwl->slots[(rig_thread_id() - 1) & mrwl->slots_mask].readers;
+
+	atomic_ops_uint_inc(readers, ATOMIC_OPS_FENCE_NONE);
+
+	// Pairs with the fence in rig_mrwlock_bias_revoke(): either the writer sees
+	// this slot taken and waits for it, or we see the bias revoked and back off
+	atomic_ops_fence(ATOMIC_OPS_FENCE_FULL);
+
+	if (atomic_ops_uint_load(&mrwl->bias, ATOMIC_OPS_FENCE_ACQUIRE) != 0) {
+		return (true);
+	}
+
+	atomic_ops_uint_dec(readers, ATOMIC_OPS_FENCE_RELEASE);
+
+	return (false);
+}
+
+/**
+ * Turn the reader bias of a read-biased Micro-Read/Write (MRW) lock back on,
+ * once the time it was inhibited for has passed.
+ * Must be called holding a read-lock through mrwlock, so no writer can be
+ * revoking it at the same time.
+ *
+ * @param mrwl
+ *     Micro-Read/Write lock data
+ */
+static inline void rig_mrwlock_bias_enable(RIG_MRWLOCK mrwl) {
+	if ((mrwl->slots != NULL)
+	 && (atomic_ops_uint_load(&mrwl->bias, ATOMIC_OPS_FENCE_NONE) == 0)
+	 && (rig_time_us() >= mrwl->bias_inhibit_us)) {
+		atomic_ops_uint_store(&mrwl->bias, 1, ATOMIC_OPS_FENCE_RELEASE);
+	}
+}
+
+/**
+ * Revoke the reader bias of a read-biased Micro-Read/Write (MRW) lock, so
+ * that new readers go through mrwlock, and check that the reader slots are
+ * drained, optionally waiting for that. If not waiting and readers still hold
+ * their slot, the bias is left on.
+ * Must be called holding mrwlock for writing.
+ *
+ * @param mrwl
+ *     Micro-Read/Write lock data
+ * @param wait
+ *     wait for readers still holding their slot
+ *
+ * @return
+ *     boolean, true if no reader holds a slot anymore, false otherwise.
+ */
+static bool rig_mrwlock_bias_revoke(RIG_MRWLOCK mrwl, bool wait) {
+	if ((mrwl->slots == NULL) || (atomic_ops_uint_load(&mrwl->bias, ATOMIC_OPS_FENCE_NONE) == 0)) {
+		return (true);
+	}
+
+	uint64_t start = rig_time_us();
+
+	atomic_ops_uint_store(&mrwl->bias, 0, ATOMIC_OPS_FENCE_NONE);
+
+	// Pairs with the fence in rig_mrwlock_slot_rdlock()
+	atomic_ops_fence(ATOMIC_OPS_FENCE_FULL);
+
+	for (size_t i = 0; i <= mrwl->slots_mask; i++) {
+		size_t spin = 0;
+
+		while (atomic_ops_uint_load(&mrwl->slots[i].readers, ATOMIC_OPS_FENCE_ACQUIRE) != 0) {
+			if (!wait) {
+				// Writers rely on the slots being drained whenever the bias is off
+				atomic_ops_uint_store(&mrwl->bias, 1, ATOMIC_OPS_FENCE_RELEASE);
+
+				return (false);
+			}
+
+			spin++;
+
+			if (spin == RIG_MRWLOCK_SPIN_MAX) {
+				spin = 0;
+				rig_thread_yield();
+			}
+		}
+	}
+
+	uint64_t now = rig_time_us();
+
+	mrwl->bias_inhibit_us = now + ((now - start) * RIG_MRWLOCK_BIAS_INHIBIT);
+
+	return (true);
+}
+
+/**
+ * Check if any reader slot of a read-biased Micro-Read/Write (MRW) lock is
+ * taken. Readers briefly taking a slot and then backing off are seen too.
+ *
+ * @param mrwl
+ *     Micro-Read/Write lock data
+ *
+ * @return
+ *     boolean, true if some reader slot is taken, false otherwise.
+ */
+static bool rig_mrwlock_slots_busy(RIG_MRWLOCK mrwl) {
+	if (mrwl->slots == NULL) {
+		return (false);
+	}
+
+	for (size_t i = 0; i <= mrwl->slots_mask; i++) {
+		if (atomic_ops_uint_load(&mrwl->slots[i].readers, ATOMIC_OPS_FENCE_ACQUIRE) != 0) {
+			return (true);
+		}
+	}
+
+	return (false);
+}
+
+
+// Event-count static configuration
+#define RIG_EVENTCOUNT_SPIN_MIN 16
+#define RIG_EVENTCOUNT_SPIN_MAX 1024
+#define RIG_EVENTCOUNT_SPIN_INIT 64
+
+// Event-count data
+struct rig_eventcount {
+	atomic_ops_uint epoch CACHELINE_ALIGNED;
+	atomic_ops_uint waiters;
+	atomic_ops_uint spin;
+};
+
+/*
+ * An event-count lets consumers of a lock-free data structure sleep while it
+ * is empty, without adding any locking or system calls to the producers'
+ * fast path: a consumer registers itself as a waiter, takes note of the
+ * current epoch, and tries to get an item once more before going to sleep
+ * on the epoch (a futex on Linux). Producers, after having published their
+ * items, check for registered waiters, and only if there are any, advance
+ * the epoch and wake them up. The full fences on both sides guarantee that
+ * either the consumer's last try sees the new item, or the producer sees
+ * the waiter, in which case the epoch changed and the consumer either
+ * doesn't go to sleep at all, or gets woken up.
+ */
+
+/**
+ * INTERNAL
+ * Initialize and return an Event-count.
+ *
+ * @return
+ *     Event-count data, NULL on error.
+ *     On error, the following error codes are set:
+ *     - ENOMEM (insufficient memory)
+ */
+RIG_EVENTCOUNT rig_eventcount_init(void) {
+	RIG_EVENTCOUNT ec = rig_mem_alloc_aligned(sizeof(*ec), 0, CACHELINE_SIZE, RIG_MEM_ALLOC_ALIGN_PAD);
+	NULLCHECK_ERRET(ec, ENOMEM, NULL);
+
+	atomic_ops_uint_store(&ec->epoch, 0, ATOMIC_OPS_FENCE_NONE);
+	atomic_ops_uint_store(&ec->waiters, 0, ATOMIC_OPS_FENCE_NONE);
+	atomic_ops_uint_store(&ec->spin, RIG_EVENTCOUNT_SPIN_INIT, ATOMIC_OPS_FENCE_NONE);
+
+	atomic_ops_fence(ATOMIC_OPS_FENCE_RELEASE);
+
+	return (ec);
+}
+
+/**
+ * INTERNAL
+ * Destroy specified Event-count and set pointer to NULL.
+ * No thread may be waiting on it anymore.
+ *
+ * @param *ec
+ *     pointer to Event-count data
+ */
+void rig_eventcount_destroy(RIG_EVENTCOUNT *ec) {
+	NULLCHECK_EXIT(ec);
+
+	// If a valid pointer already contains NULL, nothing to do!
+	if (*ec == NULL) {
+		return;
+	}
+
+	rig_mem_free_aligned(*ec);
+	*ec = NULL;
+}
+
+/**
+ * INTERNAL
+ * Notify waiting consumers that new items are available.
+ * Must be called after the items have been published. Only if there are
+ * registered waiters, the epoch is advanced and a system call made.
+ *
+ * @param ec
+ *     Event-count data
+ * @param count
+ *     number of new items, maximum number of waiters to wake up
+ */
+void rig_eventcount_notify(RIG_EVENTCOUNT ec, size_t count) {
+	NULLCHECK_EXIT(ec);
+
+	// Order the publication of the items before reading waiters
+	atomic_ops_fence(ATOMIC_OPS_FENCE_FULL);
+
+	if (atomic_ops_uint_load(&ec->waiters, ATOMIC_OPS_FENCE_NONE) == 0) {
+		return;
+	}
+
+	atomic_ops_uint_inc(&ec->epoch, ATOMIC_OPS_FENCE_FULL);
+
+	thread_ops_futex_wake(&ec->epoch, count);
+}
+
+/**
+ * INTERNAL
+ * Get an item from a data structure using the supplied function, waiting for
+ * one to become available if there's none. First try to get one for a short
+ * while, adapting the amount of tries to how often that was successful in
+ * the past, then sleep until notified of new items or the timeout expires.
+ *
+ * @param ec
+ *     Event-count data
+ * @param *try_get
+ *     function trying to get an item from ds, returning NULL if none available
+ * @param ds
+ *     data structure, passed to try_get
+ * @param qsbr
+ *     whether ds reclaims memory with QSBR: the calling thread, if online, then
+ *     goes offline while it sleeps, so as not to hold back reclamation
+ * @param timeout
+ *     maximum time to wait in microseconds, 0 means a single try, without
+ *     spinning or sleeping, SIZE_MAX means no limit
+ *
+ * @return
+ *     item, NULL on error.
+ *     On error, the following error codes are set:
+ *     - ETIMEDOUT (no item became available before the timeout expired)
+ */
+void *rig_eventcount_await(RIG_EVENTCOUNT ec, void *(*try_get)(void *ds), void *ds, bool qsbr, size_t timeout) {
+	NULLCHECK_EXIT(ec);
+	NULLCHECK_EXIT(try_get);
+
+	void *item = NULL;
+
+	// Not waiting at all, and no spinning stats to learn from either
+	if (timeout == 0) {
+		if ((item = (*try_get)(ds)) != NULL) {
+			return (item);
+		}
+
+		ERRET(ETIMEDOUT, NULL);
+	}
+
+	size_t spin_limit = atomic_ops_uint_load(&ec->spin, ATOMIC_OPS_FENCE_NONE);
+
+	for (size_t spin = 0; spin < spin_limit; spin++) {
+		if ((item = (*try_get)(ds)) != NULL) {
+			// Spinning paid off, spin longer next time
+			if (spin_limit < RIG_EVENTCOUNT_SPIN_MAX) {
+				atomic_ops_uint_store(&ec->spin, spin_limit << 1, ATOMIC_OPS_FENCE_NONE);
+			}
+
+			return (item);
+		}
+	}
+
+	// Spinning was useless, spin less next time
+	if (spin_limit > RIG_EVENTCOUNT_SPIN_MIN) {
+		atomic_ops_uint_store(&ec->spin, spin_limit >> 1, ATOMIC_OPS_FENCE_NONE);
+	}
+
+	uint64_t start = (timeout != SIZE_MAX) ? (thread_ops_time_us()) : (0);
+	size_t remaining = timeout;
+
+	while (remaining != 0) {
+		// Register as waiter, then take note of the epoch and try again
+		atomic_ops_uint_inc(&ec->waiters, ATOMIC_OPS_FENCE_FULL);
+
+		uintptr_t epoch = atomic_ops_uint_load(&ec->epoch, ATOMIC_OPS_FENCE_ACQUIRE);
+
+		if ((item = (*try_get)(ds)) == NULL) {
+			// Spinning stays online, but sleeping must not stall QSBR for everybody
+			bool offline = (qsbr) && (rig_smr_qsbr_is_online());
+
+			if (offline) {
+				rig_smr_qsbr_offline();
+			}
+
+			// Returns right away if the epoch advanced in the meantime
+			thread_ops_futex_wait(&ec->epoch, epoch, remaining);
+
+			if (offline) {
+				rig_smr_qsbr_online();
+			}
+
+			item = (*try_get)(ds);
+		}
+
+		atomic_ops_uint_dec(&ec->waiters, ATOMIC_OPS_FENCE_NONE);
+
+		if (item != NULL) {
+			return (item);
+		}
+
+		if (timeout != SIZE_MAX) {
+			uint64_t elapsed = thread_ops_time_us() - start;
+
+			remaining = (elapsed >= timeout) ? (0) : (timeout - (size_t)elapsed);
+		}
+	}
+
+	ERRET(ETIMEDOUT, NULL);
 }
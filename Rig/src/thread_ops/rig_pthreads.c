@@ -13,10 +13,13 @@
 #include <pthread.h>
 #include <sched.h>
 #include <unistd.h>
+#include <limits.h>
+#include <time.h>
 
 // Includes needed for getting the Thread ID (OS-specific)
 #if defined(SYSTEM_OS_LINUX)
 	#include <sys/syscall.h>
+	#include <linux/futex.h>
 #elif defined(SYSTEM_OS_FREEBSD)
 	#include <sys/thr.h>
 #elif defined(SYSTEM_OS_NETBSD)
@@ -779,6 +782,79 @@ bool rig_rwlock_unlock(RIG_RWLOCK rwl) {
 }
 
 
+// Futexes are 32 bit wide, use the less significant half of the word
+#if defined(SYSTEM_BIGENDIAN) && (SIZEOF_VOID_PTR == 8)
+	#define FUTEX_WORD(addr) ((int *)(void *)(addr) + 1)
+#else
+	#define FUTEX_WORD(addr) ((int *)(void *)(addr))
+#endif
+
+/**
+ * INTERNAL ABSTRACTION
+ * Implementation-specific wrapper for getting a monotonic time-stamp.
+ *
+ * @return
+ *     time-stamp in microseconds, from an unspecified starting point
+ */
+static inline uint64_t thread_ops_time_us(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (((uint64_t)ts.tv_sec * 1000000) + ((uint64_t)ts.tv_nsec / 1000));
+}
+
+/**
+ * INTERNAL ABSTRACTION
+ * Implementation-specific wrapper for waiting on an address: the calling
+ * thread sleeps until woken up by thread_ops_futex_wake() or the timeout
+ * expires, but only if the address still holds the expected value (only the
+ * lower 32 bits are compared). Spurious wake-ups are possible.
+ * Where futexes aren't available, this degrades to a short sleep.
+ *
+ * @param addr
+ *     address to wait on
+ * @param val
+ *     expected value
+ * @param timeout_us
+ *     maximum time to sleep in microseconds, SIZE_MAX means no limit
+ */
+static inline void thread_ops_futex_wait(atomic_ops_uint *addr, uintptr_t val, size_t timeout_us) {
+#if defined(SYSTEM_OS_LINUX)
+	struct timespec ts = { .tv_sec = (time_t)(timeout_us / 1000000), .tv_nsec = (long)((timeout_us % 1000000) * 1000) };
+
+	syscall(SYS_futex, FUTEX_WORD(addr), FUTEX_WAIT_PRIVATE, (int)(uint32_t)val,
+		(timeout_us == SIZE_MAX) ? (NULL) : (&ts), NULL, 0);
+#else
+	if (atomic_ops_uint_load(addr, ATOMIC_OPS_FENCE_ACQUIRE) == val) {
+		struct timespec ts = { .tv_sec = 0, .tv_nsec = (long)(((timeout_us < 1000) ? (timeout_us) : (1000)) * 1000) };
+
+		nanosleep(&ts, NULL);
+	}
+#endif
+}
+
+/**
+ * INTERNAL ABSTRACTION
+ * Implementation-specific wrapper for waking up threads waiting on an
+ * address with thread_ops_futex_wait().
+ *
+ * @param addr
+ *     address threads are waiting on
+ * @param count
+ *     maximum number of threads to wake up
+ */
+static inline void thread_ops_futex_wake(atomic_ops_uint *addr, size_t count) {
+#if defined(SYSTEM_OS_LINUX)
+	syscall(SYS_futex, FUTEX_WORD(addr), FUTEX_WAKE_PRIVATE, (count > INT_MAX) ? (INT_MAX) : ((int)count), NULL, NULL, 0);
+#else
+	// Sleepers wake up periodically by themselves
+	UNUSED(addr);
+	UNUSED(count);
+#endif
+}
+
+
 /**
  * INTERNAL
  * Wrapper around the thread start function to ensure the cleanup function
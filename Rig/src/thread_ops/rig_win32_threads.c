@@ -20,3 +20,52 @@
 void rig_thread_yield(void) {
 	Sleep(0);
 }
+
+
+/**
+ * INTERNAL ABSTRACTION
+ * Implementation-specific wrapper for getting a monotonic time-stamp.
+ *
+ * @return
+ *     time-stamp in microseconds, from an unspecified starting point
+ */
+static inline uint64_t thread_ops_time_us(void) {
+	return ((uint64_t)GetTickCount64() * 1000);
+}
+
+/**
+ * INTERNAL ABSTRACTION
+ * Implementation-specific wrapper for waiting on an address.
+ * No futexes here, so this degrades to a short sleep if the address still
+ * holds the expected value.
+ *
+ * @param addr
+ *     address to wait on
+ * @param val
+ *     expected value
+ * @param timeout_us
+ *     maximum time to sleep in microseconds, SIZE_MAX means no limit
+ */
+static inline void thread_ops_futex_wait(atomic_ops_uint *addr, uintptr_t val, size_t timeout_us) {
+	UNUSED(timeout_us);
+
+	if (atomic_ops_uint_load(addr, ATOMIC_OPS_FENCE_ACQUIRE) == val) {
+		Sleep(1);
+	}
+}
+
+/**
+ * INTERNAL ABSTRACTION
+ * Implementation-specific wrapper for waking up threads waiting on an
+ * address with thread_ops_futex_wait().
+ * Sleepers wake up periodically by themselves, nothing to do.
+ *
+ * @param addr
+ *     address threads are waiting on
+ * @param count
+ *     maximum number of threads to wake up
+ */
+static inline void thread_ops_futex_wake(atomic_ops_uint *addr, size_t count) {
+	UNUSED(addr);
+	UNUSED(count);
+}
@@ -0,0 +1,320 @@
+/**
+ * This file is part of the Rig project.
+ *
+ * For the full copyright and license information, please view the COPYING
+ * file that was distributed with this source code.
+ *
+ * @copyright  (c) the Rig project
+ * @author     Luca Longinotti <chtekk@longitekk.com>
+ * @license    BSD 2-clause
+ * @version    $Id$
+ */
+
+#include "tests.h"
+#include <string.h>
+
+Suite *test_rig_array_init(void);
+Suite *test_rig_array_destroy(void);
+Suite *test_rig_array_clear(void);
+Suite *test_rig_array_add(void);
+Suite *test_rig_array_del(void);
+Suite *test_rig_array_find(void);
+Suite *test_rig_array_lookup(void);
+Suite *test_rig_array_nested(void);
+Suite *test_rig_array_duplicate(void);
+
+int main(void) {
+	SRunner *sr = srunner_create(test_rig_array_init());
+	srunner_add_suite(sr, test_rig_array_destroy());
+	srunner_add_suite(sr, test_rig_array_clear());
+	srunner_add_suite(sr, test_rig_array_add());
+	srunner_add_suite(sr, test_rig_array_del());
+	srunner_add_suite(sr, test_rig_array_find());
+	srunner_add_suite(sr, test_rig_array_lookup());
+	srunner_add_suite(sr, test_rig_array_nested());
+	srunner_add_suite(sr, test_rig_array_duplicate());
+
+	srunner_run_all(sr, CK_VERBOSE);
+	int failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	return ((failed == 0) ? (EXIT_SUCCESS) : (EXIT_FAILURE));
+}
+
+
+RIG_ARRAY array = NULL;
+
+static void setup_array(void) {
+	array = rig_array_init(0, 10);
+	ck_assert(array != NULL);
+
+	ck_assert(rig_array_add(array,
+		RIG_ASPEC({"ii", 1, 0, 0}, {"is", 1, 0, 0}, {"si", 1, 0, 0}, {"ss", 1, 0, 0}),
+		(intmax_t)0, (intmax_t)3,
+		(intmax_t)2, "bb",
+		"aa", (intmax_t)2,
+		"c", "dd11"));
+	ck_assert(rig_array_count(array) == 4);
+	ck_assert(rig_array_capacity(array) == 10);
+}
+
+static void teardown_array(void) {
+	rig_array_destroy(&array);
+	ck_assert(array == NULL);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_array_init_normal) {
+	RIG_ARRAY a = rig_array_init(0, 0);
+	ck_assert(a != NULL);
+	ck_assert(rig_array_empty(a));
+	ck_assert(!rig_array_full(a));
+	rig_array_destroy(&a);
+} END_TEST
+
+START_TEST(test_rig_array_init_error) {
+	ck_assert(rig_array_init(RIG_ARRAY_DUPLICATE, 0) == NULL && errno == EINVAL);
+	ck_assert(rig_array_init((1 << 15), 0) == NULL && errno == EINVAL);
+} END_TEST
+
+Suite *test_rig_array_init(void) {
+	Suite *s = suite_create("test_rig_array_init");
+
+	TCASE_ADD(rig_array_init_normal);
+	TCASE_ADD(rig_array_init_error);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_array_destroy_newref) {
+	RIG_ARRAY ref = rig_array_newref(array);
+	ck_assert(ref == array);
+
+	rig_array_destroy(&array);
+	ck_assert(array == NULL);
+
+	ck_assert(rig_array_find(ref, RIG_ASPEC({"s", 1, 0, 0}), "aa"));
+
+	rig_array_destroy(&ref);
+	ck_assert(ref == NULL);
+} END_TEST
+
+START_TEST(test_rig_array_destroy_nullptr) {
+	rig_array_destroy(NULL);
+} END_TEST
+
+Suite *test_rig_array_destroy(void) {
+	Suite *s = suite_create("test_rig_array_destroy");
+
+	TCASE_ADD_FIXTURE(rig_array_destroy_newref, &setup_array, NULL);
+	TCASE_ADD_EXIT(rig_array_destroy_nullptr, EXIT_FAILURE);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_array_clear_normal) {
+	rig_array_clear(array);
+	ck_assert(rig_array_empty(array));
+	ck_assert(!rig_array_find_any(array, RIG_ASPEC({"i", 1, 0, 0}, {"s", 1, 0, 0}), (intmax_t)0, "aa") && errno == ENOENT);
+} END_TEST
+
+Suite *test_rig_array_clear(void) {
+	Suite *s = suite_create("test_rig_array_clear");
+
+	TCASE_ADD_FIXTURE(rig_array_clear_normal, &setup_array, &teardown_array);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_array_add_normal) {
+	int x = 0;
+
+	ck_assert(rig_array_add(array, RIG_ASPEC({"pi", 2, 0, 0}), (void *)&x, (intmax_t)1, (void *)array, (intmax_t)2));
+	ck_assert(rig_array_count(array) == 6);
+	ck_assert(rig_array_find(array, RIG_ASPEC({"p", 2, 0, 0}), (void *)&x, (void *)array));
+} END_TEST
+
+START_TEST(test_rig_array_add_exists) {
+	// All or nothing: "new" must be rolled back
+	ck_assert(!rig_array_add(array, RIG_ASPEC({"si", 1, 0, 0}, {"ii", 1, 0, 0}), "new", (intmax_t)1, (intmax_t)2, (intmax_t)5) && errno == EEXIST);
+	ck_assert(rig_array_count(array) == 4);
+	ck_assert(!rig_array_find(array, RIG_ASPEC({"s", 1, 0, 0}), "new") && errno == ENOENT);
+
+	// Same value, different key type
+	ck_assert(rig_array_add(array, RIG_ASPEC({"si", 1, 0, 0}), "0", (intmax_t)1));
+} END_TEST
+
+START_TEST(test_rig_array_add_full) {
+	for (intmax_t i = 10; i < 16; i++) {
+		ck_assert(rig_array_add(array, RIG_ASPEC({"ii", 1, 0, 0}), i, i));
+	}
+
+	ck_assert(rig_array_full(array));
+	ck_assert(!rig_array_add(array, RIG_ASPEC({"ii", 1, 0, 0}), (intmax_t)20, (intmax_t)20) && errno == EXFULL);
+} END_TEST
+
+START_TEST(test_rig_array_add_error) {
+	ck_assert(!rig_array_add(array, RIG_ASPEC({"xi", 1, 0, 0}), (intmax_t)1, (intmax_t)1) && errno == EINVAL);
+	ck_assert(!rig_array_add(array, RIG_ASPEC({"ai", 1, 0, 0}), array, (intmax_t)1) && errno == EINVAL);
+	ck_assert(!rig_array_add(array, RIG_ASPEC({"is", 1, 0, 0}), (intmax_t)1, NULL) && errno == EINVAL);
+	ck_assert(!rig_array_add(array, NULL, 0) && errno == EINVAL);
+	ck_assert(rig_array_count(array) == 4);
+} END_TEST
+
+Suite *test_rig_array_add(void) {
+	Suite *s = suite_create("test_rig_array_add");
+
+	TCASE_ADD_FIXTURE(rig_array_add_normal, &setup_array, &teardown_array);
+	TCASE_ADD_FIXTURE(rig_array_add_exists, &setup_array, &teardown_array);
+	TCASE_ADD_FIXTURE(rig_array_add_full, &setup_array, &teardown_array);
+	TCASE_ADD_FIXTURE(rig_array_add_error, &setup_array, &teardown_array);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_array_del_normal) {
+	ck_assert(rig_array_del(array, RIG_ASPEC({"i", 1, 0, 0}, {"s", 1, 0, 0}), (intmax_t)2, "c"));
+	ck_assert(rig_array_count(array) == 2);
+	ck_assert(!rig_array_find_any(array, RIG_ASPEC({"i", 1, 0, 0}, {"s", 1, 0, 0}), (intmax_t)2, "c"));
+	ck_assert(rig_array_find(array, RIG_ASPEC({"i", 1, 0, 0}, {"s", 1, 0, 0}), (intmax_t)0, "aa"));
+} END_TEST
+
+START_TEST(test_rig_array_del_missing) {
+	// Present keys still get removed
+	ck_assert(!rig_array_del(array, RIG_ASPEC({"i", 2, 0, 0}), (intmax_t)7, (intmax_t)0) && errno == ENOENT);
+	ck_assert(rig_array_count(array) == 3);
+} END_TEST
+
+Suite *test_rig_array_del(void) {
+	Suite *s = suite_create("test_rig_array_del");
+
+	TCASE_ADD_FIXTURE(rig_array_del_normal, &setup_array, &teardown_array);
+	TCASE_ADD_FIXTURE(rig_array_del_missing, &setup_array, &teardown_array);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_array_find_normal) {
+	ck_assert(rig_array_find(array, RIG_ASPEC({"i", 1, 0, 0}, {"s", 2, 0, 0}), (intmax_t)2, "aa", "c"));
+	ck_assert(!rig_array_find(array, RIG_ASPEC({"i", 1, 0, 0}, {"s", 1, 0, 0}), (intmax_t)2, "x") && errno == ENOENT);
+	ck_assert(rig_array_find_any(array, RIG_ASPEC({"s", 2, 0, 0}), "x", "c"));
+	ck_assert(!rig_array_find_any(array, RIG_ASPEC({"s", 1, 0, 0}, {"i", 1, 0, 0}), "x", (intmax_t)3) && errno == ENOENT);
+} END_TEST
+
+Suite *test_rig_array_find(void) {
+	Suite *s = suite_create("test_rig_array_find");
+
+	TCASE_ADD_FIXTURE(rig_array_find_normal, &setup_array, &teardown_array);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_array_lookup_normal) {
+	intmax_t i = 0;
+	char *str = NULL;
+
+	ck_assert(rig_array_lookup(array, RIG_ASPEC({"ii", 1, 0, 0}, {"ss", 1, 0, 0}), (intmax_t)0, &i, "c", &str));
+	ck_assert(i == 3);
+	ck_assert(str != NULL && strcmp(str, "dd11") == 0);
+	rig_mem_free(str);
+
+	ck_assert(!rig_array_lookup(array, RIG_ASPEC({"is", 1, 0, 0}), (intmax_t)3, &str) && errno == ENOENT);
+	ck_assert(str == NULL);
+
+	// Value stored with a different type
+	ck_assert(!rig_array_lookup(array, RIG_ASPEC({"ii", 1, 0, 0}), (intmax_t)2, &i) && errno == EINVAL);
+	ck_assert(i == 0);
+} END_TEST
+
+Suite *test_rig_array_lookup(void) {
+	Suite *s = suite_create("test_rig_array_lookup");
+
+	TCASE_ADD_FIXTURE(rig_array_lookup_normal, &setup_array, &teardown_array);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_array_nested_normal) {
+	RIG_ARRAY arr2 = rig_array_init(0, 0);
+	ck_assert(arr2 != NULL);
+	ck_assert(rig_array_add(arr2, RIG_ASPEC({"ss", 1, 0, 0}, {"si", 1, 0, 0}), "a1", "aaa", "b", (intmax_t)111));
+
+	ck_assert(rig_array_add(array, RIG_ASPEC({"ia", 1, 0, 0}), (intmax_t)9, arr2));
+
+	RIG_ARRAY nested = rig_array_nested(array, RIG_ASPEC({"i", 1, 0, 0}), (intmax_t)9);
+	ck_assert(nested == arr2);
+	rig_array_destroy(&nested);
+
+	intmax_t i = 0;
+	ck_assert(rig_array_del(arr2, RIG_ASPEC({"s", 1, 0, 0}), "b"));
+	ck_assert(!rig_array_lookup(array, RIG_ASPEC({"ia", 1, 0, 0}), (intmax_t)9, &nested) || (rig_array_count(nested) == 1));
+	rig_array_destroy(&nested);
+	ck_assert(!rig_array_lookup(arr2, RIG_ASPEC({"si", 1, 0, 0}), "b", &i) && errno == ENOENT);
+
+	// Not an array
+	ck_assert(rig_array_nested(array, RIG_ASPEC({"i", 2, 0, 0}), (intmax_t)9, (intmax_t)1) == NULL && errno == ENOENT);
+	ck_assert(rig_array_nested(array, RIG_ASPEC({"s", 1, 0, 0}), "c") == NULL && errno == EINVAL);
+
+	// The array holds its own reference
+	rig_array_destroy(&arr2);
+	ck_assert(rig_array_del(array, RIG_ASPEC({"i", 1, 0, 0}), (intmax_t)9));
+} END_TEST
+
+Suite *test_rig_array_nested(void) {
+	Suite *s = suite_create("test_rig_array_nested");
+
+	TCASE_ADD_FIXTURE(rig_array_nested_normal, &setup_array, &teardown_array);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_array_duplicate_normal) {
+	RIG_ARRAY arr2 = rig_array_init(0, 0);
+	ck_assert(arr2 != NULL);
+	ck_assert(rig_array_add(array, RIG_ASPEC({"sa", 1, 0, 0}), "n", arr2));
+
+	RIG_ARRAY shallow = rig_array_duplicate(array, 0);
+	ck_assert(shallow != NULL);
+	ck_assert(rig_array_count(shallow) == 5);
+	ck_assert(rig_array_capacity(shallow) == 10);
+
+	RIG_ARRAY deep = rig_array_duplicate(array, RIG_ARRAY_DUPLICATE);
+	ck_assert(deep != NULL);
+	ck_assert(rig_array_count(deep) == 5);
+
+	RIG_ARRAY n1 = rig_array_nested(shallow, RIG_ASPEC({"s", 1, 0, 0}), "n");
+	RIG_ARRAY n2 = rig_array_nested(deep, RIG_ASPEC({"s", 1, 0, 0}), "n");
+	ck_assert(n1 == arr2);
+	ck_assert(n2 != NULL && n2 != arr2);
+
+	rig_array_destroy(&n1);
+	rig_array_destroy(&n2);
+	rig_array_destroy(&shallow);
+	rig_array_destroy(&deep);
+	rig_array_destroy(&arr2);
+} END_TEST
+
+Suite *test_rig_array_duplicate(void) {
+	Suite *s = suite_create("test_rig_array_duplicate");
+
+	TCASE_ADD_FIXTURE(rig_array_duplicate_normal, &setup_array, &teardown_array);
+
+	return (s);
+}
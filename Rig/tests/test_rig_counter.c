@@ -21,6 +21,7 @@ Suite *test_rig_counter_inc(void);
 Suite *test_rig_counter_dec(void);
 Suite *test_rig_counter_dec_and_test(void);
 Suite *test_rig_counter_get_and_add(void);
+Suite *test_rig_counter_sharded(void);
 
 int main(void) {
 	SRunner *sr = srunner_create(test_rig_counter_init());
@@ -32,6 +33,7 @@ int main(void) {
 	srunner_add_suite(sr, test_rig_counter_dec());
 	srunner_add_suite(sr, test_rig_counter_dec_and_test());
 	srunner_add_suite(sr, test_rig_counter_get_and_add());
+	srunner_add_suite(sr, test_rig_counter_sharded());
 
 	srunner_run_all(sr, CK_VERBOSE);
 	int failed = srunner_ntests_failed(sr);
@@ -53,6 +55,67 @@ static void teardown_counter(void) {
 	ck_assert(cnt == NULL);
 }
 
+static void *inc_worker(void *arg) {
+	RIG_COUNTER got = arg;
+
+	// Failed increments must not let others past the maximum
+	while (rig_counter_inc(cnt)) {
+		rig_counter_inc(got);
+	}
+
+	ck_assert(errno == ERANGE);
+
+	return (NULL);
+}
+
+static void *inc_bounded_worker(void *arg) {
+	RIG_COUNTER roles = arg;
+
+	size_t role = 0;
+	ck_assert(rig_counter_get_and_add(roles, 1, &role));
+
+	for (size_t i = 0; i < 100000; i++) {
+		if ((role % 2) == 0) {
+			// Never more holders than the maximum allows, so this can't fail
+			ck_assert(rig_counter_inc(cnt));
+			ck_assert(rig_counter_dec(cnt));
+		}
+		else {
+			// Always fails, as one unit is held for the whole test, and
+			// must not make the holders' increments fail meanwhile
+			ck_assert(!rig_counter_add(cnt, (ssize_t)rig_counter_get_max(cnt)) && errno == ERANGE);
+		}
+	}
+
+	return (NULL);
+}
+
+static void *dec_zero_worker(void *arg) {
+	(void)(arg);
+
+	// Stays at zero, so every subtraction must fail, and a failed one
+	// must never let another one through
+	for (size_t i = 0; i < 100000; i++) {
+		ck_assert(!rig_counter_dec(cnt) && errno == ERANGE);
+		ck_assert(!rig_counter_dec_and_test(cnt) && errno == ERANGE);
+		ck_assert(!rig_counter_add(cnt, -1) && errno == ERANGE);
+	}
+
+	return (NULL);
+}
+
+static void *dec_and_test_worker(void *arg) {
+	RIG_COUNTER zero = arg;
+
+	for (size_t i = 0; i < 10000; i++) {
+		if (rig_counter_dec_and_test(cnt)) {
+			rig_counter_inc(zero);
+		}
+	}
+
+	return (NULL);
+}
+
 /******************************************************************************/
 
 START_TEST(test_rig_counter_init_normal) {
@@ -238,6 +301,46 @@ START_TEST(test_rig_counter_inc_error) {
 	ck_assert(rig_counter_get(cnt) == 10);
 } END_TEST
 
+START_TEST(test_rig_counter_inc_threads) {
+	RIG_COUNTER got = rig_counter_init(0, 0);
+	ck_assert(got != NULL);
+
+	ck_assert(rig_counter_set(cnt, 0));
+
+	RIG_THREAD thr = rig_thread_init(0, 4);
+	ck_assert(thr != NULL);
+
+	ck_assert(rig_thread_start(thr, &inc_worker, got));
+	ck_assert(rig_thread_join(thr, NULL));
+	rig_thread_destroy(&thr);
+
+	ck_assert(rig_counter_get(got) == 10);
+	ck_assert(rig_counter_get(cnt) == 10);
+
+	rig_counter_destroy(&got);
+} END_TEST
+
+START_TEST(test_rig_counter_inc_bounded) {
+	RIG_COUNTER roles = rig_counter_init(0, 0);
+	ck_assert(roles != NULL);
+
+	// One unit held all along, plus one for each of the two holders
+	rig_counter_destroy(&cnt);
+	cnt = rig_counter_init(1, 3);
+	ck_assert(cnt != NULL);
+
+	RIG_THREAD thr = rig_thread_init(0, 4);
+	ck_assert(thr != NULL);
+
+	ck_assert(rig_thread_start(thr, &inc_bounded_worker, roles));
+	ck_assert(rig_thread_join(thr, NULL));
+	rig_thread_destroy(&thr);
+
+	ck_assert(rig_counter_get(cnt) == 1);
+
+	rig_counter_destroy(&roles);
+} END_TEST
+
 START_TEST(test_rig_counter_inc_nullptr) {
 	rig_counter_inc(NULL);
 } END_TEST
@@ -247,6 +350,8 @@ Suite *test_rig_counter_inc(void) {
 
 	TCASE_ADD_FIXTURE(rig_counter_inc_normal, &setup_counter, &teardown_counter);
 	TCASE_ADD_FIXTURE(rig_counter_inc_error, &setup_counter, &teardown_counter);
+	TCASE_ADD_FIXTURE(rig_counter_inc_threads, &setup_counter, &teardown_counter);
+	TCASE_ADD_FIXTURE(rig_counter_inc_bounded, &setup_counter, &teardown_counter);
 	TCASE_ADD_EXIT(rig_counter_inc_nullptr, EXIT_FAILURE);
 
 	return (s);
@@ -272,6 +377,21 @@ START_TEST(test_rig_counter_dec_error) {
 	ck_assert(rig_counter_get(cnt) == 0);
 } END_TEST
 
+START_TEST(test_rig_counter_dec_threads) {
+	rig_counter_destroy(&cnt);
+	cnt = rig_counter_init(0, 0);
+	ck_assert(cnt != NULL);
+
+	RIG_THREAD thr = rig_thread_init(0, 4);
+	ck_assert(thr != NULL);
+
+	ck_assert(rig_thread_start(thr, &dec_zero_worker, NULL));
+	ck_assert(rig_thread_join(thr, NULL));
+	rig_thread_destroy(&thr);
+
+	ck_assert(rig_counter_get(cnt) == 0);
+} END_TEST
+
 START_TEST(test_rig_counter_dec_nullptr) {
 	rig_counter_dec(NULL);
 } END_TEST
@@ -281,6 +401,7 @@ Suite *test_rig_counter_dec(void) {
 
 	TCASE_ADD_FIXTURE(rig_counter_dec_normal, &setup_counter, &teardown_counter);
 	TCASE_ADD_FIXTURE(rig_counter_dec_error, &setup_counter, &teardown_counter);
+	TCASE_ADD_FIXTURE(rig_counter_dec_threads, &setup_counter, &teardown_counter);
 	TCASE_ADD_EXIT(rig_counter_dec_nullptr, EXIT_FAILURE);
 
 	return (s);
@@ -309,6 +430,28 @@ START_TEST(test_rig_counter_dec_and_test_error) {
 	ck_assert(rig_counter_get(cnt) == 0);
 } END_TEST
 
+START_TEST(test_rig_counter_dec_and_test_threads) {
+	RIG_COUNTER zero = rig_counter_init(0, 0);
+	ck_assert(zero != NULL);
+
+	rig_counter_destroy(&cnt);
+	cnt = rig_counter_init(4 * 10000, 0);
+	ck_assert(cnt != NULL);
+
+	RIG_THREAD thr = rig_thread_init(0, 4);
+	ck_assert(thr != NULL);
+
+	// Exactly one decrement reaches zero, like the last reference going away
+	ck_assert(rig_thread_start(thr, &dec_and_test_worker, zero));
+	ck_assert(rig_thread_join(thr, NULL));
+	rig_thread_destroy(&thr);
+
+	ck_assert(rig_counter_get(zero) == 1);
+	ck_assert(rig_counter_get(cnt) == 0);
+
+	rig_counter_destroy(&zero);
+} END_TEST
+
 START_TEST(test_rig_counter_dec_and_test_nullptr) {
 	rig_counter_dec_and_test(NULL);
 } END_TEST
@@ -318,6 +461,7 @@ Suite *test_rig_counter_dec_and_test(void) {
 
 	TCASE_ADD_FIXTURE(rig_counter_dec_and_test_normal, &setup_counter, &teardown_counter);
 	TCASE_ADD_FIXTURE(rig_counter_dec_and_test_error, &setup_counter, &teardown_counter);
+	TCASE_ADD_FIXTURE(rig_counter_dec_and_test_threads, &setup_counter, &teardown_counter);
 	TCASE_ADD_EXIT(rig_counter_dec_and_test_nullptr, EXIT_FAILURE);
 
 	return (s);
@@ -429,3 +573,84 @@ Suite *test_rig_counter_get_and_add(void) {
 
 	return (s);
 }
+
+/******************************************************************************/
+
+static void setup_counter_sharded(void) {
+	cnt = rig_counter_init_sharded(1, 10);
+	ck_assert(cnt != NULL);
+}
+
+START_TEST(test_rig_counter_sharded_normal) {
+	ck_assert(rig_counter_get_max(cnt) == 10);
+	ck_assert(rig_counter_get(cnt) == 1);
+
+	for (size_t i = 2; i < 11; i++) {
+		ck_assert(rig_counter_inc(cnt));
+		ck_assert(rig_counter_get(cnt) == i);
+	}
+
+	ck_assert(!rig_counter_inc(cnt) && errno == ERANGE);
+	ck_assert(rig_counter_get(cnt) == 10);
+	ck_assert(rig_counter_get_approx(cnt) == 10);
+
+	ck_assert(rig_counter_dec(cnt));
+	ck_assert(!rig_counter_dec_and_test(cnt) && errno == 0);
+	ck_assert(rig_counter_get(cnt) == 8);
+	ck_assert(rig_counter_get_approx(cnt) >= 8);
+
+	size_t old_val = 0;
+
+	ck_assert(rig_counter_get_and_add(cnt, -7, &old_val));
+	ck_assert(rig_counter_get(cnt) == 1);
+	ck_assert(old_val == 8);
+
+	ck_assert(!rig_counter_get_and_add(cnt, 10, NULL) && errno == ERANGE);
+	ck_assert(rig_counter_get(cnt) == 1);
+
+	ck_assert(rig_counter_get_and_add(cnt, 9, NULL));
+	ck_assert(rig_counter_get(cnt) == 10);
+
+	ck_assert(rig_counter_get_and_set(cnt, 1, &old_val));
+	ck_assert(rig_counter_get(cnt) == 1);
+	ck_assert(rig_counter_get_approx(cnt) == 1);
+	ck_assert(old_val == 10);
+
+	ck_assert(!rig_counter_get_and_set(cnt, 11, NULL) && errno == ERANGE);
+	ck_assert(rig_counter_dec_and_test(cnt));
+	ck_assert(rig_counter_get(cnt) == 0);
+} END_TEST
+
+START_TEST(test_rig_counter_sharded_threads) {
+	RIG_COUNTER got = rig_counter_init(0, 0);
+	ck_assert(got != NULL);
+
+	rig_counter_destroy(&cnt);
+	cnt = rig_counter_init_sharded(0, 100000);
+	ck_assert(cnt != NULL);
+
+	RIG_THREAD thr = rig_thread_init(0, 4);
+	ck_assert(thr != NULL);
+
+	// The maximum must hold exactly, even with units reserved by all shards
+	ck_assert(rig_thread_start(thr, &inc_worker, got));
+	ck_assert(rig_thread_join(thr, NULL));
+	rig_thread_destroy(&thr);
+
+	ck_assert(rig_counter_get(got) == 100000);
+	ck_assert(rig_counter_get(cnt) == 100000);
+
+	ck_assert(rig_counter_add(cnt, -100000));
+	ck_assert(rig_counter_get(cnt) == 0);
+
+	rig_counter_destroy(&got);
+} END_TEST
+
+Suite *test_rig_counter_sharded(void) {
+	Suite *s = suite_create("test_rig_counter_sharded");
+
+	TCASE_ADD_FIXTURE(rig_counter_sharded_normal, &setup_counter_sharded, &teardown_counter);
+	TCASE_ADD_FIXTURE(rig_counter_sharded_threads, &setup_counter_sharded, &teardown_counter);
+
+	return (s);
+}
@@ -28,6 +28,8 @@ Suite *test_rig_list_iter_delete(void);
 
 Suite *test_rig_list_duplicate(void);
 
+Suite *test_rig_list_ordered(void);
+
 int main(void) {
 	SRunner *sr = srunner_create(test_rig_list_init());
 	srunner_add_suite(sr, test_rig_list_destroy());
@@ -45,6 +47,8 @@ int main(void) {
 
 	srunner_add_suite(sr, test_rig_list_duplicate());
 
+	srunner_add_suite(sr, test_rig_list_ordered());
+
 	srunner_run_all(sr, CK_VERBOSE);
 	int failed = srunner_ntests_failed(sr);
 	srunner_free(sr);
@@ -90,13 +94,166 @@ START_TEST(test_rig_list_init_normal) {
 	ck_assert(rig_list_init(0, RIG_LIST_NODUPS, NULL, NULL) != NULL);
 	ck_assert(rig_list_init(10, RIG_LIST_NODUPS, NULL, NULL) != NULL);
 	ck_assert(rig_list_init(SIZE_MAX, RIG_LIST_NODUPS, NULL, NULL) != NULL);
+
+	ck_assert(rig_list_init(0, RIG_LIST_SMR_EPOCH, NULL, NULL) != NULL);
+	ck_assert(rig_list_init(10, RIG_LIST_NODUPS | RIG_LIST_SMR_EPOCH, NULL, NULL) != NULL);
+
+	ck_assert(rig_list_init(0, RIG_LIST_SMR_IBR, NULL, NULL) != NULL);
+	ck_assert(rig_list_init(10, RIG_LIST_NODUPS | RIG_LIST_SMR_IBR, NULL, NULL) != NULL);
+
+	ck_assert(rig_list_init(0, RIG_LIST_SMR_QSBR, NULL, NULL) != NULL);
+	ck_assert(rig_list_init(10, RIG_LIST_NODUPS | RIG_LIST_SMR_QSBR, NULL, NULL) != NULL);
+
+	ck_assert(rig_list_init(0, RIG_LIST_SHARDED_COUNT, NULL, NULL) != NULL);
+	ck_assert(rig_list_init(10, RIG_LIST_NODUPS | RIG_LIST_SHARDED_COUNT, NULL, NULL) != NULL);
+} END_TEST
+
+START_TEST(test_rig_list_init_epoch) {
+	RIG_LIST l = rig_list_init(0, RIG_LIST_NODUPS | RIG_LIST_SMR_EPOCH, NULL, NULL);
+	ck_assert(l != NULL);
+
+	ck_assert(rig_list_add(l, (void *)20));
+	ck_assert(rig_list_add(l, (void *)10));
+	ck_assert(!rig_list_add(l, (void *)10) && errno == EEXIST);
+	ck_assert(rig_list_count(l) == 2);
+
+	ck_assert(rig_list_find(l, (void *)20));
+	ck_assert(rig_list_del(l, (void *)10));
+	ck_assert(!rig_list_find(l, (void *)10) && errno == ENOENT);
+	ck_assert(rig_list_peek(l) == (void *)20);
+	ck_assert(rig_list_get(l) == (void *)20);
+	ck_assert(rig_list_get(l) == NULL && errno == ENOENT);
+
+	// Epoch iterators nest their critical sections, so more can coexist
+	ck_assert(rig_list_add(l, (void *)30));
+	ck_assert(rig_list_add(l, (void *)40));
+
+	RIG_LIST_ITER iter1 = rig_list_iter_begin(l);
+	ck_assert(iter1 != NULL);
+	RIG_LIST_ITER iter2 = rig_list_iter_begin(l);
+	ck_assert(iter2 != NULL);
+
+	size_t items = 0;
+	void *item = NULL;
+
+	while ((item = rig_list_iter_next(iter1)) != NULL) {
+		ck_assert(item == (void *)30 || item == (void *)40);
+		rig_list_iter_delete(iter1);
+		items++;
+	}
+	ck_assert(items == 2 && errno == ENOENT);
+	ck_assert(rig_list_count(l) == 0);
+
+	ck_assert(rig_list_iter_next(iter2) == NULL && errno == ENOENT);
+
+	rig_list_iter_end(&iter2);
+	rig_list_iter_end(&iter1);
+
+	rig_list_destroy(&l);
+	ck_assert(l == NULL);
+} END_TEST
+
+START_TEST(test_rig_list_init_ibr) {
+	RIG_LIST l = rig_list_init(0, RIG_LIST_NODUPS | RIG_LIST_SMR_IBR, NULL, NULL);
+	ck_assert(l != NULL);
+
+	// Enough nodes for several eras to pass
+	for (size_t i = 1; i <= 1000; i++) {
+		ck_assert(rig_list_add(l, (void *)(i * 16)));
+	}
+	ck_assert(!rig_list_add(l, (void *)16) && errno == EEXIST);
+	ck_assert(rig_list_count(l) == 1000);
+
+	for (size_t i = 1; i <= 1000; i += 2) {
+		ck_assert(rig_list_del(l, (void *)(i * 16)));
+	}
+	ck_assert(!rig_list_find(l, (void *)16) && errno == ENOENT);
+	ck_assert(rig_list_find(l, (void *)32));
+	ck_assert(rig_list_count(l) == 500);
+
+	// IBR iterators nest their critical sections, like epoch ones
+	RIG_LIST_ITER iter1 = rig_list_iter_begin(l);
+	ck_assert(iter1 != NULL);
+	RIG_LIST_ITER iter2 = rig_list_iter_begin(l);
+	ck_assert(iter2 != NULL);
+
+	size_t items = 0;
+
+	while (rig_list_iter_next(iter1) != NULL) {
+		rig_list_iter_delete(iter1);
+		items++;
+	}
+	ck_assert(items == 500 && errno == ENOENT);
+	ck_assert(rig_list_count(l) == 0);
+
+	ck_assert(rig_list_iter_next(iter2) == NULL && errno == ENOENT);
+
+	rig_list_iter_end(&iter2);
+	rig_list_iter_end(&iter1);
+
+	rig_list_destroy(&l);
+	ck_assert(l == NULL);
+} END_TEST
+
+START_TEST(test_rig_list_init_qsbr) {
+	RIG_LIST l = rig_list_init(0, RIG_LIST_NODUPS | RIG_LIST_SMR_QSBR, NULL, NULL);
+	ck_assert(l != NULL);
+
+	for (size_t i = 1; i <= 1000; i++) {
+		ck_assert(rig_list_add(l, (void *)(i * 16)));
+
+		// Once per batch, like an event loop would
+		if ((i % 100) == 0) {
+			rig_smr_qsbr_quiescent();
+		}
+	}
+	ck_assert(!rig_list_add(l, (void *)16) && errno == EEXIST);
+	ck_assert(rig_list_count(l) == 1000);
+
+	for (size_t i = 1; i <= 1000; i += 2) {
+		ck_assert(rig_list_del(l, (void *)(i * 16)));
+	}
+	ck_assert(!rig_list_find(l, (void *)16) && errno == ENOENT);
+	ck_assert(rig_list_find(l, (void *)32));
+	ck_assert(rig_list_count(l) == 500);
+
+	rig_smr_qsbr_quiescent();
+
+	// Nodes deleted through one iterator stay valid for the other one,
+	// up to the next quiescent state
+	RIG_LIST_ITER iter1 = rig_list_iter_begin(l);
+	ck_assert(iter1 != NULL);
+	RIG_LIST_ITER iter2 = rig_list_iter_begin(l);
+	ck_assert(iter2 != NULL);
+
+	size_t items = 0;
+
+	while (rig_list_iter_next(iter1) != NULL) {
+		rig_list_iter_delete(iter1);
+		items++;
+	}
+	ck_assert(items == 500 && errno == ENOENT);
+	ck_assert(rig_list_count(l) == 0);
+
+	ck_assert(rig_list_iter_next(iter2) == NULL && errno == ENOENT);
+
+	rig_list_iter_end(&iter2);
+	rig_list_iter_end(&iter1);
+
+	rig_smr_qsbr_offline();
+
+	rig_list_destroy(&l);
+	ck_assert(l == NULL);
 } END_TEST
 
 START_TEST(test_rig_list_init_error) {
-	ck_assert(rig_list_init(0, (1 << 5), NULL, NULL) == NULL && errno == EINVAL);
+	ck_assert(rig_list_init(0, (1 << 7), NULL, NULL) == NULL && errno == EINVAL);
 	ck_assert(rig_list_init(0, (1 << 15), NULL, NULL) == NULL && errno == EINVAL);
-	ck_assert(rig_list_init(0, (1 << 5) | (1 << 15), NULL, NULL) == NULL && errno == EINVAL);
-	ck_assert(rig_list_init(0, (1 << 5) | (1 << 15) | RIG_LIST_NODUPS, NULL, NULL) == NULL && errno == EINVAL);
+	ck_assert(rig_list_init(0, (1 << 7) | (1 << 15), NULL, NULL) == NULL && errno == EINVAL);
+	ck_assert(rig_list_init(0, (1 << 7) | (1 << 15) | RIG_LIST_NODUPS, NULL, NULL) == NULL && errno == EINVAL);
+	ck_assert(rig_list_init(0, RIG_LIST_SMR_EPOCH | RIG_LIST_SMR_IBR, NULL, NULL) == NULL && errno == EINVAL);
+	ck_assert(rig_list_init(0, RIG_LIST_SMR_EPOCH | RIG_LIST_SMR_QSBR, NULL, NULL) == NULL && errno == EINVAL);
+	ck_assert(rig_list_init(0, RIG_LIST_SMR_IBR | RIG_LIST_SMR_QSBR, NULL, NULL) == NULL && errno == EINVAL);
 } END_TEST
 
 Suite *test_rig_list_init(void) {
@@ -104,6 +261,9 @@ Suite *test_rig_list_init(void) {
 
 	TCASE_ADD(rig_list_init_normal);
 	TCASE_ADD(rig_list_init_error);
+	TCASE_ADD(rig_list_init_epoch);
+	TCASE_ADD(rig_list_init_ibr);
+	TCASE_ADD(rig_list_init_qsbr);
 
 	return (s);
 }
@@ -261,7 +421,28 @@ Suite *test_rig_list_peek(void) {
 /******************************************************************************/
 
 START_TEST(test_rig_list_iter_begin_normal) {
+	// Any number of iterators can be open at the same time, even nested
+	RIG_LIST_ITER outer = rig_list_iter_begin(list);
+	ck_assert(outer != NULL);
+
+	size_t items = 0;
+
+	while (rig_list_iter_next(outer) != NULL) {
+		RIG_LIST_ITER inner = rig_list_iter_begin(list);
+		ck_assert(inner != NULL);
 
+		while (rig_list_iter_next(inner) != NULL) {
+			items++;
+		}
+
+		rig_list_iter_end(&inner);
+		ck_assert(inner == NULL);
+	}
+
+	rig_list_iter_end(&outer);
+	ck_assert(outer == NULL);
+
+	ck_assert(items == 5 * 5);
 } END_TEST
 
 START_TEST(test_rig_list_iter_begin_error) {
@@ -271,7 +452,7 @@ START_TEST(test_rig_list_iter_begin_error) {
 Suite *test_rig_list_iter_begin(void) {
 	Suite *s = suite_create("test_rig_list_iter_begin");
 
-	TCASE_ADD(rig_list_iter_begin_normal);
+	TCASE_ADD_FIXTURE(rig_list_iter_begin_normal, &setup_list, &teardown_list);
 	TCASE_ADD(rig_list_iter_begin_error);
 
 	return (s);
@@ -352,3 +533,273 @@ Suite *test_rig_list_duplicate(void) {
 
 	return (s);
 }
+
+/******************************************************************************/
+
+#define ORDERED_THREADS 4
+#define ORDERED_ITEMS 1000
+
+RIG_COUNTER ordered_roles = NULL;
+uint16_t ordered_flags = 0;
+
+static size_t ordered_check_sorted(RIG_LIST l) {
+	RIG_LIST_ITER iter = rig_list_iter_begin(l);
+	ck_assert(iter != NULL);
+
+	size_t items = 0;
+	uintptr_t last = 0;
+	void *item = NULL;
+
+	while ((item = rig_list_iter_next(iter)) != NULL) {
+		ck_assert((uintptr_t)item >= last);
+		last = (uintptr_t)item;
+		items++;
+	}
+	ck_assert(errno == ENOENT);
+
+	rig_list_iter_end(&iter);
+
+	return (items);
+}
+
+static void *ordered_add_del_worker(void *arg) {
+	RIG_LIST l = arg;
+
+	size_t role = 0;
+	ck_assert(rig_counter_get_and_add(ordered_roles, 1, &role));
+
+	// Interleaved with the other threads' items, many sharing KeyNodes
+	for (size_t j = 0; j < ORDERED_ITEMS; j++) {
+		ck_assert(rig_list_add(l, (void *)(((j * ORDERED_THREADS) + role + 1) * 8)));
+
+		if ((j % 2) == 1) {
+			ck_assert(rig_list_del(l, (void *)((((j - 1) * ORDERED_THREADS) + role + 1) * 8)));
+		}
+
+		if ((TEST_BITFIELD(ordered_flags, RIG_LIST_SMR_QSBR)) && ((j % 100) == 0)) {
+			rig_smr_qsbr_quiescent();
+		}
+	}
+
+	if (TEST_BITFIELD(ordered_flags, RIG_LIST_SMR_QSBR)) {
+		rig_smr_qsbr_offline();
+	}
+
+	return (NULL);
+}
+
+START_TEST(test_rig_list_ordered_normal) {
+	RIG_LIST l = rig_list_init(0, RIG_LIST_ORDERED, NULL, NULL);
+	ck_assert(l != NULL);
+
+	ck_assert(rig_list_peek(l) == NULL && errno == ENOENT);
+	ck_assert(rig_list_get(l) == NULL && errno == ENOENT);
+
+	// Added out of order, some sharing a KeyNode, some not
+	for (size_t i = 0; i < 1000; i++) {
+		ck_assert(rig_list_add(l, (void *)((((i * 337) % 1000) + 1) * 16)));
+	}
+	ck_assert(rig_list_count(l) == 1000);
+
+	ck_assert(ordered_check_sorted(l) == 1000);
+
+	// The first item is always the lowest one
+	for (size_t i = 1; i <= 1000; i++) {
+		ck_assert(rig_list_peek(l) == (void *)(i * 16));
+		ck_assert(rig_list_get(l) == (void *)(i * 16));
+	}
+	ck_assert(rig_list_get(l) == NULL && errno == ENOENT);
+	ck_assert(rig_list_empty(l));
+
+	rig_list_destroy(&l);
+	ck_assert(l == NULL);
+} END_TEST
+
+START_TEST(test_rig_list_ordered_nodups) {
+	RIG_LIST l = rig_list_init(10, RIG_LIST_ORDERED | RIG_LIST_NODUPS, NULL, NULL);
+	ck_assert(l != NULL);
+
+	ck_assert(rig_list_add(l, (void *)30));
+	ck_assert(rig_list_add(l, (void *)10));
+	ck_assert(rig_list_add(l, (void *)20));
+	ck_assert(!rig_list_add(l, (void *)10) && errno == EEXIST);
+	ck_assert(!rig_list_add(l, (void *)30) && errno == EEXIST);
+	ck_assert(rig_list_count(l) == 3);
+
+	ck_assert(rig_list_get(l) == (void *)10);
+	ck_assert(rig_list_add(l, (void *)10));
+	ck_assert(rig_list_count(l) == 3);
+
+	rig_list_destroy(&l);
+
+	// Without NODUPS, duplicates are kept next to each other
+	l = rig_list_init(10, RIG_LIST_ORDERED, NULL, NULL);
+	ck_assert(l != NULL);
+
+	ck_assert(rig_list_add(l, (void *)20));
+	ck_assert(rig_list_add(l, (void *)10));
+	ck_assert(rig_list_add(l, (void *)20));
+	ck_assert(rig_list_add(l, (void *)10));
+	ck_assert(rig_list_count(l) == 4);
+	ck_assert(ordered_check_sorted(l) == 4);
+
+	ck_assert(rig_list_get(l) == (void *)10);
+	ck_assert(rig_list_get(l) == (void *)10);
+	ck_assert(rig_list_get(l) == (void *)20);
+	ck_assert(rig_list_get(l) == (void *)20);
+
+	rig_list_destroy(&l);
+	ck_assert(l == NULL);
+} END_TEST
+
+START_TEST(test_rig_list_ordered_del) {
+	RIG_LIST l = rig_list_init(0, RIG_LIST_ORDERED | RIG_LIST_NODUPS, NULL, NULL);
+	ck_assert(l != NULL);
+
+	for (size_t i = 1000; i >= 1; i--) {
+		ck_assert(rig_list_add(l, (void *)(i * 16)));
+	}
+
+	for (size_t i = 1; i <= 1000; i += 2) {
+		ck_assert(rig_list_del(l, (void *)(i * 16)));
+	}
+	ck_assert(!rig_list_del(l, (void *)16) && errno == ENOENT);
+	ck_assert(!rig_list_find(l, (void *)16) && errno == ENOENT);
+	ck_assert(rig_list_find(l, (void *)32));
+	ck_assert(rig_list_count(l) == 500);
+
+	ck_assert(ordered_check_sorted(l) == 500);
+	ck_assert(rig_list_peek(l) == (void *)32);
+
+	// Emptied KeyNodes stay in place, and get reused
+	ck_assert(rig_list_add(l, (void *)16));
+	ck_assert(rig_list_peek(l) == (void *)16);
+
+	rig_list_clear(l);
+	ck_assert(rig_list_empty(l));
+	ck_assert(rig_list_add(l, (void *)48));
+	ck_assert(rig_list_get(l) == (void *)48);
+
+	rig_list_destroy(&l);
+	ck_assert(l == NULL);
+} END_TEST
+
+START_TEST(test_rig_list_ordered_tall) {
+	RIG_LIST l = rig_list_init(0, RIG_LIST_ORDERED | RIG_LIST_NODUPS, NULL, NULL);
+	ck_assert(l != NULL);
+
+	// One KeyNode per item: enough of them get towers too tall for the node pool
+	for (size_t i = 5000; i >= 1; i--) {
+		ck_assert(rig_list_add(l, (void *)(i << 5)));
+	}
+	ck_assert(rig_list_count(l) == 5000);
+
+	for (size_t i = 1; i <= 5000; i++) {
+		ck_assert(rig_list_find(l, (void *)(i << 5)));
+		ck_assert(!rig_list_find(l, (void *)((i << 5) + 8)) && errno == ENOENT);
+	}
+
+	ck_assert(ordered_check_sorted(l) == 5000);
+
+	for (size_t i = 1; i <= 5000; i += 2) {
+		ck_assert(rig_list_del(l, (void *)(i << 5)));
+	}
+	ck_assert(rig_list_peek(l) == (void *)(2 << 5));
+	ck_assert(ordered_check_sorted(l) == 2500);
+
+	rig_list_destroy(&l);
+	ck_assert(l == NULL);
+} END_TEST
+
+START_TEST(test_rig_list_ordered_smr) {
+	uint16_t flags[3] = { RIG_LIST_SMR_EPOCH, RIG_LIST_SMR_IBR, RIG_LIST_SMR_QSBR };
+
+	for (size_t f = 0; f < 3; f++) {
+		RIG_LIST l = rig_list_init(0, RIG_LIST_ORDERED | RIG_LIST_NODUPS | flags[f], NULL, NULL);
+		ck_assert(l != NULL);
+
+		for (size_t i = 1; i <= 1000; i++) {
+			ck_assert(rig_list_add(l, (void *)((((i * 337) % 1000) + 1) * 16)));
+		}
+		ck_assert(!rig_list_add(l, (void *)16) && errno == EEXIST);
+
+		for (size_t i = 1; i <= 1000; i += 2) {
+			ck_assert(rig_list_del(l, (void *)(i * 16)));
+		}
+		ck_assert(!rig_list_find(l, (void *)16) && errno == ENOENT);
+		ck_assert(rig_list_find(l, (void *)32));
+
+		if (flags[f] == RIG_LIST_SMR_QSBR) {
+			rig_smr_qsbr_quiescent();
+		}
+
+		ck_assert(ordered_check_sorted(l) == 500);
+
+		for (size_t i = 2; i <= 1000; i += 2) {
+			ck_assert(rig_list_peek(l) == (void *)(i * 16));
+			ck_assert(rig_list_get(l) == (void *)(i * 16));
+		}
+		ck_assert(rig_list_empty(l));
+
+		if (flags[f] == RIG_LIST_SMR_QSBR) {
+			rig_smr_qsbr_offline();
+		}
+
+		rig_list_destroy(&l);
+		ck_assert(l == NULL);
+	}
+} END_TEST
+
+START_TEST(test_rig_list_ordered_threads) {
+	uint16_t flags[4] = { 0, RIG_LIST_SMR_EPOCH, RIG_LIST_SMR_IBR, RIG_LIST_SMR_QSBR };
+
+	for (size_t f = 0; f < 4; f++) {
+		RIG_LIST l = rig_list_init(0, RIG_LIST_ORDERED | RIG_LIST_NODUPS | flags[f], NULL, NULL);
+		ck_assert(l != NULL);
+
+		ordered_roles = rig_counter_init(0, 0);
+		ck_assert(ordered_roles != NULL);
+		ordered_flags = flags[f];
+
+		RIG_THREAD thr = rig_thread_init(0, ORDERED_THREADS);
+		ck_assert(thr != NULL);
+
+		ck_assert(rig_thread_start(thr, &ordered_add_del_worker, l));
+		ck_assert(rig_thread_join(thr, NULL));
+		rig_thread_destroy(&thr);
+
+		rig_counter_destroy(&ordered_roles);
+
+		// Every thread deleted the items it added with an even j
+		ck_assert(rig_list_count(l) == (ORDERED_THREADS * ORDERED_ITEMS) / 2);
+		ck_assert(ordered_check_sorted(l) == (ORDERED_THREADS * ORDERED_ITEMS) / 2);
+
+		for (size_t j = 0; j < ORDERED_ITEMS; j++) {
+			for (size_t role = 0; role < ORDERED_THREADS; role++) {
+				void *item = (void *)(((j * ORDERED_THREADS) + role + 1) * 8);
+
+				ck_assert(rig_list_find(l, item) == ((j % 2) == 1));
+			}
+		}
+
+		if (flags[f] == RIG_LIST_SMR_QSBR) {
+			rig_smr_qsbr_offline();
+		}
+
+		rig_list_destroy(&l);
+		ck_assert(l == NULL);
+	}
+} END_TEST
+
+Suite *test_rig_list_ordered(void) {
+	Suite *s = suite_create("test_rig_list_ordered");
+
+	TCASE_ADD(rig_list_ordered_normal);
+	TCASE_ADD(rig_list_ordered_nodups);
+	TCASE_ADD(rig_list_ordered_del);
+	TCASE_ADD(rig_list_ordered_tall);
+	TCASE_ADD(rig_list_ordered_smr);
+	TCASE_ADD(rig_list_ordered_threads);
+
+	return (s);
+}
@@ -0,0 +1,275 @@
+/**
+ * This file is part of the Rig project.
+ *
+ * For the full copyright and license information, please view the COPYING
+ * file that was distributed with this source code.
+ *
+ * @copyright  (c) the Rig project
+ * @author     Luca Longinotti <chtekk@longitekk.com>
+ * @license    BSD 2-clause
+ * @version    $Id$
+ */
+
+#include "tests.h"
+#include <string.h>
+
+Suite *test_rig_mem_pool_alloc(void);
+Suite *test_rig_mem_pool_free(void);
+Suite *test_rig_mem_pool_record_release(void);
+
+int main(void) {
+	SRunner *sr = srunner_create(test_rig_mem_pool_alloc());
+	srunner_add_suite(sr, test_rig_mem_pool_free());
+	srunner_add_suite(sr, test_rig_mem_pool_record_release());
+
+	srunner_run_all(sr, CK_VERBOSE);
+	int failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	return ((failed == 0) ? (EXIT_SUCCESS) : (EXIT_FAILURE));
+}
+
+
+#define POOL_OBJS 64
+
+void *pool_objs[POOL_OBJS];
+RIG_QUEUE pool_queue = NULL;
+
+static bool pool_objs_contains(void *obj) {
+	for (size_t i = 0; i < POOL_OBJS; i++) {
+		if (pool_objs[i] == obj) {
+			return (true);
+		}
+	}
+
+	return (false);
+}
+
+static void *pool_alloc_worker(void *arg) {
+	size_t size = (size_t)arg;
+
+	for (size_t i = 0; i < POOL_OBJS; i++) {
+		pool_objs[i] = rig_mem_pool_alloc(size);
+		ck_assert(pool_objs[i] != NULL);
+	}
+
+	return (NULL);
+}
+
+static void *pool_realloc_worker(void *arg) {
+	size_t size = (size_t)arg;
+
+	// Adopts the record of the thread that ran before, including what others gave back
+	for (size_t i = 0; i < POOL_OBJS; i++) {
+		void *obj = rig_mem_pool_alloc(size);
+		ck_assert(obj != NULL);
+		ck_assert(pool_objs_contains(obj));
+	}
+
+	return (NULL);
+}
+
+static void *pool_exchange_worker(void *arg) {
+	(void)(arg);
+
+	for (size_t i = 0; i < 10000; i++) {
+		void **obj = rig_mem_pool_alloc(32);
+		ck_assert(obj != NULL);
+
+		obj[0] = obj;
+		obj[1] = (void *)i;
+		ck_assert(rig_queue_put(pool_queue, obj));
+
+		// Most likely allocated by another thread, so freeing it is remote
+		obj = rig_queue_get(pool_queue);
+		ck_assert(obj != NULL);
+		ck_assert(obj[0] == obj);
+		rig_mem_pool_free(obj);
+	}
+
+	return (NULL);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_mem_pool_alloc_normal) {
+	for (size_t size = 1; size <= RIG_MEM_POOL_MAX; size++) {
+		uint8_t *obj = rig_mem_pool_alloc(size);
+		ck_assert(obj != NULL);
+		ck_assert(((uintptr_t)obj & 0x0F) == 0);
+
+		memset(obj, 0xAB, size);
+		rig_mem_pool_free(obj);
+	}
+} END_TEST
+
+START_TEST(test_rig_mem_pool_alloc_distinct) {
+	uint8_t *objs[1000];
+
+	// Enough to need more than one slab
+	for (size_t i = 0; i < 1000; i++) {
+		objs[i] = rig_mem_pool_alloc(RIG_MEM_POOL_MAX);
+		ck_assert(objs[i] != NULL);
+
+		memset(objs[i], (int)(i & 0xFF), RIG_MEM_POOL_MAX);
+	}
+
+	for (size_t i = 0; i < 1000; i++) {
+		for (size_t j = 0; j < RIG_MEM_POOL_MAX; j++) {
+			ck_assert(objs[i][j] == (uint8_t)(i & 0xFF));
+		}
+
+		rig_mem_pool_free(objs[i]);
+	}
+} END_TEST
+
+START_TEST(test_rig_mem_pool_alloc_error) {
+	ck_assert(rig_mem_pool_alloc(0) == NULL && errno == EINVAL);
+	ck_assert(rig_mem_pool_alloc(RIG_MEM_POOL_MAX + 1) == NULL && errno == EINVAL);
+	ck_assert(rig_mem_pool_alloc(SIZE_MAX) == NULL && errno == EINVAL);
+} END_TEST
+
+Suite *test_rig_mem_pool_alloc(void) {
+	Suite *s = suite_create("test_rig_mem_pool_alloc");
+
+	TCASE_ADD(rig_mem_pool_alloc_normal);
+	TCASE_ADD(rig_mem_pool_alloc_distinct);
+	TCASE_ADD(rig_mem_pool_alloc_error);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_mem_pool_free_normal) {
+	void *obj = rig_mem_pool_alloc(24);
+	ck_assert(obj != NULL);
+	rig_mem_pool_free(obj);
+
+	// Same size-class (17-32 bytes), so the object just freed gets reused
+	ck_assert(rig_mem_pool_alloc(20) == obj);
+
+	// Other size-classes never get it
+	void *other = rig_mem_pool_alloc(40);
+	ck_assert(other != NULL && other != obj);
+
+	rig_mem_pool_free(other);
+	rig_mem_pool_free(obj);
+} END_TEST
+
+START_TEST(test_rig_mem_pool_free_remote) {
+	// Give the main thread its own record first, else it adopts the worker's one
+	rig_mem_pool_free(rig_mem_pool_alloc(16));
+
+	RIG_THREAD thr = rig_thread_init(0, 1);
+	ck_assert(thr != NULL);
+
+	ck_assert(rig_thread_start(thr, &pool_alloc_worker, (void *)48));
+	ck_assert(rig_thread_join(thr, NULL));
+	rig_thread_destroy(&thr);
+
+	// The worker is gone: its objects go back to its record in batches
+	for (size_t i = 0; i < POOL_OBJS; i++) {
+		rig_mem_pool_free(pool_objs[i]);
+	}
+
+	thr = rig_thread_init(0, 1);
+	ck_assert(thr != NULL);
+
+	ck_assert(rig_thread_start(thr, &pool_realloc_worker, (void *)48));
+	ck_assert(rig_thread_join(thr, NULL));
+	rig_thread_destroy(&thr);
+} END_TEST
+
+START_TEST(test_rig_mem_pool_free_threads) {
+	pool_queue = rig_queue_init(0, 0);
+	ck_assert(pool_queue != NULL);
+
+	RIG_THREAD thr = rig_thread_init(0, 4);
+	ck_assert(thr != NULL);
+
+	ck_assert(rig_thread_start(thr, &pool_exchange_worker, NULL));
+	ck_assert(rig_thread_join(thr, NULL));
+	rig_thread_destroy(&thr);
+
+	ck_assert(rig_queue_empty(pool_queue));
+	rig_queue_destroy(&pool_queue);
+} END_TEST
+
+START_TEST(test_rig_mem_pool_free_null) {
+	rig_mem_pool_free(NULL);
+} END_TEST
+
+Suite *test_rig_mem_pool_free(void) {
+	Suite *s = suite_create("test_rig_mem_pool_free");
+
+	TCASE_ADD(rig_mem_pool_free_normal);
+	TCASE_ADD(rig_mem_pool_free_remote);
+	TCASE_ADD(rig_mem_pool_free_threads);
+	TCASE_ADD_EXIT(rig_mem_pool_free_null, EXIT_FAILURE);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_mem_pool_record_release_normal) {
+	// Give the main thread its own record first
+	rig_mem_pool_free(rig_mem_pool_alloc(16));
+
+	RIG_THREAD thr = rig_thread_init(0, 1);
+	ck_assert(thr != NULL);
+
+	ck_assert(rig_thread_start(thr, &pool_alloc_worker, (void *)64));
+	ck_assert(rig_thread_join(thr, NULL));
+	rig_thread_destroy(&thr);
+
+	// Less than a full batch, only handed back when releasing the record
+	for (size_t i = 0; i < 5; i++) {
+		rig_mem_pool_free(pool_objs[i]);
+	}
+
+	rig_mem_pool_record_release();
+
+	// Records are adopted newest first, so we now get the worker's one
+	for (size_t i = 0; i < 5; i++) {
+		void *obj = rig_mem_pool_alloc(64);
+		ck_assert(obj != NULL);
+		ck_assert(pool_objs_contains(obj));
+	}
+
+	rig_mem_pool_record_release();
+} END_TEST
+
+START_TEST(test_rig_mem_pool_record_release_reuse) {
+	RIG_THREAD thr = rig_thread_init(0, 1);
+	ck_assert(thr != NULL);
+
+	ck_assert(rig_thread_start(thr, &pool_alloc_worker, (void *)16));
+	ck_assert(rig_thread_join(thr, NULL));
+	rig_thread_destroy(&thr);
+
+	// Own objects of an adopted record are local frees again
+	for (size_t i = 0; i < POOL_OBJS; i++) {
+		rig_mem_pool_free(pool_objs[i]);
+	}
+
+	for (size_t i = 0; i < POOL_OBJS; i++) {
+		void *obj = rig_mem_pool_alloc(16);
+		ck_assert(obj != NULL);
+		ck_assert(pool_objs_contains(obj));
+	}
+
+	// Releasing twice, or without a record, does nothing
+	rig_mem_pool_record_release();
+	rig_mem_pool_record_release();
+} END_TEST
+
+Suite *test_rig_mem_pool_record_release(void) {
+	Suite *s = suite_create("test_rig_mem_pool_record_release");
+
+	TCASE_ADD(rig_mem_pool_record_release_normal);
+	TCASE_ADD(rig_mem_pool_record_release_reuse);
+
+	return (s);
+}
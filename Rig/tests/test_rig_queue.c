@@ -0,0 +1,684 @@
+/**
+ * This file is part of the Rig project.
+ *
+ * For the full copyright and license information, please view the COPYING
+ * file that was distributed with this source code.
+ *
+ * @copyright  (c) the Rig project
+ * @author     Luca Longinotti <chtekk@longitekk.com>
+ * @license    BSD 2-clause
+ * @version    $Id$
+ */
+
+#include "tests.h"
+
+Suite *test_rig_queue_init(void);
+Suite *test_rig_queue_destroy(void);
+Suite *test_rig_queue_put(void);
+Suite *test_rig_queue_get(void);
+Suite *test_rig_queue_peek(void);
+Suite *test_rig_queue_put_many(void);
+Suite *test_rig_queue_get_many(void);
+Suite *test_rig_queue_get_wait(void);
+Suite *test_rig_queue_spsc(void);
+Suite *test_rig_queue_mpsc(void);
+
+int main(void) {
+	SRunner *sr = srunner_create(test_rig_queue_init());
+	srunner_add_suite(sr, test_rig_queue_destroy());
+	srunner_add_suite(sr, test_rig_queue_put());
+	srunner_add_suite(sr, test_rig_queue_get());
+	srunner_add_suite(sr, test_rig_queue_peek());
+	srunner_add_suite(sr, test_rig_queue_put_many());
+	srunner_add_suite(sr, test_rig_queue_get_many());
+	srunner_add_suite(sr, test_rig_queue_get_wait());
+	srunner_add_suite(sr, test_rig_queue_spsc());
+	srunner_add_suite(sr, test_rig_queue_mpsc());
+
+	srunner_run_all(sr, CK_VERBOSE);
+	int failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	return ((failed == 0) ? (EXIT_SUCCESS) : (EXIT_FAILURE));
+}
+
+
+#define ITEMS 10000
+#define PRODUCERS 4
+
+// Items are never NULL, and keep the low bits free
+#define ITEM(i) ((void *)((uintptr_t)(i) << 4))
+#define ITEM_VALUE(p) ((uintptr_t)(p) >> 4)
+
+RIG_QUEUE queue = NULL;
+RIG_COUNTER sum = NULL;
+
+static void setup_queue(void) {
+	queue = rig_queue_init(10, 0);
+	ck_assert(queue != NULL);
+
+	sum = rig_counter_init(0, 0);
+	ck_assert(sum != NULL);
+}
+
+static void teardown_queue(void) {
+	rig_queue_destroy(&queue);
+	ck_assert(queue == NULL);
+
+	rig_counter_destroy(&sum);
+}
+
+static void *producer_worker(void *arg) {
+	(void)(arg);
+
+	// Each producer tags its items with its thread ID, to check their order
+	uintptr_t id = rig_thread_id();
+
+	for (uintptr_t i = 1; i <= ITEMS; i++) {
+		while (!rig_queue_put(queue, ITEM((id << 16) | i))) {
+			ck_assert(errno == EXFULL);
+			rig_thread_yield();
+		}
+	}
+
+	return (NULL);
+}
+
+static void *put_get_worker(void *arg) {
+	(void)(arg);
+
+	for (uintptr_t i = 1; i <= ITEMS; i++) {
+		ck_assert(rig_queue_put(queue, ITEM(i)));
+
+		void *item = rig_queue_get(queue);
+		ck_assert(item != NULL);
+		ck_assert(rig_counter_add(sum, (ssize_t)ITEM_VALUE(item)));
+	}
+
+	return (NULL);
+}
+
+static void *put_get_many_worker(void *arg) {
+	(void)(arg);
+
+	void *items[4];
+
+	for (uintptr_t i = 1; i <= ITEMS; i += 4) {
+		for (uintptr_t j = 0; j < 4; j++) {
+			items[j] = ITEM(i + j);
+		}
+
+		// Capacity is shared with the others, retry if the batch doesn't fit
+		while (!rig_queue_put_many(queue, items, 4)) {
+			ck_assert(errno == EXFULL);
+			rig_thread_yield();
+		}
+
+		// Others may have taken some already, but we put four more than we got
+		size_t got = 0;
+
+		while (got < 4) {
+			size_t n = rig_queue_get_many(queue, items, 4 - got);
+			ck_assert(n > 0);
+
+			for (size_t j = 0; j < n; j++) {
+				ck_assert(rig_counter_add(sum, (ssize_t)ITEM_VALUE(items[j])));
+			}
+
+			got += n;
+		}
+	}
+
+	return (NULL);
+}
+
+static void *get_wait_worker(void *arg) {
+	(void)(arg);
+
+	for (size_t i = 0; i < (ITEMS / 10); i++) {
+		void *item = rig_queue_get_wait(queue, SIZE_MAX);
+		ck_assert(item != NULL);
+		ck_assert(rig_counter_add(sum, (ssize_t)ITEM_VALUE(item)));
+	}
+
+	return (NULL);
+}
+
+static void consume_ordered(size_t producers) {
+	uintptr_t last[64] = { 0 };
+	size_t got = 0;
+
+	while (got < (producers * ITEMS)) {
+		void *item = rig_queue_get(queue);
+
+		if (item == NULL) {
+			ck_assert(errno == ENOENT);
+			rig_thread_yield();
+			continue;
+		}
+
+		uintptr_t id = ITEM_VALUE(item) >> 16, i = ITEM_VALUE(item) & 0xFFFF;
+		ck_assert(id < 64);
+
+		// FIFO order per producer, nothing lost or duplicated
+		ck_assert(i == last[id] + 1);
+		last[id] = i;
+		got++;
+	}
+
+	ck_assert(rig_queue_get(queue) == NULL && errno == ENOENT);
+	ck_assert(rig_queue_count(queue) == 0);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_queue_init_normal) {
+	ck_assert(rig_queue_init(0, 0) != NULL);
+	ck_assert(rig_queue_init(10, 0) != NULL);
+	ck_assert(rig_queue_init(SIZE_MAX, 0) != NULL);
+
+	ck_assert(rig_queue_init(0, RIG_QUEUE_NOCOUNT) != NULL);
+	ck_assert(rig_queue_init(10, RIG_QUEUE_SPSC) != NULL);
+	ck_assert(rig_queue_init(10, RIG_QUEUE_MPSC) != NULL);
+	ck_assert(rig_queue_init(0, RIG_QUEUE_SPSC | RIG_QUEUE_NOCOUNT) != NULL);
+	ck_assert(rig_queue_init(0, RIG_QUEUE_MPSC | RIG_QUEUE_SHARDED_COUNT) != NULL);
+
+	ck_assert(rig_queue_init(10, RIG_QUEUE_SMR_EPOCH) != NULL);
+	ck_assert(rig_queue_init(10, RIG_QUEUE_SMR_QSBR) != NULL);
+	ck_assert(rig_queue_init(10, RIG_QUEUE_SHARDED_COUNT) != NULL);
+} END_TEST
+
+START_TEST(test_rig_queue_init_error) {
+	ck_assert(rig_queue_init(0, (1 << 6)) == NULL && errno == EINVAL);
+	ck_assert(rig_queue_init(0, (1 << 15)) == NULL && errno == EINVAL);
+	ck_assert(rig_queue_init(0, RIG_QUEUE_SPSC | RIG_QUEUE_MPSC) == NULL && errno == EINVAL);
+	ck_assert(rig_queue_init(0, RIG_QUEUE_SMR_EPOCH | RIG_QUEUE_SMR_QSBR) == NULL && errno == EINVAL);
+} END_TEST
+
+Suite *test_rig_queue_init(void) {
+	Suite *s = suite_create("test_rig_queue_init");
+
+	TCASE_ADD(rig_queue_init_normal);
+	TCASE_ADD(rig_queue_init_error);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_queue_destroy_normal) {
+	ck_assert(rig_queue_put(queue, ITEM(1)));
+
+	RIG_QUEUE newref = rig_queue_newref(queue);
+	rig_queue_destroy(&newref);
+	ck_assert(newref == NULL);
+
+	// Still referenced by queue
+	ck_assert(rig_queue_get(queue) == ITEM(1));
+} END_TEST
+
+START_TEST(test_rig_queue_destroy_null) {
+	queue = NULL;
+	rig_queue_destroy(&queue);
+} END_TEST
+
+START_TEST(test_rig_queue_destroy_nullptr) {
+	rig_queue_destroy(NULL);
+} END_TEST
+
+Suite *test_rig_queue_destroy(void) {
+	Suite *s = suite_create("test_rig_queue_destroy");
+
+	TCASE_ADD_FIXTURE(rig_queue_destroy_normal, &setup_queue, &teardown_queue);
+	TCASE_ADD_EXIT(rig_queue_destroy_null, EXIT_FAILURE);
+	TCASE_ADD_EXIT(rig_queue_destroy_nullptr, EXIT_FAILURE);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_queue_put_normal) {
+	for (uintptr_t i = 1; i <= 10; i++) {
+		ck_assert(rig_queue_put(queue, ITEM(i)));
+		ck_assert(rig_queue_count(queue) == i);
+	}
+
+	ck_assert(rig_queue_full(queue));
+	ck_assert(!rig_queue_put(queue, ITEM(11)) && errno == EXFULL);
+	ck_assert(rig_queue_count(queue) == 10);
+	ck_assert(rig_queue_capacity(queue) == 10);
+} END_TEST
+
+START_TEST(test_rig_queue_put_threads) {
+	RIG_THREAD thr = rig_thread_init(0, PRODUCERS);
+	ck_assert(thr != NULL);
+
+	ck_assert(rig_thread_start(thr, &put_get_worker, NULL));
+	ck_assert(rig_thread_join(thr, NULL));
+	rig_thread_destroy(&thr);
+
+	// Every item put was gotten exactly once, by some thread
+	ck_assert(rig_counter_get(sum) == PRODUCERS * ((ITEMS * (ITEMS + 1)) / 2));
+	ck_assert(rig_queue_empty(queue));
+} END_TEST
+
+Suite *test_rig_queue_put(void) {
+	Suite *s = suite_create("test_rig_queue_put");
+
+	TCASE_ADD_FIXTURE(rig_queue_put_normal, &setup_queue, &teardown_queue);
+	TCASE_ADD_FIXTURE(rig_queue_put_threads, &setup_queue, &teardown_queue);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_queue_get_normal) {
+	ck_assert(rig_queue_get(queue) == NULL && errno == ENOENT);
+
+	ck_assert(rig_queue_put(queue, ITEM(1)));
+	ck_assert(rig_queue_put(queue, ITEM(2)));
+	ck_assert(rig_queue_put(queue, ITEM(3)));
+
+	ck_assert(rig_queue_get(queue) == ITEM(1));
+	ck_assert(rig_queue_get(queue) == ITEM(2));
+	ck_assert(rig_queue_put(queue, ITEM(4)));
+	ck_assert(rig_queue_get(queue) == ITEM(3));
+	ck_assert(rig_queue_get(queue) == ITEM(4));
+
+	ck_assert(rig_queue_get(queue) == NULL && errno == ENOENT);
+	ck_assert(rig_queue_empty(queue));
+} END_TEST
+
+Suite *test_rig_queue_get(void) {
+	Suite *s = suite_create("test_rig_queue_get");
+
+	TCASE_ADD_FIXTURE(rig_queue_get_normal, &setup_queue, &teardown_queue);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_queue_peek_normal) {
+	ck_assert(rig_queue_peek(queue) == NULL && errno == ENOENT);
+
+	ck_assert(rig_queue_put(queue, ITEM(1)));
+	ck_assert(rig_queue_put(queue, ITEM(2)));
+
+	ck_assert(rig_queue_peek(queue) == ITEM(1));
+	ck_assert(rig_queue_count(queue) == 2);
+	ck_assert(rig_queue_get(queue) == ITEM(1));
+	ck_assert(rig_queue_peek(queue) == ITEM(2));
+} END_TEST
+
+Suite *test_rig_queue_peek(void) {
+	Suite *s = suite_create("test_rig_queue_peek");
+
+	TCASE_ADD_FIXTURE(rig_queue_peek_normal, &setup_queue, &teardown_queue);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_queue_put_many_normal) {
+	void *items[8] = { ITEM(1), ITEM(2), ITEM(3), ITEM(4), ITEM(5), ITEM(6), ITEM(7), ITEM(8) };
+
+	ck_assert(rig_queue_put_many(queue, items, 5));
+	ck_assert(rig_queue_count(queue) == 5);
+
+	// All or nothing, the queue is left as it was
+	ck_assert(!rig_queue_put_many(queue, items, 8) && errno == EXFULL);
+	ck_assert(rig_queue_count(queue) == 5);
+
+	ck_assert(rig_queue_put_many(queue, items + 5, 3));
+	ck_assert(rig_queue_count(queue) == 8);
+
+	for (uintptr_t i = 1; i <= 8; i++) {
+		ck_assert(rig_queue_get(queue) == ITEM(i));
+	}
+	ck_assert(rig_queue_empty(queue));
+} END_TEST
+
+START_TEST(test_rig_queue_put_many_modes) {
+	void *items[8] = { ITEM(1), ITEM(2), ITEM(3), ITEM(4), ITEM(5), ITEM(6), ITEM(7), ITEM(8) };
+	uint16_t modes[2] = { RIG_QUEUE_SPSC, RIG_QUEUE_MPSC };
+
+	for (size_t m = 0; m < 2; m++) {
+		RIG_QUEUE q = rig_queue_init(10, modes[m]);
+		ck_assert(q != NULL);
+
+		ck_assert(rig_queue_put(q, ITEM(9)));
+		ck_assert(rig_queue_put_many(q, items, 8));
+		ck_assert(!rig_queue_put_many(q, items, 2) && errno == EXFULL);
+		ck_assert(rig_queue_count(q) == 9);
+
+		ck_assert(rig_queue_get(q) == ITEM(9));
+		for (uintptr_t i = 1; i <= 8; i++) {
+			ck_assert(rig_queue_get(q) == ITEM(i));
+		}
+		ck_assert(rig_queue_get(q) == NULL && errno == ENOENT);
+
+		rig_queue_destroy(&q);
+	}
+} END_TEST
+
+START_TEST(test_rig_queue_put_many_error) {
+	void *items[1] = { ITEM(1) };
+
+	ck_assert(!rig_queue_put_many(queue, items, 0) && errno == EINVAL);
+	ck_assert(rig_queue_empty(queue));
+} END_TEST
+
+START_TEST(test_rig_queue_put_many_threads) {
+	RIG_THREAD thr = rig_thread_init(0, PRODUCERS);
+	ck_assert(thr != NULL);
+
+	ck_assert(rig_thread_start(thr, &put_get_many_worker, NULL));
+	ck_assert(rig_thread_join(thr, NULL));
+	rig_thread_destroy(&thr);
+
+	ck_assert(rig_counter_get(sum) == PRODUCERS * ((ITEMS * (ITEMS + 1)) / 2));
+	ck_assert(rig_queue_empty(queue));
+} END_TEST
+
+Suite *test_rig_queue_put_many(void) {
+	Suite *s = suite_create("test_rig_queue_put_many");
+
+	TCASE_ADD_FIXTURE(rig_queue_put_many_normal, &setup_queue, &teardown_queue);
+	TCASE_ADD(rig_queue_put_many_modes);
+	TCASE_ADD_FIXTURE(rig_queue_put_many_error, &setup_queue, &teardown_queue);
+	TCASE_ADD_FIXTURE(rig_queue_put_many_threads, &setup_queue, &teardown_queue);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_queue_get_many_normal) {
+	void *items[8];
+
+	ck_assert(rig_queue_get_many(queue, items, 8) == 0 && errno == ENOENT);
+
+	for (uintptr_t i = 1; i <= 5; i++) {
+		ck_assert(rig_queue_put(queue, ITEM(i)));
+	}
+
+	ck_assert(rig_queue_get_many(queue, items, 2) == 2);
+	ck_assert(items[0] == ITEM(1) && items[1] == ITEM(2));
+	ck_assert(rig_queue_count(queue) == 3);
+
+	// Fewer items than asked for
+	ck_assert(rig_queue_get_many(queue, items, 8) == 3);
+	ck_assert(items[0] == ITEM(3) && items[1] == ITEM(4) && items[2] == ITEM(5));
+	ck_assert(rig_queue_count(queue) == 0);
+
+	ck_assert(rig_queue_get_many(queue, items, 8) == 0 && errno == ENOENT);
+} END_TEST
+
+START_TEST(test_rig_queue_get_many_modes) {
+	void *items[8];
+	uint16_t modes[2] = { RIG_QUEUE_SPSC, RIG_QUEUE_MPSC };
+
+	for (size_t m = 0; m < 2; m++) {
+		RIG_QUEUE q = rig_queue_init(0, modes[m]);
+		ck_assert(q != NULL);
+
+		ck_assert(rig_queue_get_many(q, items, 8) == 0 && errno == ENOENT);
+
+		for (uintptr_t i = 1; i <= 10; i++) {
+			ck_assert(rig_queue_put(q, ITEM(i)));
+		}
+
+		ck_assert(rig_queue_get_many(q, items, 8) == 8);
+		for (uintptr_t i = 1; i <= 8; i++) {
+			ck_assert(items[i - 1] == ITEM(i));
+		}
+
+		ck_assert(rig_queue_get_many(q, items, 8) == 2);
+		ck_assert(items[0] == ITEM(9) && items[1] == ITEM(10));
+		ck_assert(rig_queue_empty(q));
+
+		rig_queue_destroy(&q);
+	}
+} END_TEST
+
+START_TEST(test_rig_queue_get_many_error) {
+	void *items[1];
+
+	ck_assert(rig_queue_put(queue, ITEM(1)));
+	ck_assert(rig_queue_get_many(queue, items, 0) == 0 && errno == EINVAL);
+	ck_assert(rig_queue_count(queue) == 1);
+} END_TEST
+
+Suite *test_rig_queue_get_many(void) {
+	Suite *s = suite_create("test_rig_queue_get_many");
+
+	TCASE_ADD_FIXTURE(rig_queue_get_many_normal, &setup_queue, &teardown_queue);
+	TCASE_ADD(rig_queue_get_many_modes);
+	TCASE_ADD_FIXTURE(rig_queue_get_many_error, &setup_queue, &teardown_queue);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_queue_get_wait_normal) {
+	ck_assert(rig_queue_put(queue, ITEM(1)));
+	ck_assert(rig_queue_put(queue, ITEM(2)));
+
+	// Items already there are returned right away
+	ck_assert(rig_queue_get_wait(queue, 0) == ITEM(1));
+	ck_assert(rig_queue_get_wait(queue, SIZE_MAX) == ITEM(2));
+} END_TEST
+
+START_TEST(test_rig_queue_get_wait_timeout) {
+	ck_assert(rig_queue_get_wait(queue, 0) == NULL && errno == ETIMEDOUT);
+	ck_assert(rig_queue_get_wait(queue, 1000) == NULL && errno == ETIMEDOUT);
+	ck_assert(rig_queue_empty(queue));
+} END_TEST
+
+START_TEST(test_rig_queue_get_wait_wakeup) {
+	RIG_THREAD thr = rig_thread_init(0, PRODUCERS);
+	ck_assert(thr != NULL);
+
+	ck_assert(rig_thread_start(thr, &get_wait_worker, NULL));
+
+	// Consumers mostly find the queue empty, and go to sleep waiting for items
+	for (uintptr_t i = 1; i <= (PRODUCERS * (ITEMS / 10)); i++) {
+		while (!rig_queue_put(queue, ITEM(i))) {
+			ck_assert(errno == EXFULL);
+			rig_thread_yield();
+		}
+
+		rig_thread_yield();
+	}
+
+	ck_assert(rig_thread_join(thr, NULL));
+	rig_thread_destroy(&thr);
+
+	ck_assert(rig_counter_get(sum) == ((PRODUCERS * (ITEMS / 10)) * ((PRODUCERS * (ITEMS / 10)) + 1)) / 2);
+	ck_assert(rig_queue_empty(queue));
+} END_TEST
+
+START_TEST(test_rig_queue_get_wait_modes) {
+	uint16_t modes[2] = { RIG_QUEUE_SPSC, RIG_QUEUE_MPSC };
+
+	for (size_t m = 0; m < 2; m++) {
+		rig_queue_destroy(&queue);
+		queue = rig_queue_init(10, modes[m]);
+		ck_assert(queue != NULL);
+
+		ck_assert(rig_queue_get_wait(queue, 1000) == NULL && errno == ETIMEDOUT);
+
+		RIG_THREAD thr = rig_thread_init(0, 1);
+		ck_assert(thr != NULL);
+
+		ck_assert(rig_thread_start(thr, &producer_worker, NULL));
+
+		// Single consumer, waiting for each item in order
+		for (uintptr_t i = 1; i <= ITEMS; i++) {
+			void *item = rig_queue_get_wait(queue, SIZE_MAX);
+			ck_assert(item != NULL);
+			ck_assert((ITEM_VALUE(item) & 0xFFFF) == i);
+		}
+
+		ck_assert(rig_thread_join(thr, NULL));
+		rig_thread_destroy(&thr);
+
+		ck_assert(rig_queue_empty(queue));
+	}
+} END_TEST
+
+Suite *test_rig_queue_get_wait(void) {
+	Suite *s = suite_create("test_rig_queue_get_wait");
+
+	TCASE_ADD_FIXTURE(rig_queue_get_wait_normal, &setup_queue, &teardown_queue);
+	TCASE_ADD_FIXTURE(rig_queue_get_wait_timeout, &setup_queue, &teardown_queue);
+	TCASE_ADD_FIXTURE(rig_queue_get_wait_wakeup, &setup_queue, &teardown_queue);
+	TCASE_ADD_FIXTURE(rig_queue_get_wait_modes, &setup_queue, &teardown_queue);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_queue_spsc_normal) {
+	RIG_QUEUE q = rig_queue_init(3, RIG_QUEUE_SPSC);
+	ck_assert(q != NULL);
+
+	ck_assert(rig_queue_get(q) == NULL && errno == ENOENT);
+	ck_assert(rig_queue_peek(q) == NULL && errno == ENOENT);
+
+	ck_assert(rig_queue_put(q, ITEM(1)));
+	ck_assert(rig_queue_put(q, ITEM(2)));
+	ck_assert(rig_queue_put(q, ITEM(3)));
+	ck_assert(!rig_queue_put(q, ITEM(4)) && errno == EXFULL);
+	ck_assert(rig_queue_count(q) == 3);
+
+	ck_assert(rig_queue_peek(q) == ITEM(1));
+	ck_assert(rig_queue_get(q) == ITEM(1));
+	ck_assert(rig_queue_get(q) == ITEM(2));
+	ck_assert(rig_queue_put(q, ITEM(4)));
+	ck_assert(rig_queue_get(q) == ITEM(3));
+	ck_assert(rig_queue_get(q) == ITEM(4));
+	ck_assert(rig_queue_get(q) == NULL && errno == ENOENT);
+
+	// No iterators on single-consumer queues
+	ck_assert(rig_queue_iter_begin(q) == NULL && errno == ENAVAIL);
+
+	// Destroying frees what's still in the queue
+	ck_assert(rig_queue_put(q, ITEM(5)));
+
+	rig_queue_destroy(&q);
+	ck_assert(q == NULL);
+} END_TEST
+
+START_TEST(test_rig_queue_spsc_many) {
+	void *items[6] = { ITEM(1), ITEM(2), ITEM(3), ITEM(4), ITEM(5), ITEM(6) };
+	void *got[6] = { NULL };
+
+	// Sharding is ignored, the count stays exact
+	RIG_QUEUE q = rig_queue_init(5, RIG_QUEUE_SPSC | RIG_QUEUE_SHARDED_COUNT);
+	ck_assert(q != NULL);
+
+	ck_assert(!rig_queue_put_many(q, items, 6) && errno == EXFULL);
+	ck_assert(rig_queue_count(q) == 0);
+
+	ck_assert(rig_queue_put_many(q, items, 3));
+	ck_assert(!rig_queue_put_many(q, items + 3, 3) && errno == EXFULL);
+	ck_assert(rig_queue_count(q) == 3);
+
+	ck_assert(rig_queue_get_many(q, got, 2) == 2);
+	ck_assert(got[0] == ITEM(1) && got[1] == ITEM(2));
+	ck_assert(rig_queue_count(q) == 1);
+
+	ck_assert(rig_queue_put_many(q, items + 3, 3));
+	ck_assert(rig_queue_put(q, ITEM(7)));
+	ck_assert(rig_queue_full(q));
+	ck_assert(!rig_queue_put(q, ITEM(8)) && errno == EXFULL);
+
+	ck_assert(rig_queue_get_many(q, got, 6) == 5);
+	ck_assert(got[0] == ITEM(3) && got[4] == ITEM(7));
+	ck_assert(rig_queue_count(q) == 0);
+	ck_assert(rig_queue_empty(q));
+
+	rig_queue_destroy(&q);
+	ck_assert(q == NULL);
+} END_TEST
+
+START_TEST(test_rig_queue_spsc_threads) {
+	rig_queue_destroy(&queue);
+	queue = rig_queue_init(100, RIG_QUEUE_SPSC);
+	ck_assert(queue != NULL);
+
+	RIG_THREAD thr = rig_thread_init(0, 1);
+	ck_assert(thr != NULL);
+
+	ck_assert(rig_thread_start(thr, &producer_worker, NULL));
+
+	// The main thread is the only consumer
+	consume_ordered(1);
+
+	ck_assert(rig_thread_join(thr, NULL));
+	rig_thread_destroy(&thr);
+} END_TEST
+
+Suite *test_rig_queue_spsc(void) {
+	Suite *s = suite_create("test_rig_queue_spsc");
+
+	TCASE_ADD(rig_queue_spsc_normal);
+	TCASE_ADD(rig_queue_spsc_many);
+	TCASE_ADD_FIXTURE(rig_queue_spsc_threads, &setup_queue, &teardown_queue);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_queue_mpsc_normal) {
+	RIG_QUEUE q = rig_queue_init(0, RIG_QUEUE_MPSC);
+	ck_assert(q != NULL);
+
+	for (uintptr_t i = 1; i <= 100; i++) {
+		ck_assert(rig_queue_put(q, ITEM(i)));
+	}
+	ck_assert(rig_queue_count(q) == 100);
+
+	for (uintptr_t i = 1; i <= 100; i++) {
+		ck_assert(rig_queue_get(q) == ITEM(i));
+	}
+	ck_assert(rig_queue_get(q) == NULL && errno == ENOENT);
+	ck_assert(rig_queue_empty(q));
+
+	rig_queue_destroy(&q);
+	ck_assert(q == NULL);
+} END_TEST
+
+START_TEST(test_rig_queue_mpsc_threads) {
+	rig_queue_destroy(&queue);
+	queue = rig_queue_init(100, RIG_QUEUE_MPSC);
+	ck_assert(queue != NULL);
+
+	RIG_THREAD thr = rig_thread_init(0, PRODUCERS);
+	ck_assert(thr != NULL);
+
+	ck_assert(rig_thread_start(thr, &producer_worker, NULL));
+
+	// The main thread is the only consumer
+	consume_ordered(PRODUCERS);
+
+	ck_assert(rig_thread_join(thr, NULL));
+	rig_thread_destroy(&thr);
+} END_TEST
+
+Suite *test_rig_queue_mpsc(void) {
+	Suite *s = suite_create("test_rig_queue_mpsc");
+
+	TCASE_ADD(rig_queue_mpsc_normal);
+	TCASE_ADD_FIXTURE(rig_queue_mpsc_threads, &setup_queue, &teardown_queue);
+
+	return (s);
+}
@@ -0,0 +1,410 @@
+/**
+ * This file is part of the Rig project.
+ *
+ * For the full copyright and license information, please view the COPYING
+ * file that was distributed with this source code.
+ *
+ * @copyright  (c) the Rig project
+ * @author     Luca Longinotti <chtekk@longitekk.com>
+ * @license    BSD 2-clause
+ * @version    $Id$
+ */
+
+#include "tests.h"
+
+Suite *test_rig_ring_init(void);
+Suite *test_rig_ring_newref(void);
+Suite *test_rig_ring_destroy(void);
+Suite *test_rig_ring_clear(void);
+Suite *test_rig_ring_put(void);
+Suite *test_rig_ring_get(void);
+Suite *test_rig_ring_peek(void);
+Suite *test_rig_ring_empty(void);
+Suite *test_rig_ring_full(void);
+Suite *test_rig_ring_count(void);
+Suite *test_rig_ring_capacity(void);
+
+int main(void) {
+	SRunner *sr = srunner_create(test_rig_ring_init());
+	srunner_add_suite(sr, test_rig_ring_newref());
+	srunner_add_suite(sr, test_rig_ring_destroy());
+	srunner_add_suite(sr, test_rig_ring_clear());
+	srunner_add_suite(sr, test_rig_ring_put());
+	srunner_add_suite(sr, test_rig_ring_get());
+	srunner_add_suite(sr, test_rig_ring_peek());
+	srunner_add_suite(sr, test_rig_ring_empty());
+	srunner_add_suite(sr, test_rig_ring_full());
+	srunner_add_suite(sr, test_rig_ring_count());
+	srunner_add_suite(sr, test_rig_ring_capacity());
+
+	srunner_run_all(sr, CK_VERBOSE);
+	int failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	return ((failed == 0) ? (EXIT_SUCCESS) : (EXIT_FAILURE));
+}
+
+
+RIG_RING ring = NULL;
+
+static void setup_ring(void) {
+	ring = rig_ring_init(8, 0);
+	ck_assert(ring != NULL);
+}
+
+static void setup_ring_spsc(void) {
+	ring = rig_ring_init(8, RIG_RING_SPSC);
+	ck_assert(ring != NULL);
+}
+
+static void teardown_ring(void) {
+	rig_ring_destroy(&ring);
+	ck_assert(ring == NULL);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_ring_init_normal) {
+	ck_assert(rig_ring_init(1, 0) != NULL);
+	ck_assert(rig_ring_init(8, 0) != NULL);
+	ck_assert(rig_ring_init(1000, 0) != NULL);
+	ck_assert(rig_ring_init(8, RIG_RING_SPSC) != NULL);
+} END_TEST
+
+START_TEST(test_rig_ring_init_error) {
+	ck_assert(rig_ring_init(0, 0) == NULL && errno == EINVAL);
+	ck_assert(rig_ring_init(SIZE_MAX, 0) == NULL && errno == EINVAL);
+	ck_assert(rig_ring_init(8, 0x02) == NULL && errno == EINVAL);
+} END_TEST
+
+Suite *test_rig_ring_init(void) {
+	Suite *s = suite_create("test_rig_ring_init");
+
+	TCASE_ADD(rig_ring_init_normal);
+	TCASE_ADD(rig_ring_init_error);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_ring_newref_normal) {
+	RIG_RING ref = rig_ring_newref(ring);
+	ck_assert(ref == ring);
+
+	rig_ring_destroy(&ref);
+	ck_assert(ref == NULL);
+
+	ck_assert(rig_ring_put(ring, (void *)0x10));
+	ck_assert(rig_ring_get(ring) == (void *)0x10);
+} END_TEST
+
+START_TEST(test_rig_ring_newref_nullptr) {
+	RIG_RING ref = rig_ring_newref(NULL);
+	ck_assert(ref == NULL);
+} END_TEST
+
+Suite *test_rig_ring_newref(void) {
+	Suite *s = suite_create("test_rig_ring_newref");
+
+	TCASE_ADD_FIXTURE(rig_ring_newref_normal, &setup_ring, &teardown_ring);
+	TCASE_ADD_EXIT(rig_ring_newref_nullptr, EXIT_FAILURE);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_ring_destroy_normal) {
+	rig_ring_destroy(&ring);
+	ck_assert(ring == NULL);
+} END_TEST
+
+START_TEST(test_rig_ring_destroy_null) {
+	ring = NULL;
+	rig_ring_destroy(&ring);
+} END_TEST
+
+START_TEST(test_rig_ring_destroy_nullptr) {
+	rig_ring_destroy(NULL);
+} END_TEST
+
+Suite *test_rig_ring_destroy(void) {
+	Suite *s = suite_create("test_rig_ring_destroy");
+
+	TCASE_ADD_FIXTURE(rig_ring_destroy_normal, &setup_ring, NULL);
+	TCASE_ADD_EXIT(rig_ring_destroy_null, EXIT_FAILURE);
+	TCASE_ADD_EXIT(rig_ring_destroy_nullptr, EXIT_FAILURE);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_ring_clear_normal) {
+	for (uintptr_t i = 1; i <= 5; i++) {
+		ck_assert(rig_ring_put(ring, (void *)i));
+	}
+
+	rig_ring_clear(ring);
+	ck_assert(rig_ring_empty(ring));
+	ck_assert(rig_ring_get(ring) == NULL && errno == ENOENT);
+} END_TEST
+
+START_TEST(test_rig_ring_clear_nullptr) {
+	rig_ring_clear(NULL);
+} END_TEST
+
+Suite *test_rig_ring_clear(void) {
+	Suite *s = suite_create("test_rig_ring_clear");
+
+	TCASE_ADD_FIXTURE(rig_ring_clear_normal, &setup_ring, &teardown_ring);
+	TCASE_ADD_EXIT(rig_ring_clear_nullptr, EXIT_FAILURE);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_ring_put_normal) {
+	for (uintptr_t i = 1; i <= 8; i++) {
+		ck_assert(rig_ring_put(ring, (void *)i));
+		ck_assert(rig_ring_count(ring) == i);
+	}
+} END_TEST
+
+START_TEST(test_rig_ring_put_full) {
+	for (uintptr_t i = 1; i <= 8; i++) {
+		ck_assert(rig_ring_put(ring, (void *)i));
+	}
+
+	ck_assert(!rig_ring_put(ring, (void *)0x10) && errno == EXFULL);
+	ck_assert(rig_ring_count(ring) == 8);
+
+	// Making room lets put() succeed again
+	ck_assert(rig_ring_get(ring) == (void *)1);
+	ck_assert(rig_ring_put(ring, (void *)0x10));
+	ck_assert(!rig_ring_put(ring, (void *)0x20) && errno == EXFULL);
+} END_TEST
+
+START_TEST(test_rig_ring_put_full_spsc) {
+	for (uintptr_t i = 1; i <= 8; i++) {
+		ck_assert(rig_ring_put(ring, (void *)i));
+	}
+
+	ck_assert(!rig_ring_put(ring, (void *)0x10) && errno == EXFULL);
+	ck_assert(rig_ring_full(ring));
+
+	ck_assert(rig_ring_get(ring) == (void *)1);
+	ck_assert(rig_ring_put(ring, (void *)0x10));
+	ck_assert(!rig_ring_put(ring, (void *)0x20) && errno == EXFULL);
+} END_TEST
+
+START_TEST(test_rig_ring_put_nullptr) {
+	rig_ring_put(NULL, (void *)0x10);
+} END_TEST
+
+Suite *test_rig_ring_put(void) {
+	Suite *s = suite_create("test_rig_ring_put");
+
+	TCASE_ADD_FIXTURE(rig_ring_put_normal, &setup_ring, &teardown_ring);
+	TCASE_ADD_FIXTURE(rig_ring_put_full, &setup_ring, &teardown_ring);
+	TCASE_ADD_FIXTURE(rig_ring_put_full_spsc, &setup_ring_spsc, &teardown_ring);
+	TCASE_ADD_EXIT(rig_ring_put_nullptr, EXIT_FAILURE);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_ring_get_normal) {
+	// Go around the ring multiple times, to exercise sequence wrap-around
+	for (uintptr_t round = 0; round < 10; round++) {
+		for (uintptr_t i = 1; i <= 6; i++) {
+			ck_assert(rig_ring_put(ring, (void *)(round * 10 + i)));
+		}
+
+		for (uintptr_t i = 1; i <= 6; i++) {
+			ck_assert(rig_ring_get(ring) == (void *)(round * 10 + i));
+		}
+	}
+
+	ck_assert(rig_ring_empty(ring));
+} END_TEST
+
+START_TEST(test_rig_ring_get_empty) {
+	ck_assert(rig_ring_get(ring) == NULL && errno == ENOENT);
+
+	ck_assert(rig_ring_put(ring, (void *)0x10));
+	ck_assert(rig_ring_get(ring) == (void *)0x10);
+	ck_assert(rig_ring_get(ring) == NULL && errno == ENOENT);
+} END_TEST
+
+START_TEST(test_rig_ring_get_spsc) {
+	ck_assert(rig_ring_get(ring) == NULL && errno == ENOENT);
+
+	for (uintptr_t round = 0; round < 10; round++) {
+		for (uintptr_t i = 1; i <= 6; i++) {
+			ck_assert(rig_ring_put(ring, (void *)(round * 10 + i)));
+		}
+
+		ck_assert(rig_ring_peek(ring) == (void *)(round * 10 + 1));
+		ck_assert(rig_ring_count(ring) == 6);
+
+		for (uintptr_t i = 1; i <= 6; i++) {
+			ck_assert(rig_ring_get(ring) == (void *)(round * 10 + i));
+		}
+	}
+
+	ck_assert(rig_ring_get(ring) == NULL && errno == ENOENT);
+	ck_assert(rig_ring_peek(ring) == NULL && errno == ENOENT);
+} END_TEST
+
+START_TEST(test_rig_ring_get_nullptr) {
+	rig_ring_get(NULL);
+} END_TEST
+
+Suite *test_rig_ring_get(void) {
+	Suite *s = suite_create("test_rig_ring_get");
+
+	TCASE_ADD_FIXTURE(rig_ring_get_normal, &setup_ring, &teardown_ring);
+	TCASE_ADD_FIXTURE(rig_ring_get_empty, &setup_ring, &teardown_ring);
+	TCASE_ADD_FIXTURE(rig_ring_get_spsc, &setup_ring_spsc, &teardown_ring);
+	TCASE_ADD_EXIT(rig_ring_get_nullptr, EXIT_FAILURE);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_ring_peek_normal) {
+	ck_assert(rig_ring_peek(ring) == NULL && errno == ENOENT);
+
+	ck_assert(rig_ring_put(ring, (void *)0x10));
+	ck_assert(rig_ring_put(ring, (void *)0x20));
+
+	ck_assert(rig_ring_peek(ring) == (void *)0x10);
+	ck_assert(rig_ring_count(ring) == 2);
+
+	ck_assert(rig_ring_get(ring) == (void *)0x10);
+	ck_assert(rig_ring_peek(ring) == (void *)0x20);
+} END_TEST
+
+START_TEST(test_rig_ring_peek_nullptr) {
+	rig_ring_peek(NULL);
+} END_TEST
+
+Suite *test_rig_ring_peek(void) {
+	Suite *s = suite_create("test_rig_ring_peek");
+
+	TCASE_ADD_FIXTURE(rig_ring_peek_normal, &setup_ring, &teardown_ring);
+	TCASE_ADD_EXIT(rig_ring_peek_nullptr, EXIT_FAILURE);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_ring_empty_normal) {
+	ck_assert(rig_ring_empty(ring));
+
+	ck_assert(rig_ring_put(ring, (void *)0x10));
+	ck_assert(!rig_ring_empty(ring));
+
+	ck_assert(rig_ring_get(ring) == (void *)0x10);
+	ck_assert(rig_ring_empty(ring));
+} END_TEST
+
+START_TEST(test_rig_ring_empty_nullptr) {
+	rig_ring_empty(NULL);
+} END_TEST
+
+Suite *test_rig_ring_empty(void) {
+	Suite *s = suite_create("test_rig_ring_empty");
+
+	TCASE_ADD_FIXTURE(rig_ring_empty_normal, &setup_ring, &teardown_ring);
+	TCASE_ADD_EXIT(rig_ring_empty_nullptr, EXIT_FAILURE);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_ring_full_normal) {
+	for (uintptr_t i = 1; i <= 8; i++) {
+		ck_assert(!rig_ring_full(ring));
+		ck_assert(rig_ring_put(ring, (void *)i));
+	}
+
+	ck_assert(rig_ring_full(ring));
+
+	ck_assert(rig_ring_get(ring) == (void *)1);
+	ck_assert(!rig_ring_full(ring));
+} END_TEST
+
+START_TEST(test_rig_ring_full_nullptr) {
+	rig_ring_full(NULL);
+} END_TEST
+
+Suite *test_rig_ring_full(void) {
+	Suite *s = suite_create("test_rig_ring_full");
+
+	TCASE_ADD_FIXTURE(rig_ring_full_normal, &setup_ring, &teardown_ring);
+	TCASE_ADD_EXIT(rig_ring_full_nullptr, EXIT_FAILURE);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_ring_count_normal) {
+	ck_assert(rig_ring_count(ring) == 0);
+
+	ck_assert(rig_ring_put(ring, (void *)0x10));
+	ck_assert(rig_ring_put(ring, (void *)0x20));
+	ck_assert(rig_ring_count(ring) == 2);
+
+	ck_assert(rig_ring_get(ring) == (void *)0x10);
+	ck_assert(rig_ring_count(ring) == 1);
+} END_TEST
+
+START_TEST(test_rig_ring_count_nullptr) {
+	rig_ring_count(NULL);
+} END_TEST
+
+Suite *test_rig_ring_count(void) {
+	Suite *s = suite_create("test_rig_ring_count");
+
+	TCASE_ADD_FIXTURE(rig_ring_count_normal, &setup_ring, &teardown_ring);
+	TCASE_ADD_EXIT(rig_ring_count_nullptr, EXIT_FAILURE);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_ring_capacity_normal) {
+	ck_assert(rig_ring_capacity(ring) == 8);
+
+	RIG_RING r = rig_ring_init(1, 0);
+	ck_assert(rig_ring_capacity(r) == 1);
+	rig_ring_destroy(&r);
+
+	// Capacity gets rounded up to the next power of two
+	r = rig_ring_init(1000, 0);
+	ck_assert(rig_ring_capacity(r) == 1024);
+	rig_ring_destroy(&r);
+} END_TEST
+
+START_TEST(test_rig_ring_capacity_nullptr) {
+	rig_ring_capacity(NULL);
+} END_TEST
+
+Suite *test_rig_ring_capacity(void) {
+	Suite *s = suite_create("test_rig_ring_capacity");
+
+	TCASE_ADD_FIXTURE(rig_ring_capacity_normal, &setup_ring, &teardown_ring);
+	TCASE_ADD_EXIT(rig_ring_capacity_nullptr, EXIT_FAILURE);
+
+	return (s);
+}
@@ -0,0 +1,520 @@
+/**
+ * This file is part of the Rig project.
+ *
+ * For the full copyright and license information, please view the COPYING
+ * file that was distributed with this source code.
+ *
+ * @copyright  (c) the Rig project
+ * @author     Luca Longinotti <chtekk@longitekk.com>
+ * @license    BSD 2-clause
+ * @version    $Id$
+ */
+
+#include "tests.h"
+#include <stdio.h>
+#include <unistd.h>
+
+Suite *test_rig_smr_hp_retire_fn(void);
+Suite *test_rig_smr_epoch_retire_fn(void);
+Suite *test_rig_smr_ibr_retire(void);
+Suite *test_rig_smr_qsbr_retire_fn(void);
+Suite *test_rig_smr_threshold(void);
+Suite *test_rig_smr_reclaimer(void);
+Suite *test_rig_smr_thread_churn(void);
+
+int main(void) {
+	SRunner *sr = srunner_create(test_rig_smr_hp_retire_fn());
+	srunner_add_suite(sr, test_rig_smr_epoch_retire_fn());
+	srunner_add_suite(sr, test_rig_smr_ibr_retire());
+	srunner_add_suite(sr, test_rig_smr_qsbr_retire_fn());
+	srunner_add_suite(sr, test_rig_smr_threshold());
+	srunner_add_suite(sr, test_rig_smr_reclaimer());
+	srunner_add_suite(sr, test_rig_smr_thread_churn());
+
+	srunner_run_all(sr, CK_VERBOSE);
+	int failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	return ((failed == 0) ? (EXIT_SUCCESS) : (EXIT_FAILURE));
+}
+
+
+RIG_COUNTER freed = NULL;
+
+static void setup_freed(void) {
+	freed = rig_counter_init(0, 0);
+	ck_assert(freed != NULL);
+}
+
+static void teardown_freed(void) {
+	rig_counter_destroy(&freed);
+	ck_assert(freed == NULL);
+}
+
+static void free_counted(void *mem, void *ctx) {
+	ck_assert(ctx == (void *)freed);
+
+	rig_mem_free(mem);
+	rig_counter_inc(freed);
+}
+
+static void *retire_worker(void *arg) {
+	size_t count = (size_t)arg;
+
+	for (size_t i = 0; i < count; i++) {
+		rig_smr_hp_retire_fn(rig_mem_alloc(64, 0), &free_counted, freed);
+
+		rig_smr_epoch_critical_enter();
+		rig_smr_epoch_retire_fn(rig_mem_alloc(64, 0), &free_counted, freed);
+		rig_smr_epoch_critical_exit();
+	}
+
+	return (NULL);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_smr_hp_retire_fn_normal) {
+	RIG_SMR_HP_Record hp_record = rig_smr_hp_record_get();
+	void *mem = rig_mem_alloc(64, 0);
+
+	// Protected memory is kept back by a scan, and freed once unprotected
+	rig_smr_hp_set(hp_record, 0, mem);
+	rig_smr_hp_retire_fn(mem, &free_counted, freed);
+	rig_smr_hp_mem_scan();
+	ck_assert(rig_counter_get(freed) == 0);
+
+	rig_smr_hp_release(hp_record, 0);
+	rig_smr_hp_mem_scan();
+	ck_assert(rig_counter_get(freed) == 1);
+
+	// NULL does nothing, like free()
+	rig_smr_hp_retire_fn(NULL, &free_counted, freed);
+	rig_smr_hp_mem_scan();
+	ck_assert(rig_counter_get(freed) == 1);
+} END_TEST
+
+START_TEST(test_rig_smr_hp_retire_fn_nullfn) {
+	rig_smr_hp_retire_fn(rig_mem_alloc(64, 0), NULL, NULL);
+} END_TEST
+
+START_TEST(test_rig_smr_hp_retire_fn_unaligned) {
+	uint8_t *mem = rig_mem_alloc(64, 0);
+
+	rig_smr_hp_retire_fn(mem + 1, &free_counted, freed);
+} END_TEST
+
+Suite *test_rig_smr_hp_retire_fn(void) {
+	Suite *s = suite_create("test_rig_smr_hp_retire_fn");
+
+	TCASE_ADD_FIXTURE(rig_smr_hp_retire_fn_normal, &setup_freed, &teardown_freed);
+	TCASE_ADD_EXIT(rig_smr_hp_retire_fn_nullfn, EXIT_FAILURE);
+	TCASE_ADD_FIXTURE_EXIT(rig_smr_hp_retire_fn_unaligned, &setup_freed, &teardown_freed, EXIT_FAILURE);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_smr_epoch_retire_fn_normal) {
+	rig_smr_epoch_critical_enter();
+	rig_smr_epoch_retire_fn(rig_mem_alloc(64, 0), &free_counted, freed);
+	rig_smr_epoch_retire_fn(NULL, &free_counted, freed);
+	rig_smr_epoch_critical_exit();
+
+	ck_assert(rig_counter_get(freed) == 0);
+
+	// Giving the record back waits for the epochs to pass and frees everything
+	rig_smr_epoch_record_release();
+	ck_assert(rig_counter_get(freed) == 1);
+} END_TEST
+
+START_TEST(test_rig_smr_epoch_retire_fn_nullfn) {
+	rig_smr_epoch_critical_enter();
+	rig_smr_epoch_retire_fn(rig_mem_alloc(64, 0), NULL, NULL);
+	rig_smr_epoch_critical_exit();
+} END_TEST
+
+Suite *test_rig_smr_epoch_retire_fn(void) {
+	Suite *s = suite_create("test_rig_smr_epoch_retire_fn");
+
+	TCASE_ADD_FIXTURE(rig_smr_epoch_retire_fn_normal, &setup_freed, &teardown_freed);
+	TCASE_ADD_EXIT(rig_smr_epoch_retire_fn_nullfn, EXIT_FAILURE);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_smr_ibr_retire_fn_normal) {
+	rig_smr_ibr_critical_enter();
+	rig_smr_ibr_retire_fn(rig_mem_alloc(64, 0), &free_counted, freed);
+	rig_smr_ibr_retire_fn(NULL, &free_counted, freed);
+
+	// Memory of unknown age is kept back by any reservation older than its retirement
+	rig_smr_ibr_mem_scan();
+	ck_assert(rig_counter_get(freed) == 0);
+
+	rig_smr_ibr_critical_exit();
+
+	rig_smr_ibr_mem_scan();
+	ck_assert(rig_counter_get(freed) == 1);
+} END_TEST
+
+START_TEST(test_rig_smr_ibr_retire_fn_nullfn) {
+	rig_smr_ibr_retire_fn(rig_mem_alloc(64, 0), NULL, NULL);
+} END_TEST
+
+START_TEST(test_rig_smr_ibr_pool_retire_normal) {
+	void *old_mem = rig_smr_ibr_pool_alloc(32);
+	ck_assert(old_mem != NULL);
+
+	// Stand-in for a thread stalled in a critical section: it never protects anything new
+	RIG_SMR_IBR_Record ibr_record = rig_smr_ibr_critical_enter();
+	ck_assert(ibr_record != NULL);
+
+	// Let a few eras pass
+	for (size_t i = 0; i < 1000; i++) {
+		rig_smr_ibr_pool_free(rig_smr_ibr_pool_alloc(32));
+	}
+
+	void *new_mem = rig_smr_ibr_pool_alloc(32);
+	ck_assert(new_mem != NULL);
+
+	// Only what was alive during the reservation is kept back, the node
+	// pool gives freed memory out again right away
+	rig_smr_ibr_pool_retire(old_mem);
+	rig_smr_ibr_pool_retire(new_mem);
+	rig_smr_ibr_mem_scan();
+
+	void *mem = rig_smr_ibr_pool_alloc(32);
+	ck_assert(mem == new_mem);
+	rig_smr_ibr_pool_free(mem);
+
+	// Extending the reservation to the current era has to be noticed once
+	ck_assert(!rig_smr_ibr_protect(ibr_record));
+	ck_assert(rig_smr_ibr_protect(ibr_record));
+
+	rig_smr_ibr_critical_exit();
+
+	rig_smr_ibr_mem_scan();
+
+	mem = rig_smr_ibr_pool_alloc(32);
+	ck_assert(mem == old_mem);
+	rig_smr_ibr_pool_free(mem);
+} END_TEST
+
+START_TEST(test_rig_smr_ibr_pool_retire_error) {
+	ck_assert(rig_smr_ibr_pool_alloc(0) == NULL && errno == EINVAL);
+	ck_assert(rig_smr_ibr_pool_alloc(RIG_MEM_POOL_MAX) == NULL && errno == EINVAL);
+} END_TEST
+
+Suite *test_rig_smr_ibr_retire(void) {
+	Suite *s = suite_create("test_rig_smr_ibr_retire");
+
+	TCASE_ADD_FIXTURE(rig_smr_ibr_retire_fn_normal, &setup_freed, &teardown_freed);
+	TCASE_ADD_EXIT(rig_smr_ibr_retire_fn_nullfn, EXIT_FAILURE);
+	TCASE_ADD(rig_smr_ibr_pool_retire_normal);
+	TCASE_ADD(rig_smr_ibr_pool_retire_error);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+static void *qsbr_retire_worker(void *arg) {
+	(void)arg;
+
+	// Retiring doesn't bring a thread online, giving its record back on exit
+	// then either frees the memory or leaves it to the online threads
+	rig_smr_qsbr_retire_fn(rig_mem_alloc(64, 0), &free_counted, freed);
+
+	return (NULL);
+}
+
+static RIG_QUEUE qsbr_queue = NULL;
+static RIG_STACK qsbr_stack = NULL;
+
+static void *qsbr_get_wait_worker(void *arg) {
+	// Online after trying to get an item, but offline while asleep
+	ck_assert(rig_queue_get_wait(qsbr_queue, SIZE_MAX) == arg);
+
+	return (NULL);
+}
+
+static void *qsbr_pop_wait_worker(void *arg) {
+	ck_assert(rig_stack_pop_wait(qsbr_stack, SIZE_MAX) == arg);
+
+	return (NULL);
+}
+
+static void qsbr_retire_while_blocked(void) {
+	// Every retire tries to advance the global epoch
+	rig_smr_qsbr_threshold_set(0, 1);
+
+	// Until the other thread is asleep, it may still be online and hold
+	// everything back, after that nothing waits for it anymore
+	for (size_t i = 0; (i < 100000) && (rig_counter_get(freed) == 0); i++) {
+		rig_smr_qsbr_quiescent();
+		rig_smr_qsbr_retire_fn(rig_mem_alloc(64, 0), &free_counted, freed);
+		rig_thread_yield();
+	}
+	ck_assert(rig_counter_get(freed) > 0);
+
+	rig_smr_qsbr_threshold_set(0, (size_t)1 << 20);
+}
+
+static void qsbr_retire_thread(void) {
+	RIG_THREAD thr = rig_thread_init(0, 1);
+	ck_assert(thr != NULL);
+
+	ck_assert(rig_thread_start(thr, &qsbr_retire_worker, NULL));
+	ck_assert(rig_thread_join(thr, NULL));
+	rig_thread_destroy(&thr);
+}
+
+START_TEST(test_rig_smr_qsbr_retire_fn_normal) {
+	rig_smr_qsbr_quiescent();
+	rig_smr_qsbr_retire_fn(rig_mem_alloc(64, 0), &free_counted, freed);
+	rig_smr_qsbr_retire_fn(NULL, &free_counted, freed);
+	rig_smr_qsbr_quiescent();
+
+	ck_assert(rig_counter_get(freed) == 0);
+
+	// Giving the record back goes offline, and with nobody else online frees everything
+	rig_smr_qsbr_record_release();
+	ck_assert(rig_counter_get(freed) == 1);
+} END_TEST
+
+START_TEST(test_rig_smr_qsbr_retire_fn_online) {
+	rig_smr_qsbr_quiescent();
+
+	// We're online and didn't pass through a quiescent state since,
+	// so the exiting thread can't wait for us and orphans its memory
+	qsbr_retire_thread();
+	ck_assert(rig_counter_get(freed) == 0);
+
+	// We adopt it here, and free it with ours
+	rig_smr_qsbr_quiescent();
+
+	// Offline, we don't hold anything back anymore
+	rig_smr_qsbr_offline();
+
+	qsbr_retire_thread();
+	ck_assert(rig_counter_get(freed) == 1);
+
+	rig_smr_qsbr_online();
+	rig_smr_qsbr_record_release();
+	ck_assert(rig_counter_get(freed) == 2);
+} END_TEST
+
+START_TEST(test_rig_smr_qsbr_retire_fn_get_wait) {
+	qsbr_queue = rig_queue_init(0, RIG_QUEUE_SMR_QSBR);
+	ck_assert(qsbr_queue != NULL);
+
+	RIG_THREAD thr = rig_thread_init(0, 1);
+	ck_assert(thr != NULL);
+
+	ck_assert(rig_thread_start(thr, &qsbr_get_wait_worker, (void *)16));
+
+	qsbr_retire_while_blocked();
+
+	ck_assert(rig_queue_put(qsbr_queue, (void *)16));
+
+	ck_assert(rig_thread_join(thr, NULL));
+	rig_thread_destroy(&thr);
+
+	rig_queue_destroy(&qsbr_queue);
+
+	// Nobody else online anymore, frees everything that's left
+	rig_smr_qsbr_record_release();
+} END_TEST
+
+START_TEST(test_rig_smr_qsbr_retire_fn_pop_wait) {
+	qsbr_stack = rig_stack_init(0, RIG_STACK_SMR_QSBR);
+	ck_assert(qsbr_stack != NULL);
+
+	RIG_THREAD thr = rig_thread_init(0, 1);
+	ck_assert(thr != NULL);
+
+	ck_assert(rig_thread_start(thr, &qsbr_pop_wait_worker, (void *)16));
+
+	qsbr_retire_while_blocked();
+
+	ck_assert(rig_stack_push(qsbr_stack, (void *)16));
+
+	ck_assert(rig_thread_join(thr, NULL));
+	rig_thread_destroy(&thr);
+
+	rig_stack_destroy(&qsbr_stack);
+
+	// Nobody else online anymore, frees everything that's left
+	rig_smr_qsbr_record_release();
+} END_TEST
+
+START_TEST(test_rig_smr_qsbr_retire_fn_nullfn) {
+	rig_smr_qsbr_retire_fn(rig_mem_alloc(64, 0), NULL, NULL);
+} END_TEST
+
+Suite *test_rig_smr_qsbr_retire_fn(void) {
+	Suite *s = suite_create("test_rig_smr_qsbr_retire_fn");
+
+	TCASE_ADD_FIXTURE(rig_smr_qsbr_retire_fn_normal, &setup_freed, &teardown_freed);
+	TCASE_ADD_FIXTURE(rig_smr_qsbr_retire_fn_online, &setup_freed, &teardown_freed);
+	TCASE_ADD_FIXTURE(rig_smr_qsbr_retire_fn_get_wait, &setup_freed, &teardown_freed);
+	TCASE_ADD_FIXTURE(rig_smr_qsbr_retire_fn_pop_wait, &setup_freed, &teardown_freed);
+	TCASE_ADD_EXIT(rig_smr_qsbr_retire_fn_nullfn, EXIT_FAILURE);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_smr_threshold_normal) {
+	// Default threshold: a single retired pointer doesn't trigger a scan
+	rig_smr_hp_retire_fn(rig_mem_alloc(64, 0), &free_counted, freed);
+	ck_assert(rig_counter_get(freed) == 0);
+
+	// Byte cap lower than a single pointer: every retire scans
+	rig_smr_hp_threshold_set(0, 1);
+
+	rig_smr_hp_retire_fn(rig_mem_alloc(64, 0), &free_counted, freed);
+	ck_assert(rig_counter_get(freed) == 2);
+
+	// Back to defaults
+	rig_smr_hp_threshold_set(0, 1 << 20);
+
+	rig_smr_hp_retire_fn(rig_mem_alloc(64, 0), &free_counted, freed);
+	ck_assert(rig_counter_get(freed) == 2);
+
+	rig_smr_hp_mem_scan();
+	ck_assert(rig_counter_get(freed) == 3);
+} END_TEST
+
+Suite *test_rig_smr_threshold(void) {
+	Suite *s = suite_create("test_rig_smr_threshold");
+
+	TCASE_ADD_FIXTURE(rig_smr_threshold_normal, &setup_freed, &teardown_freed);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_smr_reclaimer_normal) {
+	ck_assert(rig_smr_reclaimer_start());
+
+	RIG_THREAD thr = rig_thread_init(0, 4);
+	ck_assert(thr != NULL);
+
+	ck_assert(rig_thread_start(thr, &retire_worker, (void *)10000));
+	ck_assert(rig_thread_join(thr, NULL));
+	rig_thread_destroy(&thr);
+
+	ck_assert(rig_smr_reclaimer_stop());
+
+	// All threads are gone, nothing is protected anymore
+	rig_smr_hp_mem_scan_full();
+	ck_assert(rig_counter_get(freed) == 4 * 2 * 10000);
+
+	struct rig_smr_stats stats;
+	rig_smr_reclaimer_stats(&stats);
+
+	ck_assert(stats.blocks > 0);
+	ck_assert(stats.bytes > 0);
+	ck_assert(stats.pending == 0);
+	ck_assert(stats.lag_max_us >= stats.lag_avg_us);
+} END_TEST
+
+START_TEST(test_rig_smr_reclaimer_error) {
+	ck_assert(!rig_smr_reclaimer_stop() && errno == EINVAL);
+
+	ck_assert(rig_smr_reclaimer_start());
+	ck_assert(!rig_smr_reclaimer_start() && errno == EALREADY);
+
+	ck_assert(rig_smr_reclaimer_stop());
+	ck_assert(!rig_smr_reclaimer_stop() && errno == EINVAL);
+} END_TEST
+
+Suite *test_rig_smr_reclaimer(void) {
+	Suite *s = suite_create("test_rig_smr_reclaimer");
+
+	TCASE_ADD_FIXTURE(rig_smr_reclaimer_normal, &setup_freed, &teardown_freed);
+	TCASE_ADD(rig_smr_reclaimer_error);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+#define CHURN_CYCLES 100000
+#define CHURN_WARMUP 1000
+#define CHURN_RSS_SLACK (4 * 1024 * 1024)
+
+static void *churn_mem = NULL;
+
+static void *churn_worker(void *arg) {
+	(void)arg;
+
+	// The main thread protects churn_mem, so it ends up orphaned at thread exit
+	rig_smr_hp_retire_fn(churn_mem, &free_counted, freed);
+
+	return (retire_worker((void *)1));
+}
+
+static size_t churn_rss(void) {
+#if defined(__linux__)
+	FILE *statm = fopen("/proc/self/statm", "r");
+	size_t size = 0, resident = 0;
+
+	if (statm != NULL) {
+		if (fscanf(statm, "%zu %zu", &size, &resident) != 2) {
+			resident = 0;
+		}
+
+		fclose(statm);
+	}
+
+	return (resident * (size_t)sysconf(_SC_PAGESIZE));
+#else
+	return (0);
+#endif
+}
+
+START_TEST(test_rig_smr_thread_churn_normal) {
+	RIG_SMR_HP_Record hp_record = rig_smr_hp_record_get();
+	size_t rss_start = 0;
+
+	for (size_t i = 0; i < CHURN_CYCLES; i++) {
+		if (i == CHURN_WARMUP) {
+			rss_start = churn_rss();
+		}
+
+		churn_mem = rig_mem_alloc(64, 0);
+		rig_smr_hp_set(hp_record, 0, churn_mem);
+
+		RIG_THREAD thr = rig_thread_init(0, 1);
+		ck_assert(thr != NULL);
+
+		ck_assert(rig_thread_start(thr, &churn_worker, NULL));
+		ck_assert(rig_thread_join(thr, NULL));
+		rig_thread_destroy(&thr);
+
+		rig_smr_hp_release(hp_record, 0);
+	}
+
+	// Memory held by orphaned retire lists and idle records must not grow
+	ck_assert(churn_rss() <= (rss_start + CHURN_RSS_SLACK));
+
+	rig_smr_hp_mem_scan_full();
+	ck_assert(rig_counter_get(freed) == CHURN_CYCLES * 3);
+} END_TEST
+
+Suite *test_rig_smr_thread_churn(void) {
+	Suite *s = suite_create("test_rig_smr_thread_churn");
+
+	TCASE_ADD_FIXTURE(rig_smr_thread_churn_normal, &setup_freed, &teardown_freed);
+	tcase_set_timeout(tc_rig_smr_thread_churn_normal, 120);
+
+	return (s);
+}
@@ -0,0 +1,594 @@
+/**
+ * This file is part of the Rig project.
+ *
+ * For the full copyright and license information, please view the COPYING
+ * file that was distributed with this source code.
+ *
+ * @copyright  (c) the Rig project
+ * @author     Luca Longinotti <chtekk@longitekk.com>
+ * @license    BSD 2-clause
+ * @version    $Id$
+ */
+
+#include "tests.h"
+
+Suite *test_rig_stack_init(void);
+Suite *test_rig_stack_destroy(void);
+Suite *test_rig_stack_push(void);
+Suite *test_rig_stack_pop(void);
+Suite *test_rig_stack_peek(void);
+Suite *test_rig_stack_pop_wait(void);
+Suite *test_rig_stack_elimination(void);
+Suite *test_rig_stack_push_chain(void);
+Suite *test_rig_stack_pop_all(void);
+Suite *test_rig_stack_chain(void);
+
+int main(void) {
+	SRunner *sr = srunner_create(test_rig_stack_init());
+	srunner_add_suite(sr, test_rig_stack_destroy());
+	srunner_add_suite(sr, test_rig_stack_push());
+	srunner_add_suite(sr, test_rig_stack_pop());
+	srunner_add_suite(sr, test_rig_stack_peek());
+	srunner_add_suite(sr, test_rig_stack_pop_wait());
+	srunner_add_suite(sr, test_rig_stack_elimination());
+	srunner_add_suite(sr, test_rig_stack_push_chain());
+	srunner_add_suite(sr, test_rig_stack_pop_all());
+	srunner_add_suite(sr, test_rig_stack_chain());
+
+	srunner_run_all(sr, CK_VERBOSE);
+	int failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	return ((failed == 0) ? (EXIT_SUCCESS) : (EXIT_FAILURE));
+}
+
+
+#define ITEMS 10000
+#define THREADS 4
+
+// Items are never NULL, and keep the low bits free
+#define ITEM(i) ((void *)((uintptr_t)(i) << 4))
+#define ITEM_VALUE(p) ((uintptr_t)(p) >> 4)
+
+RIG_STACK stack = NULL;
+RIG_COUNTER sum = NULL;
+RIG_COUNTER roles = NULL;
+
+static void setup_stack(void) {
+	stack = rig_stack_init(10, 0);
+	ck_assert(stack != NULL);
+
+	sum = rig_counter_init(0, 0);
+	ck_assert(sum != NULL);
+
+	roles = rig_counter_init(0, 0);
+	ck_assert(roles != NULL);
+}
+
+static void teardown_stack(void) {
+	rig_stack_destroy(&stack);
+	ck_assert(stack == NULL);
+
+	rig_counter_destroy(&sum);
+	rig_counter_destroy(&roles);
+}
+
+static void *push_pop_worker(void *arg) {
+	(void)(arg);
+
+	for (uintptr_t i = 1; i <= ITEMS; i++) {
+		ck_assert(rig_stack_push(stack, ITEM(i)));
+
+		void *item = rig_stack_pop(stack);
+		ck_assert(item != NULL);
+		ck_assert(rig_counter_add(sum, (ssize_t)ITEM_VALUE(item)));
+	}
+
+	return (NULL);
+}
+
+static void *push_or_pop_worker(void *arg) {
+	(void)(arg);
+
+	size_t role = 0;
+	ck_assert(rig_counter_get_and_add(roles, 1, &role));
+
+	for (uintptr_t i = 1; i <= ITEMS; i++) {
+		if ((role % 2) == 0) {
+			while (!rig_stack_push(stack, ITEM(i))) {
+				ck_assert(errno == EXFULL);
+				rig_thread_yield();
+			}
+		}
+		else {
+			void *item;
+
+			while ((item = rig_stack_pop(stack)) == NULL) {
+				ck_assert(errno == ENOENT);
+				rig_thread_yield();
+			}
+
+			ck_assert(rig_counter_add(sum, (ssize_t)ITEM_VALUE(item)));
+		}
+	}
+
+	return (NULL);
+}
+
+static void *chain_worker(void *arg) {
+	(void)(arg);
+
+	void *items[4];
+
+	for (uintptr_t i = 1; i <= ITEMS; i += 4) {
+		for (uintptr_t j = 0; j < 4; j++) {
+			items[j] = ITEM(i + j);
+		}
+
+		while (!rig_stack_push_chain(stack, items, 4)) {
+			ck_assert(errno == EXFULL);
+			rig_thread_yield();
+		}
+
+		// Now and then drain everything, own items and others' ones alike
+		if ((i % 64) == 1) {
+			RIG_STACK_CHAIN chain = rig_stack_pop_all(stack);
+
+			while (chain != NULL) {
+				void *item = rig_stack_chain_next(&chain);
+				ck_assert(item != NULL);
+				ck_assert(rig_counter_add(sum, (ssize_t)ITEM_VALUE(item)));
+			}
+		}
+	}
+
+	return (NULL);
+}
+
+static void *pop_wait_worker(void *arg) {
+	(void)(arg);
+
+	for (size_t i = 0; i < (ITEMS / 10); i++) {
+		void *item = rig_stack_pop_wait(stack, SIZE_MAX);
+		ck_assert(item != NULL);
+		ck_assert(rig_counter_add(sum, (ssize_t)ITEM_VALUE(item)));
+	}
+
+	return (NULL);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_stack_init_normal) {
+	ck_assert(rig_stack_init(0, 0) != NULL);
+	ck_assert(rig_stack_init(10, 0) != NULL);
+	ck_assert(rig_stack_init(SIZE_MAX, 0) != NULL);
+
+	ck_assert(rig_stack_init(0, RIG_STACK_NOCOUNT) != NULL);
+	ck_assert(rig_stack_init(10, RIG_STACK_ELIMINATION) != NULL);
+	ck_assert(rig_stack_init(10, RIG_STACK_SMR_EPOCH) != NULL);
+	ck_assert(rig_stack_init(10, RIG_STACK_SMR_QSBR) != NULL);
+	ck_assert(rig_stack_init(10, RIG_STACK_SHARDED_COUNT) != NULL);
+	ck_assert(rig_stack_init(10, RIG_STACK_ELIMINATION | RIG_STACK_SMR_EPOCH) != NULL);
+} END_TEST
+
+START_TEST(test_rig_stack_init_error) {
+	ck_assert(rig_stack_init(0, (1 << 5)) == NULL && errno == EINVAL);
+	ck_assert(rig_stack_init(0, (1 << 15)) == NULL && errno == EINVAL);
+	ck_assert(rig_stack_init(0, RIG_STACK_SMR_EPOCH | RIG_STACK_SMR_QSBR) == NULL && errno == EINVAL);
+} END_TEST
+
+Suite *test_rig_stack_init(void) {
+	Suite *s = suite_create("test_rig_stack_init");
+
+	TCASE_ADD(rig_stack_init_normal);
+	TCASE_ADD(rig_stack_init_error);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_stack_destroy_normal) {
+	ck_assert(rig_stack_push(stack, ITEM(1)));
+
+	RIG_STACK newref = rig_stack_newref(stack);
+	rig_stack_destroy(&newref);
+	ck_assert(newref == NULL);
+
+	// Still referenced by stack
+	ck_assert(rig_stack_pop(stack) == ITEM(1));
+} END_TEST
+
+START_TEST(test_rig_stack_destroy_null) {
+	stack = NULL;
+	rig_stack_destroy(&stack);
+} END_TEST
+
+START_TEST(test_rig_stack_destroy_nullptr) {
+	rig_stack_destroy(NULL);
+} END_TEST
+
+Suite *test_rig_stack_destroy(void) {
+	Suite *s = suite_create("test_rig_stack_destroy");
+
+	TCASE_ADD_FIXTURE(rig_stack_destroy_normal, &setup_stack, &teardown_stack);
+	TCASE_ADD_EXIT(rig_stack_destroy_null, EXIT_FAILURE);
+	TCASE_ADD_EXIT(rig_stack_destroy_nullptr, EXIT_FAILURE);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_stack_push_normal) {
+	for (uintptr_t i = 1; i <= 10; i++) {
+		ck_assert(rig_stack_push(stack, ITEM(i)));
+		ck_assert(rig_stack_count(stack) == i);
+	}
+
+	ck_assert(rig_stack_full(stack));
+	ck_assert(!rig_stack_push(stack, ITEM(11)) && errno == EXFULL);
+	ck_assert(rig_stack_count(stack) == 10);
+	ck_assert(rig_stack_capacity(stack) == 10);
+} END_TEST
+
+START_TEST(test_rig_stack_push_threads) {
+	RIG_THREAD thr = rig_thread_init(0, THREADS);
+	ck_assert(thr != NULL);
+
+	ck_assert(rig_thread_start(thr, &push_pop_worker, NULL));
+	ck_assert(rig_thread_join(thr, NULL));
+	rig_thread_destroy(&thr);
+
+	// Every item pushed was popped exactly once, by some thread
+	ck_assert(rig_counter_get(sum) == THREADS * ((ITEMS * (ITEMS + 1)) / 2));
+	ck_assert(rig_stack_empty(stack));
+} END_TEST
+
+Suite *test_rig_stack_push(void) {
+	Suite *s = suite_create("test_rig_stack_push");
+
+	TCASE_ADD_FIXTURE(rig_stack_push_normal, &setup_stack, &teardown_stack);
+	TCASE_ADD_FIXTURE(rig_stack_push_threads, &setup_stack, &teardown_stack);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_stack_pop_normal) {
+	ck_assert(rig_stack_pop(stack) == NULL && errno == ENOENT);
+
+	ck_assert(rig_stack_push(stack, ITEM(1)));
+	ck_assert(rig_stack_push(stack, ITEM(2)));
+	ck_assert(rig_stack_push(stack, ITEM(3)));
+
+	ck_assert(rig_stack_pop(stack) == ITEM(3));
+	ck_assert(rig_stack_pop(stack) == ITEM(2));
+	ck_assert(rig_stack_push(stack, ITEM(4)));
+	ck_assert(rig_stack_pop(stack) == ITEM(4));
+	ck_assert(rig_stack_pop(stack) == ITEM(1));
+
+	ck_assert(rig_stack_pop(stack) == NULL && errno == ENOENT);
+	ck_assert(rig_stack_empty(stack));
+} END_TEST
+
+Suite *test_rig_stack_pop(void) {
+	Suite *s = suite_create("test_rig_stack_pop");
+
+	TCASE_ADD_FIXTURE(rig_stack_pop_normal, &setup_stack, &teardown_stack);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_stack_peek_normal) {
+	ck_assert(rig_stack_peek(stack) == NULL && errno == ENOENT);
+
+	ck_assert(rig_stack_push(stack, ITEM(1)));
+	ck_assert(rig_stack_push(stack, ITEM(2)));
+
+	ck_assert(rig_stack_peek(stack) == ITEM(2));
+	ck_assert(rig_stack_count(stack) == 2);
+	ck_assert(rig_stack_pop(stack) == ITEM(2));
+	ck_assert(rig_stack_peek(stack) == ITEM(1));
+} END_TEST
+
+Suite *test_rig_stack_peek(void) {
+	Suite *s = suite_create("test_rig_stack_peek");
+
+	TCASE_ADD_FIXTURE(rig_stack_peek_normal, &setup_stack, &teardown_stack);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_stack_pop_wait_normal) {
+	ck_assert(rig_stack_push(stack, ITEM(1)));
+	ck_assert(rig_stack_push(stack, ITEM(2)));
+
+	// Items already there are returned right away
+	ck_assert(rig_stack_pop_wait(stack, 0) == ITEM(2));
+	ck_assert(rig_stack_pop_wait(stack, SIZE_MAX) == ITEM(1));
+} END_TEST
+
+START_TEST(test_rig_stack_pop_wait_timeout) {
+	ck_assert(rig_stack_pop_wait(stack, 0) == NULL && errno == ETIMEDOUT);
+	ck_assert(rig_stack_pop_wait(stack, 1000) == NULL && errno == ETIMEDOUT);
+	ck_assert(rig_stack_empty(stack));
+} END_TEST
+
+START_TEST(test_rig_stack_pop_wait_wakeup) {
+	RIG_THREAD thr = rig_thread_init(0, THREADS);
+	ck_assert(thr != NULL);
+
+	ck_assert(rig_thread_start(thr, &pop_wait_worker, NULL));
+
+	// Consumers mostly find the stack empty, and go to sleep waiting for items
+	for (uintptr_t i = 1; i <= (THREADS * (ITEMS / 10)); i++) {
+		while (!rig_stack_push(stack, ITEM(i))) {
+			ck_assert(errno == EXFULL);
+			rig_thread_yield();
+		}
+
+		rig_thread_yield();
+	}
+
+	ck_assert(rig_thread_join(thr, NULL));
+	rig_thread_destroy(&thr);
+
+	ck_assert(rig_counter_get(sum) == ((THREADS * (ITEMS / 10)) * ((THREADS * (ITEMS / 10)) + 1)) / 2);
+	ck_assert(rig_stack_empty(stack));
+} END_TEST
+
+Suite *test_rig_stack_pop_wait(void) {
+	Suite *s = suite_create("test_rig_stack_pop_wait");
+
+	TCASE_ADD_FIXTURE(rig_stack_pop_wait_normal, &setup_stack, &teardown_stack);
+	TCASE_ADD_FIXTURE(rig_stack_pop_wait_timeout, &setup_stack, &teardown_stack);
+	TCASE_ADD_FIXTURE(rig_stack_pop_wait_wakeup, &setup_stack, &teardown_stack);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_stack_elimination_normal) {
+	RIG_STACK s = rig_stack_init(3, RIG_STACK_ELIMINATION);
+	ck_assert(s != NULL);
+
+	// Without contention it behaves like any other stack
+	ck_assert(rig_stack_pop(s) == NULL && errno == ENOENT);
+
+	ck_assert(rig_stack_push(s, ITEM(1)));
+	ck_assert(rig_stack_push(s, ITEM(2)));
+	ck_assert(rig_stack_push(s, ITEM(3)));
+	ck_assert(!rig_stack_push(s, ITEM(4)) && errno == EXFULL);
+
+	ck_assert(rig_stack_peek(s) == ITEM(3));
+	ck_assert(rig_stack_pop(s) == ITEM(3));
+	ck_assert(rig_stack_pop(s) == ITEM(2));
+	ck_assert(rig_stack_pop(s) == ITEM(1));
+	ck_assert(rig_stack_pop(s) == NULL && errno == ENOENT);
+	ck_assert(rig_stack_count(s) == 0);
+
+	rig_stack_destroy(&s);
+	ck_assert(s == NULL);
+} END_TEST
+
+START_TEST(test_rig_stack_elimination_threads) {
+	rig_stack_destroy(&stack);
+	stack = rig_stack_init(0, RIG_STACK_ELIMINATION);
+	ck_assert(stack != NULL);
+
+	RIG_THREAD thr = rig_thread_init(0, THREADS);
+	ck_assert(thr != NULL);
+
+	ck_assert(rig_thread_start(thr, &push_pop_worker, NULL));
+	ck_assert(rig_thread_join(thr, NULL));
+	rig_thread_destroy(&thr);
+
+	ck_assert(rig_counter_get(sum) == THREADS * ((ITEMS * (ITEMS + 1)) / 2));
+	ck_assert(rig_stack_empty(stack));
+	ck_assert(rig_stack_count(stack) == 0);
+} END_TEST
+
+START_TEST(test_rig_stack_elimination_split) {
+	rig_stack_destroy(&stack);
+	stack = rig_stack_init(100, RIG_STACK_ELIMINATION);
+	ck_assert(stack != NULL);
+
+	RIG_THREAD thr = rig_thread_init(0, THREADS);
+	ck_assert(thr != NULL);
+
+	// Half the threads only push and half only pop, so pairs can meet in the elimination array
+	ck_assert(rig_thread_start(thr, &push_or_pop_worker, NULL));
+	ck_assert(rig_thread_join(thr, NULL));
+	rig_thread_destroy(&thr);
+
+	ck_assert(rig_counter_get(sum) == (THREADS / 2) * ((ITEMS * (ITEMS + 1)) / 2));
+	ck_assert(rig_stack_pop(stack) == NULL && errno == ENOENT);
+	ck_assert(rig_stack_count(stack) == 0);
+} END_TEST
+
+Suite *test_rig_stack_elimination(void) {
+	Suite *s = suite_create("test_rig_stack_elimination");
+
+	TCASE_ADD(rig_stack_elimination_normal);
+	TCASE_ADD_FIXTURE(rig_stack_elimination_threads, &setup_stack, &teardown_stack);
+	TCASE_ADD_FIXTURE(rig_stack_elimination_split, &setup_stack, &teardown_stack);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_stack_push_chain_normal) {
+	void *items[8] = { ITEM(1), ITEM(2), ITEM(3), ITEM(4), ITEM(5), ITEM(6), ITEM(7), ITEM(8) };
+
+	ck_assert(rig_stack_push_chain(stack, items, 5));
+	ck_assert(rig_stack_count(stack) == 5);
+
+	// All or nothing, the stack is left as it was
+	ck_assert(!rig_stack_push_chain(stack, items, 8) && errno == EXFULL);
+	ck_assert(rig_stack_count(stack) == 5);
+
+	ck_assert(rig_stack_push_chain(stack, items + 5, 3));
+	ck_assert(rig_stack_count(stack) == 8);
+
+	// As if pushed one by one, the last item ends up at the top
+	for (uintptr_t i = 8; i >= 1; i--) {
+		ck_assert(rig_stack_pop(stack) == ITEM(i));
+	}
+	ck_assert(rig_stack_empty(stack));
+} END_TEST
+
+START_TEST(test_rig_stack_push_chain_error) {
+	void *items[1] = { ITEM(1) };
+
+	ck_assert(!rig_stack_push_chain(stack, items, 0) && errno == EINVAL);
+	ck_assert(rig_stack_empty(stack));
+} END_TEST
+
+Suite *test_rig_stack_push_chain(void) {
+	Suite *s = suite_create("test_rig_stack_push_chain");
+
+	TCASE_ADD_FIXTURE(rig_stack_push_chain_normal, &setup_stack, &teardown_stack);
+	TCASE_ADD_FIXTURE(rig_stack_push_chain_error, &setup_stack, &teardown_stack);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_stack_pop_all_normal) {
+	ck_assert(rig_stack_pop_all(stack) == NULL && errno == ENOENT);
+
+	for (uintptr_t i = 1; i <= 10; i++) {
+		ck_assert(rig_stack_push(stack, ITEM(i)));
+	}
+
+	RIG_STACK_CHAIN chain = rig_stack_pop_all(stack);
+	ck_assert(chain != NULL);
+
+	// Detached all at once, the stack is usable again right away
+	ck_assert(rig_stack_empty(stack));
+	ck_assert(rig_stack_count(stack) == 0);
+	ck_assert(rig_stack_push(stack, ITEM(11)));
+
+	// Top item first, the chain is set to NULL after the last one
+	for (uintptr_t i = 10; i >= 1; i--) {
+		ck_assert(chain != NULL);
+		ck_assert(rig_stack_chain_next(&chain) == ITEM(i));
+	}
+	ck_assert(chain == NULL);
+	ck_assert(rig_stack_chain_next(&chain) == NULL && errno == ENOENT);
+
+	ck_assert(rig_stack_pop(stack) == ITEM(11));
+} END_TEST
+
+START_TEST(test_rig_stack_pop_all_smr) {
+	uint16_t flags[3] = { RIG_STACK_SMR_EPOCH, RIG_STACK_SMR_QSBR, RIG_STACK_ELIMINATION };
+
+	for (size_t f = 0; f < 3; f++) {
+		RIG_STACK s = rig_stack_init(0, flags[f]);
+		ck_assert(s != NULL);
+
+		ck_assert(rig_stack_pop_all(s) == NULL && errno == ENOENT);
+
+		for (uintptr_t i = 1; i <= 100; i++) {
+			ck_assert(rig_stack_push(s, ITEM(i)));
+		}
+
+		RIG_STACK_CHAIN chain = rig_stack_pop_all(s);
+		ck_assert(chain != NULL);
+		ck_assert(rig_stack_empty(s));
+
+		for (uintptr_t i = 100; i >= 1; i--) {
+			ck_assert(rig_stack_chain_next(&chain) == ITEM(i));
+		}
+		ck_assert(chain == NULL);
+
+		rig_stack_destroy(&s);
+	}
+} END_TEST
+
+START_TEST(test_rig_stack_pop_all_threads) {
+	rig_stack_destroy(&stack);
+	stack = rig_stack_init(100, 0);
+	ck_assert(stack != NULL);
+
+	RIG_THREAD thr = rig_thread_init(0, THREADS);
+	ck_assert(thr != NULL);
+
+	ck_assert(rig_thread_start(thr, &chain_worker, NULL));
+	ck_assert(rig_thread_join(thr, NULL));
+	rig_thread_destroy(&thr);
+
+	// Whatever the others left behind
+	RIG_STACK_CHAIN chain = rig_stack_pop_all(stack);
+
+	while (chain != NULL) {
+		void *item = rig_stack_chain_next(&chain);
+
+		ck_assert(rig_counter_add(sum, (ssize_t)ITEM_VALUE(item)));
+	}
+
+	ck_assert(rig_counter_get(sum) == THREADS * ((ITEMS * (ITEMS + 1)) / 2));
+	ck_assert(rig_stack_count(stack) == 0);
+} END_TEST
+
+Suite *test_rig_stack_pop_all(void) {
+	Suite *s = suite_create("test_rig_stack_pop_all");
+
+	TCASE_ADD_FIXTURE(rig_stack_pop_all_normal, &setup_stack, &teardown_stack);
+	TCASE_ADD(rig_stack_pop_all_smr);
+	TCASE_ADD_FIXTURE(rig_stack_pop_all_threads, &setup_stack, &teardown_stack);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_stack_chain_end_normal) {
+	for (uintptr_t i = 1; i <= 10; i++) {
+		ck_assert(rig_stack_push(stack, ITEM(i)));
+	}
+
+	RIG_STACK_CHAIN chain = rig_stack_pop_all(stack);
+	ck_assert(chain != NULL);
+
+	ck_assert(rig_stack_chain_next(&chain) == ITEM(10));
+	ck_assert(rig_stack_chain_next(&chain) == ITEM(9));
+
+	// Drops the remaining items
+	rig_stack_chain_end(&chain);
+	ck_assert(chain == NULL);
+
+	// Ending an already consumed chain does nothing
+	rig_stack_chain_end(&chain);
+	ck_assert(chain == NULL);
+
+	ck_assert(rig_stack_empty(stack));
+} END_TEST
+
+START_TEST(test_rig_stack_chain_end_nullptr) {
+	rig_stack_chain_end(NULL);
+} END_TEST
+
+START_TEST(test_rig_stack_chain_next_nullptr) {
+	ck_assert(rig_stack_chain_next(NULL) == NULL);
+} END_TEST
+
+Suite *test_rig_stack_chain(void) {
+	Suite *s = suite_create("test_rig_stack_chain");
+
+	TCASE_ADD_FIXTURE(rig_stack_chain_end_normal, &setup_stack, &teardown_stack);
+	TCASE_ADD_EXIT(rig_stack_chain_end_nullptr, EXIT_FAILURE);
+	TCASE_ADD_EXIT(rig_stack_chain_next_nullptr, EXIT_FAILURE);
+
+	return (s);
+}
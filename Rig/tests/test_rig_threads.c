@@ -0,0 +1,626 @@
+/**
+ * This file is part of the Rig project.
+ *
+ * For the full copyright and license information, please view the COPYING
+ * file that was distributed with this source code.
+ *
+ * @copyright  (c) the Rig project
+ * @author     Luca Longinotti <chtekk@longitekk.com>
+ * @license    BSD 2-clause
+ * @version    $Id$
+ */
+
+#include "tests.h"
+
+Suite *test_rig_mlock_init(void);
+Suite *test_rig_mlock_destroy(void);
+Suite *test_rig_mlock_lock(void);
+Suite *test_rig_mlock_trylock(void);
+Suite *test_rig_mlock_unlock(void);
+Suite *test_rig_mlock_islocked(void);
+Suite *test_rig_mrwlock_biased_rdlock(void);
+Suite *test_rig_mrwlock_biased_trywrlock(void);
+Suite *test_rig_mrwlock_biased_destroy(void);
+Suite *test_rig_mrwlock_biased_islocked(void);
+Suite *test_rig_mrwlock_biased_threads(void);
+
+int main(void) {
+	SRunner *sr = srunner_create(test_rig_mlock_init());
+	srunner_add_suite(sr, test_rig_mlock_destroy());
+	srunner_add_suite(sr, test_rig_mlock_lock());
+	srunner_add_suite(sr, test_rig_mlock_trylock());
+	srunner_add_suite(sr, test_rig_mlock_unlock());
+	srunner_add_suite(sr, test_rig_mlock_islocked());
+	srunner_add_suite(sr, test_rig_mrwlock_biased_rdlock());
+	srunner_add_suite(sr, test_rig_mrwlock_biased_trywrlock());
+	srunner_add_suite(sr, test_rig_mrwlock_biased_destroy());
+	srunner_add_suite(sr, test_rig_mrwlock_biased_islocked());
+	srunner_add_suite(sr, test_rig_mrwlock_biased_threads());
+
+	srunner_run_all(sr, CK_VERBOSE);
+	int failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	return ((failed == 0) ? (EXIT_SUCCESS) : (EXIT_FAILURE));
+}
+
+
+#define THREADS 4
+#define LOCKS 2000
+
+RIG_MLOCK mlock = NULL;
+RIG_MRWLOCK mrwlock = NULL;
+size_t shared = 0;
+size_t shared_copy = 0;
+
+static void setup_mlock(void) {
+	mlock = rig_mlock_init(0);
+	ck_assert(mlock != NULL);
+
+	shared = 0;
+}
+
+static void setup_mlock_recursive(void) {
+	mlock = rig_mlock_init(RIG_MLOCK_RECURSIVE);
+	ck_assert(mlock != NULL);
+
+	shared = 0;
+}
+
+static void teardown_mlock(void) {
+	ck_assert(rig_mlock_destroy(&mlock));
+	ck_assert(mlock == NULL);
+}
+
+static void *mlock_counter_worker(void *arg) {
+	(void)(arg);
+
+	for (size_t i = 0; i < LOCKS; i++) {
+		ck_assert(rig_mlock_lock(mlock));
+
+		// Yielding while holding the lock makes the others give up spinning
+		// and sleep on it, the lost updates would show any overlap
+		size_t value = shared;
+		rig_thread_yield();
+		shared = value + 1;
+
+		ck_assert(rig_mlock_unlock(mlock));
+	}
+
+	return (NULL);
+}
+
+static void *mlock_trylock_worker(void *arg) {
+	RIG_COUNTER got = arg;
+
+	for (size_t i = 0; i < LOCKS; i++) {
+		if (rig_mlock_trylock(mlock)) {
+			size_t value = shared;
+			rig_thread_yield();
+			shared = value + 1;
+
+			ck_assert(rig_counter_inc(got));
+			ck_assert(rig_mlock_unlock(mlock));
+		}
+		else {
+			ck_assert(errno == EBUSY);
+			rig_thread_yield();
+		}
+	}
+
+	return (NULL);
+}
+
+static void *mlock_other_worker(void *arg) {
+	(void)(arg);
+
+	// Held by the main thread: visible, but neither ours to take nor to release
+	ck_assert(rig_mlock_islocked(mlock));
+	ck_assert(!rig_mlock_trylock(mlock) && errno == EBUSY);
+	ck_assert(!rig_mlock_unlock(mlock) && errno == EPERM);
+
+	return (NULL);
+}
+
+static void mlock_other_thread(void) {
+	RIG_THREAD thr = rig_thread_init(0, 1);
+	ck_assert(thr != NULL);
+
+	ck_assert(rig_thread_start(thr, &mlock_other_worker, NULL));
+	ck_assert(rig_thread_join(thr, NULL));
+	rig_thread_destroy(&thr);
+}
+
+static void setup_mrwlock_biased(void) {
+	mrwlock = rig_mrwlock_init(RIG_MRWLOCK_READ_BIASED);
+	ck_assert(mrwlock != NULL);
+
+	shared = 0;
+	shared_copy = 0;
+}
+
+static void setup_mrwlock_biased_recursive(void) {
+	mrwlock = rig_mrwlock_init(RIG_MRWLOCK_READ_BIASED | RIG_MRWLOCK_RECURSIVE_READ);
+	ck_assert(mrwlock != NULL);
+
+	shared = 0;
+	shared_copy = 0;
+}
+
+static void teardown_mrwlock(void) {
+	ck_assert(rig_mrwlock_destroy(&mrwlock));
+	ck_assert(mrwlock == NULL);
+}
+
+static void *mrwlock_writer_worker(void *arg) {
+	RIG_COUNTER progress = arg;
+
+	// The main thread holds its reader slot, so this can't be had right away
+	ck_assert(!rig_mrwlock_trywrlock(mrwlock) && errno == EBUSY);
+	ck_assert(rig_counter_inc(progress));
+
+	// Only sees the slot if the bias was turned back on by the failed trywrlock
+	ck_assert(rig_mrwlock_wrlock(mrwlock));
+	ck_assert(rig_counter_inc(progress));
+	ck_assert(rig_mrwlock_unlock(mrwlock));
+
+	return (NULL);
+}
+
+static void *mrwlock_rdwr_worker(void *arg) {
+	RIG_COUNTER roles = arg;
+	size_t role;
+
+	ck_assert(rig_counter_get_and_add(roles, 1, &role));
+
+	for (size_t i = 0; i < LOCKS; i++) {
+		if (role == 0) {
+			ck_assert(rig_mrwlock_wrlock(mrwlock));
+
+			shared++;
+			rig_thread_yield();
+			shared_copy++;
+
+			ck_assert(rig_mrwlock_unlock(mrwlock));
+		}
+		else {
+			ck_assert(rig_mrwlock_rdlock(mrwlock));
+
+			// A writer in between would show up as a torn pair
+			size_t value = shared;
+			rig_thread_yield();
+			ck_assert(shared_copy == value);
+
+			ck_assert(rig_mrwlock_unlock(mrwlock));
+		}
+	}
+
+	return (NULL);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_mlock_init_normal) {
+	RIG_MLOCK ml = rig_mlock_init(0);
+	ck_assert(ml != NULL);
+	ck_assert(!rig_mlock_islocked(ml));
+	ck_assert(rig_mlock_destroy(&ml));
+
+	ml = rig_mlock_init(RIG_MLOCK_RECURSIVE);
+	ck_assert(ml != NULL);
+	ck_assert(!rig_mlock_islocked(ml));
+	ck_assert(rig_mlock_destroy(&ml));
+} END_TEST
+
+START_TEST(test_rig_mlock_init_error) {
+	ck_assert(rig_mlock_init((1 << 1)) == NULL && errno == EINVAL);
+	ck_assert(rig_mlock_init((1 << 15)) == NULL && errno == EINVAL);
+} END_TEST
+
+Suite *test_rig_mlock_init(void) {
+	Suite *s = suite_create("test_rig_mlock_init");
+
+	TCASE_ADD(rig_mlock_init_normal);
+	TCASE_ADD(rig_mlock_init_error);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_mlock_destroy_normal) {
+	ck_assert(rig_mlock_lock(mlock));
+	ck_assert(rig_mlock_unlock(mlock));
+} END_TEST
+
+START_TEST(test_rig_mlock_destroy_busy) {
+	ck_assert(rig_mlock_lock(mlock));
+
+	ck_assert(!rig_mlock_destroy(&mlock) && errno == EBUSY);
+	ck_assert(mlock != NULL);
+
+	ck_assert(rig_mlock_unlock(mlock));
+} END_TEST
+
+START_TEST(test_rig_mlock_destroy_null) {
+	mlock = NULL;
+	ck_assert(rig_mlock_destroy(&mlock));
+} END_TEST
+
+START_TEST(test_rig_mlock_destroy_nullptr) {
+	rig_mlock_destroy(NULL);
+} END_TEST
+
+Suite *test_rig_mlock_destroy(void) {
+	Suite *s = suite_create("test_rig_mlock_destroy");
+
+	TCASE_ADD_FIXTURE(rig_mlock_destroy_normal, &setup_mlock, &teardown_mlock);
+	TCASE_ADD_FIXTURE(rig_mlock_destroy_busy, &setup_mlock, &teardown_mlock);
+	TCASE_ADD(rig_mlock_destroy_null);
+	TCASE_ADD_EXIT(rig_mlock_destroy_nullptr, EXIT_FAILURE);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_mlock_lock_normal) {
+	ck_assert(rig_mlock_lock(mlock));
+	ck_assert(rig_mlock_islocked(mlock));
+
+	// Not recursive, locking again would deadlock
+	ck_assert(!rig_mlock_lock(mlock) && errno == EAGAIN);
+	ck_assert(!rig_mlock_trylock(mlock) && errno == EAGAIN);
+
+	ck_assert(rig_mlock_unlock(mlock));
+	ck_assert(!rig_mlock_islocked(mlock));
+} END_TEST
+
+START_TEST(test_rig_mlock_lock_recursive) {
+	for (size_t i = 0; i < 10; i++) {
+		ck_assert(rig_mlock_lock(mlock));
+	}
+	ck_assert(rig_mlock_trylock(mlock));
+
+	// Held until the last of the eleven unlocks
+	for (size_t i = 0; i < 10; i++) {
+		ck_assert(rig_mlock_unlock(mlock));
+		ck_assert(rig_mlock_islocked(mlock));
+	}
+
+	mlock_other_thread();
+
+	ck_assert(rig_mlock_unlock(mlock));
+	ck_assert(!rig_mlock_islocked(mlock));
+	ck_assert(!rig_mlock_unlock(mlock) && errno == EPERM);
+} END_TEST
+
+START_TEST(test_rig_mlock_lock_threads) {
+	RIG_THREAD thr = rig_thread_init(0, THREADS);
+	ck_assert(thr != NULL);
+
+	ck_assert(rig_thread_start(thr, &mlock_counter_worker, NULL));
+	ck_assert(rig_thread_join(thr, NULL));
+	rig_thread_destroy(&thr);
+
+	ck_assert(shared == THREADS * LOCKS);
+	ck_assert(!rig_mlock_islocked(mlock));
+} END_TEST
+
+START_TEST(test_rig_mlock_lock_nullptr) {
+	rig_mlock_lock(NULL);
+} END_TEST
+
+Suite *test_rig_mlock_lock(void) {
+	Suite *s = suite_create("test_rig_mlock_lock");
+
+	TCASE_ADD_FIXTURE(rig_mlock_lock_normal, &setup_mlock, &teardown_mlock);
+	TCASE_ADD_FIXTURE(rig_mlock_lock_recursive, &setup_mlock_recursive, &teardown_mlock);
+	TCASE_ADD_FIXTURE(rig_mlock_lock_threads, &setup_mlock, &teardown_mlock);
+	TCASE_ADD_EXIT(rig_mlock_lock_nullptr, EXIT_FAILURE);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_mlock_trylock_normal) {
+	ck_assert(rig_mlock_trylock(mlock));
+	ck_assert(rig_mlock_islocked(mlock));
+
+	mlock_other_thread();
+
+	ck_assert(rig_mlock_unlock(mlock));
+	ck_assert(!rig_mlock_islocked(mlock));
+} END_TEST
+
+START_TEST(test_rig_mlock_trylock_threads) {
+	RIG_COUNTER got = rig_counter_init(0, 0);
+	ck_assert(got != NULL);
+
+	RIG_THREAD thr = rig_thread_init(0, THREADS);
+	ck_assert(thr != NULL);
+
+	ck_assert(rig_thread_start(thr, &mlock_trylock_worker, got));
+	ck_assert(rig_thread_join(thr, NULL));
+	rig_thread_destroy(&thr);
+
+	// Only successful trylocks got to update the value
+	ck_assert(shared == rig_counter_get(got));
+
+	rig_counter_destroy(&got);
+} END_TEST
+
+Suite *test_rig_mlock_trylock(void) {
+	Suite *s = suite_create("test_rig_mlock_trylock");
+
+	TCASE_ADD_FIXTURE(rig_mlock_trylock_normal, &setup_mlock, &teardown_mlock);
+	TCASE_ADD_FIXTURE(rig_mlock_trylock_threads, &setup_mlock, &teardown_mlock);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_mlock_unlock_normal) {
+	ck_assert(rig_mlock_lock(mlock));
+	ck_assert(rig_mlock_unlock(mlock));
+
+	// Not locked at all anymore
+	ck_assert(!rig_mlock_unlock(mlock) && errno == EPERM);
+} END_TEST
+
+START_TEST(test_rig_mlock_unlock_other) {
+	ck_assert(rig_mlock_lock(mlock));
+
+	mlock_other_thread();
+
+	// Still ours
+	ck_assert(rig_mlock_islocked(mlock));
+	ck_assert(rig_mlock_unlock(mlock));
+} END_TEST
+
+Suite *test_rig_mlock_unlock(void) {
+	Suite *s = suite_create("test_rig_mlock_unlock");
+
+	TCASE_ADD_FIXTURE(rig_mlock_unlock_normal, &setup_mlock, &teardown_mlock);
+	TCASE_ADD_FIXTURE(rig_mlock_unlock_other, &setup_mlock, &teardown_mlock);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_mlock_islocked_normal) {
+	ck_assert(!rig_mlock_islocked(mlock));
+
+	ck_assert(rig_mlock_lock(mlock));
+	ck_assert(rig_mlock_islocked(mlock));
+
+	ck_assert(rig_mlock_unlock(mlock));
+	ck_assert(!rig_mlock_islocked(mlock));
+} END_TEST
+
+START_TEST(test_rig_mlock_islocked_nullptr) {
+	ck_assert(!rig_mlock_islocked(NULL));
+} END_TEST
+
+Suite *test_rig_mlock_islocked(void) {
+	Suite *s = suite_create("test_rig_mlock_islocked");
+
+	TCASE_ADD_FIXTURE(rig_mlock_islocked_normal, &setup_mlock, &teardown_mlock);
+	TCASE_ADD_EXIT(rig_mlock_islocked_nullptr, EXIT_FAILURE);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_mrwlock_biased_rdlock_normal) {
+	ck_assert(rig_mrwlock_rdlock(mrwlock));
+	ck_assert(rig_mrwlock_islocked(mrwlock));
+
+	// Not recursive, and no upgrade to a write-lock
+	ck_assert(!rig_mrwlock_rdlock(mrwlock) && errno == EAGAIN);
+	ck_assert(!rig_mrwlock_tryrdlock(mrwlock) && errno == EAGAIN);
+	ck_assert(!rig_mrwlock_wrlock(mrwlock) && errno == EDEADLK);
+	ck_assert(!rig_mrwlock_trywrlock(mrwlock) && errno == EDEADLK);
+
+	ck_assert(rig_mrwlock_unlock(mrwlock));
+	ck_assert(!rig_mrwlock_islocked(mrwlock));
+	ck_assert(!rig_mrwlock_unlock(mrwlock) && errno == EPERM);
+} END_TEST
+
+START_TEST(test_rig_mrwlock_biased_rdlock_recursive) {
+	for (size_t i = 0; i < 10; i++) {
+		ck_assert(rig_mrwlock_rdlock(mrwlock));
+	}
+	ck_assert(rig_mrwlock_tryrdlock(mrwlock));
+	ck_assert(!rig_mrwlock_wrlock(mrwlock) && errno == EDEADLK);
+
+	// The slot is held until the last of the eleven unlocks
+	for (size_t i = 0; i < 10; i++) {
+		ck_assert(rig_mrwlock_unlock(mrwlock));
+		ck_assert(rig_mrwlock_isrdlocked(mrwlock));
+	}
+
+	ck_assert(rig_mrwlock_unlock(mrwlock));
+	ck_assert(!rig_mrwlock_islocked(mrwlock));
+	ck_assert(!rig_mrwlock_unlock(mrwlock) && errno == EPERM);
+} END_TEST
+
+START_TEST(test_rig_mrwlock_biased_rdlock_revoked) {
+	// A writer revokes the bias, the next readers go through mrwlock
+	ck_assert(rig_mrwlock_wrlock(mrwlock));
+	ck_assert(rig_mrwlock_unlock(mrwlock));
+
+	for (size_t i = 0; i < 10; i++) {
+		ck_assert(rig_mrwlock_rdlock(mrwlock));
+		ck_assert(rig_mrwlock_isrdlocked(mrwlock));
+		ck_assert(rig_mrwlock_unlock(mrwlock));
+		ck_assert(!rig_mrwlock_islocked(mrwlock));
+	}
+} END_TEST
+
+Suite *test_rig_mrwlock_biased_rdlock(void) {
+	Suite *s = suite_create("test_rig_mrwlock_biased_rdlock");
+
+	TCASE_ADD_FIXTURE(rig_mrwlock_biased_rdlock_normal, &setup_mrwlock_biased, &teardown_mrwlock);
+	TCASE_ADD_FIXTURE(rig_mrwlock_biased_rdlock_recursive, &setup_mrwlock_biased_recursive, &teardown_mrwlock);
+	TCASE_ADD_FIXTURE(rig_mrwlock_biased_rdlock_revoked, &setup_mrwlock_biased_recursive, &teardown_mrwlock);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_mrwlock_biased_trywrlock_normal) {
+	ck_assert(rig_mrwlock_trywrlock(mrwlock));
+	ck_assert(rig_mrwlock_iswrlocked(mrwlock));
+	ck_assert(!rig_mrwlock_trywrlock(mrwlock) && errno == EAGAIN);
+	ck_assert(!rig_mrwlock_tryrdlock(mrwlock) && errno == EDEADLK);
+
+	ck_assert(rig_mrwlock_unlock(mrwlock));
+	ck_assert(!rig_mrwlock_islocked(mrwlock));
+} END_TEST
+
+START_TEST(test_rig_mrwlock_biased_trywrlock_busy) {
+	RIG_COUNTER progress = rig_counter_init(0, 0);
+	ck_assert(progress != NULL);
+
+	ck_assert(rig_mrwlock_rdlock(mrwlock));
+
+	RIG_THREAD thr = rig_thread_init(0, 1);
+	ck_assert(thr != NULL);
+
+	ck_assert(rig_thread_start(thr, &mrwlock_writer_worker, progress));
+
+	while (rig_counter_get(progress) == 0) {
+		rig_thread_yield();
+	}
+
+	// The writer now waits for the slot to drain, without holding the lock yet
+	for (size_t i = 0; i < 100; i++) {
+		rig_thread_yield();
+	}
+
+	ck_assert(rig_counter_get(progress) == 1);
+	ck_assert(rig_mrwlock_isrdlocked(mrwlock));
+	ck_assert(!rig_mrwlock_iswrlocked(mrwlock));
+
+	ck_assert(rig_mrwlock_unlock(mrwlock));
+
+	ck_assert(rig_thread_join(thr, NULL));
+	rig_thread_destroy(&thr);
+
+	ck_assert(rig_counter_get(progress) == 2);
+	ck_assert(!rig_mrwlock_islocked(mrwlock));
+
+	rig_counter_destroy(&progress);
+} END_TEST
+
+Suite *test_rig_mrwlock_biased_trywrlock(void) {
+	Suite *s = suite_create("test_rig_mrwlock_biased_trywrlock");
+
+	TCASE_ADD_FIXTURE(rig_mrwlock_biased_trywrlock_normal, &setup_mrwlock_biased, &teardown_mrwlock);
+	TCASE_ADD_FIXTURE(rig_mrwlock_biased_trywrlock_busy, &setup_mrwlock_biased, &teardown_mrwlock);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_mrwlock_biased_destroy_busy) {
+	ck_assert(rig_mrwlock_rdlock(mrwlock));
+
+	ck_assert(!rig_mrwlock_destroy(&mrwlock) && errno == EBUSY);
+	ck_assert(mrwlock != NULL);
+
+	ck_assert(rig_mrwlock_unlock(mrwlock));
+} END_TEST
+
+START_TEST(test_rig_mrwlock_biased_destroy_busy_write) {
+	ck_assert(rig_mrwlock_wrlock(mrwlock));
+
+	ck_assert(!rig_mrwlock_destroy(&mrwlock) && errno == EBUSY);
+	ck_assert(mrwlock != NULL);
+
+	ck_assert(rig_mrwlock_unlock(mrwlock));
+} END_TEST
+
+Suite *test_rig_mrwlock_biased_destroy(void) {
+	Suite *s = suite_create("test_rig_mrwlock_biased_destroy");
+
+	TCASE_ADD_FIXTURE(rig_mrwlock_biased_destroy_busy, &setup_mrwlock_biased, &teardown_mrwlock);
+	TCASE_ADD_FIXTURE(rig_mrwlock_biased_destroy_busy_write, &setup_mrwlock_biased, &teardown_mrwlock);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_mrwlock_biased_islocked_normal) {
+	ck_assert(!rig_mrwlock_islocked(mrwlock));
+	ck_assert(!rig_mrwlock_isrdlocked(mrwlock));
+	ck_assert(!rig_mrwlock_iswrlocked(mrwlock));
+
+	// Through the reader slot
+	ck_assert(rig_mrwlock_rdlock(mrwlock));
+	ck_assert(rig_mrwlock_islocked(mrwlock));
+	ck_assert(rig_mrwlock_isrdlocked(mrwlock));
+	ck_assert(!rig_mrwlock_iswrlocked(mrwlock));
+	ck_assert(rig_mrwlock_unlock(mrwlock));
+
+	ck_assert(rig_mrwlock_wrlock(mrwlock));
+	ck_assert(rig_mrwlock_islocked(mrwlock));
+	ck_assert(!rig_mrwlock_isrdlocked(mrwlock));
+	ck_assert(rig_mrwlock_iswrlocked(mrwlock));
+	ck_assert(rig_mrwlock_unlock(mrwlock));
+
+	// Through mrwlock, the bias was just revoked
+	ck_assert(rig_mrwlock_rdlock(mrwlock));
+	ck_assert(rig_mrwlock_islocked(mrwlock));
+	ck_assert(rig_mrwlock_isrdlocked(mrwlock));
+	ck_assert(!rig_mrwlock_iswrlocked(mrwlock));
+	ck_assert(rig_mrwlock_unlock(mrwlock));
+
+	ck_assert(!rig_mrwlock_islocked(mrwlock));
+	ck_assert(!rig_mrwlock_isrdlocked(mrwlock));
+	ck_assert(!rig_mrwlock_iswrlocked(mrwlock));
+} END_TEST
+
+Suite *test_rig_mrwlock_biased_islocked(void) {
+	Suite *s = suite_create("test_rig_mrwlock_biased_islocked");
+
+	TCASE_ADD_FIXTURE(rig_mrwlock_biased_islocked_normal, &setup_mrwlock_biased, &teardown_mrwlock);
+
+	return (s);
+}
+
+/******************************************************************************/
+
+START_TEST(test_rig_mrwlock_biased_threads_normal) {
+	RIG_COUNTER roles = rig_counter_init(0, 0);
+	ck_assert(roles != NULL);
+
+	RIG_THREAD thr = rig_thread_init(0, THREADS);
+	ck_assert(thr != NULL);
+
+	ck_assert(rig_thread_start(thr, &mrwlock_rdwr_worker, roles));
+	ck_assert(rig_thread_join(thr, NULL));
+	rig_thread_destroy(&thr);
+
+	ck_assert(shared == LOCKS);
+	ck_assert(shared_copy == LOCKS);
+	ck_assert(!rig_mrwlock_islocked(mrwlock));
+
+	rig_counter_destroy(&roles);
+} END_TEST
+
+Suite *test_rig_mrwlock_biased_threads(void) {
+	Suite *s = suite_create("test_rig_mrwlock_biased_threads");
+
+	TCASE_ADD_FIXTURE(rig_mrwlock_biased_threads_normal, &setup_mrwlock_biased, &teardown_mrwlock);
+
+	return (s);
+}
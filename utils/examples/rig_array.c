@@ -1,35 +1,53 @@
 #include <rig.h>
+#include <stdio.h>
 
-RIG_ARRAY arr = rig_array_init(0); // create empty array
+int main(void) {
+	RIG_ARRAY arr = rig_array_init(0, 0); // create empty array
 
-rig_array_insert(arr, // mass insert
-	RIG_ASP({"ii"}, {"is"}, {"si"}, {"ss"}),
-	0, 3,
-	2, STR_LIT("bb"),
-	STR_LIT("aa"), 2,
-	STR_LIT("c"), STR_LIT("dd11");
+	rig_array_add(arr, // mass add, integers must always be intmax_t
+		RIG_ASPEC({"ii"}, {"is"}, {"si"}, {"ss"}),
+		(intmax_t)0, (intmax_t)3,
+		(intmax_t)2, "bb",
+		"aa", (intmax_t)2,
+		"c", "dd11");
 
-RIG s;
-rig_array_lookup(arr, RIG_ASP({"is"}), 3, &s); // will return false and put NULL in s
-rig_array_lookup(arr, RIG_ASP({"is"}), 2, &s); // will return true and put a copy of 'bb' in s
+	char *s;
+	if (!rig_array_lookup(arr, RIG_ASPEC({"is"}), (intmax_t)3, &s)) { // will return false and put NULL in s
+		printf("3: not found\n");
+	}
+	if (rig_array_lookup(arr, RIG_ASPEC({"is"}), (intmax_t)2, &s)) { // will return true and put a copy of 'bb' in s
+		printf("2: %s\n", s);
+		rig_mem_free(s);
+	}
 
-RIG_ARRAY arr2 = rig_array_init(0); // create second empty array
-rig_array_insert(arr2, // mass insert
-	RIG_ASP({"ss"}, {"si"}),
-	STR_LIT("a1"), STR_LIT("aaa"),
-	STR_LIT("b"), 111);
+	RIG_ARRAY arr2 = rig_array_init(0, 0); // create second empty array
+	rig_array_add(arr2, // mass add
+		RIG_ASPEC({"ss"}, {"si"}),
+		"a1", "aaa",
+		"b", (intmax_t)111);
 
-rig_array_insert(arr, RIG_ASP({"ia"}), 9, arr2);
+	rig_array_add(arr, RIG_ASPEC({"ia"}), (intmax_t)9, arr2); // arr now holds its own reference to arr2
+	rig_array_destroy(&arr2);
 
-RIG_ARRAY a;
-rig_array_lookup(arr, RIG_ASP({"ia"}), 9, &a); // will return true and put a copy of arr2 into a
+	RIG_ARRAY a;
+	if (rig_array_lookup(arr, RIG_ASPEC({"ia"}), (intmax_t)9, &a)) { // will return true and put a new reference to arr2 into a
+		printf("9: %zu elements\n", rig_array_count(a));
+		rig_array_destroy(&a);
+	}
 
-intmax_t i;
-rig_array_lookup(rig_array_nested(arr, RIG_ASP({"i"}), 9), RIG_ASP({"si"}), STR_LIT("b"), &i); // will return true and put the integer in i
+	intmax_t i;
+	a = rig_array_nested(arr, RIG_ASPEC({"i"}), (intmax_t)9); // new reference to arr2 again
+	if (rig_array_lookup(a, RIG_ASPEC({"si"}), "b", &i)) { // will return true and put the integer in i
+		printf("9/b: %jd\n", i);
+	}
 
-rig_array_remove(rig_array_nested(arr, RIG_ASP({"i"}), 9), RIG_ASP({"s"}), STR_LIT("b")); // both this and the previous operate on the original arr2
+	rig_array_del(a, RIG_ASPEC({"s"}), "b"); // both this and the previous operate on the original arr2
+	rig_array_destroy(&a);
 
-rig_destroy(&arr);
+	rig_array_destroy(&arr); // also drops the reference to arr2, destroying it
+
+	return (0);
+}
 
 /*
 # Python
@@ -0,0 +1,57 @@
+#include "commonbench.h"
+
+// Build with -DMEM_POOL to use Rig's node pool, else the system allocator
+// (or tcmalloc/jemalloc, see Makefile) is used through rig_mem_alloc().
+#if defined(MEM_POOL)
+	#define NODE_ALLOC(size) rig_mem_pool_alloc(size)
+	#define NODE_FREE(ptr) rig_mem_pool_free(ptr)
+#else
+	#define NODE_ALLOC(size) rig_mem_alloc(size, 0)
+	#define NODE_FREE(ptr) rig_mem_free(ptr)
+#endif
+
+#define NODE_SIZE 16
+#define NODE_BATCH 1024
+
+void *dts_init(size_t capacity) {
+	return (rig_stack_init(capacity, RIG_STACK_NOCOUNT));
+}
+
+void dts_destroy(void **dts) {
+	void *ptr;
+
+	while ((ptr = rig_stack_pop(*dts)) != NULL) {
+		NODE_FREE(ptr);
+	}
+
+	rig_stack_destroy((RIG_STACK *)dts);
+}
+
+void *thr_function(void *dts) {
+	void *nodes[NODE_BATCH];
+
+	// Thread-local allocation and release
+	for (size_t i = 0; i < 1000; i++) {
+		for (size_t j = 0; j < NODE_BATCH; j++) {
+			nodes[j] = NODE_ALLOC(NODE_SIZE);
+		}
+
+		for (size_t j = 0; j < NODE_BATCH; j++) {
+			NODE_FREE(nodes[j]);
+		}
+	}
+
+	// Cross-thread release: memory is passed around through a shared stack,
+	// and mostly freed by a thread other than the one that allocated it
+	for (size_t i = 0; i < 1000000; i++) {
+		rig_stack_push(dts, NODE_ALLOC(NODE_SIZE));
+
+		void *ptr = rig_stack_pop(dts);
+
+		if (ptr != NULL) {
+			NODE_FREE(ptr);
+		}
+	}
+
+	return (NULL);
+}
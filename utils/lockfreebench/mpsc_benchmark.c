@@ -0,0 +1,57 @@
+#include "commonbench.h"
+
+// Build with -DMPMC to disable the MPSC algorithm, for comparison.
+#if defined(MPMC)
+	#define MPSC_FLAGS 0
+#else
+	#define MPSC_FLAGS RIG_QUEUE_MPSC
+#endif
+
+#define NUM_ITEMS 1000000
+
+// The first thread is the consumer, all the others are producers
+struct mpsc_bench {
+	RIG_QUEUE queue;
+	RIG_COUNTER role;
+};
+
+void *dts_init(size_t capacity) {
+	struct mpsc_bench *b = rig_mem_alloc(sizeof(*b), 0);
+
+	b->queue = rig_queue_init(capacity, RIG_QUEUE_NOCOUNT | MPSC_FLAGS);
+	b->role = rig_counter_init(0, 0);
+
+	return (b);
+}
+
+void dts_destroy(void **dts) {
+	struct mpsc_bench *b = *dts;
+
+	rig_queue_destroy(&b->queue);
+	rig_counter_destroy(&b->role);
+
+	rig_mem_free(b);
+	*dts = NULL;
+}
+
+void *thr_function(void *dts) {
+	struct mpsc_bench *b = dts;
+	size_t role = 0;
+
+	rig_counter_get_and_add(b->role, 1, &role);
+
+	if (role == 0) {
+		// Consumer
+		for (size_t i = 0; i < (NUM_THREADS - 1) * NUM_ITEMS; i++) {
+			while (rig_queue_get(b->queue) == NULL) { ; }
+		}
+	}
+	else {
+		// Producers
+		for (size_t i = 1; i <= NUM_ITEMS; i++) {
+			rig_queue_put(b->queue, (void *)i);
+		}
+	}
+
+	return (NULL);
+}
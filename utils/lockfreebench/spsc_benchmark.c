@@ -0,0 +1,73 @@
+#include "commonbench.h"
+
+// Build with -DRING to benchmark RIG_RING, else RIG_QUEUE is used.
+// Build with -DMPMC to disable the SPSC algorithms, for comparison.
+#if defined(MPMC)
+	#define SPSC_FLAGS(f) 0
+#else
+	#define SPSC_FLAGS(f) f
+#endif
+
+#if defined(RING)
+	#define DTS_INIT() rig_ring_init(RING_CAPACITY, SPSC_FLAGS(RIG_RING_SPSC))
+	#define DTS_DESTROY(d) rig_ring_destroy((RIG_RING *)(d))
+	#define DTS_PUT(d, i) rig_ring_put(d, i)
+	#define DTS_GET(d) rig_ring_get(d)
+#else
+	#define DTS_INIT() rig_queue_init(0, RIG_QUEUE_NOCOUNT | SPSC_FLAGS(RIG_QUEUE_SPSC))
+	#define DTS_DESTROY(d) rig_queue_destroy((RIG_QUEUE *)(d))
+	#define DTS_PUT(d, i) rig_queue_put(d, i)
+	#define DTS_GET(d) rig_queue_get(d)
+#endif
+
+#define RING_CAPACITY 1024
+#define NUM_ITEMS 10000000
+
+// Only the first two threads take part: one producer and one consumer
+struct spsc_bench {
+	void *dts;
+	RIG_COUNTER role;
+};
+
+void *dts_init(size_t capacity) {
+	(void)(capacity);
+
+	struct spsc_bench *b = rig_mem_alloc(sizeof(*b), 0);
+
+	b->dts = DTS_INIT();
+	b->role = rig_counter_init(0, 0);
+
+	return (b);
+}
+
+void dts_destroy(void **dts) {
+	struct spsc_bench *b = *dts;
+
+	DTS_DESTROY(&b->dts);
+	rig_counter_destroy(&b->role);
+
+	rig_mem_free(b);
+	*dts = NULL;
+}
+
+void *thr_function(void *dts) {
+	struct spsc_bench *b = dts;
+	size_t role = 0;
+
+	rig_counter_get_and_add(b->role, 1, &role);
+
+	if (role == 0) {
+		// Producer
+		for (size_t i = 1; i <= NUM_ITEMS; i++) {
+			while (!DTS_PUT(b->dts, (void *)i)) { ; }
+		}
+	}
+	else if (role == 1) {
+		// Consumer
+		for (size_t i = 1; i <= NUM_ITEMS; i++) {
+			while (DTS_GET(b->dts) == NULL) { ; }
+		}
+	}
+
+	return (NULL);
+}
@@ -1,7 +1,14 @@
 #include "commonbench.h"
 
+// Build with -DELIMINATION to enable the elimination array, for comparison.
+#if defined(ELIMINATION)
+	#define STACK_FLAGS (RIG_STACK_NOCOUNT | RIG_STACK_ELIMINATION)
+#else
+	#define STACK_FLAGS RIG_STACK_NOCOUNT
+#endif
+
 void *dts_init(size_t capacity) {
-	return (rig_stack_init(capacity, RIG_STACK_NOCOUNT));
+	return (rig_stack_init(capacity, STACK_FLAGS));
 }
 
 void dts_destroy(void **dts) {